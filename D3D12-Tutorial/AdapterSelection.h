@@ -0,0 +1,322 @@
+#pragma once
+
+// Windows Runtime Library. Needed for Microsoft::WRL::ComPtr<> template class.
+#include <wrl.h>
+
+#include <d3d12.h>
+#include <dxgi1_6.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Helpers.h"
+#include "MappedFile.h"
+
+// Choosing which GPU to run on.
+//
+// Knowing whether an adapter supports D3D12, and what it supports, means loading its driver and creating a
+// device, which costs tens of milliseconds per adapter. So the results are cached in a small file keyed by
+// the adapter's hardware IDs and driver version, and adapters are only probed when they have to be: the
+// preference policies take adapters in the order DXGI ranks them and stop at the first one that is good
+// enough, and after the first run nothing is probed at all until a driver changes.
+enum class AdapterPolicy
+{
+	// The order of IDXGIFactory6::EnumAdapterByGpuPreference, which knows about discrete vs integrated GPUs
+	// and the user's per-app graphics settings. Needs the Windows 10 1803 SDK to build and OS to run; otherwise
+	// both are the order of EnumAdapters1.
+	HighPerformance,
+	MinimumPower,
+	// A specific adapter, e.g. one chosen by a launcher or another process sharing resources with us
+	ExplicitLuid,
+	// Highest feature level, then shader model, binding tier and tiled resources tier, then VRAM
+	BestCapabilities,
+};
+
+struct AdapterSelection
+{
+	AdapterPolicy Policy = AdapterPolicy::HighPerformance;
+	// Only for ExplicitLuid
+	LUID Luid = {};
+	D3D_FEATURE_LEVEL MinFeatureLevel = D3D_FEATURE_LEVEL_11_0;
+};
+
+// What selection needs to know about an adapter. Stored on disk as is.
+struct AdapterProbe
+{
+	uint64_t Key;					// HashAdapter, so the probe is redone when the GPU or its driver changes
+	uint32_t MaxFeatureLevel;		// D3D_FEATURE_LEVEL, 0 if the adapter can't create a D3D12 device
+	uint32_t HighestShaderModel;	// D3D_SHADER_MODEL
+	uint32_t ResourceBindingTier;	// D3D12_RESOURCE_BINDING_TIER
+	uint32_t TiledResourcesTier;	// D3D12_TILED_RESOURCES_TIER
+};
+
+// The highest shader model device supports. CheckFeatureSupport lowers the model it is asked about to what the
+// driver supports, but fails with E_INVALIDARG for models the runtime doesn't know, so this starts above the
+// newest model and steps down until the runtime accepts one. The values are D3D_SHADER_MODEL_major_minor,
+// written as numbers since older SDKs don't name the newer models.
+inline D3D_SHADER_MODEL QueryHighestShaderModel(ID3D12Device* device)
+{
+	const uint32_t shaderModels[] = { 0x69, 0x68, 0x67, 0x66, 0x65, 0x64, 0x63, 0x62, 0x61, 0x60 };
+	for (uint32_t model : shaderModels)
+	{
+		D3D12_FEATURE_DATA_SHADER_MODEL shaderModel = { static_cast<D3D_SHADER_MODEL>(model) };
+		const HRESULT result = device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &shaderModel, sizeof(shaderModel));
+		if (SUCCEEDED(result))
+		{
+			return shaderModel.HighestShaderModel;
+		}
+		if (result != E_INVALIDARG)
+		{
+			break;
+		}
+	}
+	// Runtimes from before shader model 6 don't know the query at all
+	return D3D_SHADER_MODEL_5_1;
+}
+
+// Identifies an adapter model and driver. LUIDs change every boot, so they can't be used for this.
+inline uint64_t HashAdapter(IDXGIAdapter1* adapter)
+{
+	DXGI_ADAPTER_DESC1 desc;
+	ThrowIfFailed(adapter->GetDesc1(&desc));
+
+	// DXGI only reports the user mode driver version through the IDXGIDevice interface check
+	LARGE_INTEGER driverVersion = {};
+	if (FAILED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion)))
+	{
+		driverVersion.QuadPart = 0;
+	}
+
+	uint64_t hash = HashValue(desc.VendorId);
+	hash = HashValue(desc.DeviceId, hash);
+	hash = HashValue(desc.SubSysId, hash);
+	hash = HashValue(desc.Revision, hash);
+	hash = HashValue(desc.DedicatedVideoMemory, hash);
+	return HashValue(driverVersion.QuadPart, hash);
+}
+
+// Probes of every adapter seen, persisted between runs as a FileHeader followed by the probes.
+class AdapterProbeCache
+{
+public:
+	void Load(const wchar_t* path)
+	{
+		m_Probes.clear();
+		m_IsDirty = false;
+
+		MappedFile file;
+		if (!file.Open(path) || file.Size() < sizeof(FileHeader))
+		{
+			return;
+		}
+
+		FileHeader header;
+		memcpy(&header, file.Data(), sizeof(header));
+		if (header.Magic != FileMagic ||
+			file.Size() != sizeof(FileHeader) + uint64_t(header.NumProbes) * sizeof(AdapterProbe))
+		{
+			return;
+		}
+
+		m_Probes.resize(header.NumProbes);
+		if (header.NumProbes > 0)
+		{
+			memcpy(m_Probes.data(), static_cast<const uint8_t*>(file.Data()) + sizeof(FileHeader),
+				header.NumProbes * sizeof(AdapterProbe));
+		}
+	}
+
+	// Writes the file only if something was probed since Load
+	void Save(const wchar_t* path)
+	{
+		if (!m_IsDirty)
+		{
+			return;
+		}
+
+		FileHeader header = { FileMagic, static_cast<uint32_t>(m_Probes.size()) };
+		std::vector<uint8_t> contents(sizeof(FileHeader) + m_Probes.size() * sizeof(AdapterProbe));
+		memcpy(contents.data(), &header, sizeof(header));
+		if (!m_Probes.empty())
+		{
+			memcpy(contents.data() + sizeof(FileHeader), m_Probes.data(), m_Probes.size() * sizeof(AdapterProbe));
+		}
+
+		if (WriteWholeFile(path, contents.data(), contents.size()))
+		{
+			m_IsDirty = false;
+		}
+	}
+
+	// Returns the cached probe of adapter, probing it now if it has never been seen
+	AdapterProbe Probe(IDXGIAdapter1* adapter)
+	{
+		const uint64_t key = HashAdapter(adapter);
+		for (const AdapterProbe& probe : m_Probes)
+		{
+			if (probe.Key == key)
+			{
+				return probe;
+			}
+		}
+
+		AdapterProbe probe = {};
+		probe.Key = key;
+
+		Microsoft::WRL::ComPtr<ID3D12Device> device;
+		if (SUCCEEDED(D3D12CreateDevice(adapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device))))
+		{
+			const D3D_FEATURE_LEVEL featureLevels[] =
+			{
+				D3D_FEATURE_LEVEL_11_0, D3D_FEATURE_LEVEL_11_1, D3D_FEATURE_LEVEL_12_0, D3D_FEATURE_LEVEL_12_1,
+			};
+			D3D12_FEATURE_DATA_FEATURE_LEVELS levels = { _countof(featureLevels), featureLevels, D3D_FEATURE_LEVEL_11_0 };
+			if (SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_FEATURE_LEVELS, &levels, sizeof(levels))))
+			{
+				probe.MaxFeatureLevel = levels.MaxSupportedFeatureLevel;
+			}
+			else
+			{
+				probe.MaxFeatureLevel = D3D_FEATURE_LEVEL_11_0;
+			}
+
+			probe.HighestShaderModel = QueryHighestShaderModel(device.Get());
+
+			D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+			if (SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))))
+			{
+				probe.ResourceBindingTier = options.ResourceBindingTier;
+				probe.TiledResourcesTier = options.TiledResourcesTier;
+			}
+		}
+
+		m_Probes.push_back(probe);
+		m_IsDirty = true;
+		return probe;
+	}
+
+	uint32_t GetNumProbes() const { return static_cast<uint32_t>(m_Probes.size()); }
+
+private:
+	static const uint32_t FileMagic = 0x31504441; // "ADP1"
+
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t NumProbes;
+	};
+
+	std::vector<AdapterProbe> m_Probes;
+	bool m_IsDirty = false;
+};
+
+namespace AdapterSelectionDetail
+{
+	// Software adapters (WARP, the Basic Render Driver) are only used when asked for, so aren't even probed
+	inline bool IsSuitable(IDXGIAdapter1* adapter, AdapterProbeCache& probes, D3D_FEATURE_LEVEL minFeatureLevel,
+		DXGI_ADAPTER_DESC1& desc, AdapterProbe& probe)
+	{
+		ThrowIfFailed(adapter->GetDesc1(&desc));
+		if ((desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) != 0)
+		{
+			return false;
+		}
+		probe = probes.Probe(adapter);
+		return probe.MaxFeatureLevel >= uint32_t(minFeatureLevel);
+	}
+
+	// Earlier fields dominate later ones
+	inline bool IsBetter(const AdapterProbe& a, const DXGI_ADAPTER_DESC1& aDesc,
+		const AdapterProbe& b, const DXGI_ADAPTER_DESC1& bDesc)
+	{
+		if (a.MaxFeatureLevel != b.MaxFeatureLevel) return a.MaxFeatureLevel > b.MaxFeatureLevel;
+		if (a.HighestShaderModel != b.HighestShaderModel) return a.HighestShaderModel > b.HighestShaderModel;
+		if (a.ResourceBindingTier != b.ResourceBindingTier) return a.ResourceBindingTier > b.ResourceBindingTier;
+		if (a.TiledResourcesTier != b.TiledResourcesTier) return a.TiledResourcesTier > b.TiledResourcesTier;
+		return aDesc.DedicatedVideoMemory > bDesc.DedicatedVideoMemory;
+	}
+}
+
+// Picks a hardware adapter following selection, probing through probes. Returns null if no adapter is suitable.
+inline Microsoft::WRL::ComPtr<IDXGIAdapter4> SelectAdapter(IDXGIFactory4* factory, const AdapterSelection& selection,
+	AdapterProbeCache& probes)
+{
+	using Microsoft::WRL::ComPtr;
+	using namespace AdapterSelectionDetail;
+
+	ComPtr<IDXGIAdapter1> adapter1;
+	ComPtr<IDXGIAdapter4> adapter4;
+	DXGI_ADAPTER_DESC1 desc;
+	AdapterProbe probe;
+
+	if (selection.Policy == AdapterPolicy::ExplicitLuid)
+	{
+		if (SUCCEEDED(factory->EnumAdapterByLuid(selection.Luid, IID_PPV_ARGS(&adapter1))) &&
+			IsSuitable(adapter1.Get(), probes, selection.MinFeatureLevel, desc, probe))
+		{
+			ThrowIfFailed(adapter1.As(&adapter4));
+			return adapter4;
+		}
+
+		// The adapter may have been removed since the LUID was recorded
+		OutputDebugStringW(L"Adapter with the requested LUID is missing or unsuitable, using the high performance adapter\n");
+		AdapterSelection fallback = selection;
+		fallback.Policy = AdapterPolicy::HighPerformance;
+		return SelectAdapter(factory, fallback, probes);
+	}
+
+	// Adapters in the order to try them. EnumAdapterByGpuPreference needs Windows 10 1803, and its SDK
+	// (NTDDI_WIN10_RS4) to build; without either, the order of EnumAdapters1 (primary display's adapter first)
+	// is the best there is.
+#if defined(NTDDI_WIN10_RS4)
+	ComPtr<IDXGIFactory6> factory6;
+	const bool hasGpuPreference = SUCCEEDED(factory->QueryInterface(IID_PPV_ARGS(&factory6)));
+	const DXGI_GPU_PREFERENCE preference = selection.Policy == AdapterPolicy::MinimumPower ?
+		DXGI_GPU_PREFERENCE_MINIMUM_POWER : DXGI_GPU_PREFERENCE_HIGH_PERFORMANCE;
+	auto enumAdapter = [&](UINT i, ComPtr<IDXGIAdapter1>& adapter)
+	{
+		adapter.Reset();
+		return hasGpuPreference ?
+			factory6->EnumAdapterByGpuPreference(i, preference, IID_PPV_ARGS(&adapter)) :
+			factory->EnumAdapters1(i, &adapter);
+	};
+#else
+	auto enumAdapter = [&](UINT i, ComPtr<IDXGIAdapter1>& adapter)
+	{
+		adapter.Reset();
+		return factory->EnumAdapters1(i, &adapter);
+	};
+#endif
+
+	ComPtr<IDXGIAdapter1> best;
+	AdapterProbe bestProbe = {};
+	DXGI_ADAPTER_DESC1 bestDesc = {};
+	for (UINT i = 0; enumAdapter(i, adapter1) != DXGI_ERROR_NOT_FOUND; i++)
+	{
+		if (!IsSuitable(adapter1.Get(), probes, selection.MinFeatureLevel, desc, probe))
+		{
+			continue;
+		}
+
+		// Preference policies take the first suitable adapter, so the rest are never probed
+		if (selection.Policy != AdapterPolicy::BestCapabilities)
+		{
+			best = adapter1;
+			break;
+		}
+
+		if (!best || IsBetter(probe, desc, bestProbe, bestDesc))
+		{
+			best = adapter1;
+			bestProbe = probe;
+			bestDesc = desc;
+		}
+	}
+
+	if (best)
+	{
+		ThrowIfFailed(best.As(&adapter4));
+	}
+	return adapter4;
+}
@@ -0,0 +1,699 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <d3d12.h>
+#include "d3dx12.h"
+#endif
+
+// GPU-ready asset pack.
+//
+// Texture and buffer payloads are stored exactly as D3D12 wants them in an upload buffer: every row padded
+// to the texture data pitch alignment and every subresource starting on the placement alignment. Loading is
+// then just mapping the file and pointing D3D12_SUBRESOURCE_DATA at it; UpdateSubresources/MemcpySubresource
+// read straight from the mapping into the upload heap, with no decode buffer and no allocation per asset.
+//
+// File layout (all offsets from the start of the file, little endian):
+//	AssetPackHeader
+//	AssetPackEntry[NumAssets]				sorted by NameHash, so lookups are a binary search
+//	AssetPackSubresource[NumSubresources]	each asset owns a contiguous run of these
+//	payloads								each subresource AssetPackPlacementAlignment aligned
+//
+// The format, validator and loader only depend on the standard library (and mmap off Windows), so packs can
+// be built and checked by tools on any platform. Only the D3D12 conversions under _WIN32 are Windows specific.
+
+const uint32_t AssetPackMagic = 0x4b415047; // "GPAK"
+const uint32_t AssetPackVersion = 1;
+
+// Mirror D3D12_TEXTURE_DATA_PITCH_ALIGNMENT and D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT
+const uint32_t AssetPackPitchAlignment = 256;
+const uint32_t AssetPackPlacementAlignment = 512;
+
+// Mirror D3D12_RESOURCE_DIMENSION, so packs can be checked without the D3D12 headers
+const uint32_t AssetPackDimensionBuffer = 1;
+const uint32_t AssetPackDimensionTexture1D = 2;
+const uint32_t AssetPackDimensionTexture2D = 3;
+const uint32_t AssetPackDimensionTexture3D = 4;
+// Highest DXGI_FORMAT value a texture may use (DXGI_FORMAT_A4B4G4R4_UNORM)
+const uint32_t AssetPackMaxFormat = 191;
+
+// Planes per subresource of a DXGI_FORMAT, as D3D12GetFormatPlaneCount would report: 2 for depth stencil
+// formats with stencil and for planar video formats, otherwise 1
+inline uint32_t AssetPackFormatPlaneCount(uint32_t format)
+{
+	switch (format)
+	{
+	case 19:	// DXGI_FORMAT_R32G8X24_TYPELESS
+	case 20:	// DXGI_FORMAT_D32_FLOAT_S8X24_UINT
+	case 21:	// DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS
+	case 22:	// DXGI_FORMAT_X32_TYPELESS_G8X24_UINT
+	case 44:	// DXGI_FORMAT_R24G8_TYPELESS
+	case 45:	// DXGI_FORMAT_D24_UNORM_S8_UINT
+	case 46:	// DXGI_FORMAT_R24_UNORM_X8_TYPELESS
+	case 47:	// DXGI_FORMAT_X24_TYPELESS_G8_UINT
+	case 103:	// DXGI_FORMAT_NV12
+	case 104:	// DXGI_FORMAT_P010
+	case 105:	// DXGI_FORMAT_P016
+	case 106:	// DXGI_FORMAT_420_OPAQUE
+	case 110:	// DXGI_FORMAT_NV11
+	case 130:	// DXGI_FORMAT_P208
+	case 131:	// DXGI_FORMAT_V208
+	case 132:	// DXGI_FORMAT_V408
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+enum class AssetType : uint32_t
+{
+	Buffer = 0,
+	Texture = 1,
+};
+
+struct AssetPackHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t NumAssets;
+	uint32_t NumSubresources;
+	// Size the file had when written, catches truncated files
+	uint64_t FileSize;
+};
+
+struct AssetPackEntry
+{
+	uint64_t NameHash;		// HashString of the asset's name
+	AssetType Type;
+	uint32_t Format;		// DXGI_FORMAT, DXGI_FORMAT_UNKNOWN for buffers
+	uint32_t Dimension;		// D3D12_RESOURCE_DIMENSION
+	uint32_t Width;			// In bytes for buffers
+	uint32_t Height;
+	uint32_t DepthOrArraySize;
+	uint32_t MipLevels;
+	uint32_t FirstSubresource;	// Index into the subresource table
+	uint32_t NumSubresources;
+	uint32_t Padding;
+	uint64_t ByteWidth;		// Buffer size, or total size of all subresource payloads of a texture
+};
+
+struct AssetPackSubresource
+{
+	uint64_t Offset;		// Of the first row of the first slice
+	uint64_t SlicePitch;	// RowPitch * NumRows
+	uint32_t RowPitch;		// Multiple of AssetPackPitchAlignment for textures
+	uint32_t RowSizeInBytes;	// Bytes of real data per row, RowPitch minus padding
+	uint32_t NumRows;		// Rows of texels, or of blocks for block compressed formats
+	uint32_t Depth;			// Slices, 1 unless the texture is 3D
+};
+
+// Subresource data pointing into a mapped pack. Same layout as D3D12_SUBRESOURCE_DATA,
+// which it is converted to on Windows.
+struct AssetSubresourceData
+{
+	const void* Data;
+	int64_t RowPitch;
+	int64_t SlicePitch;
+};
+
+enum class AssetPackError
+{
+	None,
+	FileTooSmall,
+	BadMagic,
+	BadVersion,
+	SizeMismatch,
+	TablesOutOfBounds,
+	EntriesNotSorted,
+	SubresourcesOutOfBounds,
+	PayloadOutOfBounds,
+	PayloadMisaligned,
+	BadRowPitch,
+	BadSlicePitch,
+	BadDimension,
+	BadFormat,
+	BadMipLevels,
+	SubresourceCountMismatch,
+	ByteWidthMismatch,
+	PayloadsOutOfOrder,
+};
+
+inline const char* AssetPackErrorString(AssetPackError error)
+{
+	switch (error)
+	{
+	case AssetPackError::None: return "None";
+	case AssetPackError::FileTooSmall: return "File is smaller than the header";
+	case AssetPackError::BadMagic: return "Not an asset pack";
+	case AssetPackError::BadVersion: return "Unsupported asset pack version";
+	case AssetPackError::SizeMismatch: return "File size does not match header, file is truncated";
+	case AssetPackError::TablesOutOfBounds: return "Asset or subresource table extends past the end of the file";
+	case AssetPackError::EntriesNotSorted: return "Assets are not sorted by unique name hash";
+	case AssetPackError::SubresourcesOutOfBounds: return "Asset references subresources outside the subresource table";
+	case AssetPackError::PayloadOutOfBounds: return "Subresource payload extends past the end of the file";
+	case AssetPackError::PayloadMisaligned: return "Subresource payload is not placement aligned";
+	case AssetPackError::BadRowPitch: return "Row pitch is not aligned or is smaller than the row size";
+	case AssetPackError::BadSlicePitch: return "Slice pitch does not match row pitch and row count";
+	case AssetPackError::BadDimension: return "Asset dimension or size does not match its type";
+	case AssetPackError::BadFormat: return "Texture format is unknown, or a buffer has a format";
+	case AssetPackError::BadMipLevels: return "Mip level count is zero or more than the size allows";
+	case AssetPackError::SubresourceCountMismatch: return "Subresource count is not mips times array size times planes";
+	case AssetPackError::ByteWidthMismatch: return "Byte width does not match the size of the subresource payloads";
+	case AssetPackError::PayloadsOutOfOrder: return "Subresource payloads of an asset overlap or are out of order";
+	}
+	return "Unknown";
+}
+
+// Checks an asset's type, dimension, format and sizes agree, and that it has one subresource per mip, array
+// slice and plane, so code indexing subresources by mip (i % MipLevels) can trust them
+inline AssetPackError ValidateAssetPackEntry(const AssetPackEntry& entry)
+{
+	if (entry.Type == AssetType::Buffer)
+	{
+		if (entry.Dimension != AssetPackDimensionBuffer || entry.Width == 0 || entry.Height != 1 ||
+			entry.DepthOrArraySize != 1)
+		{
+			return AssetPackError::BadDimension;
+		}
+		if (entry.ByteWidth != entry.Width)
+		{
+			return AssetPackError::ByteWidthMismatch;
+		}
+		if (entry.Format != 0)
+		{
+			return AssetPackError::BadFormat;
+		}
+		if (entry.MipLevels != 1)
+		{
+			return AssetPackError::BadMipLevels;
+		}
+		return entry.NumSubresources == 1 ? AssetPackError::None : AssetPackError::SubresourceCountMismatch;
+	}
+
+	if (entry.Type != AssetType::Texture ||
+		entry.Dimension < AssetPackDimensionTexture1D || entry.Dimension > AssetPackDimensionTexture3D ||
+		entry.Width == 0 || entry.Height == 0 || entry.DepthOrArraySize == 0 ||
+		(entry.Dimension == AssetPackDimensionTexture1D && entry.Height != 1))
+	{
+		return AssetPackError::BadDimension;
+	}
+	if (entry.Format == 0 || entry.Format > AssetPackMaxFormat)
+	{
+		return AssetPackError::BadFormat;
+	}
+
+	// A full chain halves the largest dimension down to 1. Depth only counts for 3D textures, where it is
+	// not an array size.
+	const bool is3D = entry.Dimension == AssetPackDimensionTexture3D;
+	uint32_t largest = std::max(entry.Width, entry.Height);
+	if (is3D)
+	{
+		largest = std::max(largest, entry.DepthOrArraySize);
+	}
+	uint32_t maxMipLevels = 1;
+	while (largest > 1)
+	{
+		largest >>= 1;
+		maxMipLevels++;
+	}
+	if (entry.MipLevels == 0 || entry.MipLevels > maxMipLevels)
+	{
+		return AssetPackError::BadMipLevels;
+	}
+
+	const uint64_t arraySize = is3D ? 1 : entry.DepthOrArraySize;
+	if (entry.NumSubresources != uint64_t(entry.MipLevels) * arraySize * AssetPackFormatPlaneCount(entry.Format))
+	{
+		return AssetPackError::SubresourceCountMismatch;
+	}
+	return AssetPackError::None;
+}
+
+// Checks that every table and payload in a pack lies within size bytes and is laid out as D3D12 expects,
+// that every asset passes ValidateAssetPackEntry, and that its payloads are in order and sum to its ByteWidth.
+// After this succeeds the loader trusts the pack and does no further bounds checks.
+inline AssetPackError ValidateAssetPack(const void* data, uint64_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	AssetPackHeader header;
+	if (size < sizeof(header))
+	{
+		return AssetPackError::FileTooSmall;
+	}
+	memcpy(&header, bytes, sizeof(header));
+
+	if (header.Magic != AssetPackMagic)
+	{
+		return AssetPackError::BadMagic;
+	}
+	if (header.Version != AssetPackVersion)
+	{
+		return AssetPackError::BadVersion;
+	}
+	if (header.FileSize != size)
+	{
+		return AssetPackError::SizeMismatch;
+	}
+
+	// 64-bit maths throughout, so a corrupt count cannot overflow past the checks
+	const uint64_t tablesEnd = sizeof(AssetPackHeader) +
+		uint64_t(header.NumAssets) * sizeof(AssetPackEntry) +
+		uint64_t(header.NumSubresources) * sizeof(AssetPackSubresource);
+	if (tablesEnd > size)
+	{
+		return AssetPackError::TablesOutOfBounds;
+	}
+
+	const uint8_t* entries = bytes + sizeof(AssetPackHeader);
+	const uint8_t* subresources = entries + uint64_t(header.NumAssets) * sizeof(AssetPackEntry);
+
+	uint64_t previousHash = 0;
+	for (uint32_t i = 0; i < header.NumAssets; i++)
+	{
+		AssetPackEntry entry;
+		memcpy(&entry, entries + i * sizeof(AssetPackEntry), sizeof(entry));
+
+		if (i > 0 && entry.NameHash <= previousHash)
+		{
+			return AssetPackError::EntriesNotSorted;
+		}
+		previousHash = entry.NameHash;
+
+		const AssetPackError entryError = ValidateAssetPackEntry(entry);
+		if (entryError != AssetPackError::None)
+		{
+			return entryError;
+		}
+
+		if (uint64_t(entry.FirstSubresource) + entry.NumSubresources > header.NumSubresources)
+		{
+			return AssetPackError::SubresourcesOutOfBounds;
+		}
+
+		uint64_t byteWidth = 0;
+		uint64_t previousEnd = 0;
+		for (uint32_t s = 0; s < entry.NumSubresources; s++)
+		{
+			AssetPackSubresource subresource;
+			memcpy(&subresource, subresources + uint64_t(entry.FirstSubresource + s) * sizeof(AssetPackSubresource),
+				sizeof(subresource));
+
+			if (subresource.Offset % AssetPackPlacementAlignment != 0)
+			{
+				return AssetPackError::PayloadMisaligned;
+			}
+			if (subresource.RowPitch < subresource.RowSizeInBytes ||
+				(entry.Type == AssetType::Texture && subresource.RowPitch % AssetPackPitchAlignment != 0))
+			{
+				return AssetPackError::BadRowPitch;
+			}
+			if (subresource.SlicePitch != uint64_t(subresource.RowPitch) * subresource.NumRows)
+			{
+				return AssetPackError::BadSlicePitch;
+			}
+
+			// Pitches come from the file, so make sure the size calculation below cannot wrap
+			if (subresource.Depth > 1 && subresource.SlicePitch > size / (subresource.Depth - 1))
+			{
+				return AssetPackError::PayloadOutOfBounds;
+			}
+
+			// The last row of the last slice only needs RowSizeInBytes, not the full pitch
+			uint64_t payloadSize = subresource.NumRows == 0 || subresource.Depth == 0 ? 0 :
+				subresource.SlicePitch * (subresource.Depth - 1) +
+				uint64_t(subresource.RowPitch) * (subresource.NumRows - 1) + subresource.RowSizeInBytes;
+			if (subresource.Offset < tablesEnd || subresource.Offset > size || size - subresource.Offset < payloadSize)
+			{
+				return AssetPackError::PayloadOutOfBounds;
+			}
+
+			// A buffer is copied as ByteWidth bytes from its one subresource, which must be a single row of them
+			if (entry.Type == AssetType::Buffer &&
+				(subresource.RowSizeInBytes != entry.Width || subresource.NumRows != 1 || subresource.Depth != 1))
+			{
+				return AssetPackError::ByteWidthMismatch;
+			}
+
+			// Bounded by the checks above, but compared without adding so a corrupt ByteWidth cannot wrap the sum
+			const uint64_t fullSize = subresource.SlicePitch * subresource.Depth;
+			if (fullSize > entry.ByteWidth - byteWidth)
+			{
+				return AssetPackError::ByteWidthMismatch;
+			}
+			byteWidth += fullSize;
+
+			// Streaming reads an asset as one span from its first payload to the end of its last
+			if (s > 0 && subresource.Offset < previousEnd)
+			{
+				return AssetPackError::PayloadsOutOfOrder;
+			}
+			previousEnd = subresource.Offset + fullSize;
+		}
+		if (byteWidth != entry.ByteWidth)
+		{
+			return AssetPackError::ByteWidthMismatch;
+		}
+	}
+
+	return AssetPackError::None;
+}
+
+// A mapped, validated asset pack.
+// Nothing is read from disk on Open beyond the header and tables; payload pages are faulted in
+// when the GPU upload first copies from them.
+class AssetPack
+{
+public:
+	// Returns AssetPackError::FileTooSmall if the file cannot be opened at all
+	AssetPackError Open(const char* path)
+	{
+		Close();
+		if (!m_File.Open(path))
+		{
+			return AssetPackError::FileTooSmall;
+		}
+		return Attach();
+	}
+
+#if defined(_WIN32)
+	AssetPackError Open(const wchar_t* path)
+	{
+		Close();
+		if (!m_File.Open(path))
+		{
+			return AssetPackError::FileTooSmall;
+		}
+		return Attach();
+	}
+#endif
+
+	void Close()
+	{
+		m_File.Close();
+		m_Entries = nullptr;
+		m_Subresources = nullptr;
+		m_NumAssets = 0;
+	}
+
+	uint32_t GetNumAssets() const { return m_NumAssets; }
+	const AssetPackEntry& GetAsset(uint32_t index) const { return m_Entries[index]; }
+
+	// Binary search by name hash, returns null if the pack has no such asset
+	const AssetPackEntry* FindAsset(uint64_t nameHash) const
+	{
+		uint32_t first = 0;
+		uint32_t last = m_NumAssets;
+		while (first < last)
+		{
+			uint32_t middle = first + (last - first) / 2;
+			if (m_Entries[middle].NameHash < nameHash)
+			{
+				first = middle + 1;
+			}
+			else
+			{
+				last = middle;
+			}
+		}
+		return first < m_NumAssets && m_Entries[first].NameHash == nameHash ? &m_Entries[first] : nullptr;
+	}
+
+	const AssetPackEntry* FindAsset(const char* name) const { return FindAsset(HashString(name)); }
+
+	const AssetPackSubresource& GetSubresource(const AssetPackEntry& asset, uint32_t index) const
+	{
+		return m_Subresources[asset.FirstSubresource + index];
+	}
+
+	// Fills asset.NumSubresources elements of out with pointers into the mapping
+	void GetSubresourceData(const AssetPackEntry& asset, AssetSubresourceData* out) const
+	{
+		const uint8_t* base = static_cast<const uint8_t*>(m_File.Data());
+		for (uint32_t i = 0; i < asset.NumSubresources; i++)
+		{
+			const AssetPackSubresource& subresource = GetSubresource(asset, i);
+			out[i].Data = base + subresource.Offset;
+			out[i].RowPitch = subresource.RowPitch;
+			out[i].SlicePitch = static_cast<int64_t>(subresource.SlicePitch);
+		}
+	}
+
+#if defined(_WIN32)
+	// Same as above but straight into the array UpdateSubresources takes
+	void GetSubresourceData(const AssetPackEntry& asset, D3D12_SUBRESOURCE_DATA* out) const
+	{
+		static_assert(sizeof(AssetSubresourceData) == sizeof(D3D12_SUBRESOURCE_DATA), "Layouts must match");
+		static_assert(AssetPackPitchAlignment == D3D12_TEXTURE_DATA_PITCH_ALIGNMENT, "Pitch alignment must match D3D12");
+		static_assert(AssetPackPlacementAlignment == D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, "Placement alignment must match D3D12");
+
+		const uint8_t* base = static_cast<const uint8_t*>(m_File.Data());
+		for (uint32_t i = 0; i < asset.NumSubresources; i++)
+		{
+			const AssetPackSubresource& subresource = GetSubresource(asset, i);
+			out[i].pData = base + subresource.Offset;
+			out[i].RowPitch = subresource.RowPitch;
+			out[i].SlicePitch = static_cast<LONG_PTR>(subresource.SlicePitch);
+		}
+	}
+
+	// Desc to create the default heap resource the asset will be uploaded into
+	static D3D12_RESOURCE_DESC GetResourceDesc(const AssetPackEntry& asset)
+	{
+		if (asset.Type == AssetType::Buffer)
+		{
+			return CD3DX12_RESOURCE_DESC::Buffer(asset.ByteWidth);
+		}
+
+		return CD3DX12_RESOURCE_DESC(static_cast<D3D12_RESOURCE_DIMENSION>(asset.Dimension), 0,
+			asset.Width, asset.Height, static_cast<UINT16>(asset.DepthOrArraySize), static_cast<UINT16>(asset.MipLevels),
+			static_cast<DXGI_FORMAT>(asset.Format), 1, 0, D3D12_TEXTURE_LAYOUT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE);
+	}
+#endif
+
+private:
+	AssetPackError Attach()
+	{
+		AssetPackError error = ValidateAssetPack(m_File.Data(), m_File.Size());
+		if (error != AssetPackError::None)
+		{
+			Close();
+			return error;
+		}
+
+		const uint8_t* bytes = static_cast<const uint8_t*>(m_File.Data());
+		AssetPackHeader header;
+		memcpy(&header, bytes, sizeof(header));
+
+		// Tables are 8 byte aligned in the file and the mapping is page aligned, so they can be used in place
+		m_NumAssets = header.NumAssets;
+		m_Entries = reinterpret_cast<const AssetPackEntry*>(bytes + sizeof(AssetPackHeader));
+		m_Subresources = reinterpret_cast<const AssetPackSubresource*>(m_Entries + header.NumAssets);
+		return AssetPackError::None;
+	}
+
+	MappedFile m_File;
+	const AssetPackEntry* m_Entries = nullptr;
+	const AssetPackSubresource* m_Subresources = nullptr;
+	uint32_t m_NumAssets = 0;
+};
+
+// Builds asset packs, e.g. in the content pipeline.
+// Sources are given with their own pitches and are re-laid out with D3D12 alignment as they are added.
+class AssetPackWriter
+{
+public:
+	// One subresource of source data. rowSizeInBytes and numRows are as reported by
+	// ID3D12Device::GetCopyableFootprints (rows of blocks for block compressed formats).
+	struct SourceSubresource
+	{
+		const void* Data;
+		uint64_t RowPitch;
+		uint64_t SlicePitch;
+		uint32_t RowSizeInBytes;
+		uint32_t NumRows;
+		uint32_t Depth;
+	};
+
+	// Returns false, adding nothing, if size doesn't fit the 32-bit width and row pitch of the pack format
+	bool AddBuffer(const char* name, const void* data, uint64_t size)
+	{
+		if (size > UINT32_MAX)
+		{
+			return false;
+		}
+
+		Asset asset = {};
+		asset.Entry.NameHash = HashString(name);
+		asset.Entry.Type = AssetType::Buffer;
+		asset.Entry.Dimension = AssetPackDimensionBuffer;
+		asset.Entry.Width = static_cast<uint32_t>(size);
+		asset.Entry.Height = 1;
+		asset.Entry.DepthOrArraySize = 1;
+		asset.Entry.MipLevels = 1;
+
+		AssetPackSubresource subresource = {};
+		subresource.RowPitch = static_cast<uint32_t>(size);
+		subresource.RowSizeInBytes = static_cast<uint32_t>(size);
+		subresource.NumRows = 1;
+		subresource.Depth = 1;
+		subresource.SlicePitch = size;
+		AddSubresource(asset, subresource, data, size, size);
+
+		m_Assets.push_back(std::move(asset));
+		return true;
+	}
+
+	// dimension is a D3D12_RESOURCE_DIMENSION, format a DXGI_FORMAT.
+	// subresources are in D3D12 subresource order: mips of the first array slice, then the next slice.
+	void AddTexture(const char* name, uint32_t dimension, uint32_t format, uint32_t width, uint32_t height,
+		uint32_t depthOrArraySize, uint32_t mipLevels, const std::vector<SourceSubresource>& subresources)
+	{
+		Asset asset = {};
+		asset.Entry.NameHash = HashString(name);
+		asset.Entry.Type = AssetType::Texture;
+		asset.Entry.Format = format;
+		asset.Entry.Dimension = dimension;
+		asset.Entry.Width = width;
+		asset.Entry.Height = height;
+		asset.Entry.DepthOrArraySize = depthOrArraySize;
+		asset.Entry.MipLevels = mipLevels;
+
+		for (const SourceSubresource& source : subresources)
+		{
+			AssetPackSubresource subresource = {};
+			subresource.RowSizeInBytes = source.RowSizeInBytes;
+			subresource.RowPitch = AlignUp(source.RowSizeInBytes, AssetPackPitchAlignment);
+			subresource.NumRows = source.NumRows;
+			subresource.Depth = source.Depth;
+			subresource.SlicePitch = uint64_t(subresource.RowPitch) * source.NumRows;
+			AddSubresource(asset, subresource, source.Data, source.RowPitch, source.SlicePitch);
+		}
+
+		m_Assets.push_back(std::move(asset));
+	}
+
+	// Lays out and writes the pack. Returns false if the file could not be written,
+	// or if two assets have the same name hash.
+	bool Write(const char* path)
+	{
+		std::vector<uint8_t> file;
+		return Build(file) && WriteWholeFile(path, file.data(), file.size());
+	}
+
+	bool Build(std::vector<uint8_t>& file)
+	{
+		std::sort(m_Assets.begin(), m_Assets.end(), [](const Asset& a, const Asset& b)
+		{
+			return a.Entry.NameHash < b.Entry.NameHash;
+		});
+
+		uint32_t numSubresources = 0;
+		for (size_t i = 0; i < m_Assets.size(); i++)
+		{
+			if (i > 0 && m_Assets[i].Entry.NameHash == m_Assets[i - 1].Entry.NameHash)
+			{
+				return false;
+			}
+			numSubresources += static_cast<uint32_t>(m_Assets[i].Subresources.size());
+		}
+
+		const uint64_t tablesSize = sizeof(AssetPackHeader) + m_Assets.size() * sizeof(AssetPackEntry) +
+			uint64_t(numSubresources) * sizeof(AssetPackSubresource);
+
+		// Place payloads
+		uint64_t offset = tablesSize;
+		std::vector<AssetPackEntry> entries;
+		std::vector<AssetPackSubresource> subresources;
+		for (Asset& asset : m_Assets)
+		{
+			asset.Entry.FirstSubresource = static_cast<uint32_t>(subresources.size());
+			asset.Entry.NumSubresources = static_cast<uint32_t>(asset.Subresources.size());
+			asset.Entry.ByteWidth = 0;
+			for (size_t s = 0; s < asset.Subresources.size(); s++)
+			{
+				AssetPackSubresource subresource = asset.Subresources[s];
+				offset = AlignUp(offset, uint64_t(AssetPackPlacementAlignment));
+				subresource.Offset = offset;
+				offset += asset.Payloads[s].size();
+				asset.Entry.ByteWidth += asset.Payloads[s].size();
+				subresources.push_back(subresource);
+			}
+			entries.push_back(asset.Entry);
+		}
+
+		file.assign(static_cast<size_t>(offset), 0);
+
+		AssetPackHeader header = { AssetPackMagic, AssetPackVersion, static_cast<uint32_t>(entries.size()),
+			numSubresources, offset };
+		memcpy(file.data(), &header, sizeof(header));
+		if (!entries.empty())
+		{
+			memcpy(file.data() + sizeof(header), entries.data(), entries.size() * sizeof(AssetPackEntry));
+		}
+		if (!subresources.empty())
+		{
+			memcpy(file.data() + sizeof(header) + entries.size() * sizeof(AssetPackEntry), subresources.data(),
+				subresources.size() * sizeof(AssetPackSubresource));
+		}
+
+		size_t subresourceIndex = 0;
+		for (const Asset& asset : m_Assets)
+		{
+			for (const std::vector<uint8_t>& payload : asset.Payloads)
+			{
+				if (!payload.empty())
+				{
+					memcpy(file.data() + subresources[subresourceIndex].Offset, payload.data(), payload.size());
+				}
+				subresourceIndex++;
+			}
+		}
+
+		return true;
+	}
+
+private:
+	struct Asset
+	{
+		AssetPackEntry Entry;
+		std::vector<AssetPackSubresource> Subresources;
+		// Each subresource already padded to its final layout, minus the placement alignment
+		std::vector<std::vector<uint8_t>> Payloads;
+	};
+
+	template<typename T>
+	static T AlignUp(T value, T alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Copies source rows into the padded layout of subresource
+	static void AddSubresource(Asset& asset, const AssetPackSubresource& subresource, const void* data,
+		uint64_t sourceRowPitch, uint64_t sourceSlicePitch)
+	{
+		std::vector<uint8_t> payload(static_cast<size_t>(subresource.SlicePitch * subresource.Depth), 0);
+		const uint8_t* source = static_cast<const uint8_t*>(data);
+		for (uint32_t z = 0; z < subresource.Depth; z++)
+		{
+			for (uint32_t y = 0; y < subresource.NumRows; y++)
+			{
+				memcpy(payload.data() + z * subresource.SlicePitch + uint64_t(y) * subresource.RowPitch,
+					source + z * sourceSlicePitch + y * sourceRowPitch, subresource.RowSizeInBytes);
+			}
+		}
+
+		asset.Subresources.push_back(subresource);
+		asset.Payloads.push_back(std::move(payload));
+	}
+
+	std::vector<Asset> m_Assets;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#endif
+
+#include <atomic>
+#include <cstdint>
+
+// Asynchronous reads from a file into caller owned memory, polled for completion.
+//
+// On Windows this is overlapped I/O: the read is queued with the OS and the calling thread carries on.
+// Off Windows a single background thread issuing pread stands in for io_uring, which keeps the same
+// submit/poll shape (so the streaming code above it does not change) without depending on liburing.
+enum class AsyncReadStatus
+{
+	Idle,
+	Pending,
+	Complete,
+	Failed,
+};
+
+class AsyncFile;
+
+// One read in flight. Must stay at the same address, and alive, until Poll stops returning Pending.
+class AsyncRead
+{
+public:
+	AsyncRead() = default;
+	AsyncRead(const AsyncRead&) = delete;
+	AsyncRead& operator=(const AsyncRead&) = delete;
+
+	// Queues a read of size bytes at offset into destination
+	bool Begin(AsyncFile& file, uint64_t offset, uint32_t size, void* destination);
+
+	// Non-blocking
+	AsyncReadStatus Poll();
+
+private:
+	friend class AsyncFile;
+#if defined(_WIN32)
+	AsyncFile* m_File = nullptr;
+	OVERLAPPED m_Overlapped = {};
+	uint32_t m_Size = 0;
+	AsyncReadStatus m_Status = AsyncReadStatus::Idle;
+#else
+	int m_Descriptor = -1;
+	uint64_t m_Offset = 0;
+	uint32_t m_Size = 0;
+	void* m_Destination = nullptr;
+	std::atomic<AsyncReadStatus> m_Status{ AsyncReadStatus::Idle };
+#endif
+};
+
+class AsyncFile
+{
+public:
+	AsyncFile() = default;
+	~AsyncFile() { Close(); }
+
+	AsyncFile(const AsyncFile&) = delete;
+	AsyncFile& operator=(const AsyncFile&) = delete;
+
+#if defined(_WIN32)
+	bool Open(const wchar_t* path)
+	{
+		Close();
+		// FILE_FLAG_OVERLAPPED makes ReadFile return immediately with ERROR_IO_PENDING.
+		// FILE_FLAG_SEQUENTIAL_SCAN hints the cache manager to read ahead.
+		m_File = ::CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		return m_File != INVALID_HANDLE_VALUE;
+	}
+
+	void Close()
+	{
+		if (m_File != INVALID_HANDLE_VALUE)
+		{
+			// Reads still in flight would write into memory the caller is about to free
+			::CancelIoEx(m_File, NULL);
+			::CloseHandle(m_File);
+			m_File = INVALID_HANDLE_VALUE;
+		}
+	}
+
+	bool IsOpen() const { return m_File != INVALID_HANDLE_VALUE; }
+	HANDLE GetHandle() const { return m_File; }
+
+private:
+	HANDLE m_File = INVALID_HANDLE_VALUE;
+#else
+	bool Open(const char* path)
+	{
+		Close();
+		m_Descriptor = ::open(path, O_RDONLY);
+		return m_Descriptor >= 0;
+	}
+
+	// Reads still queued for this file must have completed first
+	void Close()
+	{
+		if (m_Descriptor >= 0)
+		{
+			::close(m_Descriptor);
+			m_Descriptor = -1;
+		}
+	}
+
+	bool IsOpen() const { return m_Descriptor >= 0; }
+	int GetDescriptor() const { return m_Descriptor; }
+
+private:
+	friend class AsyncRead;
+
+	// The submission queue shared by every file, serviced by one thread for the life of the process
+	class IoQueue
+	{
+	public:
+		static IoQueue& Get()
+		{
+			static IoQueue queue;
+			return queue;
+		}
+
+		void Submit(AsyncRead* read)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Reads.push_back(read);
+			}
+			m_ReadAvailable.notify_one();
+		}
+
+	private:
+		IoQueue() : m_Thread(&IoQueue::ThreadMain, this) {}
+		~IoQueue()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_IsRunning = false;
+			}
+			m_ReadAvailable.notify_one();
+			m_Thread.join();
+		}
+
+		void ThreadMain()
+		{
+			for (;;)
+			{
+				AsyncRead* read = nullptr;
+				{
+					std::unique_lock<std::mutex> lock(m_Mutex);
+					m_ReadAvailable.wait(lock, [this]() { return !m_IsRunning || !m_Reads.empty(); });
+					if (m_Reads.empty())
+					{
+						return;
+					}
+					read = m_Reads.front();
+					m_Reads.pop_front();
+				}
+
+				// pread may return short, keep going until everything has been read or it fails
+				uint8_t* destination = static_cast<uint8_t*>(read->m_Destination);
+				uint64_t done = 0;
+				bool failed = false;
+				while (done < read->m_Size)
+				{
+					ssize_t result = ::pread(read->m_Descriptor, destination + done, read->m_Size - done,
+						static_cast<off_t>(read->m_Offset + done));
+					if (result <= 0)
+					{
+						failed = true;
+						break;
+					}
+					done += static_cast<uint64_t>(result);
+				}
+
+				read->m_Status.store(failed ? AsyncReadStatus::Failed : AsyncReadStatus::Complete,
+					std::memory_order_release);
+			}
+		}
+
+		std::mutex m_Mutex;
+		std::condition_variable m_ReadAvailable;
+		std::deque<AsyncRead*> m_Reads;
+		bool m_IsRunning = true;
+		std::thread m_Thread;
+	};
+
+	int m_Descriptor = -1;
+#endif
+};
+
+#if defined(_WIN32)
+inline bool AsyncRead::Begin(AsyncFile& file, uint64_t offset, uint32_t size, void* destination)
+{
+	m_File = &file;
+	m_Size = size;
+	m_Overlapped = {};
+	m_Overlapped.Offset = static_cast<DWORD>(offset);
+	m_Overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+	// Returns FALSE with ERROR_IO_PENDING when the read was queued, or TRUE if it finished immediately
+	if (!::ReadFile(file.GetHandle(), destination, size, NULL, &m_Overlapped) &&
+		::GetLastError() != ERROR_IO_PENDING)
+	{
+		m_Status = AsyncReadStatus::Failed;
+		return false;
+	}
+
+	m_Status = AsyncReadStatus::Pending;
+	return true;
+}
+
+inline AsyncReadStatus AsyncRead::Poll()
+{
+	if (m_Status == AsyncReadStatus::Pending)
+	{
+		DWORD bytesRead = 0;
+		// bWait = FALSE, so this only checks
+		if (::GetOverlappedResult(m_File->GetHandle(), &m_Overlapped, &bytesRead, FALSE))
+		{
+			m_Status = bytesRead == m_Size ? AsyncReadStatus::Complete : AsyncReadStatus::Failed;
+		}
+		else if (::GetLastError() != ERROR_IO_INCOMPLETE)
+		{
+			m_Status = AsyncReadStatus::Failed;
+		}
+	}
+	return m_Status;
+}
+#else
+inline bool AsyncRead::Begin(AsyncFile& file, uint64_t offset, uint32_t size, void* destination)
+{
+	m_Descriptor = file.GetDescriptor();
+	m_Offset = offset;
+	m_Size = size;
+	m_Destination = destination;
+	m_Status.store(AsyncReadStatus::Pending, std::memory_order_relaxed);
+	AsyncFile::IoQueue::Get().Submit(this);
+	return true;
+}
+
+inline AsyncReadStatus AsyncRead::Poll()
+{
+	return m_Status.load(std::memory_order_acquire);
+}
+#endif
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Lz4.h"
+
+// LZ4 compressed data split into fixed size chunks which decompress independently, so one stream can be
+// spread across several threads. A thread decodes its chunk into scratch memory of its own, and only copies it
+// to its place in the destination once the whole chunk decoded, so a corrupt chunk never writes there.
+//
+// Layout:
+//	CompressedStreamHeader
+//	CompressedChunk[NumChunks]
+//	chunk payloads
+//
+// Chunk i decompresses to bytes [i * ChunkSize, min((i + 1) * ChunkSize, UncompressedSize)).
+// Chunks which LZ4 can't shrink are stored as they are, marked by CompressedSize equal to their uncompressed size.
+
+const uint32_t CompressedStreamMagic = 0x345A4C43;	// "CLZ4"
+const uint32_t CompressedStreamVersion = 1;
+const uint32_t CompressedStreamDefaultChunkSize = 64 * 1024;
+
+struct CompressedStreamHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t ChunkSize;
+	uint32_t NumChunks;
+	uint64_t UncompressedSize;
+};
+
+struct CompressedChunk
+{
+	uint64_t Offset;			// From the start of the stream
+	uint32_t CompressedSize;
+	uint32_t Padding;
+};
+
+// Checks the header and chunk table of a stream. On success the header is returned through header.
+inline bool ValidateCompressedStream(const void* data, uint64_t size, CompressedStreamHeader* header = nullptr)
+{
+	if (size < sizeof(CompressedStreamHeader))
+	{
+		return false;
+	}
+
+	CompressedStreamHeader streamHeader;
+	memcpy(&streamHeader, data, sizeof(streamHeader));
+	if (streamHeader.Magic != CompressedStreamMagic || streamHeader.Version != CompressedStreamVersion ||
+		streamHeader.ChunkSize == 0)
+	{
+		return false;
+	}
+
+	const uint64_t expectedChunks = (streamHeader.UncompressedSize + streamHeader.ChunkSize - 1) / streamHeader.ChunkSize;
+	const uint64_t tableEnd = sizeof(CompressedStreamHeader) + uint64_t(streamHeader.NumChunks) * sizeof(CompressedChunk);
+	if (streamHeader.NumChunks != expectedChunks || tableEnd > size)
+	{
+		return false;
+	}
+
+	// Copied out, as the table is only as aligned as the caller's buffer
+	const uint8_t* table = static_cast<const uint8_t*>(data) + sizeof(CompressedStreamHeader);
+	for (uint32_t i = 0; i < streamHeader.NumChunks; i++)
+	{
+		CompressedChunk chunk;
+		memcpy(&chunk, table + uint64_t(i) * sizeof(CompressedChunk), sizeof(chunk));
+		if (chunk.Offset < tableEnd || chunk.Offset > size || chunk.CompressedSize > size - chunk.Offset)
+		{
+			return false;
+		}
+	}
+
+	if (header)
+	{
+		*header = streamHeader;
+	}
+	return true;
+}
+
+// Builds a stream from uncompressed data. For content tools, this is not meant to be fast.
+inline std::vector<uint8_t> CompressChunked(const void* data, uint64_t size,
+	uint32_t chunkSize = CompressedStreamDefaultChunkSize)
+{
+	assert(chunkSize > 0);
+
+	CompressedStreamHeader header = {};
+	header.Magic = CompressedStreamMagic;
+	header.Version = CompressedStreamVersion;
+	header.ChunkSize = chunkSize;
+	header.NumChunks = static_cast<uint32_t>((size + chunkSize - 1) / chunkSize);
+	header.UncompressedSize = size;
+
+	const size_t tableEnd = sizeof(CompressedStreamHeader) + header.NumChunks * sizeof(CompressedChunk);
+	std::vector<uint8_t> stream(tableEnd);
+	std::vector<CompressedChunk> chunks(header.NumChunks);
+	std::vector<uint8_t> scratch(Lz4::CompressBound(chunkSize));
+
+	const uint8_t* source = static_cast<const uint8_t*>(data);
+	for (uint32_t i = 0; i < header.NumChunks; i++)
+	{
+		const uint64_t chunkStart = uint64_t(i) * chunkSize;
+		const size_t uncompressedSize = static_cast<size_t>(std::min<uint64_t>(chunkSize, size - chunkStart));
+		size_t compressedSize = Lz4::Compress(source + chunkStart, uncompressedSize, scratch.data());
+
+		const uint8_t* payload = scratch.data();
+		if (compressedSize >= uncompressedSize)
+		{
+			payload = source + chunkStart;
+			compressedSize = uncompressedSize;
+		}
+
+		chunks[i].Offset = stream.size();
+		chunks[i].CompressedSize = static_cast<uint32_t>(compressedSize);
+		chunks[i].Padding = 0;
+		stream.insert(stream.end(), payload, payload + compressedSize);
+	}
+
+	memcpy(stream.data(), &header, sizeof(header));
+	if (!chunks.empty())
+	{
+		memcpy(stream.data() + sizeof(header), chunks.data(), chunks.size() * sizeof(CompressedChunk));
+	}
+	return stream;
+}
+
+enum class DecompressStatus
+{
+	Idle,
+	Pending,
+	Complete,
+	Failed,
+};
+
+// One stream being decompressed. Must stay at the same address, and alive, until Poll stops returning Pending.
+class DecompressJob
+{
+public:
+	DecompressJob() = default;
+	DecompressJob(const DecompressJob&) = delete;
+	DecompressJob& operator=(const DecompressJob&) = delete;
+
+	DecompressStatus Poll() const
+	{
+		DecompressStatus status = m_Status.load(std::memory_order_acquire);
+		if (status == DecompressStatus::Pending && m_NumRemaining.load(std::memory_order_acquire) == 0)
+		{
+			status = m_HasFailed.load(std::memory_order_relaxed) ? DecompressStatus::Failed : DecompressStatus::Complete;
+		}
+		return status;
+	}
+
+private:
+	friend class Decompressor;
+
+	const uint8_t* m_Source = nullptr;
+	uint8_t* m_Destination = nullptr;
+	CompressedStreamHeader m_Header = {};
+	// Handed out under the decompressor's lock
+	uint32_t m_NextChunk = 0;
+	std::atomic<uint32_t> m_NumRemaining{ 0 };
+	std::atomic<bool> m_HasFailed{ false };
+	std::atomic<DecompressStatus> m_Status{ DecompressStatus::Idle };
+};
+
+// Decompresses chunked streams on a JobSystem's workers. Chunks are handed out one at a time, oldest job
+// first, so a large stream is spread over every worker and a small one doesn't wait behind it for long. Each
+// stream starts a job per worker, at most one per chunk, which decompresses chunks until none are queued.
+//
+// The destination is normally a mapped upload heap, which is write-combined: uncached, so reads from it are
+// very slow. LZ4 copies matches from what it has already written, so chunks aren't decompressed there directly,
+// but into a scratch buffer per thread which stays in cache, then copied out in one pass, front to back.
+class Decompressor
+{
+public:
+	~Decompressor() { Shutdown(); }
+
+	// jobSystem must stay alive until Shutdown
+	void Initialize(JobSystem& jobSystem)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_JobSystem = &jobSystem;
+		m_IsRunning = true;
+	}
+
+	// Jobs still queued are abandoned and stay Pending. Waits for chunks already being decompressed.
+	void Shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!m_IsRunning)
+			{
+				return;
+			}
+			m_IsRunning = false;
+			m_Jobs.clear();
+		}
+		m_JobSystem->Wait(m_Workers);
+		m_JobSystem = nullptr;
+	}
+
+	// Queues decompression of the stream in source into destination, which must hold destinationSize bytes.
+	// Source must stay alive until the job completes. Returns false, without queuing, if the stream is
+	// malformed or doesn't decompress to destinationSize bytes.
+	bool Begin(DecompressJob& job, const void* source, uint64_t sourceSize, void* destination, uint64_t destinationSize)
+	{
+		assert(job.Poll() != DecompressStatus::Pending && "Job is still in use");
+
+		CompressedStreamHeader header;
+		if (!ValidateCompressedStream(source, sourceSize, &header) || header.UncompressedSize != destinationSize)
+		{
+			job.m_Status.store(DecompressStatus::Failed, std::memory_order_release);
+			return false;
+		}
+
+		job.m_Source = static_cast<const uint8_t*>(source);
+		job.m_Destination = static_cast<uint8_t*>(destination);
+		job.m_Header = header;
+		job.m_NextChunk = 0;
+		job.m_NumRemaining.store(header.NumChunks, std::memory_order_relaxed);
+		job.m_HasFailed.store(false, std::memory_order_relaxed);
+		job.m_Status.store(DecompressStatus::Pending, std::memory_order_release);
+
+		if (header.NumChunks > 0)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				assert(m_IsRunning && "Decompressor is not initialized");
+				m_Jobs.push_back(&job);
+			}
+
+			// Workers already decompressing an earlier job carry on with this one, so these may find nothing left
+			const uint32_t numWorkers = std::min(header.NumChunks, std::max(1u, m_JobSystem->GetNumWorkers()));
+			for (uint32_t i = 0; i < numWorkers; i++)
+			{
+				m_JobSystem->Run([this]()
+				{
+					while (RunChunk())
+					{
+					}
+				}, &m_Workers);
+			}
+		}
+		return true;
+	}
+
+	// Blocks until job is done, decompressing queued chunks on the calling thread meanwhile rather than idling
+	DecompressStatus Wait(DecompressJob& job)
+	{
+		while (job.Poll() == DecompressStatus::Pending)
+		{
+			if (!RunChunk())
+			{
+				std::this_thread::yield();
+			}
+		}
+		return job.Poll();
+	}
+
+private:
+
+	// Sized for the largest chunk the thread has decompressed, the default chunk size to start with
+	static std::vector<uint8_t>& GetThreadScratch(size_t size)
+	{
+		static thread_local std::vector<uint8_t> scratch;
+		if (scratch.size() < size)
+		{
+			scratch.resize(std::max<size_t>(size, CompressedStreamDefaultChunkSize));
+		}
+		return scratch;
+	}
+
+	// Decompresses the next queued chunk. Returns false if there is none, or the decompressor is shut down.
+	bool RunChunk()
+	{
+		DecompressJob* job = nullptr;
+		uint32_t chunkIndex = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!m_IsRunning || m_Jobs.empty())
+			{
+				return false;
+			}
+
+			job = m_Jobs.front();
+			chunkIndex = job->m_NextChunk++;
+			if (job->m_NextChunk == job->m_Header.NumChunks)
+			{
+				m_Jobs.pop_front();
+			}
+		}
+
+		const CompressedStreamHeader& header = job->m_Header;
+		CompressedChunk chunk;
+		memcpy(&chunk, job->m_Source + sizeof(CompressedStreamHeader) + uint64_t(chunkIndex) * sizeof(CompressedChunk),
+			sizeof(chunk));
+
+		const uint64_t destinationOffset = uint64_t(chunkIndex) * header.ChunkSize;
+		const size_t uncompressedSize = static_cast<size_t>(std::min<uint64_t>(header.ChunkSize,
+			header.UncompressedSize - destinationOffset));
+
+		bool succeeded = true;
+		if (chunk.CompressedSize == uncompressedSize)
+		{
+			memcpy(job->m_Destination + destinationOffset, job->m_Source + chunk.Offset, uncompressedSize);
+		}
+		else
+		{
+			std::vector<uint8_t>& scratch = GetThreadScratch(uncompressedSize);
+			succeeded = Lz4::Decompress(job->m_Source + chunk.Offset, chunk.CompressedSize, scratch.data(), uncompressedSize);
+			if (succeeded)
+			{
+				memcpy(job->m_Destination + destinationOffset, scratch.data(), uncompressedSize);
+			}
+		}
+
+		if (!succeeded)
+		{
+			job->m_HasFailed.store(true, std::memory_order_relaxed);
+		}
+		// Release, so the chunk's writes are visible to whoever sees the count reach zero
+		job->m_NumRemaining.fetch_sub(1, std::memory_order_acq_rel);
+		return true;
+	}
+
+	JobSystem* m_JobSystem = nullptr;
+	// The job system's jobs which are decompressing chunks
+	JobCounter m_Workers;
+
+	std::mutex m_Mutex;
+	// Jobs with chunks not yet handed out, oldest first
+	std::deque<DecompressJob*> m_Jobs;
+	bool m_IsRunning = false;
+};
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <queue>
+#include <vector>
+
+#if defined(_WIN32)
+#include <wrl.h>
+#include <d3d12.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "FenceAwaiter.h"
+#include "Helpers.h"
+#endif
+
+// Submission to several command queues, e.g. DIRECT plus an async COMPUTE queue, with dependencies between
+// submissions on different queues resolved on the GPU.
+//
+// Each Queue owns a fence, signalled after every submission to it. A submission which depends on work on
+// another queue makes its queue Wait on that queue's fence first, so the CPU never blocks on cross-queue
+// dependencies. Work on one queue already runs in submission order, so dependencies within a queue cost
+// nothing.
+//
+// A GPU wait on a value that is only signalled by work submitted after the wait deadlocks the queues, which
+// is what a cycle in the dependencies would cause. So QueueSubmitter sorts each batch of submissions by
+// their dependencies before submitting any of it, and refuses batches with cycles. The sort lives in
+// SubmissionGraph, which has no D3D12 dependency so it can be run and checked on any platform.
+
+class SubmissionGraph
+{
+public:
+	typedef uint32_t SubmissionId;
+
+	SubmissionId Add()
+	{
+		m_Dependencies.emplace_back();
+		return static_cast<SubmissionId>(m_Dependencies.size() - 1);
+	}
+
+	// submission can't start until dependsOn has finished. Either may have been added first.
+	void AddDependency(SubmissionId submission, SubmissionId dependsOn)
+	{
+		assert(submission < m_Dependencies.size() && dependsOn < m_Dependencies.size());
+		m_Dependencies[submission].push_back(dependsOn);
+	}
+
+	const std::vector<SubmissionId>& GetDependencies(SubmissionId submission) const { return m_Dependencies[submission]; }
+	uint32_t GetNumSubmissions() const { return static_cast<uint32_t>(m_Dependencies.size()); }
+
+	void Clear() { m_Dependencies.clear(); }
+
+	// Orders submissions so each comes after everything it depends on. Where the dependencies allow, the
+	// order they were added in is kept. Returns false, leaving order incomplete, if the dependencies have a cycle.
+	bool Sort(std::vector<SubmissionId>& order) const
+	{
+		const uint32_t numSubmissions = GetNumSubmissions();
+		std::vector<uint32_t> numWaitingFor(numSubmissions, 0);
+		std::vector<std::vector<SubmissionId>> dependents(numSubmissions);
+		for (SubmissionId id = 0; id < numSubmissions; id++)
+		{
+			for (SubmissionId dependsOn : m_Dependencies[id])
+			{
+				numWaitingFor[id]++;
+				dependents[dependsOn].push_back(id);
+			}
+		}
+
+		// Kahn's algorithm, always taking the lowest ready id
+		std::priority_queue<SubmissionId, std::vector<SubmissionId>, std::greater<SubmissionId>> ready;
+		for (SubmissionId id = 0; id < numSubmissions; id++)
+		{
+			if (numWaitingFor[id] == 0)
+			{
+				ready.push(id);
+			}
+		}
+
+		order.clear();
+		while (!ready.empty())
+		{
+			const SubmissionId id = ready.top();
+			ready.pop();
+			order.push_back(id);
+			for (SubmissionId dependent : dependents[id])
+			{
+				if (--numWaitingFor[dependent] == 0)
+				{
+					ready.push(dependent);
+				}
+			}
+		}
+
+		// Anything left is on, or waits on, a cycle
+		return order.size() == numSubmissions;
+	}
+
+private:
+	std::vector<std::vector<SubmissionId>> m_Dependencies;
+};
+
+#if defined(_WIN32)
+// A command queue with its own fence
+class Queue
+{
+public:
+	~Queue() { Shutdown(); }
+
+	void Initialize(Microsoft::WRL::ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE type,
+		D3D12_COMMAND_QUEUE_PRIORITY priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL)
+	{
+		D3D12_COMMAND_QUEUE_DESC desc = {};
+		desc.Type = type;
+		desc.Priority = priority;
+		desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+		desc.NodeMask = 0;
+		ThrowIfFailed(device->CreateCommandQueue(&desc, IID_PPV_ARGS(&m_CommandQueue)));
+		ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_Fence)));
+
+		m_FenceEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+		assert(m_FenceEvent && "Failed to create fence event.");
+
+		m_Type = type;
+		m_LastSignalledValue = 0;
+	}
+
+	// Waits for everything submitted to finish, then releases the queue
+	void Shutdown()
+	{
+		if (m_CommandQueue)
+		{
+			Flush();
+			::CloseHandle(m_FenceEvent);
+			m_FenceEvent = NULL;
+			m_Fence.Reset();
+			m_CommandQueue.Reset();
+		}
+	}
+
+	// Executes the command lists, then signals. Returns the fence value which means they are done.
+	uint64_t Execute(UINT numCommandLists, ID3D12CommandList* const* commandLists)
+	{
+		m_CommandQueue->ExecuteCommandLists(numCommandLists, commandLists);
+		return Signal();
+	}
+
+	uint64_t Signal()
+	{
+		ThrowIfFailed(m_CommandQueue->Signal(m_Fence.Get(), ++m_LastSignalledValue));
+		return m_LastSignalledValue;
+	}
+
+	// Work submitted to this queue from now on won't start until other has reached fenceValue.
+	// Only blocks the GPU; skipped when the value has already been reached.
+	void Wait(const Queue& other, uint64_t fenceValue)
+	{
+		if (&other != this && !other.IsComplete(fenceValue))
+		{
+			ThrowIfFailed(m_CommandQueue->Wait(other.m_Fence.Get(), fenceValue));
+		}
+	}
+
+	bool IsComplete(uint64_t fenceValue) const
+	{
+		return m_Fence->GetCompletedValue() >= fenceValue;
+	}
+
+	uint64_t GetCompletedValue() const { return m_Fence->GetCompletedValue(); }
+
+	// Blocks the CPU until fenceValue is reached, or duration has passed
+	void WaitForFenceValue(uint64_t fenceValue, std::chrono::milliseconds duration = std::chrono::milliseconds::max())
+	{
+		if (!IsComplete(fenceValue))
+		{
+			ThrowIfFailed(m_Fence->SetEventOnCompletion(fenceValue, m_FenceEvent));
+			::WaitForSingleObject(m_FenceEvent, static_cast<DWORD>(duration.count()));
+		}
+	}
+
+	// For coroutines: co_await queue.Completion(fenceValue, scheduler) suspends until fenceValue is reached,
+	// without blocking a thread, and resumes through scheduler
+	FenceAwaiter<Queue> Completion(uint64_t fenceValue, ResumeScheduler& scheduler) const
+	{
+		return FenceAwaiter<Queue>(*this, fenceValue, scheduler);
+	}
+
+	void Flush()
+	{
+		WaitForFenceValue(Signal());
+	}
+
+	ID3D12CommandQueue* GetCommandQueue() const { return m_CommandQueue.Get(); }
+	ID3D12Fence* GetFence() const { return m_Fence.Get(); }
+	D3D12_COMMAND_LIST_TYPE GetType() const { return m_Type; }
+	uint64_t GetLastSignalledValue() const { return m_LastSignalledValue; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CommandQueue;
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+	HANDLE m_FenceEvent = NULL;
+	D3D12_COMMAND_LIST_TYPE m_Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+	uint64_t m_LastSignalledValue = 0;
+};
+
+// Collects a batch of submissions to any number of queues, with dependencies between them, and submits
+// them in dependency order with GPU waits wherever a dependency crosses queues.
+//
+//	QueueSubmitter submitter;
+//	auto shadows = submitter.Add(directQueue, { shadowList });
+//	auto blur = submitter.Add(computeQueue, { blurList }, { shadows });
+//	auto composite = submitter.Add(directQueue, { compositeList }, { blur });
+//	submitter.Submit();
+class QueueSubmitter
+{
+public:
+	typedef SubmissionGraph::SubmissionId SubmissionId;
+
+	SubmissionId Add(Queue& queue, std::initializer_list<ID3D12CommandList*> commandLists,
+		std::initializer_list<SubmissionId> dependsOn = {})
+	{
+		if (m_IsSubmitted)
+		{
+			Reset();
+		}
+
+		const SubmissionId id = m_Graph.Add();
+		Submission submission;
+		submission.Target = &queue;
+		submission.CommandLists.assign(commandLists.begin(), commandLists.end());
+		m_Submissions.push_back(std::move(submission));
+
+		for (SubmissionId dependency : dependsOn)
+		{
+			m_Graph.AddDependency(id, dependency);
+		}
+		return id;
+	}
+
+	void AddDependency(SubmissionId submission, SubmissionId dependsOn)
+	{
+		m_Graph.AddDependency(submission, dependsOn);
+	}
+
+	// Submits the batch. Nothing is submitted if the dependencies have a cycle, which would deadlock the GPU.
+	// Fence values of the submissions are available from GetFenceValue until the next Add.
+	void Submit()
+	{
+		if (!m_Graph.Sort(m_Order))
+		{
+			assert(false && "Submission dependencies have a cycle");
+			ThrowIfFailed(E_INVALIDARG);
+		}
+
+		m_Waits.clear();
+		for (SubmissionId id : m_Order)
+		{
+			Submission& submission = m_Submissions[id];
+
+			// One wait per other queue, for the latest value needed from it
+			for (SubmissionId dependency : m_Graph.GetDependencies(id))
+			{
+				const Submission& dependsOn = m_Submissions[dependency];
+				if (dependsOn.Target != submission.Target)
+				{
+					RequireWait(submission.Target, dependsOn.Target, dependsOn.FenceValue);
+				}
+			}
+			for (QueueWait& wait : m_Waits)
+			{
+				if (wait.Waiting == submission.Target && wait.Required > wait.Waited)
+				{
+					submission.Target->Wait(*wait.Signalling, wait.Required);
+					wait.Waited = wait.Required;
+				}
+			}
+
+			submission.FenceValue = submission.Target->Execute(static_cast<UINT>(submission.CommandLists.size()),
+				submission.CommandLists.data());
+		}
+
+		m_IsSubmitted = true;
+	}
+
+	uint64_t GetFenceValue(SubmissionId id) const
+	{
+		assert(m_IsSubmitted);
+		return m_Submissions[id].FenceValue;
+	}
+
+	// Starts a new batch
+	void Reset()
+	{
+		m_Graph.Clear();
+		m_Submissions.clear();
+		m_IsSubmitted = false;
+	}
+
+private:
+	struct Submission
+	{
+		Queue* Target = nullptr;
+		std::vector<ID3D12CommandList*> CommandLists;
+		uint64_t FenceValue = 0;
+	};
+
+	// What one queue has to wait for from another within this batch. Waits are only issued for values
+	// beyond what the queue has already waited for.
+	struct QueueWait
+	{
+		Queue* Waiting;
+		Queue* Signalling;
+		uint64_t Required;
+		uint64_t Waited;
+	};
+
+	void RequireWait(Queue* waiting, Queue* signalling, uint64_t fenceValue)
+	{
+		for (QueueWait& wait : m_Waits)
+		{
+			if (wait.Waiting == waiting && wait.Signalling == signalling)
+			{
+				wait.Required = std::max(wait.Required, fenceValue);
+				return;
+			}
+		}
+		QueueWait wait = { waiting, signalling, fenceValue, 0 };
+		m_Waits.push_back(wait);
+	}
+
+	SubmissionGraph m_Graph;
+	std::vector<Submission> m_Submissions;
+	std::vector<SubmissionId> m_Order;
+	std::vector<QueueWait> m_Waits;
+	bool m_IsSubmitted = false;
+};
+#endif
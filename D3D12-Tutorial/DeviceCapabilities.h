@@ -0,0 +1,191 @@
+#pragma once
+
+// Windows Runtime Library. Needed for Microsoft::WRL::ComPtr<> template class.
+#include <wrl.h>
+
+#include <d3d12.h>
+#include <dxgi1_6.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "AdapterSelection.h"
+#include "Helpers.h"
+#include "MappedFile.h"
+
+// Every DXGI_FORMAT value is below this, so per format tables can be indexed directly by format
+const uint32_t DeviceCapabilitiesMaxFormats = 256;
+
+// Snapshot of what a device supports, taken once so nothing needs to call CheckFeatureSupport afterwards.
+// Plain data, so it is saved to disk as is and lookups are array reads.
+struct DeviceCapabilities
+{
+	uint64_t Key;						// HashAdapter of the adapter it was taken on
+	uint32_t MaxFeatureLevel;			// D3D_FEATURE_LEVEL
+	uint32_t HighestShaderModel;		// D3D_SHADER_MODEL
+	uint32_t HighestRootSignatureVersion;	// D3D_ROOT_SIGNATURE_VERSION
+	uint32_t Padding;
+	D3D12_FEATURE_DATA_D3D12_OPTIONS Options;
+	D3D12_FEATURE_DATA_ARCHITECTURE Architecture;
+
+	// Indexed by DXGI_FORMAT. Unsupported and unknown formats have no support flags and 0 planes,
+	// the same as D3D12GetFormatPlaneCount returns for them.
+	uint32_t FormatSupport1[DeviceCapabilitiesMaxFormats];	// D3D12_FORMAT_SUPPORT1
+	uint32_t FormatSupport2[DeviceCapabilitiesMaxFormats];	// D3D12_FORMAT_SUPPORT2
+	uint8_t PlaneCount[DeviceCapabilitiesMaxFormats];
+
+	// Replaces D3D12GetFormatPlaneCount, which calls CheckFeatureSupport every time
+	uint8_t GetPlaneCount(DXGI_FORMAT format) const
+	{
+		return uint32_t(format) < DeviceCapabilitiesMaxFormats ? PlaneCount[format] : 0;
+	}
+
+	// Replaces CD3DX12_RESOURCE_DESC::Subresources, which calls D3D12GetFormatPlaneCount
+	uint32_t GetNumSubresources(const D3D12_RESOURCE_DESC& desc) const
+	{
+		const uint32_t arraySize = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : desc.DepthOrArraySize;
+		return desc.MipLevels * arraySize * GetPlaneCount(desc.Format);
+	}
+
+	bool SupportsFormat(DXGI_FORMAT format, D3D12_FORMAT_SUPPORT1 support) const
+	{
+		return uint32_t(format) < DeviceCapabilitiesMaxFormats && (FormatSupport1[format] & support) == uint32_t(support);
+	}
+
+	bool SupportsFormat(DXGI_FORMAT format, D3D12_FORMAT_SUPPORT2 support) const
+	{
+		return uint32_t(format) < DeviceCapabilitiesMaxFormats && (FormatSupport2[format] & support) == uint32_t(support);
+	}
+};
+
+// Queries everything in DeviceCapabilities from device. A few hundred CheckFeatureSupport calls, so this is
+// what the cache below avoids.
+inline void QueryDeviceCapabilities(ID3D12Device* device, uint64_t key, DeviceCapabilities& capabilities)
+{
+	memset(&capabilities, 0, sizeof(capabilities));
+	capabilities.Key = key;
+
+	const D3D_FEATURE_LEVEL featureLevels[] =
+	{
+		D3D_FEATURE_LEVEL_11_0, D3D_FEATURE_LEVEL_11_1, D3D_FEATURE_LEVEL_12_0, D3D_FEATURE_LEVEL_12_1,
+	};
+	D3D12_FEATURE_DATA_FEATURE_LEVELS levels = { _countof(featureLevels), featureLevels, D3D_FEATURE_LEVEL_11_0 };
+	capabilities.MaxFeatureLevel = SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_FEATURE_LEVELS, &levels, sizeof(levels))) ?
+		levels.MaxSupportedFeatureLevel : D3D_FEATURE_LEVEL_11_0;
+
+	capabilities.HighestShaderModel = QueryHighestShaderModel(device);
+
+	D3D12_FEATURE_DATA_ROOT_SIGNATURE rootSignature = { D3D_ROOT_SIGNATURE_VERSION_1_1 };
+	capabilities.HighestRootSignatureVersion = SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &rootSignature, sizeof(rootSignature))) ?
+		rootSignature.HighestVersion : D3D_ROOT_SIGNATURE_VERSION_1_0;
+
+	ThrowIfFailed(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &capabilities.Options, sizeof(capabilities.Options)));
+	capabilities.Architecture.NodeIndex = 0;
+	ThrowIfFailed(device->CheckFeatureSupport(D3D12_FEATURE_ARCHITECTURE, &capabilities.Architecture, sizeof(capabilities.Architecture)));
+
+	for (uint32_t format = 1; format < DeviceCapabilitiesMaxFormats; format++)
+	{
+		// Both fail for values which aren't formats, or formats the runtime doesn't know, leaving them zeroed
+		D3D12_FEATURE_DATA_FORMAT_SUPPORT support = { static_cast<DXGI_FORMAT>(format) };
+		if (SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_FORMAT_SUPPORT, &support, sizeof(support))))
+		{
+			capabilities.FormatSupport1[format] = support.Support1;
+			capabilities.FormatSupport2[format] = support.Support2;
+		}
+
+		D3D12_FEATURE_DATA_FORMAT_INFO info = { static_cast<DXGI_FORMAT>(format), 0 };
+		if (SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_FORMAT_INFO, &info, sizeof(info))))
+		{
+			capabilities.PlaneCount[format] = info.PlaneCount;
+		}
+	}
+}
+
+// Capability snapshots of every adapter seen, persisted between runs.
+// Keyed by HashAdapter, i.e. the adapter's hardware IDs and driver version, so a driver update retakes the
+// snapshot. Adapter LUIDs are not used since they change every boot.
+class DeviceCapabilityCache
+{
+public:
+	void Load(const wchar_t* path)
+	{
+		m_Entries.clear();
+		m_IsDirty = false;
+
+		MappedFile file;
+		if (!file.Open(path) || file.Size() < sizeof(FileHeader))
+		{
+			return;
+		}
+
+		FileHeader header;
+		memcpy(&header, file.Data(), sizeof(header));
+		// The struct grows when the SDK's option structs do, so files written by other builds are ignored
+		if (header.Magic != FileMagic || header.EntrySize != sizeof(DeviceCapabilities) ||
+			file.Size() != sizeof(FileHeader) + uint64_t(header.NumEntries) * sizeof(DeviceCapabilities))
+		{
+			return;
+		}
+
+		m_Entries.resize(header.NumEntries);
+		if (header.NumEntries > 0)
+		{
+			memcpy(m_Entries.data(), static_cast<const uint8_t*>(file.Data()) + sizeof(FileHeader),
+				header.NumEntries * sizeof(DeviceCapabilities));
+		}
+	}
+
+	// Writes the file only if a snapshot was taken since Load
+	void Save(const wchar_t* path)
+	{
+		if (!m_IsDirty)
+		{
+			return;
+		}
+
+		FileHeader header = { FileMagic, static_cast<uint32_t>(sizeof(DeviceCapabilities)), static_cast<uint32_t>(m_Entries.size()) };
+		std::vector<uint8_t> contents(sizeof(FileHeader) + m_Entries.size() * sizeof(DeviceCapabilities));
+		memcpy(contents.data(), &header, sizeof(header));
+		if (!m_Entries.empty())
+		{
+			memcpy(contents.data() + sizeof(FileHeader), m_Entries.data(), m_Entries.size() * sizeof(DeviceCapabilities));
+		}
+
+		if (WriteWholeFile(path, contents.data(), contents.size()))
+		{
+			m_IsDirty = false;
+		}
+	}
+
+	// Returns the snapshot for device, created on adapter, taking it now if there isn't one yet
+	const DeviceCapabilities& Get(IDXGIAdapter1* adapter, ID3D12Device* device)
+	{
+		const uint64_t key = HashAdapter(adapter);
+		for (const DeviceCapabilities& entry : m_Entries)
+		{
+			if (entry.Key == key)
+			{
+				return entry;
+			}
+		}
+
+		m_Entries.emplace_back();
+		QueryDeviceCapabilities(device, key, m_Entries.back());
+		m_IsDirty = true;
+		return m_Entries.back();
+	}
+
+private:
+	static const uint32_t FileMagic = 0x31504143; // "CAP1"
+
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t EntrySize;
+		uint32_t NumEntries;
+	};
+
+	std::vector<DeviceCapabilities> m_Entries;
+	bool m_IsDirty = false;
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Coroutines need C++20 (/std:c++latest), or the Coroutines TS (/await) with older toolsets. Without either,
+// only the awaiters are available, which compile as C++14 so headers can use them unconditionally.
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#define FENCE_AWAITER_COROUTINES 1
+typedef std::suspend_never CoroutineSuspendNever;
+#elif defined(_RESUMABLE_FUNCTIONS_SUPPORTED) || defined(__cpp_coroutines)
+#include <experimental/coroutine>
+#define FENCE_AWAITER_COROUTINES 1
+typedef std::experimental::suspend_never CoroutineSuspendNever;
+#else
+#define FENCE_AWAITER_COROUTINES 0
+#endif
+
+// Lets coroutines wait for GPU work without blocking a thread, so loaders and readbacks read top to bottom:
+//
+//	AsyncTask ReadBack(Queue& queue, ResumeScheduler& scheduler)
+//	{
+//		const uint64_t fenceValue = queue.Execute(1, &commandList);
+//		co_await queue.Completion(fenceValue, scheduler);
+//		// The copy has finished, on whichever thread scheduler resumed us
+//	}
+//
+// A suspended coroutine is handed to a ResumeScheduler, which checks the fence and resumes the coroutine once
+// it has been reached: on a job system worker (JobResumeScheduler), or on a chosen thread which pumps a
+// ThreadResumeQueue. If the fence has already been reached, co_await carries on without suspending, on the
+// same thread.
+//
+// Fences are anything with a bool IsComplete(uint64_t) const, so the awaiters and schedulers can be run
+// against a fake fence on any platform.
+
+// Resumes suspended coroutines once what they wait for is ready
+class ResumeScheduler
+{
+public:
+	virtual ~ResumeScheduler() {}
+	// Calls resume, on a thread of the scheduler's choosing, once isReady returns true. isReady is polled, so it
+	// must be cheap, and may be called from any thread.
+	virtual void Schedule(std::function<bool()> isReady, std::function<void()> resume) = 0;
+};
+
+// Resumes coroutines on the thread which calls Pump, e.g. once a frame on the render thread
+class ThreadResumeQueue : public ResumeScheduler
+{
+public:
+	void Schedule(std::function<bool()> isReady, std::function<void()> resume) override
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Waiting.push_back({ std::move(isReady), std::move(resume) });
+	}
+
+	// Resumes every coroutine whose wait is over. Those which suspend again are resumed by a later Pump.
+	void Pump()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (size_t i = 0; i < m_Waiting.size();)
+			{
+				if (m_Waiting[i].IsReady())
+				{
+					m_Ready.push_back(std::move(m_Waiting[i].Resume));
+					m_Waiting[i] = std::move(m_Waiting.back());
+					m_Waiting.pop_back();
+				}
+				else
+				{
+					i++;
+				}
+			}
+		}
+
+		// Outside the lock, since resuming runs the coroutine up to its next co_await, which may schedule again
+		for (std::function<void()>& resume : m_Ready)
+		{
+			resume();
+		}
+		m_Ready.clear();
+	}
+
+	size_t GetNumWaiting() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Waiting.size();
+	}
+
+private:
+	struct Waiting
+	{
+		std::function<bool()> IsReady;
+		std::function<void()> Resume;
+	};
+
+	mutable std::mutex m_Mutex;
+	std::vector<Waiting> m_Waiting;
+	std::vector<std::function<void()>> m_Ready;
+};
+
+// co_await suspends until fence reaches fenceValue, then resumes through scheduler
+template<typename Fence>
+class FenceAwaiter
+{
+public:
+	FenceAwaiter(const Fence& fence, uint64_t fenceValue, ResumeScheduler& scheduler)
+		: m_Fence(&fence)
+		, m_FenceValue(fenceValue)
+		, m_Scheduler(&scheduler)
+	{}
+
+	bool await_ready() const { return m_Fence->IsComplete(m_FenceValue); }
+
+	// A template so it takes std:: and std::experimental:: coroutine handles alike. The coroutine may be resumed
+	// on another thread before this returns, so nothing here touches the awaiter after scheduling.
+	template<typename CoroutineHandle>
+	void await_suspend(CoroutineHandle coroutine)
+	{
+		const Fence* fence = m_Fence;
+		const uint64_t fenceValue = m_FenceValue;
+		m_Scheduler->Schedule([fence, fenceValue]() { return fence->IsComplete(fenceValue); },
+			[coroutine]() mutable { coroutine.resume(); });
+	}
+
+	void await_resume() const {}
+
+private:
+	const Fence* m_Fence;
+	uint64_t m_FenceValue;
+	ResumeScheduler* m_Scheduler;
+};
+
+// co_await always suspends, and resumes through scheduler, e.g. to move from a job system worker back to the
+// render thread before touching a command list
+class SwitchAwaiter
+{
+public:
+	explicit SwitchAwaiter(ResumeScheduler& scheduler)
+		: m_Scheduler(&scheduler)
+	{}
+
+	bool await_ready() const { return false; }
+
+	template<typename CoroutineHandle>
+	void await_suspend(CoroutineHandle coroutine)
+	{
+		m_Scheduler->Schedule([]() { return true; }, [coroutine]() mutable { coroutine.resume(); });
+	}
+
+	void await_resume() const {}
+
+private:
+	ResumeScheduler* m_Scheduler;
+};
+
+template<typename Fence>
+FenceAwaiter<Fence> WaitForFence(const Fence& fence, uint64_t fenceValue, ResumeScheduler& scheduler)
+{
+	return FenceAwaiter<Fence>(fence, fenceValue, scheduler);
+}
+
+inline SwitchAwaiter ResumeOn(ResumeScheduler& scheduler)
+{
+	return SwitchAwaiter(scheduler);
+}
+
+#if FENCE_AWAITER_COROUTINES
+// Return type of coroutines which nothing waits on, e.g. a loader which streams an asset in and then
+// registers it. Starts running straight away, on the calling thread, until its first suspension. Its frame
+// is freed when it returns, so it must not outlive what it refers to.
+struct AsyncTask
+{
+	struct promise_type
+	{
+		AsyncTask get_return_object() { return AsyncTask(); }
+		CoroutineSuspendNever initial_suspend() noexcept { return CoroutineSuspendNever(); }
+		CoroutineSuspendNever final_suspend() noexcept { return CoroutineSuspendNever(); }
+		void return_void() {}
+		// Nothing is left to rethrow to once the task has suspended
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+#endif
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <Windows.h>
+
+// Added in Windows 10 1803's SDK, newer than the one the project builds with. Older versions of Windows fail
+// CreateWaitableTimerExW with it, which the clock falls back from.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+// Limits the frame rate to a target, by waiting at the start of each frame until its time has come.
+//
+// Sleeping alone isn't precise enough: even high resolution timers wake up a fraction of a millisecond late,
+// and the thread may not be scheduled straight away. So the limiter sleeps until shortly before the deadline
+// and spins for the rest (the spin tail). The tail adapts to how late the timer has been waking up, so it is
+// only as long as needed, which keeps the CPU time spent spinning low.
+//
+// Deadlines follow on from the previous deadline rather than from when the wait ended, so the cadence doesn't
+// drift. After a frame that overran a whole period, the schedule restarts from that frame instead of rushing
+// to catch up.
+//
+// Wait before sampling input, so the frame is built from the latest input once the wait is over.
+//
+// Time comes from a FrameLimiter::Clock, so the timing loop can be run with a fake clock on any platform.
+class FrameLimiter
+{
+public:
+	typedef int64_t Ticks;
+
+	class Clock
+	{
+	public:
+		virtual ~Clock() {}
+		virtual Ticks Now() = 0;
+		virtual Ticks GetTicksPerSecond() = 0;
+		// Blocks until about deadline, without using the CPU. May wake up late.
+		virtual void SleepUntil(Ticks deadline) = 0;
+		// Called between checks of the time while spinning
+		virtual void Spin() {}
+	};
+
+	void Initialize(Clock* clock)
+	{
+		m_Clock = clock;
+		const Ticks ticksPerSecond = clock->GetTicksPerSecond();
+		m_MinSpinTail = ticksPerSecond / 2000;	// 0.5 ms
+		m_MaxSpinTail = ticksPerSecond / 250;	// 4 ms
+		m_SpinTail = ticksPerSecond / 1000;		// 1 ms, until the timer's lateness is known
+		m_PreviousDeadline = 0;
+	}
+
+	// 0 for no limit
+	void SetTargetFrameRate(double framesPerSecond)
+	{
+		SetTargetFrameTime(framesPerSecond > 0.0 ? 1.0 / framesPerSecond : 0.0);
+	}
+
+	// Seconds, 0 for no limit
+	void SetTargetFrameTime(double seconds)
+	{
+		m_Period = static_cast<Ticks>(seconds * static_cast<double>(m_Clock->GetTicksPerSecond()));
+		m_PreviousDeadline = 0;
+	}
+
+	bool IsEnabled() const { return m_Period > 0; }
+
+	// Blocks until the current frame should start. Returns straight away without a target.
+	void Wait()
+	{
+		if (m_Period <= 0)
+		{
+			return;
+		}
+
+		Ticks now = m_Clock->Now();
+		if (m_PreviousDeadline == 0)
+		{
+			m_PreviousDeadline = now;
+			return;
+		}
+
+		Ticks deadline = m_PreviousDeadline + m_Period;
+		// The previous frame took more than a whole period, start a new schedule from now
+		if (now >= deadline + m_Period)
+		{
+			m_PreviousDeadline = now;
+			return;
+		}
+
+		// Sleep for most of the wait, measuring how late the timer wakes up to size the spin tail
+		const Ticks wakeTime = deadline - m_SpinTail;
+		if (now < wakeTime)
+		{
+			m_Clock->SleepUntil(wakeTime);
+			now = m_Clock->Now();
+			UpdateSpinTail(now - wakeTime);
+		}
+
+		while (now < deadline)
+		{
+			m_Clock->Spin();
+			now = m_Clock->Now();
+		}
+
+		m_PreviousDeadline = deadline;
+	}
+
+	// Ticks spun for at the end of each wait
+	Ticks GetSpinTail() const { return m_SpinTail; }
+
+private:
+	// Keeps the tail at twice the recent lateness of the timer: grows straight away when the timer is later
+	// than expected, and shrinks slowly
+	void UpdateSpinTail(Ticks lateness)
+	{
+		const Ticks target = std::max<Ticks>(0, lateness) * 2;
+		m_SpinTail = target > m_SpinTail ? target : m_SpinTail - (m_SpinTail - target) / 16;
+		m_SpinTail = std::min(std::max(m_SpinTail, m_MinSpinTail), m_MaxSpinTail);
+	}
+
+	Clock* m_Clock = nullptr;
+	Ticks m_Period = 0;
+	Ticks m_PreviousDeadline = 0;
+	Ticks m_SpinTail = 0;
+	Ticks m_MinSpinTail = 0;
+	Ticks m_MaxSpinTail = 0;
+};
+
+#if defined(_WIN32)
+// QueryPerformanceCounter time, sleeping on a high resolution waitable timer where available (Windows 10
+// 1803 and later), otherwise a regular waitable timer
+class WaitableTimerClock : public FrameLimiter::Clock
+{
+public:
+	WaitableTimerClock()
+	{
+		LARGE_INTEGER frequency;
+		::QueryPerformanceFrequency(&frequency);
+		m_TicksPerSecond = frequency.QuadPart;
+
+		m_Timer = ::CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (!m_Timer)
+		{
+			m_Timer = ::CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+		}
+		assert(m_Timer && "Failed to create waitable timer.");
+	}
+
+	~WaitableTimerClock()
+	{
+		::CloseHandle(m_Timer);
+	}
+
+	FrameLimiter::Ticks Now() override
+	{
+		LARGE_INTEGER counter;
+		::QueryPerformanceCounter(&counter);
+		return counter.QuadPart;
+	}
+
+	FrameLimiter::Ticks GetTicksPerSecond() override { return m_TicksPerSecond; }
+
+	void SleepUntil(FrameLimiter::Ticks deadline) override
+	{
+		const FrameLimiter::Ticks remaining = deadline - Now();
+		if (remaining <= 0)
+		{
+			return;
+		}
+
+		// Relative due times are negative, in 100 ns units
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -static_cast<LONGLONG>(remaining * 10000000 / m_TicksPerSecond);
+		if (dueTime.QuadPart < 0 && ::SetWaitableTimerEx(m_Timer, &dueTime, 0, NULL, NULL, NULL, 0))
+		{
+			::WaitForSingleObject(m_Timer, INFINITE);
+		}
+	}
+
+	void Spin() override
+	{
+		::YieldProcessor();
+	}
+
+private:
+	HANDLE m_Timer = NULL;
+	FrameLimiter::Ticks m_TicksPerSecond = 1;
+};
+#endif
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <dxgi1_6.h>
+#endif
+
+// The fields of DXGI_FRAME_STATISTICS used for pacing, about the latest present to reach the display
+struct PresentStatistics
+{
+	uint32_t PresentCount;			// Which present it was
+	uint32_t PresentRefreshCount;	// The vblank it was shown on
+	uint32_t SyncRefreshCount;		// The latest vblank when the statistics were taken
+	int64_t SyncQPCTime;			// When that vblank happened, in QPC ticks
+};
+
+// Frame pacing analysis from present statistics.
+//
+// A steady frame rate can still look like stutter, if frames are held on screen for uneven lengths of time.
+// This compares consecutive statistics samples, taken after every present, to find:
+//	- Missed vblanks: presents which reached the display on a later vblank than the sync interval allowed for,
+//	  e.g. because the frame was late.
+//	- Duplicated frames: the refreshes which showed the same frame again because of that.
+//	- Irregular cadence: time between displayed frames which is off from the recent median by more than a
+//	  quarter of a refresh, e.g. alternating one and two refreshes.
+// The counters are totals since Reset, and the report also covers a window of the most recent intervals.
+//
+// Statistics only describe the latest displayed present, so when several presents reached the display between
+// two samples, they are treated as one stretch with the intervals averaged. Only depends on the standard
+// library, so the analysis can be run and checked on any platform, fed with made up statistics.
+//
+// The window's storage is allocated by Initialize, so AddSample never allocates; only GetReport does.
+class FramePacingAnalyzer
+{
+public:
+	void Initialize(int64_t ticksPerSecond, size_t windowSize = 240)
+	{
+		assert(ticksPerSecond > 0 && windowSize > 0);
+		m_TicksPerSecond = ticksPerSecond;
+		m_WindowSize = windowSize;
+		m_Intervals.reserve(windowSize);
+		m_SortedIntervals.reserve(windowSize);
+		Reset();
+	}
+
+	void Reset()
+	{
+		m_HasPrevious = false;
+		m_Intervals.clear();
+		m_NextInterval = 0;
+		m_RefreshPeriod = 0.0;
+		m_NumPresents = 0;
+		m_NumMissedVBlanks = 0;
+		m_NumDuplicatedFrames = 0;
+		m_NumIrregularIntervals = 0;
+	}
+
+	// The next sample can't be compared with earlier ones, e.g. statistics were unavailable
+	// (DXGI_ERROR_FRAME_STATISTICS_DISJOINT) or the sync interval changed
+	void Discontinuity()
+	{
+		m_HasPrevious = false;
+	}
+
+	// Call after every present with the swap chain's statistics. syncInterval is what the presents used,
+	// 0 when not synced to vblank, in which case only cadence is checked.
+	void AddSample(const PresentStatistics& statistics, uint32_t syncInterval)
+	{
+		if (!m_HasPrevious)
+		{
+			m_Previous = statistics;
+			m_HasPrevious = true;
+			return;
+		}
+
+		// Nothing new was displayed since the last sample
+		const uint32_t presents = statistics.PresentCount - m_Previous.PresentCount;
+		if (presents == 0 || static_cast<int32_t>(presents) < 0)
+		{
+			return;
+		}
+
+		const uint32_t refreshes = statistics.SyncRefreshCount - m_Previous.SyncRefreshCount;
+		const int64_t syncTicks = statistics.SyncQPCTime - m_Previous.SyncQPCTime;
+		if (refreshes > 0 && syncTicks > 0)
+		{
+			m_RefreshPeriod = ToMilliseconds(syncTicks) / refreshes;
+		}
+
+		m_NumPresents += presents;
+		const uint32_t presentRefreshes = statistics.PresentRefreshCount - m_Previous.PresentRefreshCount;
+		if (syncInterval > 0 && presentRefreshes > presents * syncInterval)
+		{
+			m_NumMissedVBlanks++;
+			m_NumDuplicatedFrames += presentRefreshes - presents * syncInterval;
+		}
+
+		// Displayed interval per present, from the vblanks they were shown on
+		if (m_RefreshPeriod > 0.0)
+		{
+			AddInterval(m_RefreshPeriod * presentRefreshes / presents);
+		}
+
+		m_Previous = statistics;
+	}
+
+	uint64_t GetNumPresents() const { return m_NumPresents; }
+	uint64_t GetNumMissedVBlanks() const { return m_NumMissedVBlanks; }
+	uint64_t GetNumDuplicatedFrames() const { return m_NumDuplicatedFrames; }
+	uint64_t GetNumIrregularIntervals() const { return m_NumIrregularIntervals; }
+	// Milliseconds, measured from the statistics, or 0 until known
+	double GetRefreshPeriod() const { return m_RefreshPeriod; }
+
+	// Counters, and the mean, deviation and range of displayed frame intervals over the window
+	std::string GetReport() const
+	{
+		char line[256];
+		std::string report;
+		snprintf(line, sizeof(line), "Pacing: %llu presents, %llu missed vblanks, %llu duplicated frames, %llu irregular intervals\n",
+			static_cast<unsigned long long>(m_NumPresents), static_cast<unsigned long long>(m_NumMissedVBlanks),
+			static_cast<unsigned long long>(m_NumDuplicatedFrames), static_cast<unsigned long long>(m_NumIrregularIntervals));
+		report += line;
+
+		if (!m_Intervals.empty())
+		{
+			double sum = 0.0;
+			for (double interval : m_Intervals)
+			{
+				sum += interval;
+			}
+			const double mean = sum / m_Intervals.size();
+			double variance = 0.0;
+			for (double interval : m_Intervals)
+			{
+				variance += (interval - mean) * (interval - mean);
+			}
+			variance /= m_Intervals.size();
+
+			snprintf(line, sizeof(line), "  Displayed interval over %zu frames: mean %.2f ms, deviation %.2f ms, %.2f - %.2f ms (refresh %.2f ms)\n",
+				m_Intervals.size(), mean, std::sqrt(variance), *std::min_element(m_Intervals.begin(), m_Intervals.end()),
+				*std::max_element(m_Intervals.begin(), m_Intervals.end()), m_RefreshPeriod);
+			report += line;
+		}
+		return report;
+	}
+
+private:
+	double ToMilliseconds(int64_t ticks) const
+	{
+		return 1000.0 * static_cast<double>(ticks) / static_cast<double>(m_TicksPerSecond);
+	}
+
+	// Counts the interval as irregular if it is more than a quarter of a refresh off the median of the window
+	void AddInterval(double interval)
+	{
+		if (!m_Intervals.empty())
+		{
+			m_SortedIntervals.assign(m_Intervals.begin(), m_Intervals.end());
+			std::nth_element(m_SortedIntervals.begin(), m_SortedIntervals.begin() + m_SortedIntervals.size() / 2,
+				m_SortedIntervals.end());
+			const double median = m_SortedIntervals[m_SortedIntervals.size() / 2];
+			if (std::fabs(interval - median) > 0.25 * m_RefreshPeriod)
+			{
+				m_NumIrregularIntervals++;
+			}
+		}
+
+		if (m_Intervals.size() < m_WindowSize)
+		{
+			m_Intervals.push_back(interval);
+		}
+		else
+		{
+			m_Intervals[m_NextInterval] = interval;
+			m_NextInterval = (m_NextInterval + 1) % m_WindowSize;
+		}
+	}
+
+	int64_t m_TicksPerSecond = 1;
+	size_t m_WindowSize = 240;
+
+	PresentStatistics m_Previous = {};
+	bool m_HasPrevious = false;
+	double m_RefreshPeriod = 0.0;
+
+	// Milliseconds each displayed frame was on screen, in a ring of the most recent m_WindowSize
+	std::vector<double> m_Intervals;
+	size_t m_NextInterval = 0;
+	// Where AddInterval finds the median, kept to reuse its memory
+	std::vector<double> m_SortedIntervals;
+
+	uint64_t m_NumPresents = 0;
+	uint64_t m_NumMissedVBlanks = 0;
+	uint64_t m_NumDuplicatedFrames = 0;
+	uint64_t m_NumIrregularIntervals = 0;
+};
+
+#if defined(_WIN32)
+// The swap chain's statistics about the latest present to reach the display. Query once per frame, right after
+// presenting, and give them to everything which uses them. Returns false when they aren't available: not in
+// every presentation mode, not until the first vblank, and disjoint after mode changes.
+inline bool QueryPresentStatistics(IDXGISwapChain* swapChain, PresentStatistics& sample)
+{
+	DXGI_FRAME_STATISTICS statistics = {};
+	if (FAILED(swapChain->GetFrameStatistics(&statistics)) || statistics.SyncQPCTime.QuadPart == 0)
+	{
+		return false;
+	}
+
+	sample = { statistics.PresentCount, statistics.PresentRefreshCount, statistics.SyncRefreshCount,
+		statistics.SyncQPCTime.QuadPart };
+	return true;
+}
+#endif
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Lock-free triple buffer: one writer thread fills in values and publishes them, one reader thread takes the
+// latest published value. Neither ever waits for the other.
+//
+// The writer has a buffer of its own to fill in, the reader has one it is reading, and the third is the one
+// most recently published. Publish swaps the writer's buffer with it, and Acquire swaps it with the reader's
+// if anything new was published, both with a single atomic exchange. The published index and a flag saying
+// it is new share one atomic so the two change together.
+template<typename T>
+class TripleBuffer
+{
+public:
+	// Writer only. The buffer to fill in before Publish. It holds whatever was in it last, so reset anything
+	// which isn't overwritten.
+	T& GetWriteBuffer() { return m_Buffers[m_WriteIndex]; }
+
+	// Writer only. Makes the write buffer the latest value, and the writer moves on to another buffer.
+	void Publish()
+	{
+		m_WriteIndex = m_Latest.exchange(m_WriteIndex | IsNewFlag, std::memory_order_acq_rel) & IndexMask;
+	}
+
+	// Reader only. Takes the latest value if a new one was published since the last call; returns whether it did.
+	bool Acquire()
+	{
+		if ((m_Latest.load(std::memory_order_relaxed) & IsNewFlag) == 0)
+		{
+			return false;
+		}
+		m_ReadIndex = m_Latest.exchange(m_ReadIndex, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+
+	// Reader only. The value taken by the last Acquire, which the writer won't touch until the next one.
+	const T& GetReadBuffer() const { return m_Buffers[m_ReadIndex]; }
+
+private:
+	static const uint32_t IndexMask = 0x3;
+	static const uint32_t IsNewFlag = 0x4;
+
+	T m_Buffers[3];
+	uint32_t m_WriteIndex = 0;
+	uint32_t m_ReadIndex = 1;
+	std::atomic<uint32_t> m_Latest{ 2 };
+};
+
+// Pipelines simulation and rendering: while the render thread records frame N, a simulation thread already
+// runs the update for frame N+1, so the CPU time of a frame is closer to the longer of the two than their sum.
+//
+// The simulation writes everything rendering needs into a Snapshot, which is immutable once published, so
+// rendering never reads state the simulation is changing. Snapshots are handed over in a TripleBuffer, and the
+// stages tell each other about new frames with atomic counters, so when both are keeping up no locks are taken.
+// A stage only sleeps, on a condition variable, when it has to wait for the other: the render thread when the
+// next snapshot isn't finished, the simulation when it is already a frame ahead.
+//
+// The render thread drives the pipeline, once per frame after its frame pacing waits:
+//
+//	const Snapshot& snapshot = pipeline.AcquireSnapshot();	// frame N, waiting for it if needed
+//	pipeline.BeginSimulation();								// frame N+1 starts, and samples input now
+//	Render(snapshot);
+//
+// Frames are shown one frame later than they would be without pipelining, the price of the overlap.
+template<typename Snapshot>
+class FramePipeline
+{
+public:
+	typedef std::function<void(Snapshot& snapshot)> SimulateFunction;
+
+	~FramePipeline() { Stop(); }
+
+	// Starts the simulation thread, which simulates the first frame straight away
+	void Start(SimulateFunction simulate)
+	{
+		assert(!m_Thread.joinable());
+		m_Simulate = std::move(simulate);
+		m_IsStopping.store(false);
+		m_HasExited.store(false);
+		m_NumRequested.store(1);
+		m_NumPublished.store(0);
+		m_NumAcquired = 0;
+		m_Thread = std::thread(&FramePipeline::Run, this);
+	}
+
+	// Waits for the frame being simulated, if any, then stops the thread. A render thread waiting in
+	// AcquireSnapshot for a frame which won't be simulated now is woken once the thread has stopped.
+	void Stop()
+	{
+		if (m_Thread.joinable())
+		{
+			m_IsStopping.store(true);
+			Wake(m_SimulationRequested);
+			m_Thread.join();
+		}
+	}
+
+	// Render thread. Returns the snapshot of the next frame, waiting for the simulation to finish it if it
+	// hasn't yet. Stays valid, and unchanged, until the next call. Once stopped, returns the last snapshot
+	// again if the next frame was never simulated.
+	const Snapshot& AcquireSnapshot()
+	{
+		assert(m_NumAcquired < m_NumRequested.load() && "BeginSimulation must be called for every snapshot acquired");
+		const uint64_t frame = ++m_NumAcquired;
+		WaitUntil(m_SnapshotPublished, [this, frame]() { return m_NumPublished.load() >= frame || m_HasExited.load(); });
+
+		if (m_NumPublished.load() >= frame)
+		{
+			const bool isNew = m_Snapshots.Acquire();
+			assert(isNew);
+			(void)isNew;
+		}
+		return m_Snapshots.GetReadBuffer();
+	}
+
+	// Render thread. Lets the simulation start on the frame after the one last acquired.
+	void BeginSimulation()
+	{
+		m_NumRequested.fetch_add(1);
+		Wake(m_SimulationRequested);
+	}
+
+	bool IsRunning() const { return m_Thread.joinable(); }
+
+private:
+	// A condition variable which is only notified, under the lock, when its thread is asleep on it
+	struct Signal
+	{
+		std::mutex Mutex;
+		std::condition_variable Condition;
+		std::atomic<bool> IsWaiting{ false };
+	};
+
+	// The counters and IsWaiting are sequentially consistent, so either the waiting thread sees the change
+	// when it checks again after setting IsWaiting, or the other thread sees IsWaiting and notifies it
+	template<typename Predicate>
+	static void WaitUntil(Signal& signal, Predicate isReady)
+	{
+		if (isReady())
+		{
+			return;
+		}
+		std::unique_lock<std::mutex> lock(signal.Mutex);
+		signal.IsWaiting.store(true);
+		signal.Condition.wait(lock, isReady);
+		signal.IsWaiting.store(false);
+	}
+
+	static void Wake(Signal& signal)
+	{
+		if (signal.IsWaiting.load())
+		{
+			std::lock_guard<std::mutex> lock(signal.Mutex);
+			signal.Condition.notify_one();
+		}
+	}
+
+	void Run()
+	{
+		uint64_t numSimulated = 0;
+		for (;;)
+		{
+			WaitUntil(m_SimulationRequested,
+				[this, numSimulated]() { return m_IsStopping.load() || m_NumRequested.load() > numSimulated; });
+			if (m_IsStopping.load())
+			{
+				// Frames rendering is still waiting for won't come
+				m_HasExited.store(true);
+				Wake(m_SnapshotPublished);
+				return;
+			}
+
+			m_Simulate(m_Snapshots.GetWriteBuffer());
+			m_Snapshots.Publish();
+			m_NumPublished.store(++numSimulated);
+			Wake(m_SnapshotPublished);
+		}
+	}
+
+	TripleBuffer<Snapshot> m_Snapshots;
+	SimulateFunction m_Simulate;
+	std::thread m_Thread;
+
+	// Frames the render thread has let the simulation start, frames simulated and published, and frames
+	// rendering has taken. The simulation is never more than one frame ahead of rendering.
+	std::atomic<uint64_t> m_NumRequested{ 0 };
+	std::atomic<uint64_t> m_NumPublished{ 0 };
+	uint64_t m_NumAcquired = 0;
+	std::atomic<bool> m_IsStopping{ false };
+	std::atomic<bool> m_HasExited{ false };
+
+	Signal m_SimulationRequested;
+	Signal m_SnapshotPublished;
+};
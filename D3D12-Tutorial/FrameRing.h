@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+// The frames in flight of one renderer: what each needs while the GPU may still be using it (command
+// allocators, render targets), and the fence value which means the GPU is done with it. FrameData must have a
+// uint64_t FenceValue. Frames are stored inline, one after another, so each frame's data is together.
+//
+// Queues are anything with WaitForFenceValue(uint64_t) and IsComplete(uint64_t) const: the D3D12 Queue in
+// CommandQueue.h, or a fake one, so several renderers' frames can be run side by side without a GPU.
+template<typename FrameData, uint32_t MaxFrames>
+class FrameRing
+{
+public:
+	// Every frame starts out default constructed, with nothing for the GPU to finish
+	void Initialize(uint32_t numFrames)
+	{
+		assert(numFrames >= 1 && numFrames <= MaxFrames);
+		m_NumFrames = numFrames;
+		m_CurrentFrame = 0;
+		for (FrameData& frame : m_Frames)
+		{
+			frame = FrameData();
+		}
+	}
+
+	// Blocks until queue has finished the current frame's previous work, then returns it to record the next
+	template<typename QueueType>
+	FrameData& BeginFrame(QueueType& queue)
+	{
+		FrameData& frame = m_Frames[m_CurrentFrame];
+		queue.WaitForFenceValue(frame.FenceValue);
+		return frame;
+	}
+
+	// Records that the current frame's work signals fenceValue when done, and moves on to nextFrame: the next
+	// one round robin, or whichever a swap chain says is next
+	void EndFrame(uint64_t fenceValue, uint32_t nextFrame)
+	{
+		assert(nextFrame < m_NumFrames);
+		m_Frames[m_CurrentFrame].FenceValue = fenceValue;
+		m_CurrentFrame = nextFrame;
+	}
+
+	template<typename QueueType>
+	void WaitForAllFrames(QueueType& queue) const
+	{
+		uint64_t fenceValue = 0;
+		for (uint32_t i = 0; i < m_NumFrames; i++)
+		{
+			fenceValue = std::max(fenceValue, m_Frames[i].FenceValue);
+		}
+		queue.WaitForFenceValue(fenceValue);
+	}
+
+	// E.g. after a swap chain's buffers are recreated, which may change which is next
+	void SetCurrentFrameIndex(uint32_t index)
+	{
+		assert(index < m_NumFrames);
+		m_CurrentFrame = index;
+	}
+
+	FrameData& operator[](uint32_t index) { assert(index < m_NumFrames); return m_Frames[index]; }
+	const FrameData& operator[](uint32_t index) const { assert(index < m_NumFrames); return m_Frames[index]; }
+	FrameData& GetCurrentFrame() { return m_Frames[m_CurrentFrame]; }
+	const FrameData& GetCurrentFrame() const { return m_Frames[m_CurrentFrame]; }
+	uint32_t GetCurrentFrameIndex() const { return m_CurrentFrame; }
+	uint32_t GetNextFrameIndex() const { return (m_CurrentFrame + 1) % m_NumFrames; }
+	uint32_t GetNumFrames() const { return m_NumFrames; }
+
+private:
+	FrameData m_Frames[MaxFrames];
+	uint32_t m_NumFrames = 0;
+	uint32_t m_CurrentFrame = 0;
+};
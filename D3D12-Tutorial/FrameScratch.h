@@ -0,0 +1,332 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for transient CPU data, freed all at once by Reset.
+//
+// Allocations come from one block, which is only allocated the first time it is needed. If a frame needs more
+// than the block holds, the rest comes from the heap, and the next Reset replaces the block with one large
+// enough for everything the frame used. So after the first few frames, allocating is a pointer bump and
+// nothing touches the heap. GetNumHeapAllocations counts the times it did, to check that it has stopped.
+//
+// Nothing is destructed, so only use it for trivially destructible types, or destruct them yourself. Arenas are
+// for one thread at a time, unless made shared (SetShared), which takes a lock around every allocation.
+class LinearArena
+{
+public:
+	explicit LinearArena(size_t initialCapacity = 0)
+		: m_InitialCapacity(initialCapacity)
+	{}
+
+	~LinearArena()
+	{
+		FreeOverflow();
+	}
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	// Size of the block allocated on first use. Later Resets grow it as needed.
+	void SetInitialCapacity(size_t capacity) { m_InitialCapacity = capacity; }
+
+	// Lets several threads allocate at once. Reset still needs them all to be done.
+	void SetShared(bool isShared) { m_Mutex.reset(isShared ? new std::mutex : nullptr); }
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+	{
+		assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of two");
+		if (m_Mutex)
+		{
+			std::lock_guard<std::mutex> lock(*m_Mutex);
+			return AllocateUnlocked(size, alignment);
+		}
+		return AllocateUnlocked(size, alignment);
+	}
+
+	// Uninitialised storage for count Ts
+	template<typename T>
+	T* AllocateArray(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "LinearArena never destructs what it holds");
+		return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	// Frees everything allocated since the last Reset. Grows the block to fit if it overflowed.
+	void Reset()
+	{
+		m_HighWaterMark = std::max(m_HighWaterMark, m_FrameBytes);
+		if (m_Overflow)
+		{
+			FreeOverflow();
+			size_t capacity = std::max<size_t>(m_Capacity, 4096);
+			while (capacity < m_FrameBytes)
+			{
+				capacity *= 2;
+			}
+			Reserve(capacity);
+		}
+		m_Used = 0;
+		m_FrameBytes = 0;
+	}
+
+	size_t GetCapacity() const { return m_Capacity; }
+	// Bytes allocated since the last Reset, including padding for alignment
+	size_t GetUsed() const { return m_FrameBytes; }
+	// The most bytes used between two Resets
+	size_t GetHighWaterMark() const { return std::max(m_HighWaterMark, m_FrameBytes); }
+	uint64_t GetNumHeapAllocations() const { return m_NumHeapAllocations; }
+
+private:
+	// Heap allocations for what didn't fit in the block, freed by the next Reset
+	struct Overflow
+	{
+		Overflow* Next;
+	};
+
+	void* AllocateUnlocked(size_t size, size_t alignment)
+	{
+		if (!m_Block && m_InitialCapacity > 0)
+		{
+			Reserve(m_InitialCapacity);
+		}
+
+		const uintptr_t begin = reinterpret_cast<uintptr_t>(m_Block.get());
+		const uintptr_t aligned = (begin + m_Used + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+		if (m_Block && aligned + size <= begin + m_Capacity)
+		{
+			m_FrameBytes += aligned + size - (begin + m_Used);
+			m_Used = aligned + size - begin;
+			return reinterpret_cast<void*>(aligned);
+		}
+		return AllocateOverflow(size, alignment);
+	}
+
+	void Reserve(size_t capacity)
+	{
+		m_Block.reset(new uint8_t[capacity]);
+		m_Capacity = capacity;
+		m_Used = 0;
+		m_NumHeapAllocations++;
+	}
+
+	void* AllocateOverflow(size_t size, size_t alignment)
+	{
+		alignment = std::max(alignment, alignof(Overflow));
+		void* memory = std::malloc(sizeof(Overflow) + alignment - 1 + size);
+		if (!memory)
+		{
+			throw std::bad_alloc();
+		}
+		m_NumHeapAllocations++;
+		m_FrameBytes += size + alignment - 1;
+
+		Overflow* overflow = static_cast<Overflow*>(memory);
+		overflow->Next = m_Overflow;
+		m_Overflow = overflow;
+
+		const uintptr_t begin = reinterpret_cast<uintptr_t>(overflow + 1);
+		return reinterpret_cast<void*>((begin + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+	}
+
+	void FreeOverflow()
+	{
+		while (m_Overflow)
+		{
+			Overflow* next = m_Overflow->Next;
+			std::free(m_Overflow);
+			m_Overflow = next;
+		}
+	}
+
+	std::unique_ptr<uint8_t[]> m_Block;
+	// Only for shared arenas
+	std::unique_ptr<std::mutex> m_Mutex;
+	size_t m_InitialCapacity;
+	size_t m_Capacity = 0;
+	size_t m_Used = 0;
+	Overflow* m_Overflow = nullptr;
+
+	size_t m_FrameBytes = 0;
+	size_t m_HighWaterMark = 0;
+	uint64_t m_NumHeapAllocations = 0;
+};
+
+// STL allocator over a LinearArena, e.g. for a std::vector which only lives for a frame. Deallocating does
+// nothing; the memory comes back when the arena is reset, so containers must not outlive that.
+template<typename T>
+class ScratchAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ScratchAllocator(LinearArena& arena)
+		: m_Arena(&arena)
+	{}
+
+	template<typename U>
+	ScratchAllocator(const ScratchAllocator<U>& other)
+		: m_Arena(other.GetArena())
+	{}
+
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(m_Arena->Allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	void deallocate(T*, size_t) {}
+
+	LinearArena* GetArena() const { return m_Arena; }
+
+private:
+	LinearArena* m_Arena;
+};
+
+template<typename T, typename U>
+bool operator==(const ScratchAllocator<T>& a, const ScratchAllocator<U>& b) { return a.GetArena() == b.GetArena(); }
+template<typename T, typename U>
+bool operator!=(const ScratchAllocator<T>& a, const ScratchAllocator<U>& b) { return a.GetArena() != b.GetArena(); }
+
+template<typename T>
+using ScratchVector = std::vector<T, ScratchAllocator<T>>;
+
+// Scratch memory for each frame in flight, and each thread working on the frame: barriers, draw lists,
+// descriptor tables and other arrays whose size isn't known up front, and which are only needed until the GPU
+// has finished the frame.
+//
+// Each frame in flight has a LinearArena per thread, so threads never share one and allocating takes no lock.
+// That is for the first MaxThreads threads to allocate, which covers the render thread and the job system's
+// workers; any threads after those share one more arena, which locks.
+// BeginFrame moves on to the oldest frame's arenas, once the fence value EndFrame recorded for it has been
+// reached, and resets them. Fences are anything with a bool IsComplete(uint64_t) const.
+//
+// The render thread calls BeginFrame and EndFrame. Other threads may allocate from GetThreadArena between the
+// two, and must be done with a frame's memory by the time it is reused, numFrames frames later.
+class FrameScratch
+{
+public:
+	static const uint32_t MaxThreads = 64;
+
+	// bytesPerThread is the starting size of each thread's arena, allocated the first time the thread uses it
+	void Initialize(uint32_t numFrames, size_t bytesPerThread)
+	{
+		assert(numFrames > 0);
+		m_Frames.clear();
+		for (uint32_t i = 0; i < numFrames; i++)
+		{
+			m_Frames.emplace_back(new Frame(bytesPerThread));
+		}
+		m_CurrentFrame.store(0);
+	}
+
+	// Render thread. Starts allocating from the next frame's arenas, which must be finished with by the GPU:
+	// call it after waiting for the frame's fence value, e.g. after Swapchain::BeginFrame.
+	template<typename Fence>
+	void BeginFrame(const Fence& fence)
+	{
+		const uint32_t frameIndex =
+			static_cast<uint32_t>((m_CurrentFrame.load(std::memory_order_relaxed) + 1) % m_Frames.size());
+		Frame& frame = *m_Frames[frameIndex];
+		assert(fence.IsComplete(frame.FenceValue) && "The frame's scratch memory is still in use by the GPU");
+		(void)fence;
+
+		size_t highWaterMark = m_HighWaterMark.load(std::memory_order_relaxed);
+		uint64_t numHeapAllocations = 0;
+		for (LinearArena& arena : frame.Arenas)
+		{
+			arena.Reset();
+			highWaterMark = std::max(highWaterMark, arena.GetHighWaterMark());
+			numHeapAllocations += arena.GetNumHeapAllocations();
+		}
+		frame.NumHeapAllocations = numHeapAllocations;
+		m_HighWaterMark.store(highWaterMark, std::memory_order_relaxed);
+
+		m_CurrentFrame.store(frameIndex, std::memory_order_release);
+	}
+
+	// Render thread. The fence value signalled after the frame's work, which BeginFrame waits for before
+	// reusing its memory.
+	void EndFrame(uint64_t fenceValue)
+	{
+		m_Frames[m_CurrentFrame.load(std::memory_order_relaxed)]->FenceValue = fenceValue;
+	}
+
+	// The calling thread's arena for the current frame
+	LinearArena& GetThreadArena()
+	{
+		return m_Frames[m_CurrentFrame.load(std::memory_order_acquire)]->Arenas[GetThreadIndex()];
+	}
+
+	template<typename T>
+	ScratchVector<T> MakeVector()
+	{
+		return ScratchVector<T>(ScratchAllocator<T>(GetThreadArena()));
+	}
+
+	// The most any thread used in one frame, up to the last BeginFrame, for sizing bytesPerThread
+	size_t GetHighWaterMark() const { return m_HighWaterMark.load(std::memory_order_relaxed); }
+
+	// Render thread. Heap allocations made by all arenas, up to the last BeginFrame. Stops increasing once every arena has
+	// grown to fit its thread's busiest frame.
+	uint64_t GetNumHeapAllocations() const
+	{
+		uint64_t numHeapAllocations = 0;
+		for (const std::unique_ptr<Frame>& frame : m_Frames)
+		{
+			numHeapAllocations += frame->NumHeapAllocations;
+		}
+		return numHeapAllocations;
+	}
+
+private:
+	struct Frame
+	{
+		explicit Frame(size_t bytesPerThread)
+		{
+			for (LinearArena& arena : Arenas)
+			{
+				arena.SetInitialCapacity(bytesPerThread);
+			}
+			Arenas[SharedArena].SetShared(true);
+		}
+
+		LinearArena Arenas[MaxThreads + 1];
+		uint64_t FenceValue = 0;
+		uint64_t NumHeapAllocations = 0;
+	};
+
+	// The arena for threads after the first MaxThreads
+	static const uint32_t SharedArena = MaxThreads;
+
+	// Numbers threads in the order they first allocate, the same for every FrameScratch. Indices aren't reused
+	// when threads exit, so a program which keeps starting threads ends up with them all in the shared arena.
+	static uint32_t GetThreadIndex()
+	{
+		static thread_local uint32_t index = AssignThreadIndex();
+		return index;
+	}
+
+	// The count stops at SharedArena, so it never wraps around to indices threads already have
+	static uint32_t AssignThreadIndex()
+	{
+		static std::atomic<uint32_t> s_NumThreads{ 0 };
+		uint32_t index = s_NumThreads.load(std::memory_order_relaxed);
+		while (index < SharedArena && !s_NumThreads.compare_exchange_weak(index, index + 1, std::memory_order_relaxed))
+		{
+		}
+		return index;
+	}
+
+	std::vector<std::unique_ptr<Frame>> m_Frames;
+	std::atomic<uint32_t> m_CurrentFrame{ 0 };
+	std::atomic<size_t> m_HighWaterMark{ 0 };
+};
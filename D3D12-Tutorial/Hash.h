@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint> // for uint64_t
+#include <cstddef> // for size_t
+
+// 64-bit FNV-1a offset basis, used as the seed for a fresh hash
+constexpr uint64_t g_HashSeed = 0xcbf29ce484222325ull;
+
+// FNV-1a hash of a block of bytes. Not cryptographic, but stable across runs and machines,
+// so the result can be used as a key for caches persisted to disk.
+// Pass a previous result as the seed to hash several blocks as one.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = g_HashSeed)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull; // FNV-1a 64-bit prime
+	}
+	return hash;
+}
+
+// FNV-1a of a single 32-bit value, byte by byte in little endian order so that it matches HashValue(value).
+// Usable in constant expressions, so types built at compile time can carry a hash for runtime caches.
+constexpr uint64_t HashUInt32(uint32_t value, uint64_t seed = g_HashSeed)
+{
+	uint64_t hash = seed;
+	for (int i = 0; i < 4; i++)
+	{
+		hash ^= (value >> (i * 8)) & 0xff;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Hashes a POD value (e.g. a D3D12 desc struct with no pointers in it). Its bytes are hashed as they are, so
+// only use it for types without padding, which is indeterminate; hash the fields of any others one by one.
+template<typename T>
+inline uint64_t HashValue(const T& value, uint64_t seed = g_HashSeed)
+{
+	return HashBytes(&value, sizeof(T), seed);
+}
+
+// Hashes a null terminated string, a null pointer hashes differently to an empty string
+inline uint64_t HashString(const char* str, uint64_t seed = g_HashSeed)
+{
+	if (str == nullptr)
+	{
+		return HashValue(uint8_t(0xff), seed);
+	}
+	size_t length = 0;
+	while (str[length] != '\0')
+	{
+		length++;
+	}
+	return HashBytes(str, length + 1, seed);
+}
@@ -4,7 +4,10 @@
 #include <Windows.h> // For HRESULT
 #include <exception> // for std::exception
 
-// From DXSampleHelper.h 
+// Hashing helpers, kept separate since they are also used by code that builds without Windows.h
+#include "Hash.h"
+
+// From DXSampleHelper.h
 // Source: https://github.com/Microsoft/DirectX-Graphics-Samples
 inline void ThrowIfFailed(HRESULT hr)
 {
@@ -12,4 +15,4 @@ inline void ThrowIfFailed(HRESULT hr)
 	{
 		throw std::exception();
 	}
-}
\ No newline at end of file
+}
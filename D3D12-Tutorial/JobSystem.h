@@ -0,0 +1,567 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FenceAwaiter.h"
+#include "Threading.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+
+#include "CommandQueue.h"
+#endif
+
+// Counts jobs which haven't finished. JobSystem::Wait on it returns once they all have.
+class JobCounter
+{
+public:
+	bool IsDone() const { return m_Count.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<uint32_t> m_Count{ 0 };
+};
+
+// Chase-Lev work stealing deque of a fixed capacity, a power of two.
+// The owner thread pushes and pops at the bottom, like a stack, so it works on what it pushed most recently,
+// which is most likely still in its cache. Other threads steal from the top, the oldest and usually the
+// biggest pieces of work. Only a steal racing the owner for the last item needs a compare and swap.
+template<typename T, size_t Capacity>
+class WorkStealingDeque
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	// Owner only. Returns false when full.
+	bool Push(T item)
+	{
+		const int64_t bottom = m_Bottom.load(std::memory_order_relaxed);
+		const int64_t top = m_Top.load(std::memory_order_acquire);
+		if (bottom - top >= static_cast<int64_t>(Capacity))
+		{
+			return false;
+		}
+		m_Items[bottom & (Capacity - 1)].store(item, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Owner only. Returns false when empty.
+	bool Pop(T& item)
+	{
+		const int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+		m_Bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = m_Top.load(std::memory_order_relaxed);
+
+		bool hasItem = false;
+		if (top <= bottom)
+		{
+			item = m_Items[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+			hasItem = true;
+			// The last item, which a thief may be taking at the same time
+			if (top == bottom)
+			{
+				hasItem = m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+				m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+		}
+		else
+		{
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return hasItem;
+	}
+
+	// Any thread. Returns false when empty, or when another thread took the item first.
+	bool Steal(T& item)
+	{
+		int64_t top = m_Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+		if (top >= bottom)
+		{
+			return false;
+		}
+		item = m_Items[top & (Capacity - 1)].load(std::memory_order_relaxed);
+		return m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+
+	// Approximate unless called by the owner with no thieves about
+	bool IsEmpty() const
+	{
+		return m_Top.load(std::memory_order_acquire) >= m_Bottom.load(std::memory_order_acquire);
+	}
+
+private:
+	static const size_t CacheLineSize = 64;
+
+	// Padded onto separate cache lines rather than with alignas, since deques are allocated with new, which
+	// only guarantees over-aligned allocations from C++17
+	std::atomic<int64_t> m_Top{ 0 };
+	char m_TopPadding[CacheLineSize];
+	std::atomic<int64_t> m_Bottom{ 0 };
+	char m_BottomPadding[CacheLineSize];
+	std::unique_ptr<std::atomic<T>[]> m_Items{ new std::atomic<T>[Capacity] };
+};
+
+// Work stealing job scheduler shared by everything which runs work in parallel (uploads, command recording,
+// culling, asset processing), instead of each having threads of its own.
+//
+// Every worker thread has a WorkStealingDeque. Jobs started on a worker go to its own deque; jobs started from
+// other threads go to a shared queue. A worker out of jobs takes from the shared queue, then steals from the
+// other workers, then sleeps until more are started.
+//
+// Jobs can start child jobs (RunChild). A job only counts as finished, for the JobCounter it was started with,
+// once its children have too. Wait doesn't block: it runs jobs, its own or stolen, until the counter is done,
+// so waiting inside a job never ties up a worker and can't deadlock for lack of threads.
+//
+// Jobs can also wait on something outside the scheduler, e.g. GPU progress (RunWhen, RunAfterFence), without
+// blocking a thread: they are checked whenever a thread runs out of work, and started once ready.
+class JobSystem
+{
+public:
+	typedef std::function<void()> JobFunction;
+
+	~JobSystem() { Shutdown(); }
+
+	// numWorkers 0 for one per hardware thread, less one for the thread calling Initialize, which usually waits
+	// on jobs (and so runs them) too. pinThreads pins worker i to logical processor i + 1, keeping each worker's
+	// cache warm, at the cost of the OS not moving them away from busy cores.
+	void Initialize(uint32_t numWorkers = 0, bool pinThreads = false)
+	{
+		if (numWorkers == 0)
+		{
+			numWorkers = GetDefaultNumWorkerThreads();
+		}
+
+		m_IsStopping.store(false);
+		m_Workers.clear();
+		for (uint32_t i = 0; i < numWorkers; i++)
+		{
+			m_Workers.emplace_back(new Worker);
+		}
+		for (uint32_t i = 0; i < numWorkers; i++)
+		{
+			m_Workers[i]->Thread = std::thread(&JobSystem::WorkerMain, this, i);
+			if (pinThreads)
+			{
+				PinThread(m_Workers[i]->Thread, i + 1);
+			}
+		}
+	}
+
+	// Finishes the jobs which are running, then stops the workers. Jobs not started yet are dropped, but count
+	// as finished for their counters and parents, so threads in Wait return rather than wait for them forever.
+	void Shutdown()
+	{
+		if (m_Workers.empty())
+		{
+			return;
+		}
+
+		m_IsStopping.store(true);
+		{
+			std::lock_guard<std::mutex> lock(m_SleepMutex);
+			m_WorkAvailable.notify_all();
+		}
+		for (std::unique_ptr<Worker>& worker : m_Workers)
+		{
+			worker->Thread.join();
+		}
+		// Threads in Wait stop taking jobs once they see m_IsStopping, but may still be running one
+		while (m_NumHelpers.load() > 0)
+		{
+			std::this_thread::yield();
+		}
+
+		Job* job;
+		for (std::unique_ptr<Worker>& worker : m_Workers)
+		{
+			while (worker->Jobs.Pop(job))
+			{
+				Finish(job);
+			}
+		}
+		m_Workers.clear();
+		for (Job* queued : m_SharedJobs)
+		{
+			Finish(queued);
+		}
+		m_SharedJobs.clear();
+		for (PendingJob& pending : m_PendingJobs)
+		{
+			Finish(pending.Waiting);
+		}
+		m_PendingJobs.clear();
+		m_NumPendingJobs.store(0);
+	}
+
+	// Starts function on any thread. counter, if given, stays not done until it and its children have finished.
+	// Must not be called after Shutdown.
+	void Run(JobFunction function, JobCounter* counter = nullptr)
+	{
+		Submit(CreateJob(std::move(function), counter, nullptr));
+	}
+
+	// From inside a job: starts function as a child of the running job, which won't count as finished until
+	// function has
+	void RunChild(JobFunction function)
+	{
+		Job* parent = GetThreadState().CurrentJob;
+		assert(parent && "RunChild can only be called from a job");
+		parent->Unfinished.fetch_add(1, std::memory_order_relaxed);
+		Submit(CreateJob(std::move(function), nullptr, parent));
+	}
+
+	// Starts function once isReady returns true. isReady is polled by threads which are out of work, so it
+	// must be cheap and may be called from any thread.
+	void RunWhen(std::function<bool()> isReady, JobFunction function, JobCounter* counter = nullptr)
+	{
+		Job* job = CreateJob(std::move(function), counter, nullptr);
+		{
+			std::lock_guard<std::mutex> lock(m_PendingMutex);
+			m_PendingJobs.push_back({ std::move(isReady), job });
+			m_NumPendingJobs.fetch_add(1);
+		}
+		WakeWorker();
+	}
+
+	// Runs jobs until counter is done. Once Shutdown has started, only waits for it to drop what is left.
+	void Wait(JobCounter& counter)
+	{
+		while (!counter.IsDone())
+		{
+			if (!HelpRunJob())
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// Calls function(begin, end) for consecutive ranges of at most grainSize indices covering [begin, end),
+	// in parallel, and returns once all have returned
+	template<typename Function>
+	void ParallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const Function& function)
+	{
+		assert(grainSize > 0);
+		JobCounter counter;
+		for (uint32_t rangeBegin = begin; rangeBegin < end; rangeBegin += std::min(grainSize, end - rangeBegin))
+		{
+			const uint32_t rangeEnd = rangeBegin + std::min(grainSize, end - rangeBegin);
+			Run([&function, rangeBegin, rangeEnd]() { function(rangeBegin, rangeEnd); }, &counter);
+		}
+		Wait(counter);
+	}
+
+	uint32_t GetNumWorkers() const { return static_cast<uint32_t>(m_Workers.size()); }
+
+private:
+	static const size_t MaxJobsPerWorker = 4096;
+
+	struct Job
+	{
+		JobFunction Function;
+		JobCounter* Counter;
+		Job* Parent;
+		// The job itself and its children which haven't finished
+		std::atomic<uint32_t> Unfinished;
+	};
+
+	struct Worker
+	{
+		std::thread Thread;
+		WorkStealingDeque<Job*, MaxJobsPerWorker> Jobs;
+	};
+
+	struct PendingJob
+	{
+		std::function<bool()> IsReady;
+		Job* Waiting;
+	};
+
+	// Which worker, if any, of which job system the thread is, and the job it is running
+	struct ThreadState
+	{
+		JobSystem* System = nullptr;
+		uint32_t WorkerIndex = 0;
+		Job* CurrentJob = nullptr;
+	};
+
+	static ThreadState& GetThreadState()
+	{
+		static thread_local ThreadState state;
+		return state;
+	}
+
+	Worker* GetCurrentWorker()
+	{
+		ThreadState& state = GetThreadState();
+		return state.System == this ? m_Workers[state.WorkerIndex].get() : nullptr;
+	}
+
+	static void PinThread(std::thread& thread, uint32_t processor)
+	{
+#if defined(_WIN32)
+		if (processor < 64)
+		{
+			::SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << processor);
+		}
+#else
+		(void)thread;
+		(void)processor;
+#endif
+	}
+
+	// Once Shutdown has started nothing would run the job, and its counter would never be done. Jobs still
+	// running may start more, which Shutdown drops; anything else throws rather than hang whoever waits on it.
+	Job* CreateJob(JobFunction function, JobCounter* counter, Job* parent)
+	{
+		const bool isTooLate = m_IsStopping.load() && !GetThreadState().CurrentJob;
+		assert(!isTooLate && "Jobs can't be started once Shutdown has been called");
+		if (isTooLate)
+		{
+			throw std::exception();
+		}
+
+		Job* job = new Job;
+		job->Function = std::move(function);
+		job->Counter = counter;
+		job->Parent = parent;
+		job->Unfinished.store(1, std::memory_order_relaxed);
+		if (counter)
+		{
+			counter->m_Count.fetch_add(1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	void Submit(Job* job)
+	{
+		// Workers keep jobs they start to themselves, unless their deque is full
+		Worker* worker = GetCurrentWorker();
+		if (!worker || !worker->Jobs.Push(job))
+		{
+			std::lock_guard<std::mutex> lock(m_SharedMutex);
+			m_SharedJobs.push_back(job);
+		}
+		WakeWorker();
+	}
+
+	// The version and the sleeper count are sequentially consistent, so either a worker going to sleep sees
+	// the new version, or the submitter sees it is asleep and notifies it
+	void WakeWorker()
+	{
+		m_WorkVersion.fetch_add(1);
+		if (m_NumSleeping.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock(m_SleepMutex);
+			m_WorkAvailable.notify_one();
+		}
+	}
+
+	void Execute(Job* job)
+	{
+		ThreadState& state = GetThreadState();
+		Job* const previousJob = state.CurrentJob;
+		state.CurrentJob = job;
+		job->Function();
+		state.CurrentJob = previousJob;
+		Finish(job);
+	}
+
+	// Once a job and all its children are done, the parent has one less unfinished child
+	void Finish(Job* job)
+	{
+		while (job && job->Unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			Job* const parent = job->Parent;
+			if (job->Counter)
+			{
+				job->Counter->m_Count.fetch_sub(1, std::memory_order_release);
+			}
+			delete job;
+			job = parent;
+		}
+	}
+
+	// Starts pending jobs which have become ready. Only one thread checks at a time; the others carry on.
+	void StartReadyJobs()
+	{
+		if (m_NumPendingJobs.load(std::memory_order_relaxed) == 0)
+		{
+			return;
+		}
+		std::unique_lock<std::mutex> lock(m_PendingMutex, std::try_to_lock);
+		if (!lock.owns_lock())
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < m_PendingJobs.size();)
+		{
+			if (m_PendingJobs[i].IsReady())
+			{
+				Job* job = m_PendingJobs[i].Waiting;
+				m_PendingJobs[i] = std::move(m_PendingJobs.back());
+				m_PendingJobs.pop_back();
+				m_NumPendingJobs.fetch_sub(1);
+				std::lock_guard<std::mutex> sharedLock(m_SharedMutex);
+				m_SharedJobs.push_back(job);
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+
+	// RunOneJob for threads in Wait, unless Shutdown has started. The helper count and the stopping flag are
+	// sequentially consistent, so either this sees the flag, or Shutdown sees the count and waits for the job.
+	// Waits inside a job carry on running jobs regardless, since Shutdown is waiting for that job to finish.
+	bool HelpRunJob()
+	{
+		if (GetThreadState().CurrentJob)
+		{
+			return RunOneJob();
+		}
+		m_NumHelpers.fetch_add(1);
+		const bool hasRun = !m_IsStopping.load() && RunOneJob();
+		m_NumHelpers.fetch_sub(1);
+		return hasRun;
+	}
+
+	// Runs a job from the thread's own deque, the shared queue, or another worker's deque, in that order.
+	// Returns false if there weren't any.
+	bool RunOneJob()
+	{
+		Job* job = nullptr;
+		Worker* worker = GetCurrentWorker();
+		if (worker && worker->Jobs.Pop(job))
+		{
+			Execute(job);
+			return true;
+		}
+
+		StartReadyJobs();
+		{
+			std::lock_guard<std::mutex> lock(m_SharedMutex);
+			if (!m_SharedJobs.empty())
+			{
+				job = m_SharedJobs.front();
+				m_SharedJobs.pop_front();
+			}
+		}
+		if (job)
+		{
+			Execute(job);
+			return true;
+		}
+
+		// Start from a different worker each time, so thieves spread out
+		const size_t numWorkers = m_Workers.size();
+		const size_t first = m_NextVictim.fetch_add(1, std::memory_order_relaxed);
+		for (size_t i = 0; i < numWorkers; i++)
+		{
+			Worker* victim = m_Workers[(first + i) % numWorkers].get();
+			if (victim != worker && victim->Jobs.Steal(job))
+			{
+				Execute(job);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WorkerMain(uint32_t index)
+	{
+		ThreadState& state = GetThreadState();
+		state.System = this;
+		state.WorkerIndex = index;
+
+		while (!m_IsStopping.load())
+		{
+			const uint32_t version = m_WorkVersion.load();
+			if (RunOneJob())
+			{
+				continue;
+			}
+
+			// Nothing to run. While jobs are pending on something outside the scheduler, only sleep briefly so
+			// they are checked again soon.
+			std::unique_lock<std::mutex> lock(m_SleepMutex);
+			m_NumSleeping.fetch_add(1);
+			auto isWoken = [this, version]() { return m_IsStopping.load() || m_WorkVersion.load() != version; };
+			if (m_NumPendingJobs.load() > 0)
+			{
+				m_WorkAvailable.wait_for(lock, std::chrono::microseconds(500), isWoken);
+			}
+			else
+			{
+				m_WorkAvailable.wait(lock, isWoken);
+			}
+			m_NumSleeping.fetch_sub(1);
+		}
+
+		state = ThreadState();
+	}
+
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	std::atomic<size_t> m_NextVictim{ 0 };
+	std::atomic<bool> m_IsStopping{ false };
+	// Threads in HelpRunJob
+	std::atomic<uint32_t> m_NumHelpers{ 0 };
+
+	// Jobs started from threads which aren't workers
+	std::mutex m_SharedMutex;
+	std::deque<Job*> m_SharedJobs;
+
+	std::mutex m_PendingMutex;
+	std::vector<PendingJob> m_PendingJobs;
+	std::atomic<uint32_t> m_NumPendingJobs{ 0 };
+
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WorkAvailable;
+	std::atomic<uint32_t> m_NumSleeping{ 0 };
+	std::atomic<uint32_t> m_WorkVersion{ 0 };
+};
+
+// Resumes coroutines on the job system's workers
+class JobResumeScheduler : public ResumeScheduler
+{
+public:
+	explicit JobResumeScheduler(JobSystem& jobs)
+		: m_Jobs(&jobs)
+	{}
+
+	void Schedule(std::function<bool()> isReady, std::function<void()> resume) override
+	{
+		m_Jobs->RunWhen(std::move(isReady), std::move(resume));
+	}
+
+private:
+	JobSystem* m_Jobs;
+};
+
+#if defined(_WIN32)
+// Starts function once queue's fence reaches fenceValue, e.g. to read back results or recycle upload memory
+// without a thread blocking on the GPU
+inline void RunAfterFence(JobSystem& jobs, const Queue& queue, uint64_t fenceValue, JobSystem::JobFunction function,
+	JobCounter* counter = nullptr)
+{
+	jobs.RunWhen([&queue, fenceValue]() { return queue.IsComplete(fenceValue); }, std::move(function), counter);
+}
+#endif
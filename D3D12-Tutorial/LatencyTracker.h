@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <dxgi1_6.h>
+#endif
+
+// Input to present latency measurement.
+//
+// Every input event is given an id and a timestamp when it arrives (RecordInput). Each frame, once it starts
+// (after any frame latency wait), takes the newest event that arrived since the previous frame (BeginFrame),
+// and carries its id and timestamp through to Present (MarkPresented). Where the swap chain reports when
+// presents reach the display, those times are matched back to frames by present count (MarkDisplayed).
+// Each frame which consumed an event adds a sample of input to present, and where known input to display,
+// latency; GetReport summarises their distribution.
+//
+// Timestamps are ticks of any monotonic clock, with the frequency given to Initialize. On Windows that is
+// QueryPerformanceCounter, the clock DXGI frame statistics use. Nothing but the Windows helpers at the
+// bottom depends on Windows, so the bookkeeping can be run and checked on any platform.
+//
+// Samples and frames waiting for display times are kept in rings allocated by Initialize, so the calls made
+// every frame never allocate; only the percentiles and GetReport do.
+class LatencyTracker
+{
+public:
+	typedef int64_t Ticks;
+	typedef uint64_t EventId;
+	// No input was consumed by the frame
+	static const EventId NoEvent = 0;
+
+	struct InputEvent
+	{
+		EventId Id = NoEvent;
+		Ticks Timestamp = 0;
+	};
+
+	void Initialize(Ticks ticksPerSecond, size_t maxSamples = 1024)
+	{
+		assert(ticksPerSecond > 0 && maxSamples > 0);
+		m_TicksPerSecond = ticksPerSecond;
+		m_MaxSamples = maxSamples;
+		m_InputToPresent.Values.reserve(maxSamples);
+		m_InputToDisplay.Values.reserve(maxSamples);
+		Reset();
+	}
+
+	// Clears the samples and frames in flight. Events recorded before are still consumed by the next frame.
+	void Reset()
+	{
+		m_FirstPendingFrame = 0;
+		m_NumPendingFrames = 0;
+		m_InputToPresent.Clear();
+		m_InputToDisplay.Clear();
+		m_NumFrames = 0;
+		m_NumFramesWithInput = 0;
+	}
+
+	// Call as each input event arrives, from any thread. Returns the event's id.
+	EventId RecordInput(Ticks timestamp)
+	{
+		std::lock_guard<std::mutex> lock(m_InputMutex);
+		m_NewestInput.Id = ++m_LastEventId;
+		m_NewestInput.Timestamp = timestamp;
+		return m_NewestInput.Id;
+	}
+
+	// Call at the start of each frame, before input is sampled. Returns the id of the newest event this frame
+	// consumes, or NoEvent if none arrived since the previous frame.
+	EventId BeginFrame()
+	{
+		const InputEvent input = ConsumeInput();
+		BeginFrame(input);
+		return input.Id;
+	}
+
+	// For frames which sample input on another thread than the one presenting them (see FramePipeline.h):
+	// ConsumeInput where input is sampled, from any thread, and BeginFrame with it on the presenting thread
+	// before the frame is presented.
+	InputEvent ConsumeInput()
+	{
+		InputEvent input;
+		std::lock_guard<std::mutex> lock(m_InputMutex);
+		if (m_NewestInput.Id != m_LastConsumedId)
+		{
+			input = m_NewestInput;
+			m_LastConsumedId = m_NewestInput.Id;
+		}
+		return input;
+	}
+
+	void BeginFrame(const InputEvent& input)
+	{
+		m_CurrentFrame = Frame();
+		m_CurrentFrame.Input = input;
+		m_NumFrames++;
+	}
+
+	// The newest input event consumed by the frame being recorded
+	EventId GetFrameInput() const { return m_CurrentFrame.Input.Id; }
+
+	// Call right after Present, with the swap chain's present count for it (GetLastPresentCount)
+	void MarkPresented(Ticks timestamp, uint32_t presentCount)
+	{
+		Frame frame = m_CurrentFrame;
+		frame.PresentTime = timestamp;
+		frame.PresentCount = presentCount;
+		m_CurrentFrame = Frame();
+
+		if (frame.Input.Id == NoEvent)
+		{
+			return;
+		}
+		m_NumFramesWithInput++;
+		AddSample(m_InputToPresent, frame.PresentTime - frame.Input.Timestamp);
+
+		// Presents reach the display a few frames later. Frames which never get a display time (e.g. statistics
+		// aren't available in this mode) are dropped once there are more than could be queued.
+		if (m_NumPendingFrames == MaxPendingFrames)
+		{
+			PopPendingFrame();
+		}
+		m_PendingFrames[(m_FirstPendingFrame + m_NumPendingFrames) % MaxPendingFrames] = frame;
+		m_NumPendingFrames++;
+	}
+
+	// Call when the swap chain reports the time a present was shown (DXGI_FRAME_STATISTICS's PresentCount and
+	// SyncQPCTime). Earlier presents still waiting for a time won't get one.
+	void MarkDisplayed(uint32_t presentCount, Ticks displayTime)
+	{
+		while (m_NumPendingFrames > 0 && PresentCountBefore(m_PendingFrames[m_FirstPendingFrame].PresentCount, presentCount))
+		{
+			PopPendingFrame();
+		}
+		if (m_NumPendingFrames > 0 && m_PendingFrames[m_FirstPendingFrame].PresentCount == presentCount)
+		{
+			AddSample(m_InputToDisplay, displayTime - m_PendingFrames[m_FirstPendingFrame].Input.Timestamp);
+			PopPendingFrame();
+		}
+	}
+
+	// Latencies in milliseconds at a percentile of the samples (0 to 100), or 0 without any samples
+	double GetInputToPresent(double percentile) const { return GetPercentile(m_InputToPresent, percentile); }
+	double GetInputToDisplay(double percentile) const { return GetPercentile(m_InputToDisplay, percentile); }
+	size_t GetNumInputToPresentSamples() const { return m_InputToPresent.Values.size(); }
+	size_t GetNumInputToDisplaySamples() const { return m_InputToDisplay.Values.size(); }
+	uint64_t GetNumFrames() const { return m_NumFrames; }
+	uint64_t GetNumFramesWithInput() const { return m_NumFramesWithInput; }
+
+	// Percentiles of both latencies, over the most recent samples
+	std::string GetReport() const
+	{
+		char line[256];
+		std::string report;
+		snprintf(line, sizeof(line), "Latency over %zu frames with input (of %llu):\n", m_InputToPresent.Values.size(),
+			static_cast<unsigned long long>(m_NumFrames));
+		report += line;
+		AppendDistribution(report, "Input to present", m_InputToPresent);
+		AppendDistribution(report, "Input to display", m_InputToDisplay);
+		return report;
+	}
+
+private:
+	static const size_t MaxPendingFrames = 16;
+
+	struct Frame
+	{
+		InputEvent Input;
+		Ticks PresentTime = 0;
+		uint32_t PresentCount = 0;
+	};
+
+	// Latencies in milliseconds, in a ring of the most recent m_MaxSamples
+	struct Samples
+	{
+		std::vector<double> Values;
+		size_t Next = 0;
+
+		// Keeps the memory for the next samples
+		void Clear()
+		{
+			Values.clear();
+			Next = 0;
+		}
+	};
+
+	void PopPendingFrame()
+	{
+		m_FirstPendingFrame = (m_FirstPendingFrame + 1) % MaxPendingFrames;
+		m_NumPendingFrames--;
+	}
+
+	// Present counts wrap, so compared as a signed difference
+	static bool PresentCountBefore(uint32_t a, uint32_t b)
+	{
+		return static_cast<int32_t>(a - b) < 0;
+	}
+
+	void AddSample(Samples& samples, Ticks latency)
+	{
+		const double milliseconds = 1000.0 * static_cast<double>(latency) / static_cast<double>(m_TicksPerSecond);
+		if (samples.Values.size() < m_MaxSamples)
+		{
+			samples.Values.push_back(milliseconds);
+		}
+		else
+		{
+			samples.Values[samples.Next] = milliseconds;
+			samples.Next = (samples.Next + 1) % m_MaxSamples;
+		}
+	}
+
+	static double GetPercentile(const Samples& samples, double percentile)
+	{
+		if (samples.Values.empty())
+		{
+			return 0.0;
+		}
+		std::vector<double> sorted(samples.Values);
+		const size_t index = std::min(sorted.size() - 1,
+			static_cast<size_t>(std::max(0.0, percentile) / 100.0 * static_cast<double>(sorted.size())));
+		std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+		return sorted[index];
+	}
+
+	static void AppendDistribution(std::string& report, const char* name, const Samples& samples)
+	{
+		char line[256];
+		if (samples.Values.empty())
+		{
+			snprintf(line, sizeof(line), "  %s: no samples\n", name);
+		}
+		else
+		{
+			snprintf(line, sizeof(line), "  %s: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n", name,
+				GetPercentile(samples, 50.0), GetPercentile(samples, 95.0), GetPercentile(samples, 99.0),
+				*std::max_element(samples.Values.begin(), samples.Values.end()));
+		}
+		report += line;
+	}
+
+	Ticks m_TicksPerSecond = 1;
+	size_t m_MaxSamples = 1024;
+
+	std::mutex m_InputMutex;
+	InputEvent m_NewestInput;
+	EventId m_LastEventId = NoEvent;
+	EventId m_LastConsumedId = NoEvent;
+
+	Frame m_CurrentFrame;
+	// Presented frames waiting for their display time, oldest first, in a ring from m_FirstPendingFrame
+	Frame m_PendingFrames[MaxPendingFrames];
+	size_t m_FirstPendingFrame = 0;
+	size_t m_NumPendingFrames = 0;
+	Samples m_InputToPresent;
+	Samples m_InputToDisplay;
+	uint64_t m_NumFrames = 0;
+	uint64_t m_NumFramesWithInput = 0;
+};
+
+#if defined(_WIN32)
+// QueryPerformanceCounter ticks, the clock used by DXGI frame statistics
+inline LatencyTracker::Ticks QueryTimestamp()
+{
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+inline LatencyTracker::Ticks QueryTimestampFrequency()
+{
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+}
+
+// Call right after swapChain has presented, to record the present. Its display time comes later, from the
+// frame statistics (QueryPresentStatistics in FramePacing.h), given to MarkDisplayed.
+inline void MarkPresented(LatencyTracker& tracker, IDXGISwapChain* swapChain)
+{
+	UINT presentCount = 0;
+	if (SUCCEEDED(swapChain->GetLastPresentCount(&presentCount)))
+	{
+		tracker.MarkPresented(QueryTimestamp(), presentCount);
+	}
+}
+#endif
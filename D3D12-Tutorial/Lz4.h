@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// LZ4 block format codec.
+// Spec: https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+//
+// Only the block format is implemented (no frames, checksums or dictionaries), since the chunked
+// containers in ChunkedCompression.h carry their own sizes. The decoder is the hot path: it checks every
+// read and write against the buffer bounds, so corrupt data fails cleanly instead of overrunning the
+// upload heap it is writing into. The encoder is a simple greedy one, intended for content tools.
+namespace Lz4
+{
+	const uint32_t MinMatch = 4;
+	// The last 5 bytes of a block are always literals, and the last match starts at least 12 bytes from the end
+	const uint32_t LastLiterals = 5;
+	const uint32_t MatchFindLimit = 12;
+	const uint32_t MaxOffset = 65535;
+
+	// Worst case compressed size of size bytes (incompressible data grows slightly)
+	inline size_t CompressBound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	namespace Detail
+	{
+		inline uint32_t Read32(const uint8_t* p)
+		{
+			uint32_t value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+
+		// Lengths of 15 or more continue in following bytes, each adding up to 255
+		inline uint8_t* WriteLength(uint8_t* op, size_t length)
+		{
+			while (length >= 255)
+			{
+				*op++ = 255;
+				length -= 255;
+			}
+			*op++ = static_cast<uint8_t>(length);
+			return op;
+		}
+
+		inline uint8_t* WriteSequence(uint8_t* op, const uint8_t* literals, size_t numLiterals,
+			uint32_t offset, size_t matchLength)
+		{
+			uint8_t* token = op++;
+			*token = static_cast<uint8_t>((numLiterals >= 15 ? 15 : numLiterals) << 4);
+			if (numLiterals >= 15)
+			{
+				op = WriteLength(op, numLiterals - 15);
+			}
+			memcpy(op, literals, numLiterals);
+			op += numLiterals;
+
+			// The final sequence has literals only
+			if (matchLength == 0)
+			{
+				return op;
+			}
+
+			*op++ = static_cast<uint8_t>(offset);
+			*op++ = static_cast<uint8_t>(offset >> 8);
+
+			size_t storedLength = matchLength - MinMatch;
+			*token |= static_cast<uint8_t>(storedLength >= 15 ? 15 : storedLength);
+			if (storedLength >= 15)
+			{
+				op = WriteLength(op, storedLength - 15);
+			}
+			return op;
+		}
+	}
+
+	// Compresses source into destination, which must hold CompressBound(sourceSize) bytes.
+	// Returns the compressed size.
+	inline size_t Compress(const void* source, size_t sourceSize, void* destination)
+	{
+		const uint8_t* src = static_cast<const uint8_t*>(source);
+		uint8_t* op = static_cast<uint8_t*>(destination);
+
+		const uint8_t* anchor = src;
+		if (sourceSize > MatchFindLimit)
+		{
+			// Last position seen for each hash of 4 bytes
+			const uint32_t hashBits = 12;
+			std::vector<int64_t> table(size_t(1) << hashBits, -1);
+
+			const uint8_t* ip = src;
+			const uint8_t* matchFindEnd = src + sourceSize - MatchFindLimit;
+			const uint8_t* matchEnd = src + sourceSize - LastLiterals;
+
+			while (ip < matchFindEnd)
+			{
+				const uint32_t sequence = Detail::Read32(ip);
+				// Knuth's multiplicative hash
+				const uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+				const int64_t candidate = table[hash];
+				table[hash] = ip - src;
+
+				if (candidate < 0 || (ip - src) - candidate > MaxOffset || Detail::Read32(src + candidate) != sequence)
+				{
+					ip++;
+					continue;
+				}
+
+				const uint8_t* match = src + candidate;
+				size_t length = MinMatch;
+				while (ip + length < matchEnd && match[length] == ip[length])
+				{
+					length++;
+				}
+
+				op = Detail::WriteSequence(op, anchor, ip - anchor, static_cast<uint32_t>(ip - match), length);
+				ip += length;
+				anchor = ip;
+			}
+		}
+
+		op = Detail::WriteSequence(op, anchor, src + sourceSize - anchor, 0, 0);
+		return op - static_cast<uint8_t*>(destination);
+	}
+
+	inline std::vector<uint8_t> Compress(const void* source, size_t sourceSize)
+	{
+		std::vector<uint8_t> compressed(CompressBound(sourceSize));
+		compressed.resize(Compress(source, sourceSize, compressed.data()));
+		return compressed;
+	}
+
+	// Decompresses a block into destination. Returns false if the block is corrupt or does not decompress
+	// to exactly destinationSize bytes.
+	inline bool Decompress(const void* source, size_t sourceSize, void* destination, size_t destinationSize)
+	{
+		const uint8_t* ip = static_cast<const uint8_t*>(source);
+		const uint8_t* const ipEnd = ip + sourceSize;
+		uint8_t* op = static_cast<uint8_t*>(destination);
+		uint8_t* const opStart = op;
+		uint8_t* const opEnd = op + destinationSize;
+
+		auto readLength = [&ip, ipEnd](size_t& length) -> bool
+		{
+			uint8_t byte;
+			do
+			{
+				if (ip >= ipEnd)
+				{
+					return false;
+				}
+				byte = *ip++;
+				length += byte;
+			} while (byte == 255);
+			return true;
+		};
+
+		while (ip < ipEnd)
+		{
+			const uint8_t token = *ip++;
+
+			// Literals
+			size_t numLiterals = token >> 4;
+			if (numLiterals == 15 && !readLength(numLiterals))
+			{
+				return false;
+			}
+			if (numLiterals > size_t(ipEnd - ip) || numLiterals > size_t(opEnd - op))
+			{
+				return false;
+			}
+			memcpy(op, ip, numLiterals);
+			ip += numLiterals;
+			op += numLiterals;
+
+			// The last sequence ends after its literals
+			if (ip == ipEnd)
+			{
+				break;
+			}
+
+			// Match
+			if (ipEnd - ip < 2)
+			{
+				return false;
+			}
+			const size_t offset = ip[0] | (size_t(ip[1]) << 8);
+			ip += 2;
+			if (offset == 0 || offset > size_t(op - opStart))
+			{
+				return false;
+			}
+
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !readLength(matchLength))
+			{
+				return false;
+			}
+			matchLength += MinMatch;
+			if (matchLength > size_t(opEnd - op))
+			{
+				return false;
+			}
+
+			const uint8_t* match = op - offset;
+			if (offset >= matchLength)
+			{
+				// No overlap, one copy
+				memcpy(op, match, matchLength);
+				op += matchLength;
+			}
+			else if (offset >= 8)
+			{
+				// Overlapping, but each 8 byte step only reads bytes already written
+				uint8_t* const matchEnd = op + matchLength;
+				while (matchEnd - op >= 8)
+				{
+					memcpy(op, match, 8);
+					op += 8;
+					match += 8;
+				}
+				while (op < matchEnd)
+				{
+					*op++ = *match++;
+				}
+			}
+			else
+			{
+				// Short offsets repeat the last few bytes, so must go byte by byte
+				for (size_t i = 0; i < matchLength; i++)
+				{
+					*op++ = *match++;
+				}
+			}
+		}
+
+		return op == opEnd;
+	}
+}
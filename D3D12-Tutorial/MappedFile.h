@@ -0,0 +1,231 @@
+#pragma once
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+// POSIX equivalents, so file formats and loaders built on this can be run and checked off Windows
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+
+// Read-only view of a whole file mapped into the address space.
+// Pages are only read from disk when touched, so opening a large cache file is close to free,
+// and data can be handed straight to D3D12 without copying it into a heap allocation first.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+#if defined(_WIN32)
+			std::swap(m_File, other.m_File);
+			std::swap(m_Mapping, other.m_Mapping);
+#endif
+			std::swap(m_Data, other.m_Data);
+			std::swap(m_Size, other.m_Size);
+		}
+		return *this;
+	}
+
+#if defined(_WIN32)
+	// Returns false if the file does not exist or is empty, which is the normal case on a first run
+	bool Open(const wchar_t* path)
+	{
+		Close();
+
+		// FILE_SHARE_READ lets other views of the same file be opened, but nobody can write
+		// to it underneath us while it is mapped
+		m_File = ::CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+		return MapOpenedFile();
+	}
+
+	bool Open(const char* path)
+	{
+		Close();
+		m_File = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+		return MapOpenedFile();
+	}
+#else
+	bool Open(const char* path)
+	{
+		Close();
+
+		int file = ::open(path, O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat fileStat = {};
+		// A zero sized file cannot be mapped
+		if (::fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+		{
+			::close(file);
+			return false;
+		}
+
+		// The mapping holds its own reference to the file, so the descriptor can be closed straight away
+		void* data = ::mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		::close(file);
+		if (data == MAP_FAILED)
+		{
+			return false;
+		}
+
+		m_Data = data;
+		m_Size = static_cast<uint64_t>(fileStat.st_size);
+		return true;
+	}
+#endif
+
+	void Close()
+	{
+#if defined(_WIN32)
+		if (m_Data)
+		{
+			::UnmapViewOfFile(m_Data);
+		}
+		if (m_Mapping)
+		{
+			::CloseHandle(m_Mapping);
+			m_Mapping = NULL;
+		}
+		if (m_File != INVALID_HANDLE_VALUE)
+		{
+			::CloseHandle(m_File);
+			m_File = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (m_Data)
+		{
+			::munmap(m_Data, static_cast<size_t>(m_Size));
+		}
+#endif
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+
+	bool IsOpen() const { return m_Data != nullptr; }
+	const void* Data() const { return m_Data; }
+	uint64_t Size() const { return m_Size; }
+
+private:
+#if defined(_WIN32)
+	bool MapOpenedFile()
+	{
+		if (m_File == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER fileSize = {};
+		// A zero sized file cannot be mapped
+		if (!::GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		// Passing 0 for the max size maps the whole file
+		m_Mapping = ::CreateFileMappingW(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_Mapping == NULL)
+		{
+			Close();
+			return false;
+		}
+
+		m_Data = ::MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+		if (m_Data == nullptr)
+		{
+			Close();
+			return false;
+		}
+
+		m_Size = static_cast<uint64_t>(fileSize.QuadPart);
+		return true;
+	}
+
+	HANDLE m_File = INVALID_HANDLE_VALUE;
+	HANDLE m_Mapping = NULL;
+#endif
+	void* m_Data = nullptr;
+	uint64_t m_Size = 0;
+};
+
+#if defined(_WIN32)
+// Writes a whole file in one go, replacing it if it already exists.
+// Any view of the same file must be closed first.
+inline bool WriteWholeFile(const wchar_t* path, const void* data, uint64_t size)
+{
+	HANDLE file = ::CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	DWORD bytesWritten = 0;
+	BOOL succeeded = ::WriteFile(file, data, static_cast<DWORD>(size), &bytesWritten, NULL);
+	::CloseHandle(file);
+
+	return succeeded && bytesWritten == size;
+}
+
+// Overwrites size bytes of an existing file at offset, leaving the rest of it as it is.
+// Any view of the same file must be closed first.
+inline bool WriteFileAt(const wchar_t* path, uint64_t offset, const void* data, uint64_t size)
+{
+	HANDLE file = ::CreateFileW(path, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER position = {};
+	position.QuadPart = static_cast<LONGLONG>(offset);
+	DWORD bytesWritten = 0;
+	BOOL succeeded = ::SetFilePointerEx(file, position, NULL, FILE_BEGIN) &&
+		::WriteFile(file, data, static_cast<DWORD>(size), &bytesWritten, NULL);
+	::CloseHandle(file);
+
+	return succeeded && bytesWritten == size;
+}
+#endif
+
+// Portable version for tools and formats which are also built off Windows
+inline bool WriteWholeFile(const char* path, const void* data, uint64_t size)
+{
+	FILE* file = nullptr;
+#if defined(_WIN32)
+	// fopen is deprecated by the SDL checks
+	fopen_s(&file, path, "wb");
+#else
+	file = std::fopen(path, "wb");
+#endif
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	size_t bytesWritten = std::fwrite(data, 1, static_cast<size_t>(size), file);
+	bool closed = std::fclose(file) == 0;
+
+	return closed && bytesWritten == size;
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <wrl.h>
+#include <d3d12.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "JobSystem.h"
+#include "PipelineStateCache.h"
+
+// Priorities for pipeline compiles, higher values are compiled first.
+// Render code raises a pipeline's priority when something using it becomes visible.
+enum class PipelinePriority : uint32_t
+{
+	Prefetch = 0,	// Not needed yet, e.g. warming pipelines for the next level
+	Default = 1,
+	Visible = 2,	// Needed by something on screen, currently drawn with a fallback or skipped
+};
+
+// Shared between a PipelineHandle and the compile worker building it
+struct PipelineRequest
+{
+	uint64_t Hash = 0;
+	// Copy of the stream bytes. Subobjects which point to other memory (shaders, input layouts) still
+	// point at the caller's data, which must stay alive until the compile finishes.
+	std::vector<uint8_t> Stream;
+	std::atomic<uint32_t> Priority{ 0 };
+
+	// Set once by the worker. Ready is released after PipelineState is written, so a reader who
+	// observes Ready == true may read PipelineState without locking.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> PipelineState;
+	std::atomic<bool> Ready{ false };
+	std::atomic<bool> Failed{ false };
+
+	// Drawn with instead while not ready, may be null in which case the draw should be skipped
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> Fallback;
+};
+
+// Future-like handle to a pipeline being compiled by a PipelineCompiler.
+// Cheap to copy; every copy refers to the same compile.
+class PipelineHandle
+{
+public:
+	PipelineHandle() = default;
+	explicit PipelineHandle(std::shared_ptr<PipelineRequest> request) : m_Request(std::move(request)) {}
+
+	bool IsValid() const { return m_Request != nullptr; }
+	bool IsReady() const { return m_Request && m_Request->Ready.load(std::memory_order_acquire); }
+	bool HasFailed() const { return m_Request && m_Request->Failed.load(std::memory_order_acquire); }
+
+	// The pipeline to bind this frame: the real PSO once it is ready, otherwise the registered fallback.
+	// Returns nullptr if neither is available, in which case the draw should be skipped.
+	ID3D12PipelineState* Resolve() const
+	{
+		if (!m_Request)
+		{
+			return nullptr;
+		}
+		if (IsReady())
+		{
+			return m_Request->PipelineState.Get();
+		}
+		return m_Request->Fallback.Get();
+	}
+
+	uint64_t GetHash() const { return m_Request ? m_Request->Hash : 0; }
+
+private:
+	friend class PipelineCompiler;
+	std::shared_ptr<PipelineRequest> m_Request;
+};
+
+// Moves PSO creation off the render thread.
+// Requests are queued and compiled by jobs on the job system through a PipelineStateCache,
+// so pipelines already in memory or in the pipeline library on disk are ready almost immediately.
+// Every request starts a job, which compiles whichever request is pending with the highest PipelinePriority
+// when it runs; the render thread calls Prioritize for pipelines it tried to draw with this frame so that
+// what is on screen is compiled before prefetches.
+class PipelineCompiler
+{
+public:
+	PipelineCompiler() = default;
+	~PipelineCompiler() { Shutdown(); }
+
+	PipelineCompiler(const PipelineCompiler&) = delete;
+	PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+	// jobSystem must stay alive until Shutdown
+	void Initialize(PipelineStateCache* cache, JobSystem& jobSystem)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Cache = cache;
+		m_JobSystem = &jobSystem;
+		m_IsRunning = true;
+	}
+
+	// Pending requests are dropped, and fail, compiles already running are finished
+	void Shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!m_IsRunning)
+			{
+				return;
+			}
+			m_IsRunning = false;
+			// Or threads in Wait for them would wait forever
+			for (const std::shared_ptr<PipelineRequest>& request : m_Pending)
+			{
+				request->Failed.store(true, std::memory_order_release);
+			}
+			m_Pending.clear();
+			m_CompileFinished.notify_all();
+		}
+
+		// Jobs for dropped requests find nothing to compile
+		m_JobSystem->Wait(m_Compiles);
+		m_JobSystem = nullptr;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_InFlight.clear();
+	}
+
+	// Queues desc for compilation and returns immediately.
+	// Requesting a pipeline which is already queued or compiled returns a handle to the same compile.
+	// fallback is used by PipelineHandle::Resolve until the real pipeline is ready. It is only taken by the first
+	// request for a pipeline, since the handle may already be resolved on other threads by the next.
+	PipelineHandle Compile(const D3D12_PIPELINE_STATE_STREAM_DESC& desc, uint64_t rootSignatureHash,
+		PipelinePriority priority = PipelinePriority::Default,
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> fallback = nullptr)
+	{
+		uint64_t hash = HashPipelineStream(desc, rootSignatureHash);
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		assert(m_IsRunning && "PipelineCompiler is not initialized");
+
+		auto it = m_InFlight.find(hash);
+		if (it != m_InFlight.end())
+		{
+			PipelineHandle handle(it->second);
+			lock.unlock();
+			Prioritize(handle, priority);
+			return handle;
+		}
+
+		auto request = std::make_shared<PipelineRequest>();
+		request->Hash = hash;
+		const uint8_t* streamBytes = static_cast<const uint8_t*>(desc.pPipelineStateSubobjectStream);
+		request->Stream.assign(streamBytes, streamBytes + desc.SizeInBytes);
+		request->Priority = static_cast<uint32_t>(priority);
+		request->Fallback = fallback;
+
+		m_InFlight.emplace(hash, request);
+		m_Pending.push_back(request);
+		lock.unlock();
+
+		m_JobSystem->Run([this]() { CompileNext(); }, &m_Compiles);
+		return PipelineHandle(request);
+	}
+
+	// Fallbacks may also be registered after the request, e.g. once a generic pipeline has been compiled.
+	// Must be called before the handle is shared with other threads.
+	void SetFallback(const PipelineHandle& handle, Microsoft::WRL::ComPtr<ID3D12PipelineState> fallback)
+	{
+		if (handle.m_Request)
+		{
+			handle.m_Request->Fallback = fallback;
+		}
+	}
+
+	// Raises the priority of a pending compile. Priorities never decrease, so calling this every frame
+	// for visible pipelines is safe.
+	void Prioritize(const PipelineHandle& handle, PipelinePriority priority)
+	{
+		if (!handle.m_Request || handle.IsReady())
+		{
+			return;
+		}
+
+		uint32_t newPriority = static_cast<uint32_t>(priority);
+		uint32_t current = handle.m_Request->Priority.load(std::memory_order_relaxed);
+		while (current < newPriority &&
+			!handle.m_Request->Priority.compare_exchange_weak(current, newPriority, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	// Blocks until handle is ready, or has failed. Only meant for loading screens and shutdown, never the render loop.
+	void Wait(const PipelineHandle& handle)
+	{
+		if (!handle.IsValid())
+		{
+			return;
+		}
+		Prioritize(handle, PipelinePriority::Visible);
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_CompileFinished.wait(lock, [&handle]() { return handle.IsReady() || handle.HasFailed(); });
+	}
+
+	uint32_t GetNumPending()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return static_cast<uint32_t>(m_Pending.size());
+	}
+
+private:
+	// Removes and returns the highest priority pending request, oldest first among equals.
+	// Priorities change without the lock held, so rather than keep a sorted heap we scan the list, which
+	// stays short since requests are only pending for as long as the workers are behind.
+	std::shared_ptr<PipelineRequest> PopHighestPriority()
+	{
+		auto best = m_Pending.begin();
+		for (auto it = m_Pending.begin(); it != m_Pending.end(); ++it)
+		{
+			if ((*it)->Priority.load(std::memory_order_relaxed) > (*best)->Priority.load(std::memory_order_relaxed))
+			{
+				best = it;
+			}
+		}
+
+		std::shared_ptr<PipelineRequest> request = std::move(*best);
+		m_Pending.erase(best);
+		return request;
+	}
+
+	// Run as a job for every request
+	void CompileNext()
+	{
+		std::shared_ptr<PipelineRequest> request;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!m_IsRunning || m_Pending.empty())
+			{
+				return;
+			}
+			request = PopHighestPriority();
+		}
+
+		D3D12_PIPELINE_STATE_STREAM_DESC desc = {};
+		desc.SizeInBytes = request->Stream.size();
+		desc.pPipelineStateSubobjectStream = request->Stream.data();
+
+		try
+		{
+			request->PipelineState = m_Cache->GetPipelineState(desc, request->Hash, nullptr);
+			request->Ready.store(true, std::memory_order_release);
+		}
+		catch (const std::exception&)
+		{
+			// Leave Resolve() returning the fallback forever rather than bring down the worker
+			request->Failed.store(true, std::memory_order_release);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			// The cache now owns the PSO, so later requests for it will hit there immediately
+			m_InFlight.erase(request->Hash);
+		}
+		m_CompileFinished.notify_all();
+	}
+
+	PipelineStateCache* m_Cache = nullptr;
+	JobSystem* m_JobSystem = nullptr;
+	// Jobs started by Compile which haven't finished
+	JobCounter m_Compiles;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_CompileFinished;
+	bool m_IsRunning = false;
+
+	// Requests waiting for a job to compile them
+	std::vector<std::shared_ptr<PipelineRequest>> m_Pending;
+	// Requests queued or compiling, by hash, used to dedupe requests for the same pipeline
+	std::unordered_map<uint64_t, std::shared_ptr<PipelineRequest>> m_InFlight;
+};
@@ -0,0 +1,408 @@
+#pragma once
+
+// Windows Runtime Library. Needed for Microsoft::WRL::ComPtr<> template class.
+#include <wrl.h>
+
+#include <d3d12.h>
+#include "d3dx12.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Helpers.h"
+#include "MappedFile.h"
+
+// Hash of a shader's bytecode.
+// DXBC/DXIL containers start with the "DXBC" fourcc followed by a 16 byte digest of the rest of the
+// container, so when that digest is present we can hash 16 bytes instead of the whole shader.
+inline uint64_t HashShaderBytecode(const D3D12_SHADER_BYTECODE& bytecode, uint64_t seed = g_HashSeed)
+{
+	const size_t headerSize = 4 + 16;
+	if (bytecode.pShaderBytecode == nullptr || bytecode.BytecodeLength == 0)
+	{
+		return HashValue(uint64_t(0), seed);
+	}
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(bytecode.pShaderBytecode);
+	if (bytecode.BytecodeLength >= headerSize &&
+		bytes[0] == 'D' && bytes[1] == 'X' && bytes[2] == 'B' && bytes[3] == 'C')
+	{
+		// Unsigned containers leave the digest zeroed, in which case it tells us nothing
+		uint64_t digest[2];
+		memcpy(digest, bytes + 4, sizeof(digest));
+		if (digest[0] != 0 || digest[1] != 0)
+		{
+			return HashBytes(digest, sizeof(digest), HashValue(bytecode.BytecodeLength, seed));
+		}
+	}
+
+	return HashBytes(bytecode.pShaderBytecode, bytecode.BytecodeLength, seed);
+}
+
+// Walks a pipeline state stream with D3DX12ParsePipelineStream and folds every subobject into one hash.
+// Subobjects holding pointers (shaders, input layout, stream output, view instancing) are hashed by the
+// content they point at, so the hash is the same across runs and can be used to name pipelines in a
+// pipeline library on disk. The root signature is a COM object with no content to hash, so callers
+// provide a hash for it (e.g. of its serialized blob) instead, which must not be 0 if the stream sets one:
+// otherwise streams differing only in their root signature would hash the same.
+class PipelineStreamHasher : public ID3DX12PipelineParserCallbacks
+{
+public:
+	explicit PipelineStreamHasher(uint64_t rootSignatureHash)
+		: m_Hash(HashValue(rootSignatureHash))
+	{}
+
+	uint64_t GetHash() const { return m_Hash; }
+	bool HasError() const { return m_HasError; }
+	bool HasRootSignature() const { return m_HasRootSignature; }
+
+	// Plain value subobjects
+	void FlagsCb(D3D12_PIPELINE_STATE_FLAGS flags) override { Add(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_FLAGS, flags); }
+	void NodeMaskCb(UINT nodeMask) override { Add(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_NODE_MASK, nodeMask); }
+	void IBStripCutValueCb(D3D12_INDEX_BUFFER_STRIP_CUT_VALUE value) override { Add(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_IB_STRIP_CUT_VALUE, value); }
+	void PrimitiveTopologyTypeCb(D3D12_PRIMITIVE_TOPOLOGY_TYPE type) override { Add(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PRIMITIVE_TOPOLOGY, type); }
+	void DSVFormatCb(DXGI_FORMAT format) override { Add(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT, format); }
+	void SampleDescCb(const DXGI_SAMPLE_DESC& desc) override { Add(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_DESC, desc); }
+	void SampleMaskCb(UINT mask) override { Add(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_MASK, mask); }
+
+	// The root signature is covered by the hash passed to the constructor.
+	// A cached PSO blob is only an accelerator and does not change the pipeline, so neither is hashed here.
+	void RootSignatureCb(ID3D12RootSignature*) override { m_HasRootSignature = true; }
+	void CachedPSOCb(const D3D12_CACHED_PIPELINE_STATE&) override {}
+
+	// Shaders
+	void VSCb(const D3D12_SHADER_BYTECODE& bytecode) override { AddShader(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_VS, bytecode); }
+	void GSCb(const D3D12_SHADER_BYTECODE& bytecode) override { AddShader(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_GS, bytecode); }
+	void HSCb(const D3D12_SHADER_BYTECODE& bytecode) override { AddShader(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_HS, bytecode); }
+	void DSCb(const D3D12_SHADER_BYTECODE& bytecode) override { AddShader(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DS, bytecode); }
+	void PSCb(const D3D12_SHADER_BYTECODE& bytecode) override { AddShader(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PS, bytecode); }
+	void CSCb(const D3D12_SHADER_BYTECODE& bytecode) override { AddShader(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_CS, bytecode); }
+
+	// Structs with padding (e.g. after RenderTargetWriteMask and StencilWriteMask), which is indeterminate,
+	// so they are hashed field by field rather than as raw bytes
+	void BlendStateCb(const D3D12_BLEND_DESC& desc) override
+	{
+		m_Hash = HashValue(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_BLEND, m_Hash);
+		m_Hash = HashValue(desc.AlphaToCoverageEnable, m_Hash);
+		m_Hash = HashValue(desc.IndependentBlendEnable, m_Hash);
+		for (const D3D12_RENDER_TARGET_BLEND_DESC& target : desc.RenderTarget)
+		{
+			m_Hash = HashValue(target.BlendEnable, m_Hash);
+			m_Hash = HashValue(target.LogicOpEnable, m_Hash);
+			m_Hash = HashValue(target.SrcBlend, m_Hash);
+			m_Hash = HashValue(target.DestBlend, m_Hash);
+			m_Hash = HashValue(target.BlendOp, m_Hash);
+			m_Hash = HashValue(target.SrcBlendAlpha, m_Hash);
+			m_Hash = HashValue(target.DestBlendAlpha, m_Hash);
+			m_Hash = HashValue(target.BlendOpAlpha, m_Hash);
+			m_Hash = HashValue(target.LogicOp, m_Hash);
+			m_Hash = HashValue(target.RenderTargetWriteMask, m_Hash);
+		}
+	}
+
+	void DepthStencilStateCb(const D3D12_DEPTH_STENCIL_DESC& desc) override
+	{
+		m_Hash = HashValue(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL, m_Hash);
+		AddDepthStencil(desc.DepthEnable, desc.DepthWriteMask, desc.DepthFunc, desc.StencilEnable,
+			desc.StencilReadMask, desc.StencilWriteMask, desc.FrontFace, desc.BackFace);
+	}
+
+	void DepthStencilState1Cb(const D3D12_DEPTH_STENCIL_DESC1& desc) override
+	{
+		m_Hash = HashValue(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL1, m_Hash);
+		AddDepthStencil(desc.DepthEnable, desc.DepthWriteMask, desc.DepthFunc, desc.StencilEnable,
+			desc.StencilReadMask, desc.StencilWriteMask, desc.FrontFace, desc.BackFace);
+		m_Hash = HashValue(desc.DepthBoundsTestEnable, m_Hash);
+	}
+
+	void RasterizerStateCb(const D3D12_RASTERIZER_DESC& desc) override
+	{
+		m_Hash = HashValue(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RASTERIZER, m_Hash);
+		m_Hash = HashValue(desc.FillMode, m_Hash);
+		m_Hash = HashValue(desc.CullMode, m_Hash);
+		m_Hash = HashValue(desc.FrontCounterClockwise, m_Hash);
+		m_Hash = HashValue(desc.DepthBias, m_Hash);
+		m_Hash = HashValue(desc.DepthBiasClamp, m_Hash);
+		m_Hash = HashValue(desc.SlopeScaledDepthBias, m_Hash);
+		m_Hash = HashValue(desc.DepthClipEnable, m_Hash);
+		m_Hash = HashValue(desc.MultisampleEnable, m_Hash);
+		m_Hash = HashValue(desc.AntialiasedLineEnable, m_Hash);
+		m_Hash = HashValue(desc.ForcedSampleCount, m_Hash);
+		m_Hash = HashValue(desc.ConservativeRaster, m_Hash);
+	}
+
+	void RTVFormatsCb(const D3D12_RT_FORMAT_ARRAY& formats) override
+	{
+		m_Hash = HashValue(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS, m_Hash);
+		m_Hash = HashValue(formats.NumRenderTargets, m_Hash);
+		for (DXGI_FORMAT format : formats.RTFormats)
+		{
+			m_Hash = HashValue(format, m_Hash);
+		}
+	}
+
+	// Subobjects which point to arrays
+	void InputLayoutCb(const D3D12_INPUT_LAYOUT_DESC& desc) override
+	{
+		m_Hash = HashValue(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_INPUT_LAYOUT, m_Hash);
+		m_Hash = HashValue(desc.NumElements, m_Hash);
+		for (UINT i = 0; i < desc.NumElements; i++)
+		{
+			const D3D12_INPUT_ELEMENT_DESC& element = desc.pInputElementDescs[i];
+			m_Hash = HashString(element.SemanticName, m_Hash);
+			m_Hash = HashValue(element.SemanticIndex, m_Hash);
+			m_Hash = HashValue(element.Format, m_Hash);
+			m_Hash = HashValue(element.InputSlot, m_Hash);
+			m_Hash = HashValue(element.AlignedByteOffset, m_Hash);
+			m_Hash = HashValue(element.InputSlotClass, m_Hash);
+			m_Hash = HashValue(element.InstanceDataStepRate, m_Hash);
+		}
+	}
+
+	void StreamOutputCb(const D3D12_STREAM_OUTPUT_DESC& desc) override
+	{
+		m_Hash = HashValue(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_STREAM_OUTPUT, m_Hash);
+		m_Hash = HashValue(desc.NumEntries, m_Hash);
+		for (UINT i = 0; i < desc.NumEntries; i++)
+		{
+			const D3D12_SO_DECLARATION_ENTRY& entry = desc.pSODeclaration[i];
+			m_Hash = HashValue(entry.Stream, m_Hash);
+			m_Hash = HashString(entry.SemanticName, m_Hash);
+			m_Hash = HashValue(entry.SemanticIndex, m_Hash);
+			m_Hash = HashValue(entry.StartComponent, m_Hash);
+			m_Hash = HashValue(entry.ComponentCount, m_Hash);
+			m_Hash = HashValue(entry.OutputSlot, m_Hash);
+		}
+		m_Hash = HashValue(desc.NumStrides, m_Hash);
+		if (desc.NumStrides > 0)
+		{
+			m_Hash = HashBytes(desc.pBufferStrides, desc.NumStrides * sizeof(UINT), m_Hash);
+		}
+		m_Hash = HashValue(desc.RasterizedStream, m_Hash);
+	}
+
+	void ViewInstancingCb(const D3D12_VIEW_INSTANCING_DESC& desc) override
+	{
+		m_Hash = HashValue(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_VIEW_INSTANCING, m_Hash);
+		m_Hash = HashValue(desc.ViewInstanceCount, m_Hash);
+		if (desc.ViewInstanceCount > 0)
+		{
+			m_Hash = HashBytes(desc.pViewInstanceLocations,
+				desc.ViewInstanceCount * sizeof(D3D12_VIEW_INSTANCE_LOCATION), m_Hash);
+		}
+		m_Hash = HashValue(desc.Flags, m_Hash);
+	}
+
+	// Errors
+	void ErrorBadInputParameter(UINT) override { m_HasError = true; }
+	void ErrorDuplicateSubobject(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE) override { m_HasError = true; }
+	void ErrorUnknownSubobject(UINT) override { m_HasError = true; }
+
+private:
+	// The subobject type is hashed too, so e.g. the same bytecode bound as VS and as PS hash differently
+	template<typename T>
+	void Add(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE type, const T& value)
+	{
+		m_Hash = HashValue(type, m_Hash);
+		m_Hash = HashValue(value, m_Hash);
+	}
+
+	void AddDepthStencilOp(const D3D12_DEPTH_STENCILOP_DESC& op)
+	{
+		m_Hash = HashValue(op.StencilFailOp, m_Hash);
+		m_Hash = HashValue(op.StencilDepthFailOp, m_Hash);
+		m_Hash = HashValue(op.StencilPassOp, m_Hash);
+		m_Hash = HashValue(op.StencilFunc, m_Hash);
+	}
+
+	// The fields D3D12_DEPTH_STENCIL_DESC and D3D12_DEPTH_STENCIL_DESC1 share
+	void AddDepthStencil(BOOL depthEnable, D3D12_DEPTH_WRITE_MASK depthWriteMask, D3D12_COMPARISON_FUNC depthFunc,
+		BOOL stencilEnable, UINT8 stencilReadMask, UINT8 stencilWriteMask,
+		const D3D12_DEPTH_STENCILOP_DESC& frontFace, const D3D12_DEPTH_STENCILOP_DESC& backFace)
+	{
+		m_Hash = HashValue(depthEnable, m_Hash);
+		m_Hash = HashValue(depthWriteMask, m_Hash);
+		m_Hash = HashValue(depthFunc, m_Hash);
+		m_Hash = HashValue(stencilEnable, m_Hash);
+		m_Hash = HashValue(stencilReadMask, m_Hash);
+		m_Hash = HashValue(stencilWriteMask, m_Hash);
+		AddDepthStencilOp(frontFace);
+		AddDepthStencilOp(backFace);
+	}
+
+	void AddShader(D3D12_PIPELINE_STATE_SUBOBJECT_TYPE type, const D3D12_SHADER_BYTECODE& bytecode)
+	{
+		m_Hash = HashShaderBytecode(bytecode, HashValue(type, m_Hash));
+	}
+
+	uint64_t m_Hash;
+	bool m_HasError = false;
+	bool m_HasRootSignature = false;
+};
+
+// Returns a stable content hash of a pipeline state stream, see PipelineStreamHasher
+inline uint64_t HashPipelineStream(const D3D12_PIPELINE_STATE_STREAM_DESC& desc, uint64_t rootSignatureHash)
+{
+	PipelineStreamHasher hasher(rootSignatureHash);
+	ThrowIfFailed(D3DX12ParsePipelineStream(desc, &hasher));
+	assert(!hasher.HasError() && "Malformed pipeline state stream");
+	assert((!hasher.HasRootSignature() || rootSignatureHash != 0) && "The stream sets a root signature, so it needs a hash");
+	return hasher.GetHash();
+}
+
+// Caches Pipeline State Objects (PSOs) by the content hash of the stream that describes them.
+//	- In memory, asking for the same pipeline twice returns the same PSO rather than compiling it again.
+//	- On disk, compiled PSOs are stored in an ID3D12PipelineLibrary which is serialized on Shutdown and
+//	  memory mapped on the next Initialize. Loading from the library skips the driver's shader compilation,
+//	  which is most of the cost of CreatePipelineState.
+// The driver can reject a library written by another driver version or adapter. In that case we simply
+// start an empty library, and if pipeline libraries are unsupported entirely only the in-memory cache is used.
+// GetPipelineState may be called from several threads at once.
+class PipelineStateCache
+{
+public:
+	void Initialize(Microsoft::WRL::ComPtr<ID3D12Device2> device, const std::wstring& libraryPath)
+	{
+		m_Device = device;
+		m_LibraryPath = libraryPath;
+
+		// Pipeline libraries were added with ID3D12Device1
+		Microsoft::WRL::ComPtr<ID3D12Device1> device1;
+		if (FAILED(m_Device.As(&device1)))
+		{
+			return;
+		}
+
+		// The library references the blob directly rather than copying it, so the mapping
+		// must stay open for as long as the library is alive
+		HRESULT hr = E_FAIL;
+		if (m_LibraryFile.Open(m_LibraryPath.c_str()))
+		{
+			hr = device1->CreatePipelineLibrary(m_LibraryFile.Data(), static_cast<SIZE_T>(m_LibraryFile.Size()),
+				IID_PPV_ARGS(&m_PipelineLibrary));
+		}
+
+		// No file yet, or the driver rejected it (D3D12_ERROR_DRIVER_VERSION_MISMATCH, D3D12_ERROR_ADAPTER_NOT_FOUND
+		// or a corrupt file). Start an empty library which will replace the file on Shutdown.
+		if (FAILED(hr))
+		{
+			m_LibraryFile.Close();
+			m_PipelineLibrary.Reset();
+			if (FAILED(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&m_PipelineLibrary))))
+			{
+				// DXGI_ERROR_UNSUPPORTED, e.g. on some older drivers. Fall back to the in-memory cache only.
+				m_PipelineLibrary.Reset();
+			}
+		}
+	}
+
+	// Returns the PSO for desc, creating it on a miss.
+	// rootSignatureHash identifies the root signature set in the stream, see PipelineStreamHasher.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> GetPipelineState(const D3D12_PIPELINE_STATE_STREAM_DESC& desc,
+		uint64_t rootSignatureHash)
+	{
+		return GetPipelineState(desc, HashPipelineStream(desc, rootSignatureHash), nullptr);
+	}
+
+	// As above, but with a precomputed hash. wasCreated (optional) is set if the driver had to compile the PSO.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> GetPipelineState(const D3D12_PIPELINE_STATE_STREAM_DESC& desc,
+		uint64_t hash, bool* wasCreated)
+	{
+		if (wasCreated)
+		{
+			*wasCreated = false;
+		}
+
+		// In memory
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_PipelineStates.find(hash);
+			if (it != m_PipelineStates.end())
+			{
+				return it->second;
+			}
+		}
+
+		// Compiling happens outside of the lock so other threads can keep hitting the cache.
+		// Two threads missing on the same hash will both compile, and the second result is dropped below.
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineState;
+		const std::wstring name = PipelineName(hash);
+
+		// From the library on disk. LoadPipeline fails with E_INVALIDARG if the name is missing,
+		// or if the stored pipeline does not match desc.
+		bool loaded = m_PipelineLibrary &&
+			SUCCEEDED(m_PipelineLibrary->LoadPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pipelineState)));
+
+		if (!loaded)
+		{
+			ThrowIfFailed(m_Device->CreatePipelineState(&desc, IID_PPV_ARGS(&pipelineState)));
+			if (wasCreated)
+			{
+				*wasCreated = true;
+			}
+
+			if (m_PipelineLibrary)
+			{
+				// Fails if a stale pipeline already uses this name, which is harmless: we just won't
+				// persist this one until the library is rebuilt
+				if (SUCCEEDED(m_PipelineLibrary->StorePipeline(name.c_str(), pipelineState.Get())))
+				{
+					m_IsDirty = true;
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto result = m_PipelineStates.emplace(hash, pipelineState);
+		return result.first->second;
+	}
+
+	// Serializes the library to disk if any pipelines were added, then releases everything.
+	// All PSOs should have finished executing on the GPU before this is called.
+	void Shutdown()
+	{
+		if (m_PipelineLibrary && m_IsDirty)
+		{
+			std::vector<uint8_t> blob(m_PipelineLibrary->GetSerializedSize());
+			if (SUCCEEDED(m_PipelineLibrary->Serialize(blob.data(), blob.size())))
+			{
+				// The file is still mapped by the library we are serializing, so release both before writing over it
+				m_PipelineLibrary.Reset();
+				m_LibraryFile.Close();
+				WriteWholeFile(m_LibraryPath.c_str(), blob.data(), blob.size());
+			}
+		}
+
+		m_PipelineStates.clear();
+		m_PipelineLibrary.Reset();
+		m_LibraryFile.Close();
+		m_Device.Reset();
+		m_IsDirty = false;
+	}
+
+private:
+	// Pipelines in a library are looked up by name, so use the hash as hex
+	static std::wstring PipelineName(uint64_t hash)
+	{
+		wchar_t name[17];
+		swprintf_s(name, L"%016llx", static_cast<unsigned long long>(hash));
+		return name;
+	}
+
+	Microsoft::WRL::ComPtr<ID3D12Device2> m_Device;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary1> m_PipelineLibrary;
+	// Backing memory of m_PipelineLibrary
+	MappedFile m_LibraryFile;
+	std::wstring m_LibraryPath;
+	// True once a pipeline has been stored that is not in the file on disk
+	std::atomic<bool> m_IsDirty{ false };
+
+	std::mutex m_Mutex;
+	std::unordered_map<uint64_t, Microsoft::WRL::ComPtr<ID3D12PipelineState>> m_PipelineStates;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+// Windows Runtime Library. Needed for Microsoft::WRL::ComPtr<> template class.
+#include <wrl.h>
+
+#include <d3d12.h>
+#include <dxgi1_6.h>
+
+#include "CommandQueue.h"
+#include "Helpers.h"
+
+// A device with its queues: everything one renderer needs besides what it renders to (see Swapchain.h).
+// Holds no global state, so a process can run several renderers side by side, each on its own RenderDevice,
+// e.g. for offscreen rendering on behalf of several clients.
+class RenderDevice
+{
+public:
+	~RenderDevice() { Shutdown(); }
+
+	// device is created by the caller, so it decides on the adapter and debug settings
+	void Initialize(Microsoft::WRL::ComPtr<IDXGIFactory4> factory, Microsoft::WRL::ComPtr<ID3D12Device2> device)
+	{
+		m_Factory = factory;
+		m_Device = device;
+		m_DirectQueue.Initialize(device, D3D12_COMMAND_LIST_TYPE_DIRECT);
+		m_ComputeQueue.Initialize(device, D3D12_COMMAND_LIST_TYPE_COMPUTE);
+
+		// Rather than create the DXGI 1.5 factory interface directly, the 1.4 one is queried for it, since
+		// graphics debugging tools may not support the 1.5 factory
+		Microsoft::WRL::ComPtr<IDXGIFactory5> factory5;
+		BOOL allowTearing = FALSE;
+		if (SUCCEEDED(m_Factory.As(&factory5)) &&
+			SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))))
+		{
+			m_TearingSupported = allowTearing == TRUE;
+		}
+	}
+
+	// Waits for the GPU to finish everything, then releases the queues and device
+	void Shutdown()
+	{
+		m_ComputeQueue.Shutdown();
+		m_DirectQueue.Shutdown();
+		m_Device.Reset();
+		m_Factory.Reset();
+	}
+
+	// Waits for all work submitted so far, e.g. before releasing resources it uses
+	void Flush()
+	{
+		m_DirectQueue.Flush();
+		m_ComputeQueue.Flush();
+	}
+
+	bool IsInitialized() const { return m_Device != nullptr; }
+	ID3D12Device2* GetDevice() const { return m_Device.Get(); }
+	IDXGIFactory4* GetFactory() const { return m_Factory.Get(); }
+	bool IsTearingSupported() const { return m_TearingSupported; }
+
+	// Graphics work, and presentation
+	Queue& GetDirectQueue() { return m_DirectQueue; }
+	// Compute work run alongside the direct queue; QueueSubmitter orders submissions to both with GPU-side waits
+	Queue& GetComputeQueue() { return m_ComputeQueue; }
+
+private:
+	Microsoft::WRL::ComPtr<IDXGIFactory4> m_Factory;
+	Microsoft::WRL::ComPtr<ID3D12Device2> m_Device;
+	Queue m_DirectQueue;
+	Queue m_ComputeQueue;
+	bool m_TearingSupported = false;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Helpers.h"
+#include "RenderDevice.h"
+#include "Swapchain.h"
+
+// Drives any number of outputs from one RenderDevice: windows' swap chains, or headless targets with no
+// window, e.g. for offscreen rendering on a machine without a display.
+//
+// Every tick records a command list per output, then submits all of them with a single ExecuteCommandLists
+// and a single fence signal, and presents the windows. Outputs share everything except what is per frame:
+// each is a Swapchain with its own frame contexts, so one window being resized or removed doesn't wait for
+// the others.
+class RenderServer
+{
+public:
+	// Records one output's frame into commandList. The render target is already in the RENDER_TARGET state
+	// and must be left in it.
+	typedef std::function<void(Swapchain& output, ID3D12GraphicsCommandList* commandList)> RecordFunction;
+
+	void Initialize(RenderDevice* device)
+	{
+		m_RenderDevice = device;
+	}
+
+	// Waits for the GPU to finish with every output, then releases them
+	void Shutdown()
+	{
+		m_Outputs.clear();
+		m_RenderDevice = nullptr;
+	}
+
+	Swapchain* AddWindow(HWND hWnd, uint32_t width, uint32_t height, uint32_t numFrames = 3, uint32_t maxFrameLatency = 0)
+	{
+		std::unique_ptr<Swapchain> output(new Swapchain);
+		output->InitializeWindow(m_RenderDevice, hWnd, width, height, numFrames, maxFrameLatency);
+		m_Outputs.push_back(std::move(output));
+		return m_Outputs.back().get();
+	}
+
+	Swapchain* AddHeadless(uint32_t width, uint32_t height, uint32_t numFrames = 2,
+		DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM)
+	{
+		std::unique_ptr<Swapchain> output(new Swapchain);
+		output->InitializeHeadless(m_RenderDevice, width, height, numFrames, format);
+		m_Outputs.push_back(std::move(output));
+		return m_Outputs.back().get();
+	}
+
+	// Waits for the GPU to finish with the output, then releases it
+	void RemoveOutput(Swapchain* output)
+	{
+		m_Outputs.erase(std::remove_if(m_Outputs.begin(), m_Outputs.end(),
+			[output](const std::unique_ptr<Swapchain>& o) { return o.get() == output; }), m_Outputs.end());
+	}
+
+	// Renders one frame of every output with record, then submits them all at once and presents
+	void Tick(const RecordFunction& record)
+	{
+		if (m_Outputs.empty())
+		{
+			return;
+		}
+
+		m_CommandLists.clear();
+		for (std::unique_ptr<Swapchain>& output : m_Outputs)
+		{
+			// Waitable outputs are recorded once they can take another frame, so what they show is recent
+			output->WaitForNextFrame();
+			ID3D12GraphicsCommandList* commandList = output->BeginFrame();
+			record(*output, commandList);
+			m_CommandLists.push_back(output->EndFrame());
+		}
+
+		const uint64_t fenceValue = m_RenderDevice->GetDirectQueue().Execute(static_cast<UINT>(m_CommandLists.size()),
+			m_CommandLists.data());
+
+		for (std::unique_ptr<Swapchain>& output : m_Outputs)
+		{
+			output->Present(fenceValue, VSync);
+		}
+	}
+
+	size_t GetNumOutputs() const { return m_Outputs.size(); }
+	Swapchain* GetOutput(size_t index) const { return m_Outputs[index].get(); }
+
+	// Whether windows present on vertical blank
+	bool VSync = true;
+
+private:
+	RenderDevice* m_RenderDevice = nullptr;
+	std::vector<std::unique_ptr<Swapchain>> m_Outputs;
+	std::vector<ID3D12CommandList*> m_CommandLists;
+};
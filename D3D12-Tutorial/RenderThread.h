@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "SpscQueue.h"
+
+// A thread which owns rendering, fed window events by the window thread.
+//
+// Rendering on the window thread ties frames to message handling: the modal loop Windows runs while a window
+// is moved or resized stops frames altogether, and time spent handling messages shows up as uneven frame
+// times. Instead, the window thread only posts what changed (Post), and the render thread applies it between
+// frames, so everything which submits to the GPU, resizes or presents runs on one thread.
+//
+// Posting never blocks the window thread on a frame. Resizes are coalesced as they are posted: dragging a
+// window edge posts a resize for every mouse move, so only the latest size is kept, in an atomic, and applied
+// once the frame in progress is done; the swap chain is resized at most once a frame. Other events travel over
+// a lock-free single producer, single consumer queue, and are dropped if it is full, which takes the render
+// thread stalling for hundreds of them.
+//
+// The window thread must not wait on the render thread while it owns the window, e.g. with a blocking call in
+// WndProc, since DXGI can send messages to the window from Present or ResizeBuffers.
+class RenderThread
+{
+public:
+	enum class EventType
+	{
+		Resize,		// Width and Height of the client area
+		VSync,		// Enabled
+	};
+
+	struct Event
+	{
+		EventType Type;
+		uint32_t Width;
+		uint32_t Height;
+		bool Enabled;
+	};
+
+	typedef std::function<void(const Event& event)> EventHandler;
+	typedef std::function<void()> FrameFunction;
+
+	~RenderThread() { Stop(); }
+
+	// Starts the thread, which alternates handling events and running frames until Stop
+	void Start(EventHandler handleEvent, FrameFunction runFrame)
+	{
+		assert(!m_Thread.joinable());
+		m_HandleEvent = std::move(handleEvent);
+		m_RunFrame = std::move(runFrame);
+		m_IsStopping.store(false, std::memory_order_relaxed);
+		m_Thread = std::thread(&RenderThread::Run, this);
+	}
+
+	// Finishes the current frame and stops. Events posted but not handled yet are dropped.
+	void Stop()
+	{
+		if (m_Thread.joinable())
+		{
+			m_IsStopping.store(true, std::memory_order_release);
+			m_Thread.join();
+		}
+	}
+
+	// Window thread only. Returns false, dropping the event, if the render thread is too far behind to take it.
+	bool Post(const Event& event)
+	{
+		if (event.Type == EventType::Resize)
+		{
+			PostResize(event.Width, event.Height);
+			return true;
+		}
+		if (!m_Events.TryPush(event))
+		{
+			m_NumDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+
+	// Replaces any resize which the render thread hasn't applied yet
+	void PostResize(uint32_t width, uint32_t height)
+	{
+		m_ResizeSize.store(static_cast<uint64_t>(width) << 32 | height, std::memory_order_relaxed);
+		if (m_IsResizePending.exchange(true, std::memory_order_acq_rel))
+		{
+			m_NumCoalescedResizes.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	bool PostVSync(bool enabled)
+	{
+		return Post({ EventType::VSync, 0, 0, enabled });
+	}
+
+	bool IsRunning() const { return m_Thread.joinable(); }
+	// Resizes which a later one replaced before the render thread got to them
+	uint64_t GetNumCoalescedResizes() const { return m_NumCoalescedResizes.load(std::memory_order_relaxed); }
+	// Events other than resizes which Post dropped because the queue was full
+	uint64_t GetNumDroppedEvents() const { return m_NumDroppedEvents.load(std::memory_order_relaxed); }
+
+private:
+	void Run()
+	{
+		while (!m_IsStopping.load(std::memory_order_acquire))
+		{
+			HandleEvents();
+			m_RunFrame();
+		}
+	}
+
+	// Handles everything posted since the last frame, in order, then the latest resize if there was one
+	void HandleEvents()
+	{
+		Event event;
+		while (m_Events.TryPop(event))
+		{
+			m_HandleEvent(event);
+		}
+
+		// The acquire pairs with PostResize's exchange, so the size read is at least as new as the flag. A resize
+		// posted in between may be applied now and again next frame, which is harmless.
+		if (m_IsResizePending.exchange(false, std::memory_order_acq_rel))
+		{
+			const uint64_t size = m_ResizeSize.load(std::memory_order_relaxed);
+			m_HandleEvent({ EventType::Resize, static_cast<uint32_t>(size >> 32), static_cast<uint32_t>(size), false });
+		}
+	}
+
+	std::thread m_Thread;
+	std::atomic<bool> m_IsStopping{ false };
+	SpscQueue<Event, 256> m_Events;
+	// The latest size posted, width in the high 32 bits, and whether it is yet to be applied
+	std::atomic<uint64_t> m_ResizeSize{ 0 };
+	std::atomic<bool> m_IsResizePending{ false };
+	EventHandler m_HandleEvent;
+	FrameFunction m_RunFrame;
+	std::atomic<uint64_t> m_NumCoalescedResizes{ 0 };
+	std::atomic<uint64_t> m_NumDroppedEvents{ 0 };
+};
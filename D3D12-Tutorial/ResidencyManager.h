@@ -0,0 +1,264 @@
+#pragma once
+
+// Windows Runtime Library. Needed for Microsoft::WRL::ComPtr<> template class.
+#include <wrl.h>
+
+#include <d3d12.h>
+#include <dxgi1_6.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "Helpers.h"
+
+// Keeps the process's video memory usage inside the budget the OS gives it.
+//
+// The budget (DXGI_QUERY_VIDEO_MEMORY_INFO::Budget) is how much local video memory the process can use before
+// the OS starts paging its allocations in and out, which stalls for hundreds of milliseconds at a time. It
+// changes as other processes come and go, so it is re-queried whenever the OS signals a budget change, when
+// our own residency has changed, and otherwise every few updates.
+//
+// Heaps and committed resources registered with Track are kept in least recently used order. While usage is
+// above the target fraction of the budget, the least recently used ones the GPU has finished with are
+// evicted. Anything evicted is made resident again by the next MakeResident after it is marked used, before
+// the work that uses it is submitted.
+class ResidencyManager
+{
+public:
+	~ResidencyManager() { Shutdown(); }
+
+	// targetFraction leaves headroom below the budget, for allocations made outside the manager
+	void Initialize(Microsoft::WRL::ComPtr<ID3D12Device2> device, Microsoft::WRL::ComPtr<IDXGIAdapter4> adapter,
+		float targetFraction = 0.9f)
+	{
+		m_Device = device;
+		m_Adapter = adapter;
+		m_TargetFraction = targetFraction;
+
+		// Auto reset, so each wait consumes one notification. Without it the manager falls back to polling.
+		m_BudgetChangedEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (m_BudgetChangedEvent != NULL &&
+			FAILED(m_Adapter->RegisterVideoMemoryBudgetChangeNotificationEvent(m_BudgetChangedEvent, &m_BudgetChangedCookie)))
+		{
+			::CloseHandle(m_BudgetChangedEvent);
+			m_BudgetChangedEvent = NULL;
+		}
+
+		QueryBudget();
+	}
+
+	void Shutdown()
+	{
+		if (m_BudgetChangedEvent != NULL)
+		{
+			m_Adapter->UnregisterVideoMemoryBudgetChangeNotification(m_BudgetChangedCookie);
+			::CloseHandle(m_BudgetChangedEvent);
+			m_BudgetChangedEvent = NULL;
+		}
+
+		m_Objects.clear();
+		m_LeastRecentlyUsed.clear();
+		m_ToMakeResident.clear();
+		m_Adapter.Reset();
+		m_Device.Reset();
+	}
+
+	// Starts managing a heap or committed resource of size bytes, which must be resident.
+	// The caller keeps it alive, and must Untrack it before releasing it. Never a swap chain back buffer: the
+	// fence only says rendering to it has finished, not that DXGI is done presenting it.
+	void Track(ID3D12Pageable* object, uint64_t size)
+	{
+		assert(m_Objects.find(object) == m_Objects.end() && "Already tracked");
+
+		m_LeastRecentlyUsed.push_front(object);
+		Object& tracked = m_Objects[object];
+		tracked.Size = size;
+		tracked.LruPosition = m_LeastRecentlyUsed.begin();
+		m_ResidentSize += size;
+		m_IsUsageStale = true;
+	}
+
+	void Untrack(ID3D12Pageable* object)
+	{
+		auto it = m_Objects.find(object);
+		assert(it != m_Objects.end() && "Not tracked");
+
+		if (it->second.IsResident)
+		{
+			m_ResidentSize -= it->second.Size;
+		}
+		else
+		{
+			m_EvictedSize -= it->second.Size;
+		}
+		m_LeastRecentlyUsed.erase(it->second.LruPosition);
+		m_Objects.erase(it);
+		m_IsUsageStale = true;
+
+		// Drop it from a pending MakeResident too
+		for (size_t i = 0; i < m_ToMakeResident.size(); i++)
+		{
+			if (m_ToMakeResident[i] == object)
+			{
+				m_ToMakeResident[i] = m_ToMakeResident.back();
+				m_ToMakeResident.pop_back();
+				break;
+			}
+		}
+	}
+
+	// Records that object is used by work which will signal fenceValue when it completes.
+	// Call for everything a command list references, then MakeResident, then submit it.
+	void MarkUsed(ID3D12Pageable* object, uint64_t fenceValue)
+	{
+		auto it = m_Objects.find(object);
+		assert(it != m_Objects.end() && "Not tracked");
+
+		Object& tracked = it->second;
+		tracked.LastUsedFenceValue = fenceValue;
+		m_LeastRecentlyUsed.splice(m_LeastRecentlyUsed.begin(), m_LeastRecentlyUsed, tracked.LruPosition);
+
+		if (!tracked.IsResident && !tracked.IsMakeResidentPending)
+		{
+			tracked.IsMakeResidentPending = true;
+			m_ToMakeResident.push_back(object);
+		}
+	}
+
+	// Makes everything marked used since the last call resident, in one batch. Blocks until it is.
+	void MakeResident(uint64_t completedFenceValue)
+	{
+		if (m_ToMakeResident.empty())
+		{
+			return;
+		}
+
+		uint64_t size = 0;
+		for (ID3D12Pageable* object : m_ToMakeResident)
+		{
+			size += m_Objects[object].Size;
+		}
+
+		// Make room first, so bringing these back doesn't push usage over the budget
+		EvictToFit(size, completedFenceValue);
+
+		HRESULT result = m_Device->MakeResident(static_cast<UINT>(m_ToMakeResident.size()), m_ToMakeResident.data());
+		if (result == E_OUTOFMEMORY)
+		{
+			// Usage went up underneath us. Evict everything the GPU no longer needs and try once more.
+			EvictToFit(m_Budget.Budget, completedFenceValue);
+			result = m_Device->MakeResident(static_cast<UINT>(m_ToMakeResident.size()), m_ToMakeResident.data());
+		}
+		ThrowIfFailed(result);
+
+		for (ID3D12Pageable* object : m_ToMakeResident)
+		{
+			Object& tracked = m_Objects[object];
+			tracked.IsResident = true;
+			tracked.IsMakeResidentPending = false;
+			m_ResidentSize += tracked.Size;
+			m_EvictedSize -= tracked.Size;
+		}
+		m_ToMakeResident.clear();
+		m_IsUsageStale = true;
+	}
+
+	// Refreshes the budget if it may have changed, and evicts down to the target if usage is over it.
+	// Call once per frame. completedFenceValue is the GPU's progress on the fence passed to MarkUsed.
+	void Update(uint64_t completedFenceValue)
+	{
+		bool budgetChanged = m_BudgetChangedEvent != NULL &&
+			::WaitForSingleObject(m_BudgetChangedEvent, 0) == WAIT_OBJECT_0;
+		if (budgetChanged || m_IsUsageStale || ++m_UpdatesSinceQuery >= PollInterval)
+		{
+			QueryBudget();
+		}
+
+		EvictToFit(0, completedFenceValue);
+	}
+
+	// For the local segment group, i.e. dedicated video memory on discrete GPUs and all of it on integrated ones
+	const DXGI_QUERY_VIDEO_MEMORY_INFO& GetBudget() const { return m_Budget; }
+	uint64_t GetTargetUsage() const { return static_cast<uint64_t>(m_Budget.Budget * m_TargetFraction); }
+	uint64_t GetResidentSize() const { return m_ResidentSize; }
+	uint64_t GetEvictedSize() const { return m_EvictedSize; }
+	uint64_t GetNumEvictions() const { return m_NumEvictions; }
+
+private:
+	// Updates between budget queries when nothing has signalled a change
+	static const uint32_t PollInterval = 30;
+
+	struct Object
+	{
+		uint64_t Size = 0;
+		uint64_t LastUsedFenceValue = 0;
+		bool IsResident = true;
+		bool IsMakeResidentPending = false;
+		std::list<ID3D12Pageable*>::iterator LruPosition;
+	};
+
+	void QueryBudget()
+	{
+		ThrowIfFailed(m_Adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &m_Budget));
+		m_IsUsageStale = false;
+		m_UpdatesSinceQuery = 0;
+	}
+
+	// Evicts least recently used objects until usage plus extraSize is within the target. Objects the GPU may
+	// still be using, or about to be made resident, are skipped; evicting them would fault the GPU.
+	void EvictToFit(uint64_t extraSize, uint64_t completedFenceValue)
+	{
+		const uint64_t target = GetTargetUsage();
+		if (m_Budget.CurrentUsage + extraSize <= target)
+		{
+			return;
+		}
+		uint64_t toFree = m_Budget.CurrentUsage + extraSize - target;
+
+		std::vector<ID3D12Pageable*> evicted;
+		for (auto it = m_LeastRecentlyUsed.rbegin(); it != m_LeastRecentlyUsed.rend() && toFree > 0; ++it)
+		{
+			Object& tracked = m_Objects[*it];
+			if (!tracked.IsResident || tracked.IsMakeResidentPending || tracked.LastUsedFenceValue > completedFenceValue)
+			{
+				continue;
+			}
+
+			evicted.push_back(*it);
+			tracked.IsResident = false;
+			m_ResidentSize -= tracked.Size;
+			m_EvictedSize += tracked.Size;
+			toFree -= std::min(toFree, tracked.Size);
+		}
+
+		if (!evicted.empty())
+		{
+			ThrowIfFailed(m_Device->Evict(static_cast<UINT>(evicted.size()), evicted.data()));
+			m_NumEvictions += evicted.size();
+			QueryBudget();
+		}
+	}
+
+	Microsoft::WRL::ComPtr<ID3D12Device2> m_Device;
+	Microsoft::WRL::ComPtr<IDXGIAdapter4> m_Adapter;
+	float m_TargetFraction = 0.9f;
+
+	HANDLE m_BudgetChangedEvent = NULL;
+	DWORD m_BudgetChangedCookie = 0;
+	DXGI_QUERY_VIDEO_MEMORY_INFO m_Budget = {};
+	bool m_IsUsageStale = true;
+	uint32_t m_UpdatesSinceQuery = 0;
+
+	std::unordered_map<ID3D12Pageable*, Object> m_Objects;
+	// Most recently used first
+	std::list<ID3D12Pageable*> m_LeastRecentlyUsed;
+	std::vector<ID3D12Pageable*> m_ToMakeResident;
+
+	uint64_t m_ResidentSize = 0;
+	uint64_t m_EvictedSize = 0;
+	uint64_t m_NumEvictions = 0;
+};
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <d3d12.h>
+
+#include <cassert>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+#include "Helpers.h"
+
+// Compile time root signature description.
+// A root signature is declared as a type, e.g.
+//
+//	using MeshRootSignature = RootSig::RootSignature<
+//		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT,
+//		RootSig::Constants<16, 0>,									// b0: model view projection matrix
+//		RootSig::Table<D3D12_SHADER_VISIBILITY_PIXEL,
+//			RootSig::SRVRange<4, 0>>,								// t0-t3: material textures
+//		RootSig::StaticSampler<0, D3D12_FILTER_MIN_MAG_MIP_LINEAR>>;	// s0
+//
+// and everything that can be checked is checked when that line compiles:
+//	- the cost of the parameters against the 64 DWORD root signature limit,
+//	- descriptor tables not mixing samplers with CBV/SRV/UAV ranges, and not being empty.
+// Its hash (MeshRootSignature::Hash) is a constant, so it can key the root signature and PSO caches
+// without hashing the desc at runtime. MeshRootSignature::Slot<N> is a typed binding for root parameter N
+// which only accepts the right kind of argument, e.g. Slot<0>::SetGraphics(commandList, mvpMatrix).
+//
+// Plain D3D12 descs with pointers in them (and root parameters, which are unions) cannot be constant
+// initialised before C++20, so GetDesc() builds the D3D12_VERSIONED_ROOT_SIGNATURE_DESC the first time it is
+// called and returns the same one after that. Descriptor ranges and static samplers are constexpr.
+namespace RootSig
+{
+	// Root signature costs, in DWORDs
+	// Docs: https://docs.microsoft.com/en-us/windows/win32/direct3d12/root-signature-limits
+	const uint32_t MaxCost = 64;
+	const uint32_t TableCost = 1;
+	const uint32_t RootDescriptorCost = 2;
+
+	// D3D12_FLOAT32_MAX and 0.0f as bits, used to hash static samplers at compile time
+	const uint32_t Float32MaxBits = 0x7f7fffff;
+	const uint32_t Float32ZeroBits = 0;
+
+	namespace Detail
+	{
+		constexpr uint32_t Sum() { return 0; }
+		template<typename... Rest>
+		constexpr uint32_t Sum(uint32_t first, Rest... rest) { return first + Sum(rest...); }
+
+		constexpr bool All() { return true; }
+		template<typename... Rest>
+		constexpr bool All(bool first, Rest... rest) { return first && All(rest...); }
+
+		// Folds T::Hash over a list of types, in order
+		template<typename... Ts>
+		struct HashChain
+		{
+			static constexpr uint64_t Apply(uint64_t seed) { return seed; }
+		};
+
+		template<typename T, typename... Rest>
+		struct HashChain<T, Rest...>
+		{
+			static constexpr uint64_t Apply(uint64_t seed) { return HashChain<Rest...>::Apply(T::Hash(seed)); }
+		};
+	}
+
+	// Descriptor ranges, used in a Table
+	template<D3D12_DESCRIPTOR_RANGE_TYPE RangeType, uint32_t NumDescriptors, uint32_t BaseRegister, uint32_t Space,
+		D3D12_DESCRIPTOR_RANGE_FLAGS Flags, uint32_t Offset>
+	struct DescriptorRange
+	{
+		static_assert(NumDescriptors > 0, "Descriptor range must contain at least one descriptor (use UINT_MAX for unbounded)");
+
+		static const bool IsSampler = RangeType == D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
+
+		static constexpr D3D12_DESCRIPTOR_RANGE1 Get()
+		{
+			return { RangeType, NumDescriptors, BaseRegister, Space, Flags, Offset };
+		}
+
+		static constexpr uint64_t Hash(uint64_t seed)
+		{
+			return HashUInt32(Offset, HashUInt32(Flags, HashUInt32(Space, HashUInt32(BaseRegister,
+				HashUInt32(NumDescriptors, HashUInt32(RangeType, seed))))));
+		}
+	};
+
+	template<uint32_t NumDescriptors, uint32_t BaseRegister, uint32_t Space = 0,
+		D3D12_DESCRIPTOR_RANGE_FLAGS Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE, uint32_t Offset = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND>
+	using SRVRange = DescriptorRange<D3D12_DESCRIPTOR_RANGE_TYPE_SRV, NumDescriptors, BaseRegister, Space, Flags, Offset>;
+
+	template<uint32_t NumDescriptors, uint32_t BaseRegister, uint32_t Space = 0,
+		D3D12_DESCRIPTOR_RANGE_FLAGS Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE, uint32_t Offset = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND>
+	using UAVRange = DescriptorRange<D3D12_DESCRIPTOR_RANGE_TYPE_UAV, NumDescriptors, BaseRegister, Space, Flags, Offset>;
+
+	template<uint32_t NumDescriptors, uint32_t BaseRegister, uint32_t Space = 0,
+		D3D12_DESCRIPTOR_RANGE_FLAGS Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE, uint32_t Offset = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND>
+	using CBVRange = DescriptorRange<D3D12_DESCRIPTOR_RANGE_TYPE_CBV, NumDescriptors, BaseRegister, Space, Flags, Offset>;
+
+	template<uint32_t NumDescriptors, uint32_t BaseRegister, uint32_t Space = 0,
+		D3D12_DESCRIPTOR_RANGE_FLAGS Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE, uint32_t Offset = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND>
+	using SamplerRange = DescriptorRange<D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, NumDescriptors, BaseRegister, Space, Flags, Offset>;
+
+	// Root parameters
+	// Each has a Cost, a Hash, a Fill that writes its D3D12_ROOT_PARAMETER1, and a Binding<Index> which is
+	// what RootSignature::Slot<Index> resolves to.
+
+	// 32-bit constants written straight into the root signature, costs one DWORD each
+	template<uint32_t Num32BitValues, uint32_t Register, uint32_t Space = 0,
+		D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL>
+	struct Constants
+	{
+		static_assert(Num32BitValues > 0, "Root constants must contain at least one value");
+
+		static const uint32_t Cost = Num32BitValues;
+
+		static void Fill(D3D12_ROOT_PARAMETER1& parameter)
+		{
+			parameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+			parameter.Constants.ShaderRegister = Register;
+			parameter.Constants.RegisterSpace = Space;
+			parameter.Constants.Num32BitValues = Num32BitValues;
+			parameter.ShaderVisibility = Visibility;
+		}
+
+		static constexpr uint64_t Hash(uint64_t seed)
+		{
+			return HashUInt32(Num32BitValues, HashUInt32(Space, HashUInt32(Register,
+				HashUInt32(Visibility, HashUInt32(D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, seed)))));
+		}
+
+		template<uint32_t Index>
+		struct Binding
+		{
+			// T is any struct made of 32-bit values, e.g. a matrix or a small constant block
+			template<typename T>
+			static void SetGraphics(ID3D12GraphicsCommandList* commandList, const T& values, uint32_t destOffset = 0)
+			{
+				static_assert(sizeof(T) % 4 == 0, "Root constants must be a whole number of 32-bit values");
+				assert(destOffset + sizeof(T) / 4 <= Num32BitValues && "Too many values for root constants");
+				commandList->SetGraphicsRoot32BitConstants(Index, sizeof(T) / 4, &values, destOffset);
+			}
+
+			template<typename T>
+			static void SetCompute(ID3D12GraphicsCommandList* commandList, const T& values, uint32_t destOffset = 0)
+			{
+				static_assert(sizeof(T) % 4 == 0, "Root constants must be a whole number of 32-bit values");
+				assert(destOffset + sizeof(T) / 4 <= Num32BitValues && "Too many values for root constants");
+				commandList->SetComputeRoot32BitConstants(Index, sizeof(T) / 4, &values, destOffset);
+			}
+		};
+	};
+
+	// Root descriptors (CBV/SRV/UAV), a GPU virtual address in the root signature, costs two DWORDs
+	template<D3D12_ROOT_PARAMETER_TYPE Type, uint32_t Register, uint32_t Space, D3D12_SHADER_VISIBILITY Visibility,
+		D3D12_ROOT_DESCRIPTOR_FLAGS Flags>
+	struct RootDescriptor
+	{
+		static const uint32_t Cost = RootDescriptorCost;
+
+		static void Fill(D3D12_ROOT_PARAMETER1& parameter)
+		{
+			parameter.ParameterType = Type;
+			parameter.Descriptor.ShaderRegister = Register;
+			parameter.Descriptor.RegisterSpace = Space;
+			parameter.Descriptor.Flags = Flags;
+			parameter.ShaderVisibility = Visibility;
+		}
+
+		static constexpr uint64_t Hash(uint64_t seed)
+		{
+			return HashUInt32(Flags, HashUInt32(Space, HashUInt32(Register,
+				HashUInt32(Visibility, HashUInt32(Type, seed)))));
+		}
+
+		template<uint32_t Index>
+		struct Binding
+		{
+			static void SetGraphics(ID3D12GraphicsCommandList* commandList, D3D12_GPU_VIRTUAL_ADDRESS address)
+			{
+				switch (Type)
+				{
+				case D3D12_ROOT_PARAMETER_TYPE_CBV: commandList->SetGraphicsRootConstantBufferView(Index, address); break;
+				case D3D12_ROOT_PARAMETER_TYPE_SRV: commandList->SetGraphicsRootShaderResourceView(Index, address); break;
+				case D3D12_ROOT_PARAMETER_TYPE_UAV: commandList->SetGraphicsRootUnorderedAccessView(Index, address); break;
+				}
+			}
+
+			static void SetCompute(ID3D12GraphicsCommandList* commandList, D3D12_GPU_VIRTUAL_ADDRESS address)
+			{
+				switch (Type)
+				{
+				case D3D12_ROOT_PARAMETER_TYPE_CBV: commandList->SetComputeRootConstantBufferView(Index, address); break;
+				case D3D12_ROOT_PARAMETER_TYPE_SRV: commandList->SetComputeRootShaderResourceView(Index, address); break;
+				case D3D12_ROOT_PARAMETER_TYPE_UAV: commandList->SetComputeRootUnorderedAccessView(Index, address); break;
+				}
+			}
+		};
+	};
+
+	template<uint32_t Register, uint32_t Space = 0, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL,
+		D3D12_ROOT_DESCRIPTOR_FLAGS Flags = D3D12_ROOT_DESCRIPTOR_FLAG_NONE>
+	using CBV = RootDescriptor<D3D12_ROOT_PARAMETER_TYPE_CBV, Register, Space, Visibility, Flags>;
+
+	template<uint32_t Register, uint32_t Space = 0, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL,
+		D3D12_ROOT_DESCRIPTOR_FLAGS Flags = D3D12_ROOT_DESCRIPTOR_FLAG_NONE>
+	using SRV = RootDescriptor<D3D12_ROOT_PARAMETER_TYPE_SRV, Register, Space, Visibility, Flags>;
+
+	template<uint32_t Register, uint32_t Space = 0, D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL,
+		D3D12_ROOT_DESCRIPTOR_FLAGS Flags = D3D12_ROOT_DESCRIPTOR_FLAG_NONE>
+	using UAV = RootDescriptor<D3D12_ROOT_PARAMETER_TYPE_UAV, Register, Space, Visibility, Flags>;
+
+	// Descriptor table, a handle to a run of descriptors in a shader visible heap, costs one DWORD
+	template<D3D12_SHADER_VISIBILITY Visibility, typename... Ranges>
+	struct Table
+	{
+		static_assert(sizeof...(Ranges) > 0, "Descriptor table must contain at least one range");
+		static_assert(Detail::All(Ranges::IsSampler...) || Detail::All(!Ranges::IsSampler...),
+			"Descriptor table cannot mix sampler ranges with CBV/SRV/UAV ranges");
+
+		static const uint32_t Cost = TableCost;
+		static const uint32_t NumRanges = sizeof...(Ranges);
+
+		static const D3D12_DESCRIPTOR_RANGE1* GetRanges()
+		{
+			static const D3D12_DESCRIPTOR_RANGE1 ranges[] = { Ranges::Get()... };
+			return ranges;
+		}
+
+		static void Fill(D3D12_ROOT_PARAMETER1& parameter)
+		{
+			parameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+			parameter.DescriptorTable.NumDescriptorRanges = NumRanges;
+			parameter.DescriptorTable.pDescriptorRanges = GetRanges();
+			parameter.ShaderVisibility = Visibility;
+		}
+
+		static constexpr uint64_t Hash(uint64_t seed)
+		{
+			return Detail::HashChain<Ranges...>::Apply(HashUInt32(NumRanges,
+				HashUInt32(Visibility, HashUInt32(D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, seed))));
+		}
+
+		template<uint32_t Index>
+		struct Binding
+		{
+			static void SetGraphics(ID3D12GraphicsCommandList* commandList, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+			{
+				commandList->SetGraphicsRootDescriptorTable(Index, baseDescriptor);
+			}
+
+			static void SetCompute(ID3D12GraphicsCommandList* commandList, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+			{
+				commandList->SetComputeRootDescriptorTable(Index, baseDescriptor);
+			}
+		};
+	};
+
+	// Static samplers are baked into the root signature and cost nothing.
+	// LOD bias and clamps are fixed to the CD3DX12_STATIC_SAMPLER_DESC defaults, since floats cannot be template arguments.
+	template<uint32_t Register, D3D12_FILTER Filter = D3D12_FILTER_ANISOTROPIC,
+		D3D12_TEXTURE_ADDRESS_MODE AddressMode = D3D12_TEXTURE_ADDRESS_MODE_WRAP,
+		D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL, uint32_t Space = 0,
+		uint32_t MaxAnisotropy = 16, D3D12_COMPARISON_FUNC ComparisonFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL,
+		D3D12_STATIC_BORDER_COLOR BorderColor = D3D12_STATIC_BORDER_COLOR_OPAQUE_WHITE>
+	struct StaticSampler
+	{
+		static const bool IsStaticSampler = true;
+
+		static constexpr D3D12_STATIC_SAMPLER_DESC Get()
+		{
+			return { Filter, AddressMode, AddressMode, AddressMode, 0.0f, MaxAnisotropy, ComparisonFunc, BorderColor,
+				0.0f, D3D12_FLOAT32_MAX, Register, Space, Visibility };
+		}
+
+		// Same field order as the D3D12_STATIC_SAMPLER_DESC, floats hashed by their bits
+		static constexpr uint64_t Hash(uint64_t seed)
+		{
+			return HashUInt32(Visibility, HashUInt32(Space, HashUInt32(Register,
+				HashUInt32(Float32MaxBits, HashUInt32(Float32ZeroBits, HashUInt32(BorderColor,
+				HashUInt32(ComparisonFunc, HashUInt32(MaxAnisotropy, HashUInt32(Float32ZeroBits,
+				HashUInt32(AddressMode, HashUInt32(AddressMode, HashUInt32(AddressMode, HashUInt32(Filter, seed)))))))))))));
+		}
+	};
+
+	template<typename T, typename = void>
+	struct IsStaticSampler : std::false_type {};
+	template<typename T>
+	struct IsStaticSampler<T, typename std::enable_if<T::IsStaticSampler>::type> : std::true_type {};
+
+	namespace Detail
+	{
+		// Splits a RootSignature's argument list into root parameters and static samplers, keeping their order
+		template<typename Parameters, typename Samplers, typename... Ts>
+		struct Split
+		{
+			using ParameterList = Parameters;
+			using SamplerList = Samplers;
+		};
+
+		template<typename... Ps, typename... Ss, typename T, typename... Rest>
+		struct Split<std::tuple<Ps...>, std::tuple<Ss...>, T, Rest...>
+			: std::conditional<IsStaticSampler<T>::value,
+				Split<std::tuple<Ps...>, std::tuple<Ss..., T>, Rest...>,
+				Split<std::tuple<Ps..., T>, std::tuple<Ss...>, Rest...>>::type
+		{};
+
+		template<typename Parameters, typename Samplers>
+		struct Layout;
+
+		template<typename... Parameters, typename... Samplers>
+		struct Layout<std::tuple<Parameters...>, std::tuple<Samplers...>>
+		{
+			static const uint32_t NumParameters = sizeof...(Parameters);
+			static const uint32_t NumStaticSamplers = sizeof...(Samplers);
+			static const uint32_t Cost = Sum(Parameters::Cost...);
+
+			static constexpr uint64_t Hash(D3D12_ROOT_SIGNATURE_FLAGS flags)
+			{
+				return HashUInt32(flags,
+					HashChain<Samplers...>::Apply(HashUInt32(NumStaticSamplers,
+					HashChain<Parameters...>::Apply(HashUInt32(NumParameters,
+					HashUInt32(D3D_ROOT_SIGNATURE_VERSION_1_1, g_HashSeed))))));
+			}
+
+			static void FillParameters(D3D12_ROOT_PARAMETER1* parameters)
+			{
+				// Expands to one Fill per parameter, in order
+				int unused[] = { 0, (Parameters::Fill(*parameters++), 0)... };
+				(void)unused;
+			}
+
+			static void FillStaticSamplers(D3D12_STATIC_SAMPLER_DESC* samplers)
+			{
+				int unused[] = { 0, (*samplers++ = Samplers::Get(), 0)... };
+				(void)unused;
+			}
+		};
+	}
+
+	// A root signature made of root parameters (Constants, CBV, SRV, UAV, Table) and StaticSamplers,
+	// in any order. Root parameter indices count root parameters only, in the order given.
+	template<D3D12_ROOT_SIGNATURE_FLAGS Flags, typename... Ts>
+	struct RootSignature
+	{
+	private:
+		using Split = Detail::Split<std::tuple<>, std::tuple<>, Ts...>;
+		using Layout = Detail::Layout<typename Split::ParameterList, typename Split::SamplerList>;
+
+	public:
+		static const uint32_t NumParameters = Layout::NumParameters;
+		static const uint32_t NumStaticSamplers = Layout::NumStaticSamplers;
+		static const uint32_t Cost = Layout::Cost;
+		static_assert(Cost <= MaxCost, "Root signature exceeds the 64 DWORD limit. Move root constants or root "
+			"descriptors into a descriptor table.");
+
+		// Hash of every field of GetDesc(), computed at compile time. Equal to HashRootSignatureDesc(GetDesc()).
+		static constexpr uint64_t Hash = Layout::Hash(Flags);
+
+		// Typed binding for root parameter Index
+		template<uint32_t Index>
+		using Slot = typename std::tuple_element<Index, typename Split::ParameterList>::type::template Binding<Index>;
+
+		static const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& GetDesc()
+		{
+			// Function local statics are initialised once, and thread safely
+			static const Storage storage;
+			return storage.Desc;
+		}
+
+	private:
+		struct Storage
+		{
+			// Zero sized arrays are not allowed, so always keep at least one element
+			D3D12_ROOT_PARAMETER1 Parameters[NumParameters > 0 ? NumParameters : 1] = {};
+			D3D12_STATIC_SAMPLER_DESC StaticSamplers[NumStaticSamplers > 0 ? NumStaticSamplers : 1] = {};
+			D3D12_VERSIONED_ROOT_SIGNATURE_DESC Desc = {};
+
+			Storage()
+			{
+				Layout::FillParameters(Parameters);
+				Layout::FillStaticSamplers(StaticSamplers);
+
+				Desc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+				Desc.Desc_1_1.NumParameters = NumParameters;
+				Desc.Desc_1_1.pParameters = NumParameters > 0 ? Parameters : nullptr;
+				Desc.Desc_1_1.NumStaticSamplers = NumStaticSamplers;
+				Desc.Desc_1_1.pStaticSamplers = NumStaticSamplers > 0 ? StaticSamplers : nullptr;
+				Desc.Desc_1_1.Flags = Flags;
+			}
+		};
+	};
+
+	template<D3D12_ROOT_SIGNATURE_FLAGS Flags, typename... Ts>
+	constexpr uint64_t RootSignature<Flags, Ts...>::Hash;
+}
@@ -0,0 +1,436 @@
+#pragma once
+
+#include <wrl.h>
+#include <d3d12.h>
+#include "d3dx12.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Helpers.h"
+#include "JobSystem.h"
+#include "MappedFile.h"
+
+// Runtime hash of a versioned root signature desc.
+// Fields are hashed in declaration order with HashUInt32, which is exactly what RootSig::RootSignature::Hash
+// computes at compile time, so a desc built by the RootSignatureBuilder hashes to its constant Hash.
+inline uint64_t HashRootSignatureDesc(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc)
+{
+	auto hashFloat = [](float value, uint64_t seed)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return HashUInt32(bits, seed);
+	};
+
+	const bool isVersion1_1 = desc.Version == D3D_ROOT_SIGNATURE_VERSION_1_1;
+	uint64_t hash = HashUInt32(desc.Version);
+
+	// 1.0 and 1.1 descs only differ by the flags on ranges and root descriptors, so read the
+	// common fields through whichever is in use
+	const UINT numParameters = isVersion1_1 ? desc.Desc_1_1.NumParameters : desc.Desc_1_0.NumParameters;
+	hash = HashUInt32(numParameters, hash);
+	for (UINT i = 0; i < numParameters; i++)
+	{
+		const D3D12_ROOT_PARAMETER_TYPE type = isVersion1_1 ?
+			desc.Desc_1_1.pParameters[i].ParameterType : desc.Desc_1_0.pParameters[i].ParameterType;
+		const D3D12_SHADER_VISIBILITY visibility = isVersion1_1 ?
+			desc.Desc_1_1.pParameters[i].ShaderVisibility : desc.Desc_1_0.pParameters[i].ShaderVisibility;
+		hash = HashUInt32(visibility, HashUInt32(type, hash));
+
+		switch (type)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+		{
+			const D3D12_ROOT_CONSTANTS& constants = isVersion1_1 ?
+				desc.Desc_1_1.pParameters[i].Constants : desc.Desc_1_0.pParameters[i].Constants;
+			hash = HashUInt32(constants.ShaderRegister, hash);
+			hash = HashUInt32(constants.RegisterSpace, hash);
+			hash = HashUInt32(constants.Num32BitValues, hash);
+			break;
+		}
+		case D3D12_ROOT_PARAMETER_TYPE_CBV:
+		case D3D12_ROOT_PARAMETER_TYPE_SRV:
+		case D3D12_ROOT_PARAMETER_TYPE_UAV:
+			if (isVersion1_1)
+			{
+				const D3D12_ROOT_DESCRIPTOR1& descriptor = desc.Desc_1_1.pParameters[i].Descriptor;
+				hash = HashUInt32(descriptor.ShaderRegister, hash);
+				hash = HashUInt32(descriptor.RegisterSpace, hash);
+				hash = HashUInt32(descriptor.Flags, hash);
+			}
+			else
+			{
+				const D3D12_ROOT_DESCRIPTOR& descriptor = desc.Desc_1_0.pParameters[i].Descriptor;
+				hash = HashUInt32(descriptor.ShaderRegister, hash);
+				hash = HashUInt32(descriptor.RegisterSpace, hash);
+			}
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+			if (isVersion1_1)
+			{
+				const D3D12_ROOT_DESCRIPTOR_TABLE1& table = desc.Desc_1_1.pParameters[i].DescriptorTable;
+				hash = HashUInt32(table.NumDescriptorRanges, hash);
+				for (UINT r = 0; r < table.NumDescriptorRanges; r++)
+				{
+					const D3D12_DESCRIPTOR_RANGE1& range = table.pDescriptorRanges[r];
+					hash = HashUInt32(range.RangeType, hash);
+					hash = HashUInt32(range.NumDescriptors, hash);
+					hash = HashUInt32(range.BaseShaderRegister, hash);
+					hash = HashUInt32(range.RegisterSpace, hash);
+					hash = HashUInt32(range.Flags, hash);
+					hash = HashUInt32(range.OffsetInDescriptorsFromTableStart, hash);
+				}
+			}
+			else
+			{
+				const D3D12_ROOT_DESCRIPTOR_TABLE& table = desc.Desc_1_0.pParameters[i].DescriptorTable;
+				hash = HashUInt32(table.NumDescriptorRanges, hash);
+				for (UINT r = 0; r < table.NumDescriptorRanges; r++)
+				{
+					const D3D12_DESCRIPTOR_RANGE& range = table.pDescriptorRanges[r];
+					hash = HashUInt32(range.RangeType, hash);
+					hash = HashUInt32(range.NumDescriptors, hash);
+					hash = HashUInt32(range.BaseShaderRegister, hash);
+					hash = HashUInt32(range.RegisterSpace, hash);
+					hash = HashUInt32(range.OffsetInDescriptorsFromTableStart, hash);
+				}
+			}
+			break;
+		}
+	}
+
+	const UINT numStaticSamplers = isVersion1_1 ? desc.Desc_1_1.NumStaticSamplers : desc.Desc_1_0.NumStaticSamplers;
+	const D3D12_STATIC_SAMPLER_DESC* staticSamplers = isVersion1_1 ? desc.Desc_1_1.pStaticSamplers : desc.Desc_1_0.pStaticSamplers;
+	hash = HashUInt32(numStaticSamplers, hash);
+	for (UINT i = 0; i < numStaticSamplers; i++)
+	{
+		const D3D12_STATIC_SAMPLER_DESC& sampler = staticSamplers[i];
+		hash = HashUInt32(sampler.Filter, hash);
+		hash = HashUInt32(sampler.AddressU, hash);
+		hash = HashUInt32(sampler.AddressV, hash);
+		hash = HashUInt32(sampler.AddressW, hash);
+		hash = hashFloat(sampler.MipLODBias, hash);
+		hash = HashUInt32(sampler.MaxAnisotropy, hash);
+		hash = HashUInt32(sampler.ComparisonFunc, hash);
+		hash = HashUInt32(sampler.BorderColor, hash);
+		hash = hashFloat(sampler.MinLOD, hash);
+		hash = hashFloat(sampler.MaxLOD, hash);
+		hash = HashUInt32(sampler.ShaderRegister, hash);
+		hash = HashUInt32(sampler.RegisterSpace, hash);
+		hash = HashUInt32(sampler.ShaderVisibility, hash);
+	}
+
+	const D3D12_ROOT_SIGNATURE_FLAGS flags = isVersion1_1 ? desc.Desc_1_1.Flags : desc.Desc_1_0.Flags;
+	return HashUInt32(flags, hash);
+}
+
+// Caches root signatures by the hash of their versioned desc.
+// Serializing a root signature (and on devices which only support 1.0, converting a 1.1 desc first)
+// costs the same every time, so each desc is serialized once and the blob is kept along with the created
+// ID3D12RootSignature. Blobs are saved to a file on Shutdown and memory mapped on the next Initialize,
+// so later runs only pay for CreateRootSignature. Prewarm creates a known set of root signatures as jobs
+// on the job system while the rest of startup carries on.
+// GetRootSignature may be called from several threads at once.
+class RootSignatureCache
+{
+public:
+	RootSignatureCache() = default;
+	~RootSignatureCache() { WaitForPrewarmJobs(); }
+
+	RootSignatureCache(const RootSignatureCache&) = delete;
+	RootSignatureCache& operator=(const RootSignatureCache&) = delete;
+
+	// maxVersion is the highest root signature version the device supports, from its DeviceCapabilities
+	void Initialize(Microsoft::WRL::ComPtr<ID3D12Device2> device, const std::wstring& cachePath,
+		D3D_ROOT_SIGNATURE_VERSION maxVersion)
+	{
+		m_Device = device;
+		m_CachePath = cachePath;
+		m_MaxVersion = maxVersion;
+
+		LoadBlobs();
+	}
+
+	// Returns the root signature for desc, serializing and creating it on a miss
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> GetRootSignature(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc)
+	{
+		return GetRootSignature(desc, HashRootSignatureDesc(desc));
+	}
+
+	// For root signatures declared with the RootSignatureBuilder, whose hash is known at compile time
+	template<typename RootSignatureType>
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> GetRootSignature()
+	{
+		return GetRootSignature(RootSignatureType::GetDesc(), RootSignatureType::Hash);
+	}
+
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> GetRootSignature(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc,
+		uint64_t descHash)
+	{
+		const uint64_t key = Key(descHash);
+
+		const void* blobData = nullptr;
+		size_t blobSize = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Entries.find(key);
+			if (it != m_Entries.end())
+			{
+				if (it->second.RootSignature)
+				{
+					return it->second.RootSignature;
+				}
+				// Blob loaded from disk, root signature not created yet this run
+				blobData = it->second.BlobData;
+				blobSize = it->second.BlobSize;
+			}
+		}
+
+		// Serializing and creating happen outside the lock, so Prewarm jobs run in parallel
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
+		bool isBlobCorrupt = false;
+		if (blobData != nullptr &&
+			FAILED(m_Device->CreateRootSignature(0, blobData, blobSize, IID_PPV_ARGS(&rootSignature))))
+		{
+			// The blob on disk is damaged (or the file was edited), drop it and serialize the desc again
+			isBlobCorrupt = true;
+			blobData = nullptr;
+			blobSize = 0;
+		}
+
+		Microsoft::WRL::ComPtr<ID3DBlob> blob;
+		if (blobData == nullptr)
+		{
+			Microsoft::WRL::ComPtr<ID3DBlob> errorBlob;
+			HRESULT hr = D3DX12SerializeVersionedRootSignature(&desc, m_MaxVersion, &blob, &errorBlob);
+			if (FAILED(hr) && errorBlob)
+			{
+				OutputDebugStringA(static_cast<const char*>(errorBlob->GetBufferPointer()));
+			}
+			ThrowIfFailed(hr);
+			blobData = blob->GetBufferPointer();
+			blobSize = blob->GetBufferSize();
+
+			ThrowIfFailed(m_Device->CreateRootSignature(0, blobData, blobSize, IID_PPV_ARGS(&rootSignature)));
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Entry& entry = m_Entries[key];
+		// Another thread may have got here first, in which case keep its root signature
+		if (!entry.RootSignature)
+		{
+			entry.RootSignature = rootSignature;
+		}
+		if (entry.BlobData == nullptr || (isBlobCorrupt && !entry.Blob))
+		{
+			entry.Blob = blob;
+			entry.BlobData = blobData;
+			entry.BlobSize = blobSize;
+			m_IsDirty = true;
+		}
+		return entry.RootSignature;
+	}
+
+	// Creates each root signature as a job on jobSystem and returns immediately.
+	// descs, and jobSystem, must stay alive until WaitForPrewarm returns.
+	void Prewarm(JobSystem& jobSystem, const std::vector<const D3D12_VERSIONED_ROOT_SIGNATURE_DESC*>& descs)
+	{
+		WaitForPrewarm();
+
+		m_PrewarmJobSystem = &jobSystem;
+		m_PrewarmError = nullptr;
+		for (const D3D12_VERSIONED_ROOT_SIGNATURE_DESC* desc : descs)
+		{
+			jobSystem.Run([this, desc]()
+			{
+				// An exception leaving a job would terminate, so keep the first and let the other jobs carry on
+				try
+				{
+					GetRootSignature(*desc);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					if (!m_PrewarmError)
+					{
+						m_PrewarmError = std::current_exception();
+					}
+				}
+			}, &m_PrewarmJobs);
+		}
+	}
+
+	// Waits for Prewarm to finish, then rethrows the first error it had, if any. Serialization errors have been
+	// written to the debug output.
+	void WaitForPrewarm()
+	{
+		WaitForPrewarmJobs();
+		if (m_PrewarmError)
+		{
+			std::exception_ptr error = m_PrewarmError;
+			m_PrewarmError = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+
+	// Saves any newly serialized blobs, then releases everything. Errors of a Prewarm not yet waited for are
+	// dropped; the root signatures which failed were never cached.
+	void Shutdown()
+	{
+		WaitForPrewarmJobs();
+		m_PrewarmError = nullptr;
+
+		if (m_IsDirty)
+		{
+			// Copy everything out before the mapping the loaded blobs point into is closed
+			std::vector<uint8_t> file = SerializeBlobs();
+			m_Entries.clear();
+			m_CacheFile.Close();
+			WriteWholeFile(m_CachePath.c_str(), file.data(), file.size());
+		}
+
+		m_Entries.clear();
+		m_CacheFile.Close();
+		m_Device.Reset();
+		m_IsDirty = false;
+	}
+
+private:
+	// File layout: FileHeader, then per blob an EntryHeader followed by the blob padded to 8 bytes
+	static const uint32_t FileMagic = 0x31435352; // "RSC1"
+
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t NumEntries;
+	};
+
+	struct EntryHeader
+	{
+		uint64_t Key;
+		uint64_t BlobSize;
+	};
+
+	struct Entry
+	{
+		// Set for blobs serialized this run. Blobs loaded from disk point into m_CacheFile instead.
+		Microsoft::WRL::ComPtr<ID3DBlob> Blob;
+		const void* BlobData = nullptr;
+		size_t BlobSize = 0;
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> RootSignature;
+	};
+
+	static size_t AlignUp8(size_t size) { return (size + 7) & ~size_t(7); }
+
+	// Runs prewarm jobs on the calling thread while it waits
+	void WaitForPrewarmJobs()
+	{
+		if (m_PrewarmJobSystem)
+		{
+			m_PrewarmJobSystem->Wait(m_PrewarmJobs);
+			m_PrewarmJobSystem = nullptr;
+		}
+	}
+
+	// The serialized blob depends on the version it was serialized for, so include it in the key
+	uint64_t Key(uint64_t descHash) const
+	{
+		return HashUInt32(m_MaxVersion, descHash);
+	}
+
+	void LoadBlobs()
+	{
+		if (!m_CacheFile.Open(m_CachePath.c_str()))
+		{
+			return;
+		}
+
+		const uint8_t* data = static_cast<const uint8_t*>(m_CacheFile.Data());
+		const uint64_t size = m_CacheFile.Size();
+
+		FileHeader header;
+		if (size < sizeof(header))
+		{
+			return;
+		}
+		memcpy(&header, data, sizeof(header));
+		if (header.Magic != FileMagic)
+		{
+			return;
+		}
+
+		// Entries are validated against the size of the file, a truncated file keeps whatever came before the cut
+		uint64_t offset = sizeof(header);
+		for (uint32_t i = 0; i < header.NumEntries; i++)
+		{
+			EntryHeader entryHeader;
+			if (size - offset < sizeof(entryHeader))
+			{
+				break;
+			}
+			memcpy(&entryHeader, data + offset, sizeof(entryHeader));
+			offset += sizeof(entryHeader);
+
+			if (size - offset < entryHeader.BlobSize)
+			{
+				break;
+			}
+
+			Entry& entry = m_Entries[entryHeader.Key];
+			entry.BlobData = data + offset;
+			entry.BlobSize = static_cast<size_t>(entryHeader.BlobSize);
+
+			offset += AlignUp8(static_cast<size_t>(entryHeader.BlobSize));
+			// The last blob's padding was cut off, so there is nothing more to read
+			if (offset > size)
+			{
+				break;
+			}
+		}
+	}
+
+	std::vector<uint8_t> SerializeBlobs()
+	{
+		std::vector<uint8_t> file(sizeof(FileHeader));
+
+		FileHeader header = { FileMagic, 0 };
+		for (auto& pair : m_Entries)
+		{
+			if (pair.second.BlobData == nullptr)
+			{
+				continue;
+			}
+
+			EntryHeader entryHeader = { pair.first, pair.second.BlobSize };
+			size_t offset = file.size();
+			file.resize(offset + sizeof(entryHeader) + AlignUp8(pair.second.BlobSize));
+			memcpy(file.data() + offset, &entryHeader, sizeof(entryHeader));
+			memcpy(file.data() + offset + sizeof(entryHeader), pair.second.BlobData, pair.second.BlobSize);
+			header.NumEntries++;
+		}
+
+		memcpy(file.data(), &header, sizeof(header));
+		return file;
+	}
+
+	Microsoft::WRL::ComPtr<ID3D12Device2> m_Device;
+	D3D_ROOT_SIGNATURE_VERSION m_MaxVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+	std::wstring m_CachePath;
+	MappedFile m_CacheFile;
+	bool m_IsDirty = false;
+
+	std::mutex m_Mutex;
+	std::unordered_map<uint64_t, Entry> m_Entries;
+
+	JobSystem* m_PrewarmJobSystem = nullptr;
+	JobCounter m_PrewarmJobs;
+	// First exception thrown by a prewarm job, guarded by m_Mutex while they run
+	std::exception_ptr m_PrewarmError;
+};
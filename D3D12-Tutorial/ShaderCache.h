@@ -0,0 +1,398 @@
+#pragma once
+
+#include <wrl.h>
+#include <d3d12.h>
+#include <d3dcompiler.h>
+#include "d3dx12.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Helpers.h"
+#include "JobSystem.h"
+#include "MappedFile.h"
+
+#pragma comment(lib, "d3dcompiler.lib")
+
+// Everything that determines the bytecode a shader compiles to.
+// Includes are passed in by name rather than read from disk by the compiler, so that their content
+// is part of the hash and editing an included file invalidates every shader which uses it.
+struct ShaderDesc
+{
+	std::string Source;
+	// Name used in compiler errors
+	std::string SourceName;
+	std::string EntryPoint = "main";
+	// e.g. "vs_5_1", "ps_5_1"
+	std::string Target;
+	// Preprocessor defines as (name, value) pairs
+	std::vector<std::pair<std::string, std::string>> Defines;
+	// #include "name" resolves to the matching (name, content) pair
+	std::vector<std::pair<std::string, std::string>> Includes;
+	// D3DCOMPILE_* flags
+	UINT Flags = 0;
+};
+
+// Content hash of a ShaderDesc, the key into the ShaderCache.
+// Each string is hashed with its terminator, so adjacent strings cannot run into each other.
+inline uint64_t HashShaderDesc(const ShaderDesc& desc)
+{
+	uint64_t hash = HashString(desc.Source.c_str());
+	hash = HashString(desc.EntryPoint.c_str(), hash);
+	hash = HashString(desc.Target.c_str(), hash);
+	hash = HashValue(desc.Flags, hash);
+
+	hash = HashValue(static_cast<uint32_t>(desc.Defines.size()), hash);
+	for (const auto& define : desc.Defines)
+	{
+		hash = HashString(define.first.c_str(), hash);
+		hash = HashString(define.second.c_str(), hash);
+	}
+
+	hash = HashValue(static_cast<uint32_t>(desc.Includes.size()), hash);
+	for (const auto& include : desc.Includes)
+	{
+		hash = HashString(include.first.c_str(), hash);
+		hash = HashString(include.second.c_str(), hash);
+	}
+
+	return hash;
+}
+
+// Serves #includes from ShaderDesc::Includes
+class ShaderIncludeHandler : public ID3DInclude
+{
+public:
+	explicit ShaderIncludeHandler(const ShaderDesc& desc) : m_Desc(desc) {}
+
+	HRESULT __stdcall Open(D3D_INCLUDE_TYPE, LPCSTR fileName, LPCVOID, LPCVOID* data, UINT* bytes) override
+	{
+		for (const auto& include : m_Desc.Includes)
+		{
+			if (include.first == fileName)
+			{
+				*data = include.second.data();
+				*bytes = static_cast<UINT>(include.second.size());
+				return S_OK;
+			}
+		}
+		return E_FAIL;
+	}
+
+	// Data is owned by the ShaderDesc, nothing to free
+	HRESULT __stdcall Close(LPCVOID) override { return S_OK; }
+
+private:
+	const ShaderDesc& m_Desc;
+};
+
+// Compiles desc with D3DCompile. Compiler errors are written to the debug output before throwing.
+inline Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(const ShaderDesc& desc)
+{
+	// D3D_SHADER_MACRO arrays are terminated by a null entry
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (const auto& define : desc.Defines)
+	{
+		macros.push_back({ define.first.c_str(), define.second.c_str() });
+	}
+	macros.push_back({ nullptr, nullptr });
+
+	ShaderIncludeHandler includeHandler(desc);
+	Microsoft::WRL::ComPtr<ID3DBlob> bytecode;
+	Microsoft::WRL::ComPtr<ID3DBlob> errors;
+	HRESULT hr = D3DCompile(desc.Source.data(), desc.Source.size(), desc.SourceName.c_str(), macros.data(),
+		&includeHandler, desc.EntryPoint.c_str(), desc.Target.c_str(), desc.Flags, 0, &bytecode, &errors);
+	if (errors)
+	{
+		OutputDebugStringA(static_cast<const char*>(errors->GetBufferPointer()));
+	}
+	ThrowIfFailed(hr);
+
+	return bytecode;
+}
+
+// Content addressed cache of compiled shader bytecode, keyed by HashShaderDesc.
+//
+// All bytecode from previous runs lives in one file which is memory mapped on Initialize. Hits return a
+// CD3DX12_SHADER_BYTECODE pointing straight into the mapping, so nothing is read or copied until the
+// driver consumes it, and pages of shaders that are never used are never touched.
+// Misses are compiled (in parallel with CompileAll) and kept in memory for the rest of the run.
+//
+// Returned bytecode stays valid until Shutdown, so nothing can be evicted while running. Instead, if shaders
+// were added, Shutdown rewrites the file with the most recently used shaders first, dropping least recently
+// used ones once the file would exceed its size budget. Use is tracked with a tick that persists across runs,
+// so shaders not needed for several sessions age out. Runs which only hit the cache just update the tick and
+// the last use of each shader in the file's index, in place.
+class ShaderCache
+{
+public:
+	void Initialize(const std::wstring& cachePath, uint64_t maxFileSize = 256ull * 1024 * 1024)
+	{
+		m_CachePath = cachePath;
+		m_MaxFileSize = maxFileSize;
+		LoadIndex();
+	}
+
+	// Returns the bytecode for desc, compiling it on this thread on a miss
+	CD3DX12_SHADER_BYTECODE GetShader(const ShaderDesc& desc)
+	{
+		const uint64_t key = HashShaderDesc(desc);
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Entries.find(key);
+			if (it != m_Entries.end())
+			{
+				it->second.LastUsed = ++m_Tick;
+				return CD3DX12_SHADER_BYTECODE(it->second.Data, it->second.Size);
+			}
+		}
+
+		return AddCompiled(key, CompileShader(desc));
+	}
+
+	// Compiles every desc that is not in the cache as jobs on jobSystem, and waits for them.
+	// Call with every permutation known up front (e.g. at load time), then GetShader always hits.
+	void CompileAll(JobSystem& jobSystem, const std::vector<const ShaderDesc*>& descs)
+	{
+		// Find the misses first so jobs are only started for real work
+		std::vector<std::pair<uint64_t, const ShaderDesc*>> misses;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (const ShaderDesc* desc : descs)
+			{
+				uint64_t key = HashShaderDesc(*desc);
+				if (m_Entries.find(key) == m_Entries.end())
+				{
+					misses.emplace_back(key, desc);
+				}
+			}
+		}
+
+		// One shader per job, since compile times vary a lot. The calling thread runs jobs too while it waits.
+		std::atomic<bool> failed{ false };
+		const uint32_t numMisses = static_cast<uint32_t>(misses.size());
+		jobSystem.ParallelFor(0, numMisses, 1, [this, &misses, &failed](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				// An exception leaving a job would terminate
+				try
+				{
+					AddCompiled(misses[i].first, CompileShader(*misses[i].second));
+				}
+				catch (const std::exception&)
+				{
+					failed = true;
+				}
+			}
+		});
+
+		// Errors have been written to the debug output by CompileShader
+		if (failed)
+		{
+			throw std::exception();
+		}
+	}
+
+	// Writes the cache file (see class comment) and releases everything.
+	// No bytecode returned by this cache may be used after this.
+	void Shutdown()
+	{
+		// Rewrite if shaders were added, or the file is over a budget which has since shrunk
+		if (m_IsDirty || m_CacheFile.Size() > m_MaxFileSize)
+		{
+			std::vector<uint8_t> file = SerializeEntries();
+			m_Entries.clear();
+			m_CacheFile.Close();
+			WriteWholeFile(m_CachePath.c_str(), file.data(), file.size());
+		}
+		// Only used, so the bytecode in the file stays as it is and just the recency in its index is saved
+		else if (m_Tick != m_LoadTick && m_CacheFile.IsOpen())
+		{
+			std::vector<uint8_t> index = SerializeIndex();
+			m_Entries.clear();
+			m_CacheFile.Close();
+			WriteFileAt(m_CachePath.c_str(), 0, index.data(), index.size());
+		}
+
+		m_Entries.clear();
+		m_CacheFile.Close();
+		m_IsDirty = false;
+	}
+
+private:
+	// File layout: FileHeader, FileEntry[NumEntries], then bytecode, each blob 8 byte aligned
+	static const uint32_t FileMagic = 0x31434853; // "SHC1"
+
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t NumEntries;
+		uint64_t Tick;
+	};
+
+	struct FileEntry
+	{
+		uint64_t Key;
+		uint64_t Offset;
+		uint64_t Size;
+		uint64_t LastUsed;
+	};
+
+	struct Entry
+	{
+		// Points into m_CacheFile, or into Blob for shaders compiled this run
+		const void* Data = nullptr;
+		size_t Size = 0;
+		uint64_t LastUsed = 0;
+		Microsoft::WRL::ComPtr<ID3DBlob> Blob;
+		// Of its FileEntry, for shaders loaded from m_CacheFile
+		uint32_t FileIndex = NotInFile;
+	};
+
+	static const uint32_t NotInFile = UINT32_MAX;
+
+	static uint64_t AlignUp8(uint64_t size) { return (size + 7) & ~uint64_t(7); }
+
+	CD3DX12_SHADER_BYTECODE AddCompiled(uint64_t key, Microsoft::WRL::ComPtr<ID3DBlob> blob)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		Entry& entry = m_Entries[key];
+		// If another thread compiled the same shader meanwhile, keep the first so pointers already handed out stay valid
+		if (entry.Data == nullptr)
+		{
+			entry.Blob = blob;
+			entry.Data = blob->GetBufferPointer();
+			entry.Size = blob->GetBufferSize();
+			m_IsDirty = true;
+		}
+		entry.LastUsed = ++m_Tick;
+		return CD3DX12_SHADER_BYTECODE(entry.Data, entry.Size);
+	}
+
+	void LoadIndex()
+	{
+		if (!m_CacheFile.Open(m_CachePath.c_str()))
+		{
+			return;
+		}
+
+		const uint8_t* data = static_cast<const uint8_t*>(m_CacheFile.Data());
+		const uint64_t size = m_CacheFile.Size();
+
+		FileHeader header;
+		if (size < sizeof(header))
+		{
+			return;
+		}
+		memcpy(&header, data, sizeof(header));
+		if (header.Magic != FileMagic || (size - sizeof(header)) / sizeof(FileEntry) < header.NumEntries)
+		{
+			return;
+		}
+		m_Tick = header.Tick;
+
+		const uint8_t* fileEntries = data + sizeof(header);
+		for (uint32_t i = 0; i < header.NumEntries; i++)
+		{
+			FileEntry fileEntry;
+			memcpy(&fileEntry, fileEntries + i * sizeof(FileEntry), sizeof(fileEntry));
+			// Skip anything pointing outside the file rather than trusting it
+			if (fileEntry.Offset > size || size - fileEntry.Offset < fileEntry.Size)
+			{
+				continue;
+			}
+
+			Entry& entry = m_Entries[fileEntry.Key];
+			entry.Data = data + fileEntry.Offset;
+			entry.Size = static_cast<size_t>(fileEntry.Size);
+			entry.LastUsed = fileEntry.LastUsed;
+			entry.FileIndex = i;
+		}
+		m_LoadTick = m_Tick;
+	}
+
+	// The FileHeader and FileEntry table of m_CacheFile, with the current tick and last uses
+	std::vector<uint8_t> SerializeIndex()
+	{
+		const uint8_t* data = static_cast<const uint8_t*>(m_CacheFile.Data());
+		FileHeader header;
+		memcpy(&header, data, sizeof(header));
+		std::vector<uint8_t> index(data, data + sizeof(FileHeader) + header.NumEntries * sizeof(FileEntry));
+
+		header.Tick = m_Tick;
+		memcpy(index.data(), &header, sizeof(header));
+		for (const auto& pair : m_Entries)
+		{
+			if (pair.second.FileIndex != NotInFile)
+			{
+				const size_t entryOffset = sizeof(FileHeader) + pair.second.FileIndex * sizeof(FileEntry);
+				memcpy(index.data() + entryOffset + offsetof(FileEntry, LastUsed), &pair.second.LastUsed, sizeof(uint64_t));
+			}
+		}
+		return index;
+	}
+
+	std::vector<uint8_t> SerializeEntries()
+	{
+		// Most recently used first, so when the budget runs out it is the least recently used that are dropped
+		std::vector<std::pair<uint64_t, const Entry*>> sorted;
+		for (const auto& pair : m_Entries)
+		{
+			sorted.emplace_back(pair.first, &pair.second);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const std::pair<uint64_t, const Entry*>& a,
+			const std::pair<uint64_t, const Entry*>& b)
+		{
+			return a.second->LastUsed > b.second->LastUsed;
+		});
+
+		uint64_t dataSize = 0;
+		size_t numKept = 0;
+		for (; numKept < sorted.size(); numKept++)
+		{
+			uint64_t entryCost = sizeof(FileEntry) + AlignUp8(sorted[numKept].second->Size);
+			if (sizeof(FileHeader) + dataSize + entryCost > m_MaxFileSize)
+			{
+				break;
+			}
+			dataSize += entryCost;
+		}
+
+		std::vector<uint8_t> file(static_cast<size_t>(sizeof(FileHeader) + dataSize));
+		FileHeader header = { FileMagic, static_cast<uint32_t>(numKept), m_Tick };
+		memcpy(file.data(), &header, sizeof(header));
+
+		uint64_t offset = sizeof(FileHeader) + numKept * sizeof(FileEntry);
+		for (size_t i = 0; i < numKept; i++)
+		{
+			const Entry& entry = *sorted[i].second;
+			FileEntry fileEntry = { sorted[i].first, offset, entry.Size, entry.LastUsed };
+			memcpy(file.data() + sizeof(FileHeader) + i * sizeof(FileEntry), &fileEntry, sizeof(fileEntry));
+			memcpy(file.data() + offset, entry.Data, entry.Size);
+			offset += AlignUp8(entry.Size);
+		}
+
+		return file;
+	}
+
+	std::wstring m_CachePath;
+	uint64_t m_MaxFileSize = 0;
+	MappedFile m_CacheFile;
+
+	std::mutex m_Mutex;
+	std::unordered_map<uint64_t, Entry> m_Entries;
+	// Incremented on every use, persisted so that recency carries over between runs
+	uint64_t m_Tick = 0;
+	// m_Tick when the file was loaded
+	uint64_t m_LoadTick = 0;
+	bool m_IsDirty = false;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+// Bounded lock-free queue for one producer thread and one consumer thread.
+//
+// A ring of Capacity slots (a power of two) with a head the consumer advances and a tail the producer advances.
+// Each side only writes its own index, and publishes it with release after touching the slot, so neither ever
+// waits for the other or takes a lock. The indices sit on separate cache lines so the two threads don't keep
+// stealing the line from each other.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	// Producer only. Returns false, leaving the queue as it was, when it is full.
+	bool TryPush(const T& item)
+	{
+		const size_t tail = m_Tail.load(std::memory_order_relaxed);
+		if (tail - m_Head.load(std::memory_order_acquire) == Capacity)
+		{
+			return false;
+		}
+		m_Items[tail & (Capacity - 1)] = item;
+		m_Tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Producer only. Yields until there is room, for items which can't be dropped.
+	void Push(const T& item)
+	{
+		while (!TryPush(item))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// Consumer only. Returns false when the queue is empty.
+	bool TryPop(T& item)
+	{
+		const size_t head = m_Head.load(std::memory_order_relaxed);
+		if (head == m_Tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		item = m_Items[head & (Capacity - 1)];
+		m_Head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Only exact when called from either thread while the other is idle
+	bool IsEmpty() const
+	{
+		return m_Head.load(std::memory_order_acquire) == m_Tail.load(std::memory_order_acquire);
+	}
+
+private:
+	static const size_t CacheLineSize = 64;
+
+	alignas(CacheLineSize) std::atomic<size_t> m_Head{ 0 };
+	alignas(CacheLineSize) std::atomic<size_t> m_Tail{ 0 };
+	alignas(CacheLineSize) T m_Items[Capacity];
+};
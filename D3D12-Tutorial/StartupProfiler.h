@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Startup timing and parallel initialization.
+//
+// InitGraph runs initialization steps as soon as the steps they depend on are done, on a few threads, and
+// times each one. Its report lists the steps on a timeline and marks the critical path: the chain of
+// dependencies which decided when startup finished, which is the only place where making a step faster
+// gets to the first frame sooner.
+//
+// Only depends on the standard library, so the scheduling can be run and checked on any platform.
+class InitGraph
+{
+public:
+	typedef uint32_t StepId;
+	typedef std::chrono::steady_clock Clock;
+
+	// Dependencies must already have been added, so the graph can't have cycles.
+	// Steps run on the calling thread of Run if onCallingThread is set, e.g. window creation, since a window
+	// belongs to the thread which created it. Otherwise they can run on any thread.
+	StepId AddStep(const char* name, std::function<void()> function, std::initializer_list<StepId> dependencies = {},
+		bool onCallingThread = false)
+	{
+		const StepId id = static_cast<StepId>(m_Steps.size());
+
+		Step step;
+		step.Name = name;
+		step.Function = std::move(function);
+		step.OnCallingThread = onCallingThread;
+		for (StepId dependency : dependencies)
+		{
+			assert(dependency < id && "Dependencies must be added first");
+			step.Dependencies.push_back(dependency);
+			m_Steps[dependency].Dependents.push_back(id);
+		}
+		m_Steps.push_back(std::move(step));
+		return id;
+	}
+
+	// Runs every step, using numThreads threads including the calling one (0 for one per hardware thread, and at
+	// least two, since steps often wait on the driver or the disk rather than use the CPU). With more than one
+	// thread the calling thread only runs its own steps, so it is free the moment one of them becomes ready.
+	// If a step throws, steps not yet started are skipped and the exception is rethrown once running ones finish.
+	void Run(uint32_t numThreads = 0)
+	{
+		if (numThreads == 0)
+		{
+			numThreads = std::max(2u, std::thread::hardware_concurrency());
+		}
+		m_NumThreads = numThreads;
+
+		m_Start = Clock::now();
+		m_NumDone = 0;
+		m_NumRunning = 0;
+		m_Error = nullptr;
+		m_Ready.clear();
+		m_ReadyOnCallingThread.clear();
+		for (StepId id = 0; id < m_Steps.size(); id++)
+		{
+			m_Steps[id].NumWaitingFor = static_cast<uint32_t>(m_Steps[id].Dependencies.size());
+			m_Steps[id].Start = Clock::time_point();
+			m_Steps[id].End = Clock::time_point();
+			if (m_Steps[id].NumWaitingFor == 0)
+			{
+				MakeReady(id);
+			}
+		}
+
+		std::vector<std::thread> workers;
+		for (uint32_t i = 1; i < numThreads; i++)
+		{
+			workers.emplace_back(&InitGraph::RunSteps, this, i);
+		}
+		RunSteps(0);
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+
+		m_End = Clock::now();
+		if (m_Error)
+		{
+			std::rethrow_exception(m_Error);
+		}
+	}
+
+	// The chain of steps, first to last, which finished last, each one the latest finishing dependency of the next
+	std::vector<StepId> GetCriticalPath() const
+	{
+		std::vector<StepId> path;
+		if (m_Steps.empty())
+		{
+			return path;
+		}
+
+		StepId last = 0;
+		for (StepId id = 1; id < m_Steps.size(); id++)
+		{
+			if (m_Steps[id].End > m_Steps[last].End)
+			{
+				last = id;
+			}
+		}
+
+		for (;;)
+		{
+			path.push_back(last);
+			const std::vector<StepId>& dependencies = m_Steps[last].Dependencies;
+			if (dependencies.empty())
+			{
+				break;
+			}
+			last = *std::max_element(dependencies.begin(), dependencies.end(),
+				[this](StepId a, StepId b) { return m_Steps[a].End < m_Steps[b].End; });
+		}
+
+		std::reverse(path.begin(), path.end());
+		return path;
+	}
+
+	// Milliseconds from the start of Run
+	double GetStepStart(StepId id) const { return ToMilliseconds(m_Steps[id].Start - m_Start); }
+	double GetStepEnd(StepId id) const { return ToMilliseconds(m_Steps[id].End - m_Start); }
+	double GetTotalTime() const { return ToMilliseconds(m_End - m_Start); }
+
+	// One line per step in start order: start and end times, thread, and '*' if it is on the critical path.
+	// Ends with how long startup took against how long the same steps take one after another.
+	std::string GetReport() const
+	{
+		std::vector<StepId> order(m_Steps.size());
+		for (StepId id = 0; id < order.size(); id++)
+		{
+			order[id] = id;
+		}
+		std::sort(order.begin(), order.end(), [this](StepId a, StepId b) { return m_Steps[a].Start < m_Steps[b].Start; });
+
+		const std::vector<StepId> criticalPath = GetCriticalPath();
+		std::string report = "Startup:\n";
+		double serialTime = 0.0;
+		char line[256];
+		for (StepId id : order)
+		{
+			const Step& step = m_Steps[id];
+			// Skipped after an error
+			if (step.Start == Clock::time_point())
+			{
+				continue;
+			}
+			const bool isCritical = std::find(criticalPath.begin(), criticalPath.end(), id) != criticalPath.end();
+			serialTime += GetStepEnd(id) - GetStepStart(id);
+			snprintf(line, sizeof(line), "%c %8.2f - %8.2f ms  [thread %u]  %s\n", isCritical ? '*' : ' ',
+				GetStepStart(id), GetStepEnd(id), step.Thread, step.Name.c_str());
+			report += line;
+		}
+		snprintf(line, sizeof(line), "Total %.2f ms (%.2f ms run one after another)\n", GetTotalTime(), serialTime);
+		report += line;
+		return report;
+	}
+
+private:
+	struct Step
+	{
+		std::string Name;
+		std::function<void()> Function;
+		bool OnCallingThread = false;
+		std::vector<StepId> Dependencies;
+		std::vector<StepId> Dependents;
+
+		uint32_t NumWaitingFor = 0;
+		uint32_t Thread = 0;
+		Clock::time_point Start;
+		Clock::time_point End;
+	};
+
+	static double ToMilliseconds(Clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	// Called with the lock held, or before the threads start
+	void MakeReady(StepId id)
+	{
+		(m_Steps[id].OnCallingThread ? m_ReadyOnCallingThread : m_Ready).push_back(id);
+	}
+
+	// Thread 0 is the calling thread
+	void RunSteps(uint32_t thread)
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		for (;;)
+		{
+			const bool stopping = m_Error != nullptr;
+			std::deque<StepId>* queue = nullptr;
+			if (!stopping && thread == 0 && !m_ReadyOnCallingThread.empty())
+			{
+				queue = &m_ReadyOnCallingThread;
+			}
+			else if (!stopping && !m_Ready.empty() && (thread != 0 || m_NumThreads == 1))
+			{
+				queue = &m_Ready;
+			}
+
+			if (queue == nullptr)
+			{
+				// Finished when every step has run, or after an error when nothing is left running
+				if (m_NumDone == m_Steps.size() || (stopping && m_NumRunning == 0))
+				{
+					m_StepDone.notify_all();
+					return;
+				}
+				m_StepDone.wait(lock);
+				continue;
+			}
+
+			const StepId id = queue->front();
+			queue->pop_front();
+			m_NumRunning++;
+
+			Step& step = m_Steps[id];
+			step.Thread = thread;
+			lock.unlock();
+
+			step.Start = Clock::now();
+			std::exception_ptr error;
+			try
+			{
+				step.Function();
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			step.End = Clock::now();
+
+			lock.lock();
+			m_NumRunning--;
+			m_NumDone++;
+			if (error && !m_Error)
+			{
+				m_Error = error;
+			}
+			for (StepId dependent : step.Dependents)
+			{
+				if (--m_Steps[dependent].NumWaitingFor == 0)
+				{
+					MakeReady(dependent);
+				}
+			}
+			m_StepDone.notify_all();
+		}
+	}
+
+	std::vector<Step> m_Steps;
+	uint32_t m_NumThreads = 1;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_StepDone;
+	std::deque<StepId> m_Ready;
+	std::deque<StepId> m_ReadyOnCallingThread;
+	size_t m_NumDone = 0;
+	uint32_t m_NumRunning = 0;
+	std::exception_ptr m_Error;
+
+	Clock::time_point m_Start;
+	Clock::time_point m_End;
+};
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <wrl.h>
+#include <d3d12.h>
+#include "d3dx12.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "AssetPack.h"
+#include "AsyncFile.h"
+#include "ChunkedCompression.h"
+#include "DeviceCapabilities.h"
+#include "Helpers.h"
+
+// Streams data from files into GPU resources without stalling rendering.
+//
+//	1) A request reads its bytes with an AsyncRead straight into a persistently mapped upload buffer taken
+//	   from a small fixed pool (the staging buffers). If none are free the request waits its turn, which
+//	   bounds the upload memory in use no matter how much is queued.
+//	2) Once the read lands, a copy is recorded into that staging buffer's command list and submitted to a
+//	   dedicated COPY queue, so the transfer runs alongside graphics work on the copy engine.
+//	   Compressed requests (StreamCompressedBuffer) are read into CPU memory instead, then decompressed in
+//	   parallel as jobs on the job system. Each chunk is decoded into a per-thread scratch buffer and then
+//	   copied into the staging buffer in one pass: the staging buffer is write-combined memory, and LZ4 reads
+//	   back what it has written to copy matches, which would be very slow from uncached memory.
+//	3) Every submission signals the streaming fence. The value it signals is the request's ticket, handed
+//	   out when the request was made. The graphics queue waits on tickets GPU-side (WaitOnQueue), and the
+//	   CPU only ever polls (IsComplete), it never blocks.
+//
+// A request whose read or decompression fails, or whose data doesn't fit its destination or a staging buffer,
+// copies nothing, but its ticket is still signalled in turn so nothing waits on it forever. GetStatus tells the
+// two apart.
+//
+// Call Update once per frame to move requests along. Staging buffers are only allocated once requests need them.
+// Destination resources must be in the COMMON state. Copy queue writes decay back to COMMON, from where the
+// graphics queue can implicitly promote them to a read state.
+class StreamingQueue
+{
+public:
+	typedef uint64_t Ticket;
+
+	enum class Status
+	{
+		Pending,
+		Complete,
+		// Nothing was copied to the destination
+		Failed,
+	};
+
+	// capabilities must stay alive while the queue is in use, and jobSystem until Shutdown
+	void Initialize(Microsoft::WRL::ComPtr<ID3D12Device2> device, const DeviceCapabilities& capabilities,
+		JobSystem& jobSystem, uint32_t numStagingBuffers = 4, uint64_t stagingBufferSize = 32ull * 1024 * 1024)
+	{
+		m_Device = device;
+		m_Capabilities = &capabilities;
+		m_StagingBufferSize = stagingBufferSize;
+		m_Decompressor.Initialize(jobSystem);
+
+		D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+		queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+		queueDesc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+		ThrowIfFailed(m_Device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_CopyQueue)));
+		ThrowIfFailed(m_Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_Fence)));
+
+		// Created by the first request to need each one
+		m_StagingBuffers.resize(numStagingBuffers);
+	}
+
+	// Waits for outstanding reads, decompression and copies, then releases everything
+	void Shutdown()
+	{
+		while (!m_Requests.empty() || !m_Submitted.empty())
+		{
+			Update();
+			std::this_thread::yield();
+		}
+
+		m_Decompressor.Shutdown();
+		m_StagingBuffers.clear();
+		m_FailedTickets.clear();
+		m_Fence.Reset();
+		m_CopyQueue.Reset();
+		m_Device.Reset();
+	}
+
+	// Streams size bytes at fileOffset into destination at destinationOffset.
+	// Fails if size is larger than a staging buffer.
+	Ticket StreamBuffer(AsyncFile& file, uint64_t fileOffset, uint32_t size,
+		ID3D12Resource* destination, uint64_t destinationOffset)
+	{
+		std::unique_ptr<Request> request(new Request);
+		request->File = &file;
+		request->FileOffset = fileOffset;
+		request->Size = size;
+		request->Destination = destination;
+		request->DestinationOffset = destinationOffset;
+		// The read would run past the end of the staging buffer
+		request->Failed = size > m_StagingBufferSize;
+		return Enqueue(std::move(request));
+	}
+
+	// Streams a chunked LZ4 stream (see ChunkedCompression.h) of compressedSize bytes at fileOffset, which
+	// decompresses to uncompressedSize bytes, into destination at destinationOffset. Fails if uncompressedSize is
+	// larger than a staging buffer.
+	Ticket StreamCompressedBuffer(AsyncFile& file, uint64_t fileOffset, uint32_t compressedSize, uint32_t uncompressedSize,
+		ID3D12Resource* destination, uint64_t destinationOffset)
+	{
+		std::unique_ptr<Request> request(new Request);
+		request->File = &file;
+		request->FileOffset = fileOffset;
+		request->Size = uncompressedSize;
+		request->CompressedSize = compressedSize;
+		request->Destination = destination;
+		request->DestinationOffset = destinationOffset;
+		// The decompressor would write past the end of the staging buffer
+		request->Failed = uncompressedSize > m_StagingBufferSize;
+		return Enqueue(std::move(request));
+	}
+
+	// Streams every subresource of a texture asset from an asset pack. The pack stores payloads with D3D12's
+	// pitch and placement alignment, so the whole run of subresources is read in one go and copied from
+	// in place; nothing is repacked on the CPU. Fails if the pack's layout isn't the one D3D12 expects for
+	// destination, e.g. because the asset doesn't describe it, or if the texture is larger than a staging buffer.
+	Ticket StreamTexture(AsyncFile& file, const AssetPack& pack, const AssetPackEntry& asset, ID3D12Resource* destination)
+	{
+		assert(asset.Type == AssetType::Texture && asset.NumSubresources > 0);
+
+		const AssetPackSubresource& first = pack.GetSubresource(asset, 0);
+		const AssetPackSubresource& last = pack.GetSubresource(asset, asset.NumSubresources - 1);
+		const uint64_t end = last.Offset + last.SlicePitch * last.Depth;
+
+		std::unique_ptr<Request> request(new Request);
+		request->File = &file;
+		request->FileOffset = first.Offset;
+		request->Destination = destination;
+
+		// Checked before narrowing, so a span of 4 GiB or more can't wrap around to one which fits
+		const uint64_t size = end - first.Offset;
+		if (size > m_StagingBufferSize)
+		{
+			request->Failed = true;
+			return Enqueue(std::move(request));
+		}
+		request->Size = static_cast<uint32_t>(size);
+
+		// An asset with more subresources than destination would have D3D12 read past the end of its description
+		const D3D12_RESOURCE_DESC desc = destination->GetDesc();
+		if (m_Capabilities->GetNumSubresources(desc) != asset.NumSubresources)
+		{
+			request->Failed = true;
+			return Enqueue(std::move(request));
+		}
+
+		// Sizes, block rounded for compressed formats, and pitches as D3D12 lays them out
+		request->Footprints.resize(asset.NumSubresources);
+		std::vector<UINT> numRows(asset.NumSubresources);
+		m_Device->GetCopyableFootprints(&desc, 0, asset.NumSubresources, 0, request->Footprints.data(), numRows.data(),
+			nullptr, nullptr);
+
+		// Offsets in the pack are placement aligned, and the read starts on one, so they stay aligned in the staging buffer
+		for (uint32_t i = 0; i < asset.NumSubresources; i++)
+		{
+			const AssetPackSubresource& subresource = pack.GetSubresource(asset, i);
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = request->Footprints[i];
+			// Each payload has to lie within the span read, or the copy would go past what was staged
+			if (subresource.Offset < first.Offset || subresource.Offset > end ||
+				subresource.SlicePitch * subresource.Depth > end - subresource.Offset)
+			{
+				request->Failed = true;
+				break;
+			}
+			footprint.Offset = subresource.Offset - first.Offset;
+			if (footprint.Footprint.RowPitch != subresource.RowPitch || numRows[i] != subresource.NumRows ||
+				footprint.Footprint.Depth != subresource.Depth)
+			{
+				request->Failed = true;
+			}
+		}
+
+		return Enqueue(std::move(request));
+	}
+
+	// Moves requests through read -> (decompress) -> copy -> complete. Call once per frame.
+	void Update()
+	{
+		// Recycle staging buffers whose copies the GPU has finished
+		const uint64_t completedValue = m_Fence->GetCompletedValue();
+		while (!m_Submitted.empty() && m_Submitted.front()->FenceValue <= completedValue)
+		{
+			if (m_Submitted.front()->Staging)
+			{
+				m_Submitted.front()->Staging->InUse = false;
+			}
+			m_Submitted.pop_front();
+		}
+
+		// Start reads for waiting requests, oldest first, while staging buffers are free
+		for (std::unique_ptr<Request>& request : m_Requests)
+		{
+			if (request->Staging != nullptr || request->Failed)
+			{
+				continue;
+			}
+			StagingBuffer* staging = FindFreeStagingBuffer();
+			if (staging == nullptr)
+			{
+				break;
+			}
+			staging->InUse = true;
+			request->Staging = staging;
+
+			// Compressed data only goes through CPU memory, the staging buffer receives the decompressed bytes
+			void* readDestination = staging->Data;
+			uint32_t readSize = request->Size;
+			if (request->CompressedSize != 0)
+			{
+				request->CompressedData.resize(request->CompressedSize);
+				readDestination = request->CompressedData.data();
+				readSize = request->CompressedSize;
+			}
+			if (!request->Read.Begin(*request->File, request->FileOffset, readSize, readDestination))
+			{
+				request->Failed = true;
+			}
+		}
+
+		// Decompress every compressed request whose read has landed, not just the oldest, so the workers stay busy
+		for (std::unique_ptr<Request>& request : m_Requests)
+		{
+			if (request->CompressedSize == 0 || request->Staging == nullptr || request->Failed ||
+				request->Decompress.Poll() != DecompressStatus::Idle || request->Read.Poll() != AsyncReadStatus::Complete)
+			{
+				continue;
+			}
+			if (!m_Decompressor.Begin(request->Decompress, request->CompressedData.data(), request->CompressedSize,
+				request->Staging->Data, request->Size))
+			{
+				request->Failed = true;
+			}
+		}
+
+		// Submit finished reads, and signal failed requests. Tickets must be signalled in the order they were
+		// handed out, so stop at the first request which is still reading or decompressing.
+		while (!m_Requests.empty() && (m_Requests.front()->Staging != nullptr || m_Requests.front()->Failed))
+		{
+			Request& request = *m_Requests.front();
+			if (!request.Failed)
+			{
+				// Reads which return fewer bytes than asked for fail too
+				const AsyncReadStatus status = request.Read.Poll();
+				if (status == AsyncReadStatus::Pending)
+				{
+					break;
+				}
+				request.Failed = status == AsyncReadStatus::Failed;
+			}
+
+			if (!request.Failed && request.CompressedSize != 0)
+			{
+				// Idle if the read landed after decompression was started for this Update
+				const DecompressStatus decompressStatus = request.Decompress.Poll();
+				if (decompressStatus != DecompressStatus::Complete && decompressStatus != DecompressStatus::Failed)
+				{
+					break;
+				}
+				request.Failed = decompressStatus == DecompressStatus::Failed;
+			}
+			// Not while a read or decompression may still be writing to it
+			std::vector<uint8_t>().swap(request.CompressedData);
+
+			if (request.Failed)
+			{
+				m_FailedTickets.push_back(request.FenceValue);
+			}
+			Submit(request);
+			m_Submitted.push_back(std::move(m_Requests.front()));
+			m_Requests.pop_front();
+		}
+	}
+
+	// True once ticket has finished, whether its data made it to the destination or not (see GetStatus)
+	bool IsComplete(Ticket ticket) const
+	{
+		return m_Fence->GetCompletedValue() >= ticket;
+	}
+
+	Status GetStatus(Ticket ticket) const
+	{
+		if (!IsComplete(ticket))
+		{
+			return Status::Pending;
+		}
+		// Tickets fail in the order they are signalled, so the list stays sorted
+		return std::binary_search(m_FailedTickets.begin(), m_FailedTickets.end(), ticket) ? Status::Failed : Status::Complete;
+	}
+
+	// Makes queue wait on the GPU until ticket completes, before running anything submitted to it afterwards.
+	// May be called before the ticket is submitted to the copy queue, the wait just lasts longer.
+	void WaitOnQueue(ID3D12CommandQueue* queue, Ticket ticket) const
+	{
+		ThrowIfFailed(queue->Wait(m_Fence.Get(), ticket));
+	}
+
+	ID3D12CommandQueue* GetCopyQueue() const { return m_CopyQueue.Get(); }
+	size_t GetNumPending() const { return m_Requests.size() + m_Submitted.size(); }
+
+private:
+	struct StagingBuffer
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+		uint8_t* Data = nullptr;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CommandAllocator;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList;
+		bool InUse = false;
+	};
+
+	struct Request
+	{
+		// Fence value signalled once this request's copy has executed
+		uint64_t FenceValue = 0;
+		AsyncFile* File = nullptr;
+		uint64_t FileOffset = 0;
+		// Of the data copied to the destination, after any decompression
+		uint32_t Size = 0;
+		// 0 if the data is stored uncompressed
+		uint32_t CompressedSize = 0;
+		ID3D12Resource* Destination = nullptr;
+		uint64_t DestinationOffset = 0;
+		// Empty for buffer copies
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Footprints;
+		// Only signalled, nothing is copied
+		bool Failed = false;
+
+		StagingBuffer* Staging = nullptr;
+		AsyncRead Read;
+		std::vector<uint8_t> CompressedData;
+		DecompressJob Decompress;
+	};
+
+	Ticket Enqueue(std::unique_ptr<Request> request)
+	{
+		// Requests are submitted, and so signalled, in the order they are made, so the ticket is known now
+		request->FenceValue = ++m_LastTicket;
+		Ticket ticket = request->FenceValue;
+		m_Requests.push_back(std::move(request));
+		return ticket;
+	}
+
+	// Prefers staging buffers which have been created, only creating another once they are all in use
+	StagingBuffer* FindFreeStagingBuffer()
+	{
+		StagingBuffer* uncreated = nullptr;
+		for (StagingBuffer& staging : m_StagingBuffers)
+		{
+			if (!staging.InUse && staging.Buffer)
+			{
+				return &staging;
+			}
+			if (!staging.Buffer && !uncreated)
+			{
+				uncreated = &staging;
+			}
+		}
+		if (uncreated)
+		{
+			CreateStagingBuffer(*uncreated);
+		}
+		return uncreated;
+	}
+
+	void CreateStagingBuffer(StagingBuffer& staging)
+	{
+		CD3DX12_HEAP_PROPERTIES uploadHeap(D3D12_HEAP_TYPE_UPLOAD);
+		CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(m_StagingBufferSize);
+		ThrowIfFailed(m_Device->CreateCommittedResource(&uploadHeap, D3D12_HEAP_FLAG_NONE, &bufferDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&staging.Buffer)));
+
+		// Upload heaps can stay mapped for their whole life. An empty read range tells D3D12 the CPU won't read it.
+		CD3DX12_RANGE readRange(0, 0);
+		ThrowIfFailed(staging.Buffer->Map(0, &readRange, reinterpret_cast<void**>(&staging.Data)));
+
+		ThrowIfFailed(m_Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+			IID_PPV_ARGS(&staging.CommandAllocator)));
+		ThrowIfFailed(m_Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+			staging.CommandAllocator.Get(), nullptr, IID_PPV_ARGS(&staging.CommandList)));
+		ThrowIfFailed(staging.CommandList->Close());
+	}
+
+	void Submit(Request& request)
+	{
+		// Failed requests may not have a staging buffer. The queue signals their ticket after the copies before it.
+		if (request.Failed)
+		{
+			ThrowIfFailed(m_CopyQueue->Signal(m_Fence.Get(), request.FenceValue));
+			return;
+		}
+
+		StagingBuffer& staging = *request.Staging;
+
+		// The allocator's previous commands finished when this staging buffer was recycled
+		ThrowIfFailed(staging.CommandAllocator->Reset());
+		ThrowIfFailed(staging.CommandList->Reset(staging.CommandAllocator.Get(), nullptr));
+
+		if (request.Footprints.empty())
+		{
+			staging.CommandList->CopyBufferRegion(request.Destination, request.DestinationOffset,
+				staging.Buffer.Get(), 0, request.Size);
+		}
+		else
+		{
+			for (UINT i = 0; i < static_cast<UINT>(request.Footprints.size()); i++)
+			{
+				CD3DX12_TEXTURE_COPY_LOCATION destination(request.Destination, i);
+				CD3DX12_TEXTURE_COPY_LOCATION source(staging.Buffer.Get(), request.Footprints[i]);
+				staging.CommandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+			}
+		}
+
+		ThrowIfFailed(staging.CommandList->Close());
+		ID3D12CommandList* const commandLists[] = { staging.CommandList.Get() };
+		m_CopyQueue->ExecuteCommandLists(_countof(commandLists), commandLists);
+		ThrowIfFailed(m_CopyQueue->Signal(m_Fence.Get(), request.FenceValue));
+	}
+
+	Microsoft::WRL::ComPtr<ID3D12Device2> m_Device;
+	const DeviceCapabilities* m_Capabilities = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+	Ticket m_LastTicket = 0;
+
+	uint64_t m_StagingBufferSize = 0;
+	std::vector<StagingBuffer> m_StagingBuffers;
+	Decompressor m_Decompressor;
+
+	// Waiting for a staging buffer or for their read, in ticket order
+	std::deque<std::unique_ptr<Request>> m_Requests;
+	// Submitted to the copy queue, in ticket order
+	std::deque<std::unique_ptr<Request>> m_Submitted;
+	// Tickets of failed requests, in order
+	std::vector<Ticket> m_FailedTickets;
+};
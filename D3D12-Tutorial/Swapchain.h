@@ -0,0 +1,331 @@
+#pragma once
+
+// Windows Runtime Library. Needed for Microsoft::WRL::ComPtr<> template class.
+#include <wrl.h>
+
+#include <d3d12.h>
+#include <dxgi1_6.h>
+#include "d3dx12.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+#include "FrameRing.h"
+#include "Helpers.h"
+#include "RenderDevice.h"
+
+// Resources used by one frame in flight
+struct FrameContext
+{
+	// Backing memory for the frame's commands. Can't be reset until the GPU has executed them, or the debug
+	// layer reports COMMAND_ALLOCATOR_SYNC, hence one per frame.
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CommandAllocator;
+	Microsoft::WRL::ComPtr<ID3D12Resource> RenderTarget;
+	// Signalled on the direct queue once the GPU is done with the frame, so its allocator and target can be reused
+	uint64_t FenceValue = 0;
+};
+
+// The render targets a renderer draws its frames to, with everything kept per frame in flight: either a
+// window's swap chain, or, when headless, textures with no window for offscreen rendering.
+//
+// Frame contexts are stored inline in a FrameRing, one after another, rather than as parallel arrays of
+// allocators, buffers and fence values, so each frame's data is together.
+//
+//	ID3D12GraphicsCommandList* commandList = swapchain.BeginFrame();
+//	commandList->ClearRenderTargetView(swapchain.GetRenderTargetView(), clearColor, 0, nullptr);
+//	swapchain.EndFrame();
+//	swapchain.Present(queue.Execute(1, lists), vsync);
+//
+// Window swap chains can be created waitable, for low latency. DXGI normally lets the CPU queue up to three
+// frames ahead of the display, and blocks in Present once it has, so input sampled for a frame is that many
+// frames old by the time it is shown. A waitable swap chain instead signals an object when a new frame can be
+// queued without blocking. Waiting on it with WaitForNextFrame at the start of the frame, before input is
+// sampled, keeps the queue at the maximum frame latency (1 for the lowest latency) and input as fresh as possible.
+class Swapchain
+{
+public:
+	static const uint32_t MaxFrames = 4;
+
+	~Swapchain() { Shutdown(); }
+
+	// maxFrameLatency is how many frames can be queued for presentation, with 0 for DXGI's default queueing and
+	// no waitable object
+	void InitializeWindow(RenderDevice* device, HWND hWnd, uint32_t width, uint32_t height, uint32_t numFrames,
+		uint32_t maxFrameLatency = 0)
+	{
+		assert(numFrames >= 2 && numFrames <= MaxFrames);
+		m_RenderDevice = device;
+		m_Frames.Initialize(numFrames);
+		m_Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		m_hWnd = hWnd;
+		m_AllowTearing = device->IsTearingSupported();
+
+		DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+		swapChainDesc.Width = width;
+		swapChainDesc.Height = height;
+		swapChainDesc.Format = m_Format;
+		// Used for 3D
+		swapChainDesc.Stereo = FALSE;
+		// Must be { 1, 0 } for flip models
+		swapChainDesc.SampleDesc = { 1, 0 };
+		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		swapChainDesc.BufferCount = numFrames;
+		// Behaviour when the back buffer size does not match the window
+		swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
+		// Docs; https://docs.microsoft.com/en-us/windows/win32/api/dxgi/ne-dxgi-dxgi_swap_effect
+		swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+		swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
+		// It is recommended to always allow tearing if tearing support is available
+		swapChainDesc.Flags = m_AllowTearing ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING : 0;
+		if (maxFrameLatency > 0)
+		{
+			swapChainDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+		}
+
+		IDXGIFactory4* factory = device->GetFactory();
+		Microsoft::WRL::ComPtr<IDXGISwapChain1> swapChain1;
+		ThrowIfFailed(factory->CreateSwapChainForHwnd(device->GetDirectQueue().GetCommandQueue(), hWnd, &swapChainDesc,
+			nullptr, nullptr, &swapChain1));
+		// Disable Alt+Enter to fullscreen, as it is handled manually
+		ThrowIfFailed(factory->MakeWindowAssociation(hWnd, DXGI_MWA_NO_ALT_ENTER));
+		ThrowIfFailed(swapChain1.As(&m_SwapChain));
+
+		if (maxFrameLatency > 0)
+		{
+			m_FrameLatencyWaitableObject = m_SwapChain->GetFrameLatencyWaitableObject();
+			SetMaximumFrameLatency(maxFrameLatency);
+		}
+
+		CreateFrameObjects();
+		CreateRenderTargets(width, height);
+	}
+
+	void InitializeHeadless(RenderDevice* device, uint32_t width, uint32_t height, uint32_t numFrames,
+		DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM)
+	{
+		assert(numFrames >= 1 && numFrames <= MaxFrames);
+		m_RenderDevice = device;
+		m_Frames.Initialize(numFrames);
+		m_Format = format;
+
+		CreateFrameObjects();
+		CreateRenderTargets(width, height);
+	}
+
+	// Waits for the GPU to finish with every frame, then releases them
+	void Shutdown()
+	{
+		if (m_RenderDevice)
+		{
+			WaitForAllFrames();
+			m_Frames.Initialize(m_Frames.GetNumFrames());
+			m_CommandList.Reset();
+			m_RTVDescriptorHeap.Reset();
+			if (m_FrameLatencyWaitableObject)
+			{
+				::CloseHandle(m_FrameLatencyWaitableObject);
+				m_FrameLatencyWaitableObject = NULL;
+			}
+			m_SwapChain.Reset();
+			m_RenderDevice = nullptr;
+		}
+	}
+
+	// Blocks until a new frame can be queued without Present blocking. Call at the start of the frame, before
+	// input is sampled. Returns false if the wait timed out, and straight away if the swap chain isn't waitable.
+	bool WaitForNextFrame(DWORD timeout = 1000)
+	{
+		if (!m_FrameLatencyWaitableObject)
+		{
+			return true;
+		}
+		return ::WaitForSingleObjectEx(m_FrameLatencyWaitableObject, timeout, TRUE) == WAIT_OBJECT_0;
+	}
+
+	// Can be changed at any time on waitable swap chains
+	void SetMaximumFrameLatency(uint32_t maxFrameLatency)
+	{
+		assert(IsWaitable() && maxFrameLatency >= 1 && maxFrameLatency <= DXGI_MAX_SWAP_CHAIN_BUFFERS);
+		ThrowIfFailed(m_SwapChain->SetMaximumFrameLatency(maxFrameLatency));
+		m_MaxFrameLatency = maxFrameLatency;
+	}
+
+	// Waits for the GPU to finish with the current frame, and resets its allocator and the command list to
+	// record it. The render target is transitioned to RENDER_TARGET, and must be left in it.
+	ID3D12GraphicsCommandList* BeginFrame()
+	{
+		FrameContext& frame = m_Frames.BeginFrame(m_RenderDevice->GetDirectQueue());
+
+		ThrowIfFailed(frame.CommandAllocator->Reset());
+		ThrowIfFailed(m_CommandList->Reset(frame.CommandAllocator.Get(), nullptr));
+
+		// The previous state must be given, there's no way to query it
+		CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(frame.RenderTarget.Get(),
+			D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		m_CommandList->ResourceBarrier(1, &barrier);
+
+		return m_CommandList.Get();
+	}
+
+	// Transitions the render target back to PRESENT and closes the command list, ready to be executed
+	ID3D12GraphicsCommandList* EndFrame()
+	{
+		CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_Frames.GetCurrentFrame().RenderTarget.Get(),
+			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
+		m_CommandList->ResourceBarrier(1, &barrier);
+		ThrowIfFailed(m_CommandList->Close());
+
+		return m_CommandList.Get();
+	}
+
+	// Call once the frame's command list has been executed on the direct queue, with the fence value which
+	// means it has finished. Presents windows, and moves on to the next frame.
+	void Present(uint64_t fenceValue, bool vsync)
+	{
+		if (m_SwapChain)
+		{
+			//	-syncInterval : specifies how to sync presentation of frame with vertical blank
+			//	-flags: https://docs.microsoft.com/en-us/windows/win32/direct3ddxgi/dxgi-present
+			UINT syncInterval = vsync ? 1 : 0;
+			UINT presentFlags = m_AllowTearing && !vsync ? DXGI_PRESENT_ALLOW_TEARING : 0;
+			ThrowIfFailed(m_SwapChain->Present(syncInterval, presentFlags));
+		}
+
+		// Swap chains decide which buffer is next, headless targets are used round robin
+		m_Frames.EndFrame(fenceValue, m_SwapChain ? m_SwapChain->GetCurrentBackBufferIndex() : m_Frames.GetNextFrameIndex());
+	}
+
+	// Waits for the GPU to finish with this swapchain's frames, then resizes them. Other work on the queue,
+	// e.g. other swapchains' frames, isn't waited for.
+	void Resize(uint32_t width, uint32_t height)
+	{
+		// Don't allow 0 size render targets
+		width = std::max(1u, width);
+		height = std::max(1u, height);
+		if (width == m_Width && height == m_Height)
+		{
+			return;
+		}
+
+		WaitForAllFrames();
+		// Every reference to the back buffers must be released before the swap chain can be resized
+		for (uint32_t i = 0; i < m_Frames.GetNumFrames(); i++)
+		{
+			m_Frames[i].RenderTarget.Reset();
+		}
+		if (m_SwapChain)
+		{
+			// Keeps the format and flags the swap chain was created with; the waitable flag can't change
+			// after creation
+			DXGI_SWAP_CHAIN_DESC swapChainDesc = {};
+			ThrowIfFailed(m_SwapChain->GetDesc(&swapChainDesc));
+			ThrowIfFailed(m_SwapChain->ResizeBuffers(m_Frames.GetNumFrames(), width, height, swapChainDesc.BufferDesc.Format,
+				swapChainDesc.Flags));
+		}
+		CreateRenderTargets(width, height);
+	}
+
+	void WaitForAllFrames()
+	{
+		m_Frames.WaitForAllFrames(m_RenderDevice->GetDirectQueue());
+	}
+
+	bool IsInitialized() const { return m_RenderDevice != nullptr; }
+	bool IsHeadless() const { return !m_SwapChain; }
+	bool IsWaitable() const { return m_FrameLatencyWaitableObject != NULL; }
+	uint32_t GetMaximumFrameLatency() const { return m_MaxFrameLatency; }
+	HWND GetWindow() const { return m_hWnd; }
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	DXGI_FORMAT GetFormat() const { return m_Format; }
+	uint32_t GetNumFrames() const { return m_Frames.GetNumFrames(); }
+	IDXGISwapChain4* GetSwapChain() const { return m_SwapChain.Get(); }
+	RenderDevice* GetRenderDevice() const { return m_RenderDevice; }
+
+	// The frame being recorded, from one Present until the next
+	FrameContext& GetCurrentFrame() { return m_Frames.GetCurrentFrame(); }
+	const FrameContext& GetFrame(uint32_t index) const { return m_Frames[index]; }
+	uint32_t GetCurrentFrameIndex() const { return m_Frames.GetCurrentFrameIndex(); }
+	ID3D12Resource* GetRenderTarget() const { return m_Frames.GetCurrentFrame().RenderTarget.Get(); }
+	D3D12_CPU_DESCRIPTOR_HANDLE GetRenderTargetView() const
+	{
+		return CD3DX12_CPU_DESCRIPTOR_HANDLE(m_RTVDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
+			m_Frames.GetCurrentFrameIndex(), m_RTVDescriptorSize);
+	}
+
+private:
+	void CreateFrameObjects()
+	{
+		ID3D12Device2* device = m_RenderDevice->GetDevice();
+
+		// RTVs need a heap of their own, they can't share one with CBVs, SRVs and UAVs
+		D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+		heapDesc.NumDescriptors = m_Frames.GetNumFrames();
+		heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+		ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_RTVDescriptorHeap)));
+		// Descriptor sizes are device dependent
+		m_RTVDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+		for (uint32_t i = 0; i < m_Frames.GetNumFrames(); i++)
+		{
+			ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+				IID_PPV_ARGS(&m_Frames[i].CommandAllocator)));
+		}
+
+		// Unlike allocators, a command list can be reset while its commands are executing, so one is enough.
+		// It is created recording and BeginFrame starts by resetting it, so it is closed straight away.
+		ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+			m_Frames[0].CommandAllocator.Get(), nullptr, IID_PPV_ARGS(&m_CommandList)));
+		ThrowIfFailed(m_CommandList->Close());
+	}
+
+	// Gets the swap chain's buffers, or creates textures when headless, with an RTV for each
+	void CreateRenderTargets(uint32_t width, uint32_t height)
+	{
+		ID3D12Device2* device = m_RenderDevice->GetDevice();
+		m_Width = width;
+		m_Height = height;
+
+		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_RTVDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+		for (uint32_t i = 0; i < m_Frames.GetNumFrames(); i++)
+		{
+			if (m_SwapChain)
+			{
+				ThrowIfFailed(m_SwapChain->GetBuffer(i, IID_PPV_ARGS(&m_Frames[i].RenderTarget)));
+			}
+			else
+			{
+				// Created in the state a presented swap chain buffer is in, so frames are recorded the same way
+				CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_DEFAULT);
+				CD3DX12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Tex2D(m_Format, width, height, 1, 1, 1, 0,
+					D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+				ThrowIfFailed(device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &desc,
+					D3D12_RESOURCE_STATE_PRESENT, nullptr, IID_PPV_ARGS(&m_Frames[i].RenderTarget)));
+			}
+
+			device->CreateRenderTargetView(m_Frames[i].RenderTarget.Get(), nullptr, rtvHandle);
+			rtvHandle.Offset(m_RTVDescriptorSize);
+		}
+
+		// May have changed after a resize
+		m_Frames.SetCurrentFrameIndex(m_SwapChain ? m_SwapChain->GetCurrentBackBufferIndex() : 0);
+	}
+
+	RenderDevice* m_RenderDevice = nullptr;
+	Microsoft::WRL::ComPtr<IDXGISwapChain4> m_SwapChain;
+	HWND m_hWnd = NULL;
+	bool m_AllowTearing = false;
+	// Only for waitable swap chains
+	HANDLE m_FrameLatencyWaitableObject = NULL;
+	uint32_t m_MaxFrameLatency = 0;
+	DXGI_FORMAT m_Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_RTVDescriptorHeap;
+	UINT m_RTVDescriptorSize = 0;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList;
+
+	FrameRing<FrameContext, MaxFrames> m_Frames;
+};
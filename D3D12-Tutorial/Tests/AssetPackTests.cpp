@@ -0,0 +1,238 @@
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+#include "../AssetPack.h"
+
+namespace
+{
+	const uint32_t FormatR8G8B8A8Unorm = 28;
+	const uint32_t FormatD24UnormS8Uint = 45;
+
+	// An 8x8 RGBA8 texture with a full mip chain, and a small buffer
+	std::vector<uint8_t> BuildPack()
+	{
+		static uint8_t texels[8 * 8 * 4];
+		for (size_t i = 0; i < sizeof(texels); i++)
+		{
+			texels[i] = static_cast<uint8_t>(i);
+		}
+		static const uint8_t bufferData[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+		std::vector<AssetPackWriter::SourceSubresource> mips;
+		for (uint32_t size = 8; size >= 1; size /= 2)
+		{
+			mips.push_back({ texels, size * 4, size * size * 4, size * 4, size, 1 });
+		}
+
+		AssetPackWriter writer;
+		writer.AddTexture("Texture", AssetPackDimensionTexture2D, FormatR8G8B8A8Unorm, 8, 8, 1, 4, mips);
+		CHECK(writer.AddBuffer("Buffer", bufferData, sizeof(bufferData)));
+
+		std::vector<uint8_t> file;
+		CHECK(writer.Build(file));
+		return file;
+	}
+
+	// The entry of the asset called name in a built pack, to corrupt it
+	AssetPackEntry* GetEntry(std::vector<uint8_t>& file, const char* name)
+	{
+		AssetPackHeader header;
+		memcpy(&header, file.data(), sizeof(header));
+		AssetPackEntry* entries = reinterpret_cast<AssetPackEntry*>(file.data() + sizeof(AssetPackHeader));
+		for (uint32_t i = 0; i < header.NumAssets; i++)
+		{
+			if (entries[i].NameHash == HashString(name))
+			{
+				return &entries[i];
+			}
+		}
+		return nullptr;
+	}
+
+	// The subresource at index in a built pack's subresource table
+	AssetPackSubresource* GetSubresource(std::vector<uint8_t>& file, uint32_t index)
+	{
+		AssetPackHeader header;
+		memcpy(&header, file.data(), sizeof(header));
+		return reinterpret_cast<AssetPackSubresource*>(file.data() + sizeof(AssetPackHeader) +
+			header.NumAssets * sizeof(AssetPackEntry)) + index;
+	}
+
+	AssetPackError Validate(const std::vector<uint8_t>& file)
+	{
+		return ValidateAssetPack(file.data(), file.size());
+	}
+}
+
+TEST(ValidPackValidates)
+{
+	std::vector<uint8_t> file = BuildPack();
+	CHECK(Validate(file) == AssetPackError::None);
+}
+
+TEST(LoaderFindsAssetsAndPointsAtPayloads)
+{
+	std::vector<uint8_t> file = BuildPack();
+	const char* path = "AssetPackTests.bin";
+	CHECK(WriteWholeFile(path, file.data(), file.size()));
+
+	AssetPack pack;
+	CHECK(pack.Open(path) == AssetPackError::None);
+	CHECK(pack.GetNumAssets() == 2);
+	CHECK(pack.FindAsset("Missing") == nullptr);
+
+	const AssetPackEntry* texture = pack.FindAsset("Texture");
+	CHECK(texture != nullptr);
+	if (texture)
+	{
+		CHECK(texture->MipLevels == 4 && texture->NumSubresources == 4);
+		AssetSubresourceData data[4];
+		pack.GetSubresourceData(*texture, data);
+		// Rows are re-laid out with the D3D12 pitch, so the second row starts a pitch in
+		CHECK(data[0].RowPitch == AssetPackPitchAlignment);
+		CHECK(static_cast<const uint8_t*>(data[0].Data)[0] == 0);
+		CHECK(static_cast<const uint8_t*>(data[0].Data)[AssetPackPitchAlignment] == 32);
+		CHECK(data[3].RowPitch == AssetPackPitchAlignment && data[3].SlicePitch == AssetPackPitchAlignment);
+	}
+
+	const AssetPackEntry* buffer = pack.FindAsset("Buffer");
+	CHECK(buffer != nullptr);
+	if (buffer)
+	{
+		AssetSubresourceData data;
+		pack.GetSubresourceData(*buffer, &data);
+		CHECK(buffer->ByteWidth == 10);
+		CHECK(memcmp(data.Data, "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a", 10) == 0);
+	}
+
+	pack.Close();
+	std::remove(path);
+}
+
+TEST(TruncatedAndForeignFilesAreRejected)
+{
+	std::vector<uint8_t> file = BuildPack();
+	CHECK(ValidateAssetPack(file.data(), 4) == AssetPackError::FileTooSmall);
+	CHECK(ValidateAssetPack(file.data(), file.size() - 1) == AssetPackError::SizeMismatch);
+
+	file[0] ^= 0xff;
+	CHECK(Validate(file) == AssetPackError::BadMagic);
+}
+
+TEST(ZeroMipLevelsAreRejected)
+{
+	std::vector<uint8_t> file = BuildPack();
+	GetEntry(file, "Texture")->MipLevels = 0;
+	CHECK(Validate(file) == AssetPackError::BadMipLevels);
+}
+
+TEST(MoreMipLevelsThanTheSizeAllowsAreRejected)
+{
+	std::vector<uint8_t> file = BuildPack();
+	AssetPackEntry* texture = GetEntry(file, "Texture");
+	texture->MipLevels = 5;
+	texture->NumSubresources = 5;
+	CHECK(Validate(file) != AssetPackError::None);
+}
+
+TEST(SubresourceCountMustMatchMipsArraySizeAndPlanes)
+{
+	std::vector<uint8_t> file = BuildPack();
+	AssetPackEntry* texture = GetEntry(file, "Texture");
+	texture->MipLevels = 2;
+	CHECK(Validate(file) == AssetPackError::SubresourceCountMismatch);
+
+	// Depth stencil formats have a second plane, so the same 4 subresources only cover 2 mips
+	texture->Format = FormatD24UnormS8Uint;
+	CHECK(Validate(file) == AssetPackError::None);
+}
+
+TEST(BadFormatsAreRejected)
+{
+	std::vector<uint8_t> file = BuildPack();
+	GetEntry(file, "Texture")->Format = 0;
+	CHECK(Validate(file) == AssetPackError::BadFormat);
+	GetEntry(file, "Texture")->Format = AssetPackMaxFormat + 1;
+	CHECK(Validate(file) == AssetPackError::BadFormat);
+
+	file = BuildPack();
+	GetEntry(file, "Buffer")->Format = FormatR8G8B8A8Unorm;
+	CHECK(Validate(file) == AssetPackError::BadFormat);
+}
+
+TEST(BadDimensionsAreRejected)
+{
+	std::vector<uint8_t> file = BuildPack();
+	GetEntry(file, "Texture")->Dimension = AssetPackDimensionBuffer;
+	CHECK(Validate(file) == AssetPackError::BadDimension);
+	GetEntry(file, "Texture")->Dimension = 7;
+	CHECK(Validate(file) == AssetPackError::BadDimension);
+
+	file = BuildPack();
+	GetEntry(file, "Texture")->Width = 0;
+	CHECK(Validate(file) == AssetPackError::BadDimension);
+
+	file = BuildPack();
+	GetEntry(file, "Buffer")->Dimension = AssetPackDimensionTexture2D;
+	CHECK(Validate(file) == AssetPackError::BadDimension);
+}
+
+TEST(BuffersTooLargeForThePackAreRejected)
+{
+	AssetPackWriter writer;
+	const uint8_t byte = 0;
+	// Rejected before the data is read, so one byte stands in for 4 GB
+	CHECK(!writer.AddBuffer("Huge", &byte, uint64_t(UINT32_MAX) + 1));
+}
+
+TEST(EmptyBuffersAreRejected)
+{
+	std::vector<uint8_t> file = BuildPack();
+	GetEntry(file, "Buffer")->Width = 0;
+	CHECK(Validate(file) == AssetPackError::BadDimension);
+}
+
+TEST(BufferByteWidthMustMatchItsWidth)
+{
+	std::vector<uint8_t> file = BuildPack();
+	GetEntry(file, "Buffer")->ByteWidth = 4096;
+	CHECK(Validate(file) == AssetPackError::ByteWidthMismatch);
+}
+
+TEST(BufferRowMustHoldTheWholeBuffer)
+{
+	std::vector<uint8_t> file = BuildPack();
+	AssetPackSubresource* subresource = GetSubresource(file, GetEntry(file, "Buffer")->FirstSubresource);
+	// Still a consistent layout on its own, just shorter than the buffer
+	subresource->RowSizeInBytes = 4;
+	subresource->RowPitch = 4;
+	subresource->SlicePitch = 4;
+	CHECK(Validate(file) == AssetPackError::ByteWidthMismatch);
+}
+
+TEST(TextureByteWidthMustMatchItsPayloads)
+{
+	std::vector<uint8_t> file = BuildPack();
+	GetEntry(file, "Texture")->ByteWidth += 1;
+	CHECK(Validate(file) == AssetPackError::ByteWidthMismatch);
+
+	file = BuildPack();
+	GetEntry(file, "Texture")->ByteWidth -= 1;
+	CHECK(Validate(file) == AssetPackError::ByteWidthMismatch);
+}
+
+TEST(OverlappingPayloadsAreRejected)
+{
+	std::vector<uint8_t> file = BuildPack();
+	const uint32_t firstSubresource = GetEntry(file, "Texture")->FirstSubresource;
+	// Mip 1 moved back onto mip 0, still aligned and within the file
+	GetSubresource(file, firstSubresource + 1)->Offset = GetSubresource(file, firstSubresource)->Offset;
+	CHECK(Validate(file) == AssetPackError::PayloadsOutOfOrder);
+}
+
+int main()
+{
+	return RunTests();
+}
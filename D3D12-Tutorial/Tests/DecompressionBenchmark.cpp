@@ -0,0 +1,94 @@
+// Decompression throughput of chunked LZ4 streams on a synthetic dataset, with the Decompressor on 1 worker up
+// to one per hardware thread, and checks every run decompressed correctly. Build with optimisations:
+//
+//	g++ -std=c++14 -O2 -pthread -I.. DecompressionBenchmark.cpp -o DecompressionBenchmark
+//	./DecompressionBenchmark [megabytes, 256 by default]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../ChunkedCompression.h"
+
+namespace
+{
+	// Texture-like data: 4 byte texels forming smooth gradients, with noise in the low bits of some regions,
+	// and some runs of a flat colour. Compresses to somewhere near half its size, like typical colour maps.
+	std::vector<uint8_t> MakeDataset(size_t size)
+	{
+		std::vector<uint8_t> data(size);
+		std::mt19937 random(1234);
+		const size_t regionSize = 16 * 1024;
+		for (size_t regionStart = 0; regionStart < size; regionStart += regionSize)
+		{
+			const uint32_t kind = random() % 4;
+			const uint32_t noiseMask = kind == 0 ? 0x0f : kind == 1 ? 0x03 : 0;
+			const uint8_t flat = static_cast<uint8_t>(random());
+			for (size_t i = regionStart; i < std::min(size, regionStart + regionSize); i++)
+			{
+				const size_t texel = i / 4;
+				uint8_t value = kind == 3 ? flat : static_cast<uint8_t>(texel * (i % 4 + 1) / 64);
+				value ^= static_cast<uint8_t>(random() & noiseMask);
+				data[i] = value;
+			}
+		}
+		return data;
+	}
+
+	double Seconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const size_t megabytes = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : 256;
+	const size_t size = megabytes * 1024 * 1024;
+	const int repeats = 5;
+
+	const std::vector<uint8_t> data = MakeDataset(size);
+	const std::vector<uint8_t> stream = CompressChunked(data.data(), data.size());
+	printf("%zu MB in %u KB chunks, compressed to %.1f%%\n", megabytes, CompressedStreamDefaultChunkSize / 1024,
+		100.0 * stream.size() / size);
+
+	std::vector<uint8_t> output(size);
+	bool allMatched = true;
+	const uint32_t maxWorkers = GetDefaultNumWorkerThreads();
+	for (uint32_t numWorkers = 1; numWorkers <= maxWorkers;
+		numWorkers = numWorkers < maxWorkers ? std::min(numWorkers * 2, maxWorkers) : numWorkers + 1)
+	{
+		// The waiting thread decompresses chunks too
+		JobSystem jobSystem;
+		jobSystem.Initialize(numWorkers);
+		Decompressor decompressor;
+		decompressor.Initialize(jobSystem);
+
+		double best = 1e30;
+		for (int repeat = 0; repeat < repeats; repeat++)
+		{
+			memset(output.data(), 0, output.size());
+			DecompressJob job;
+			const auto start = std::chrono::steady_clock::now();
+			const bool began = decompressor.Begin(job, stream.data(), stream.size(), output.data(), output.size());
+			const DecompressStatus status = began ? decompressor.Wait(job) : DecompressStatus::Failed;
+			best = std::min(best, Seconds(start));
+
+			if (status != DecompressStatus::Complete || output != data)
+			{
+				allMatched = false;
+			}
+		}
+		printf("%2u workers: %8.1f MB/s\n", numWorkers, megabytes / best);
+	}
+
+	if (!allMatched)
+	{
+		printf("Decompressed data does not match the original\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+#include "../ChunkedCompression.h"
+
+// Corrupt LZ4 blocks and chunked streams must fail without reading past the end of their input or writing
+// outside their output. Writes are caught by guard bytes around the output; build with -fsanitize=address to
+// catch reads too, since every input is a vector of exactly its size.
+
+namespace
+{
+	const size_t GuardSize = 64;
+	const uint8_t GuardValue = 0xcd;
+
+	// An output buffer of size bytes with guard bytes on both sides
+	class GuardedBuffer
+	{
+	public:
+		explicit GuardedBuffer(size_t size)
+			: m_Bytes(size + 2 * GuardSize, GuardValue)
+			, m_Size(size)
+		{}
+
+		uint8_t* Data() { return m_Bytes.data() + GuardSize; }
+		size_t Size() const { return m_Size; }
+
+		bool AreGuardsIntact() const
+		{
+			for (size_t i = 0; i < GuardSize; i++)
+			{
+				if (m_Bytes[i] != GuardValue || m_Bytes[GuardSize + m_Size + i] != GuardValue)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+	private:
+		std::vector<uint8_t> m_Bytes;
+		size_t m_Size;
+	};
+
+	// Repetitive enough to compress into long matches, with some literals between them
+	std::vector<uint8_t> MakeData(size_t size)
+	{
+		std::vector<uint8_t> data(size);
+		for (size_t i = 0; i < size; i++)
+		{
+			data[i] = static_cast<uint8_t>((i / 7) % 13 + (i % 97 == 0 ? i : 0));
+		}
+		return data;
+	}
+
+	bool Decompress(const std::vector<uint8_t>& block, GuardedBuffer& output)
+	{
+		return Lz4::Decompress(block.data(), block.size(), output.Data(), output.Size());
+	}
+}
+
+TEST(ValidBlockRoundTrips)
+{
+	const std::vector<uint8_t> data = MakeData(4096);
+	const std::vector<uint8_t> block = Lz4::Compress(data.data(), data.size());
+	CHECK(block.size() < data.size());
+
+	GuardedBuffer output(data.size());
+	CHECK(Decompress(block, output));
+	CHECK(memcmp(output.Data(), data.data(), data.size()) == 0);
+	CHECK(output.AreGuardsIntact());
+}
+
+TEST(TruncatedBlocksFail)
+{
+	const std::vector<uint8_t> data = MakeData(4096);
+	const std::vector<uint8_t> block = Lz4::Compress(data.data(), data.size());
+
+	// Cut at every length, so the end falls in a token, a length, the literals and an offset in turn
+	bool allFailed = true;
+	bool guardsIntact = true;
+	for (size_t size = 0; size < block.size(); size++)
+	{
+		const std::vector<uint8_t> truncated(block.begin(), block.begin() + size);
+		GuardedBuffer output(data.size());
+		allFailed &= !Decompress(truncated, output);
+		guardsIntact &= output.AreGuardsIntact();
+	}
+	CHECK(allFailed);
+	CHECK(guardsIntact);
+}
+
+TEST(MatchOffsetsBeforeTheOutputFail)
+{
+	GuardedBuffer output(64);
+
+	// One literal, then a match 2 bytes back, with only 1 byte written
+	const std::vector<uint8_t> beforeStart = { 0x10, 'A', 2, 0, 0x00, 'B', 'C', 'D', 'E', 'F' };
+	CHECK(!Decompress(beforeStart, output));
+
+	// The furthest offset there is, with nothing written
+	const std::vector<uint8_t> farBeforeStart = { 0x00, 0xff, 0xff, 0x00, 'A', 'B', 'C', 'D', 'E' };
+	CHECK(!Decompress(farBeforeStart, output));
+
+	// Offset 0 is never valid
+	const std::vector<uint8_t> zeroOffset = { 0x40, 'A', 'B', 'C', 'D', 0, 0, 0x00, 'E' };
+	CHECK(!Decompress(zeroOffset, output));
+
+	CHECK(output.AreGuardsIntact());
+}
+
+TEST(OversizedLiteralLengthsFail)
+{
+	GuardedBuffer output(64);
+
+	// 15 + 255 + 10 literals claimed, with the input holding them all but the output only 64 bytes
+	std::vector<uint8_t> moreThanOutput = { 0xf0, 255, 10 };
+	moreThanOutput.resize(moreThanOutput.size() + 15 + 255 + 10, 'L');
+	CHECK(!Decompress(moreThanOutput, output));
+
+	// 20 literals claimed, 8 present
+	const std::vector<uint8_t> moreThanInput = { 0xf0, 5, 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H' };
+	CHECK(!Decompress(moreThanInput, output));
+
+	// A length which continues to the end of the input
+	const std::vector<uint8_t> unterminated = { 0xf0, 255, 255, 255 };
+	CHECK(!Decompress(unterminated, output));
+
+	CHECK(output.AreGuardsIntact());
+}
+
+TEST(OversizedMatchLengthsFail)
+{
+	GuardedBuffer output(64);
+
+	// One literal, repeated 4 + 15 + 255 times by a match
+	const std::vector<uint8_t> moreThanOutput = { 0x1f, 'A', 1, 0, 255, 0, 0x00, 'B' };
+	CHECK(!Decompress(moreThanOutput, output));
+
+	// A match length which continues to the end of the input
+	const std::vector<uint8_t> unterminated = { 0x1f, 'A', 1, 0, 255, 255 };
+	CHECK(!Decompress(unterminated, output));
+
+	// A match which fits, but leaves the output short of its size
+	const std::vector<uint8_t> shortOfOutput = { 0x10, 'A', 1, 0, 0x00, 'B' };
+	CHECK(!Decompress(shortOfOutput, output));
+
+	CHECK(output.AreGuardsIntact());
+}
+
+TEST(CorruptChunksFailTheStream)
+{
+	const uint32_t chunkSize = 1024;
+	const std::vector<uint8_t> data = MakeData(8 * chunkSize);
+	std::vector<uint8_t> stream = CompressChunked(data.data(), data.size(), chunkSize);
+
+	// Shorten a compressed chunk in the table, so it decodes a truncated block
+	CompressedChunk* chunks = reinterpret_cast<CompressedChunk*>(stream.data() + sizeof(CompressedStreamHeader));
+	CHECK(chunks[3].CompressedSize < chunkSize);
+	chunks[3].CompressedSize /= 2;
+
+	JobSystem jobs;
+	jobs.Initialize(2);
+	Decompressor decompressor;
+	decompressor.Initialize(jobs);
+
+	GuardedBuffer output(data.size());
+	DecompressJob job;
+	CHECK(decompressor.Begin(job, stream.data(), stream.size(), output.Data(), output.Size()));
+	CHECK(decompressor.Wait(job) == DecompressStatus::Failed);
+	CHECK(output.AreGuardsIntact());
+
+	// The other chunks still decompressed
+	CHECK(memcmp(output.Data(), data.data(), 3 * chunkSize) == 0);
+}
+
+TEST(MalformedStreamsAreNotQueued)
+{
+	const std::vector<uint8_t> data = MakeData(4096);
+	const std::vector<uint8_t> stream = CompressChunked(data.data(), data.size(), 1024);
+
+	JobSystem jobs;
+	jobs.Initialize(1);
+	Decompressor decompressor;
+	decompressor.Initialize(jobs);
+	GuardedBuffer output(data.size());
+	DecompressJob job;
+
+	// Cut off in the chunk table
+	CHECK(!decompressor.Begin(job, stream.data(), sizeof(CompressedStreamHeader) + 8, output.Data(), output.Size()));
+	CHECK(job.Poll() == DecompressStatus::Failed);
+
+	// Chunk payloads past the end of the stream
+	std::vector<uint8_t> truncated(stream.begin(), stream.end() - 1);
+	CHECK(!decompressor.Begin(job, truncated.data(), truncated.size(), output.Data(), output.Size()));
+
+	// A destination of the wrong size
+	CHECK(!decompressor.Begin(job, stream.data(), stream.size(), output.Data(), output.Size() - 1));
+
+	CHECK(output.AreGuardsIntact());
+}
+
+int main()
+{
+	return RunTests();
+}
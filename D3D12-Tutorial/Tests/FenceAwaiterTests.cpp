@@ -0,0 +1,171 @@
+#include "Test.h"
+
+#include <atomic>
+#include <thread>
+
+#include "../FenceAwaiter.h"
+#include "../JobSystem.h"
+
+namespace
+{
+	// Completes whatever value the test sets, from any thread
+	class FakeFence
+	{
+	public:
+		bool IsComplete(uint64_t fenceValue) const { return m_CompletedValue.load(std::memory_order_acquire) >= fenceValue; }
+		void Complete(uint64_t fenceValue) { m_CompletedValue.store(fenceValue, std::memory_order_release); }
+
+	private:
+		std::atomic<uint64_t> m_CompletedValue{ 0 };
+	};
+
+	// Stands in for a coroutine handle where coroutines aren't available, counting resumes
+	struct FakeCoroutine
+	{
+		uint32_t* NumResumes;
+		void resume() { (*NumResumes)++; }
+	};
+}
+
+TEST(CompletedFenceIsReadyWithoutScheduling)
+{
+	FakeFence fence;
+	fence.Complete(5);
+	ThreadResumeQueue queue;
+	CHECK(WaitForFence(fence, 5, queue).await_ready());
+	CHECK(WaitForFence(fence, 3, queue).await_ready());
+	CHECK(!WaitForFence(fence, 6, queue).await_ready());
+	CHECK(queue.GetNumWaiting() == 0);
+}
+
+TEST(PumpResumesOnceTheFenceIsReached)
+{
+	FakeFence fence;
+	ThreadResumeQueue queue;
+	uint32_t numResumes = 0;
+	FenceAwaiter<FakeFence> awaiter = WaitForFence(fence, 2, queue);
+	CHECK(!awaiter.await_ready());
+	awaiter.await_suspend(FakeCoroutine{ &numResumes });
+	CHECK(queue.GetNumWaiting() == 1);
+
+	queue.Pump();
+	fence.Complete(1);
+	queue.Pump();
+	CHECK(numResumes == 0 && queue.GetNumWaiting() == 1);
+
+	fence.Complete(2);
+	queue.Pump();
+	CHECK(numResumes == 1 && queue.GetNumWaiting() == 0);
+	// Resumed only once
+	queue.Pump();
+	CHECK(numResumes == 1);
+}
+
+TEST(SwitchAlwaysSuspends)
+{
+	ThreadResumeQueue queue;
+	uint32_t numResumes = 0;
+	SwitchAwaiter awaiter = ResumeOn(queue);
+	CHECK(!awaiter.await_ready());
+	awaiter.await_suspend(FakeCoroutine{ &numResumes });
+	queue.Pump();
+	CHECK(numResumes == 1);
+}
+
+#if FENCE_AWAITER_COROUTINES
+namespace
+{
+	// Records each step, and the thread it ran on
+	struct Progress
+	{
+		std::atomic<uint32_t> Step{ 0 };
+		std::thread::id ThreadId;
+	};
+
+	AsyncTask WaitThenContinue(const FakeFence& fence, uint64_t fenceValue, ResumeScheduler& scheduler, Progress& progress)
+	{
+		progress.Step = 1;
+		co_await WaitForFence(fence, fenceValue, scheduler);
+		progress.ThreadId = std::this_thread::get_id();
+		progress.Step = 2;
+	}
+
+	AsyncTask SwitchThenContinue(ResumeScheduler& scheduler, Progress& progress)
+	{
+		progress.Step = 1;
+		co_await ResumeOn(scheduler);
+		progress.ThreadId = std::this_thread::get_id();
+		progress.Step = 2;
+	}
+}
+
+TEST(CoroutineCarriesOnWhenTheFenceIsAlreadyReached)
+{
+	FakeFence fence;
+	fence.Complete(10);
+	ThreadResumeQueue queue;
+	Progress progress;
+	WaitThenContinue(fence, 10, queue, progress);
+	CHECK(progress.Step == 2);
+	CHECK(progress.ThreadId == std::this_thread::get_id());
+	CHECK(queue.GetNumWaiting() == 0);
+}
+
+TEST(CoroutineResumesOnThePumpingThread)
+{
+	FakeFence fence;
+	ThreadResumeQueue queue;
+	Progress progress;
+	WaitThenContinue(fence, 1, queue, progress);
+	CHECK(progress.Step == 1 && queue.GetNumWaiting() == 1);
+	queue.Pump();
+	CHECK(progress.Step == 1);
+
+	// The GPU finishes, and another thread, like the render thread at the start of a frame, pumps the queue
+	fence.Complete(1);
+	std::thread::id pumpingThread;
+	std::thread renderThread([&queue, &pumpingThread]()
+	{
+		pumpingThread = std::this_thread::get_id();
+		queue.Pump();
+	});
+	renderThread.join();
+	CHECK(progress.Step == 2);
+	CHECK(progress.ThreadId == pumpingThread);
+}
+
+TEST(ResumeOnMovesToTheScheduler)
+{
+	ThreadResumeQueue queue;
+	Progress progress;
+	SwitchThenContinue(queue, progress);
+	CHECK(progress.Step == 1);
+	queue.Pump();
+	CHECK(progress.Step == 2 && progress.ThreadId == std::this_thread::get_id());
+}
+
+TEST(JobResumeSchedulerResumesOnAWorker)
+{
+	JobSystem jobs;
+	jobs.Initialize(2);
+	JobResumeScheduler scheduler(jobs);
+	FakeFence fence;
+	Progress progress;
+	WaitThenContinue(fence, 7, scheduler, progress);
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	CHECK(progress.Step == 1);
+
+	fence.Complete(7);
+	while (progress.Step != 2)
+	{
+		std::this_thread::yield();
+	}
+	CHECK(progress.ThreadId != std::this_thread::get_id());
+	jobs.Shutdown();
+}
+#endif
+
+int main()
+{
+	return RunTests();
+}
@@ -0,0 +1,175 @@
+#include "Test.h"
+
+#include "../FrameLimiter.h"
+
+namespace
+{
+	// Microsecond ticks which only move when the limiter sleeps or spins, or a frame's work is simulated. Sleeps
+	// wake up Lateness ticks after their deadline, and each spin takes a tick.
+	class FakeClock : public FrameLimiter::Clock
+	{
+	public:
+		FrameLimiter::Ticks Now() override { return m_Now; }
+		FrameLimiter::Ticks GetTicksPerSecond() override { return 1000000; }
+
+		void SleepUntil(FrameLimiter::Ticks deadline) override
+		{
+			m_NumSleeps++;
+			m_Now = std::max(m_Now, deadline + Lateness);
+		}
+
+		void Spin() override
+		{
+			m_NumSpins++;
+			m_Now++;
+		}
+
+		void Advance(FrameLimiter::Ticks ticks) { m_Now += ticks; }
+
+		uint32_t GetNumSleeps() const { return m_NumSleeps; }
+		uint64_t GetNumSpins() const { return m_NumSpins; }
+		void ResetCounts() { m_NumSleeps = 0; m_NumSpins = 0; }
+
+		FrameLimiter::Ticks Lateness = 0;
+
+	private:
+		FrameLimiter::Ticks m_Now = 5000000;
+		uint32_t m_NumSleeps = 0;
+		uint64_t m_NumSpins = 0;
+	};
+
+	// 60 fps
+	const FrameLimiter::Ticks Period = 16666;
+
+	struct Harness
+	{
+		Harness()
+		{
+			Limiter.Initialize(&Clock);
+			Limiter.SetTargetFrameTime(static_cast<double>(Period) / 1000000.0);
+		}
+
+		// Waits for the frame to start, then works on it for workTicks. Returns when the frame started.
+		FrameLimiter::Ticks RunFrame(FrameLimiter::Ticks workTicks)
+		{
+			Limiter.Wait();
+			const FrameLimiter::Ticks start = Clock.Now();
+			Clock.Advance(workTicks);
+			return start;
+		}
+
+		FakeClock Clock;
+		FrameLimiter Limiter;
+	};
+}
+
+TEST(NoTargetNeverWaits)
+{
+	FakeClock clock;
+	FrameLimiter limiter;
+	limiter.Initialize(&clock);
+	limiter.SetTargetFrameRate(0.0);
+	const FrameLimiter::Ticks start = clock.Now();
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		limiter.Wait();
+	}
+	CHECK(!limiter.IsEnabled());
+	CHECK(clock.Now() == start && clock.GetNumSleeps() == 0 && clock.GetNumSpins() == 0);
+}
+
+TEST(FramesStartOnePeriodApart)
+{
+	Harness harness;
+	FrameLimiter::Ticks previous = harness.RunFrame(3000);
+	for (uint32_t i = 0; i < 20; i++)
+	{
+		const FrameLimiter::Ticks start = harness.RunFrame(3000);
+		CHECK(start - previous == Period);
+		previous = start;
+	}
+	// Mostly asleep: the timer is on time, so the spin tail stays small
+	CHECK(harness.Clock.GetNumSleeps() == 20);
+	CHECK(harness.Limiter.GetSpinTail() <= 1000);
+}
+
+TEST(ScheduleDoesNotDriftWithUnevenWork)
+{
+	Harness harness;
+	harness.Clock.Lateness = 200;
+	const FrameLimiter::Ticks first = harness.RunFrame(0);
+	const FrameLimiter::Ticks work[] = { 1000, 12000, 500, 16000, 7000, 9000 };
+	for (uint32_t i = 1; i <= 30; i++)
+	{
+		const FrameLimiter::Ticks start = harness.RunFrame(work[i % 6]);
+		CHECK(start == first + i * Period);
+	}
+}
+
+TEST(SpinTailFollowsTheTimersLateness)
+{
+	Harness harness;
+	harness.RunFrame(0);
+
+	// A timer waking up 1.5 ms late grows the tail to cover it straight away
+	harness.Clock.Lateness = 1500;
+	harness.RunFrame(1000);
+	CHECK(harness.Limiter.GetSpinTail() == 3000);
+	// Even later is clamped to the 4 ms maximum
+	harness.Clock.Lateness = 3000;
+	harness.RunFrame(1000);
+	CHECK(harness.Limiter.GetSpinTail() == 4000);
+
+	// Back on time, the tail shrinks slowly down to the 0.5 ms minimum, and with it the time spent spinning
+	harness.Clock.Lateness = 0;
+	FrameLimiter::Ticks previousTail = harness.Limiter.GetSpinTail();
+	for (uint32_t i = 0; i < 100; i++)
+	{
+		harness.RunFrame(1000);
+		CHECK(harness.Limiter.GetSpinTail() <= previousTail);
+		previousTail = harness.Limiter.GetSpinTail();
+	}
+	CHECK(harness.Limiter.GetSpinTail() == 500);
+	harness.Clock.ResetCounts();
+	harness.RunFrame(1000);
+	CHECK(harness.Clock.GetNumSpins() == 500);
+}
+
+TEST(TimerWakingPastTheDeadlineDoesNotSpin)
+{
+	Harness harness;
+	harness.RunFrame(0);
+	harness.Clock.Lateness = 5000;
+	harness.Clock.ResetCounts();
+	harness.RunFrame(0);
+	CHECK(harness.Clock.GetNumSleeps() == 1 && harness.Clock.GetNumSpins() == 0);
+}
+
+TEST(OverrunRestartsTheSchedule)
+{
+	Harness harness;
+	harness.RunFrame(0);
+	harness.RunFrame(0);
+	// A hitch of two and a half periods
+	const FrameLimiter::Ticks late = harness.RunFrame(2 * Period + Period / 2);
+	const FrameLimiter::Ticks afterHitch = harness.RunFrame(1000);
+	// Started as soon as the hitch was over, and the next frames are a whole period apart, not rushed
+	CHECK(afterHitch == late + 2 * Period + Period / 2);
+	CHECK(harness.RunFrame(1000) == afterHitch + Period);
+	CHECK(harness.RunFrame(1000) == afterHitch + 2 * Period);
+}
+
+TEST(ChangingTheTargetRestartsTheSchedule)
+{
+	Harness harness;
+	harness.RunFrame(0);
+	harness.RunFrame(0);
+	harness.Limiter.SetTargetFrameRate(30.0);
+	const FrameLimiter::Ticks first = harness.RunFrame(0);
+	CHECK(harness.RunFrame(0) == first + 33333);
+}
+
+int main()
+{
+	return RunTests();
+}
@@ -0,0 +1,277 @@
+#include "Test.h"
+
+#include <atomic>
+#include <new>
+
+#include "../FramePacing.h"
+#include "../LatencyTracker.h"
+
+// Counts heap allocations, to check that what runs every frame makes none
+std::atomic<uint64_t> g_NumAllocations{ 0 };
+
+// Once these are inlined, GCC sees memory from operator new handed to free and warns, although new and delete
+// are both replaced here, with malloc and free, so they do match
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+	g_NumAllocations.fetch_add(1);
+	if (void* memory = std::malloc(size > 0 ? size : 1))
+	{
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+	// A 60 Hz display on a clock of 60000 ticks a second, so each refresh is 1000 ticks
+	const int64_t TicksPerSecond = 60000;
+	const int64_t TicksPerRefresh = 1000;
+	const double RefreshPeriod = 1000.0 / 60.0;
+
+	// Makes up the statistics a swap chain would report, sampled right after each present reaches the display
+	class FakeDisplay
+	{
+	public:
+		explicit FakeDisplay(uint32_t presentCount = 0, uint32_t refreshCount = 0)
+			: m_PresentCount(presentCount)
+			, m_RefreshCount(refreshCount)
+		{}
+
+		// presents more presents were made, and the latest is shown refreshes vblanks after the previous one
+		PresentStatistics Show(uint32_t refreshes, uint32_t presents = 1)
+		{
+			m_PresentCount += presents;
+			m_RefreshCount += refreshes;
+			m_Time += refreshes * TicksPerRefresh;
+			return PresentStatistics{ m_PresentCount, m_RefreshCount, m_RefreshCount, m_Time };
+		}
+
+	private:
+		uint32_t m_PresentCount;
+		uint32_t m_RefreshCount;
+		int64_t m_Time = 1000000;
+	};
+
+	FramePacingAnalyzer MakeAnalyzer()
+	{
+		FramePacingAnalyzer analyzer;
+		analyzer.Initialize(TicksPerSecond);
+		return analyzer;
+	}
+
+	bool IsNear(double a, double b)
+	{
+		return std::fabs(a - b) < 0.001;
+	}
+}
+
+TEST(SteadyFramesAreEven)
+{
+	FramePacingAnalyzer analyzer = MakeAnalyzer();
+	FakeDisplay display;
+	for (uint32_t i = 0; i < 20; i++)
+	{
+		analyzer.AddSample(display.Show(1), 1);
+	}
+	// The first sample is only what the rest are compared with
+	CHECK(analyzer.GetNumPresents() == 19);
+	CHECK(IsNear(analyzer.GetRefreshPeriod(), RefreshPeriod));
+	CHECK(analyzer.GetNumMissedVBlanks() == 0);
+	CHECK(analyzer.GetNumDuplicatedFrames() == 0);
+	CHECK(analyzer.GetNumIrregularIntervals() == 0);
+}
+
+TEST(MissedVBlankShowsThePreviousFrameAgain)
+{
+	FramePacingAnalyzer analyzer = MakeAnalyzer();
+	FakeDisplay display;
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		analyzer.AddSample(display.Show(1), 1);
+	}
+	// One late frame, shown a refresh later than it should have been
+	analyzer.AddSample(display.Show(2), 1);
+	analyzer.AddSample(display.Show(1), 1);
+
+	CHECK(analyzer.GetNumMissedVBlanks() == 1);
+	CHECK(analyzer.GetNumDuplicatedFrames() == 1);
+	// And it was on screen twice as long as the rest
+	CHECK(analyzer.GetNumIrregularIntervals() == 1);
+}
+
+TEST(LongStallDuplicatesSeveralFrames)
+{
+	FramePacingAnalyzer analyzer = MakeAnalyzer();
+	FakeDisplay display;
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		analyzer.AddSample(display.Show(2), 2);
+	}
+	// At sync interval 2, a frame 3 refreshes late held the previous one for 3 more
+	analyzer.AddSample(display.Show(5), 2);
+
+	CHECK(analyzer.GetNumMissedVBlanks() == 1);
+	CHECK(analyzer.GetNumDuplicatedFrames() == 3);
+}
+
+TEST(AlternatingCadenceIsIrregular)
+{
+	// Not synced to vblank, so nothing counts as missed, but frames alternate one and two refreshes on screen:
+	// 40 fps on average, stuttering all the way
+	FramePacingAnalyzer analyzer = MakeAnalyzer();
+	FakeDisplay display;
+	for (uint32_t i = 0; i < 40; i++)
+	{
+		analyzer.AddSample(display.Show(1 + i % 2), 0);
+	}
+	CHECK(analyzer.GetNumMissedVBlanks() == 0);
+	CHECK(analyzer.GetNumDuplicatedFrames() == 0);
+	CHECK(analyzer.GetNumIrregularIntervals() >= 19);
+}
+
+TEST(SeveralPresentsBetweenSamplesAreAveraged)
+{
+	FramePacingAnalyzer analyzer = MakeAnalyzer();
+	FakeDisplay display;
+	analyzer.AddSample(display.Show(1), 1);
+	analyzer.AddSample(display.Show(1), 1);
+	// Three presents on three refreshes reached the display since the last sample: all on time
+	analyzer.AddSample(display.Show(3, 3), 1);
+	CHECK(analyzer.GetNumPresents() == 4);
+	CHECK(analyzer.GetNumMissedVBlanks() == 0);
+	CHECK(analyzer.GetNumIrregularIntervals() == 0);
+
+	// A sample where nothing new was displayed is ignored
+	analyzer.AddSample(display.Show(0, 0), 1);
+	CHECK(analyzer.GetNumPresents() == 4);
+}
+
+TEST(CountsWrapAround)
+{
+	// Present and refresh counts are 32 bits, and wrap after a couple of years at 60 Hz
+	FramePacingAnalyzer analyzer = MakeAnalyzer();
+	FakeDisplay display(0xfffffff0u, 0xfffffff8u);
+	for (uint32_t i = 0; i < 30; i++)
+	{
+		analyzer.AddSample(display.Show(1), 1);
+	}
+	CHECK(analyzer.GetNumPresents() == 29);
+	CHECK(analyzer.GetNumMissedVBlanks() == 0);
+	CHECK(analyzer.GetNumIrregularIntervals() == 0);
+	CHECK(IsNear(analyzer.GetRefreshPeriod(), RefreshPeriod));
+
+	// A missed vblank across the wrap is still one missed vblank
+	FakeDisplay wrapping(100, 0xffffffffu);
+	FramePacingAnalyzer late = MakeAnalyzer();
+	late.AddSample(wrapping.Show(0), 1);
+	late.AddSample(wrapping.Show(2), 1);
+	CHECK(late.GetNumMissedVBlanks() == 1 && late.GetNumDuplicatedFrames() == 1);
+}
+
+TEST(DiscontinuityStartsAfresh)
+{
+	FramePacingAnalyzer analyzer = MakeAnalyzer();
+	FakeDisplay display;
+	analyzer.AddSample(display.Show(1), 1);
+	// E.g. the statistics were disjoint for a while, across a mode change
+	analyzer.Discontinuity();
+	analyzer.AddSample(display.Show(50, 20), 1);
+	analyzer.AddSample(display.Show(1), 1);
+	CHECK(analyzer.GetNumPresents() == 1);
+	CHECK(analyzer.GetNumMissedVBlanks() == 0);
+}
+
+TEST(DisplayTimesMatchPresentsAcrossTheWrap)
+{
+	// The same statistics give the latency tracker when each present was shown
+	LatencyTracker tracker;
+	tracker.Initialize(TicksPerSecond);
+	FakeDisplay display(0xfffffffeu, 0);
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		tracker.RecordInput(i * TicksPerRefresh);
+		tracker.BeginFrame();
+		// Presented half a refresh after input, and shown two refreshes after input
+		tracker.MarkPresented(i * TicksPerRefresh + TicksPerRefresh / 2, 0xffffffffu + i);
+		const PresentStatistics statistics = display.Show(1);
+		tracker.MarkDisplayed(statistics.PresentCount, i * TicksPerRefresh + 2 * TicksPerRefresh);
+	}
+	CHECK(tracker.GetNumInputToDisplaySamples() == 4);
+	CHECK(IsNear(tracker.GetInputToDisplay(50.0), 2.0 * RefreshPeriod));
+	CHECK(IsNear(tracker.GetInputToPresent(50.0), 0.5 * RefreshPeriod));
+}
+
+TEST(FramesWithoutDisplayTimesAreDropped)
+{
+	LatencyTracker tracker;
+	tracker.Initialize(TicksPerSecond);
+	// More frames than can be queued go by without statistics, then the latest is shown
+	for (uint32_t i = 1; i <= 40; i++)
+	{
+		tracker.RecordInput(i * TicksPerRefresh);
+		tracker.BeginFrame();
+		tracker.MarkPresented(i * TicksPerRefresh, i);
+	}
+	// Present 20 was dropped to make room
+	tracker.MarkDisplayed(20, 50 * TicksPerRefresh);
+	CHECK(tracker.GetNumInputToDisplaySamples() == 0);
+	tracker.MarkDisplayed(30, 50 * TicksPerRefresh);
+	CHECK(tracker.GetNumInputToDisplaySamples() == 1);
+	CHECK(IsNear(tracker.GetInputToDisplay(50.0), 20.0 * RefreshPeriod));
+	// Frames before it won't be matched later
+	tracker.MarkDisplayed(28, 60 * TicksPerRefresh);
+	CHECK(tracker.GetNumInputToDisplaySamples() == 1);
+	tracker.MarkDisplayed(40, 60 * TicksPerRefresh);
+	CHECK(tracker.GetNumInputToDisplaySamples() == 2);
+}
+
+TEST(PerFrameCallsDontAllocate)
+{
+	// Small windows, so the rings wrap many times
+	FramePacingAnalyzer analyzer;
+	analyzer.Initialize(TicksPerSecond, 30);
+	LatencyTracker tracker;
+	tracker.Initialize(TicksPerSecond, 50);
+	FakeDisplay display;
+
+	const uint64_t numAllocations = g_NumAllocations.load();
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		const LatencyTracker::Ticks now = i * TicksPerRefresh;
+		tracker.RecordInput(now);
+		tracker.BeginFrame();
+		const PresentStatistics statistics = display.Show(i % 7 == 0 ? 2 : 1);
+		tracker.MarkPresented(now, statistics.PresentCount);
+		// Shown two frames later
+		tracker.MarkDisplayed(statistics.PresentCount - 2, now + TicksPerRefresh);
+		analyzer.AddSample(statistics, 1);
+	}
+	CHECK(g_NumAllocations.load() == numAllocations);
+	CHECK(analyzer.GetNumMissedVBlanks() > 0);
+	CHECK(tracker.GetNumInputToDisplaySamples() == 50);
+}
+
+int main()
+{
+	return RunTests();
+}
@@ -0,0 +1,210 @@
+#include "Test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../FramePipeline.h"
+
+namespace
+{
+	struct Snapshot
+	{
+		uint64_t Frame = 0;
+		// Filled in with the frame too, to catch a snapshot read while the simulation is writing it
+		uint64_t Payload[16] = {};
+	};
+
+	// Simulation which numbers its frames, and counts any it starts more than a frame ahead of rendering
+	class Simulation
+	{
+	public:
+		void Simulate(Snapshot& snapshot)
+		{
+			const uint64_t frame = m_NumSimulated.load() + 1;
+			if (frame > m_NumAcquired.load() + 1)
+			{
+				m_NumTooFarAhead.fetch_add(1);
+			}
+			snapshot.Frame = frame;
+			for (uint64_t& value : snapshot.Payload)
+			{
+				value = frame;
+			}
+			m_NumSimulated.store(frame);
+		}
+
+		// Called by the render side once it holds a frame's snapshot
+		void Acquired(uint64_t frame) { m_NumAcquired.store(frame); }
+
+		uint64_t GetNumSimulated() const { return m_NumSimulated.load(); }
+		uint32_t GetNumTooFarAhead() const { return m_NumTooFarAhead.load(); }
+
+	private:
+		std::atomic<uint64_t> m_NumSimulated{ 0 };
+		std::atomic<uint64_t> m_NumAcquired{ 0 };
+		std::atomic<uint32_t> m_NumTooFarAhead{ 0 };
+	};
+
+	bool IsWhole(const Snapshot& snapshot)
+	{
+		for (uint64_t value : snapshot.Payload)
+		{
+			if (value != snapshot.Frame)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+TEST(TripleBufferReaderGetsTheLatestOnly)
+{
+	TripleBuffer<int> buffer;
+	CHECK(!buffer.Acquire());
+
+	buffer.GetWriteBuffer() = 1;
+	buffer.Publish();
+	buffer.GetWriteBuffer() = 2;
+	buffer.Publish();
+	CHECK(buffer.Acquire());
+	CHECK(buffer.GetReadBuffer() == 2);
+	// Nothing new since
+	CHECK(!buffer.Acquire());
+	CHECK(buffer.GetReadBuffer() == 2);
+
+	buffer.GetWriteBuffer() = 3;
+	buffer.Publish();
+	CHECK(buffer.Acquire());
+	CHECK(buffer.GetReadBuffer() == 3);
+}
+
+TEST(SnapshotsArriveInOrderWithoutSkipsOrRepeats)
+{
+	Simulation simulation;
+	FramePipeline<Snapshot> pipeline;
+	pipeline.Start([&simulation](Snapshot& snapshot) { simulation.Simulate(snapshot); });
+
+	// Rendering which sometimes takes longer than the simulation, and sometimes less, so both sides wait
+	const uint64_t numFrames = 20000;
+	uint64_t numOutOfOrder = 0;
+	uint64_t numTorn = 0;
+	for (uint64_t frame = 1; frame <= numFrames; frame++)
+	{
+		const Snapshot& snapshot = pipeline.AcquireSnapshot();
+		simulation.Acquired(frame);
+		pipeline.BeginSimulation();
+
+		numOutOfOrder += snapshot.Frame != frame ? 1 : 0;
+		numTorn += IsWhole(snapshot) ? 0 : 1;
+		if (frame % 7 == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+	pipeline.Stop();
+
+	CHECK(numOutOfOrder == 0);
+	CHECK(numTorn == 0);
+	CHECK(simulation.GetNumTooFarAhead() == 0);
+	// The frame after the last one rendered may have been simulated, no more
+	CHECK(simulation.GetNumSimulated() >= numFrames && simulation.GetNumSimulated() <= numFrames + 1);
+}
+
+TEST(SimulationWaitsForRenderingToLetItStart)
+{
+	Simulation simulation;
+	FramePipeline<Snapshot> pipeline;
+	pipeline.Start([&simulation](Snapshot& snapshot) { simulation.Simulate(snapshot); });
+
+	for (uint64_t frame = 1; frame <= 5; frame++)
+	{
+		const Snapshot& snapshot = pipeline.AcquireSnapshot();
+		CHECK(snapshot.Frame == frame);
+		simulation.Acquired(frame);
+
+		// Given plenty of time, the simulation still doesn't start the next frame until BeginSimulation
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		CHECK(simulation.GetNumSimulated() == frame);
+		pipeline.BeginSimulation();
+	}
+	pipeline.Stop();
+	CHECK(simulation.GetNumTooFarAhead() == 0);
+}
+
+TEST(StopWhileRenderingWaitsForASlowFrame)
+{
+	std::atomic<bool> isSimulationBlocked{ false };
+	std::atomic<bool> isSimulationReleased{ false };
+	FramePipeline<Snapshot> pipeline;
+	uint64_t numSimulated = 0;
+	pipeline.Start([&](Snapshot& snapshot)
+	{
+		snapshot.Frame = ++numSimulated;
+		// The second frame is stuck until the test lets it go
+		if (snapshot.Frame == 2)
+		{
+			isSimulationBlocked.store(true);
+			while (!isSimulationReleased.load())
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	CHECK(pipeline.AcquireSnapshot().Frame == 1);
+	pipeline.BeginSimulation();
+
+	// The render side blocks on the stuck frame, and Stop is called meanwhile
+	std::atomic<uint64_t> renderedFrame{ 0 };
+	std::thread render([&]() { renderedFrame.store(pipeline.AcquireSnapshot().Frame); });
+	while (!isSimulationBlocked.load())
+	{
+		std::this_thread::yield();
+	}
+	std::atomic<bool> hasStopped{ false };
+	std::thread stopper([&]()
+	{
+		pipeline.Stop();
+		hasStopped.store(true);
+	});
+
+	// Stop waits for the frame being simulated, which then reaches the render side
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	CHECK(!hasStopped.load());
+	isSimulationReleased.store(true);
+	stopper.join();
+	render.join();
+	CHECK(hasStopped.load());
+	CHECK(renderedFrame.load() == 2);
+	CHECK(!pipeline.IsRunning());
+}
+
+TEST(StopWakesRenderingWaitingForAFrameNeverSimulated)
+{
+	FramePipeline<Snapshot> pipeline;
+	uint64_t numSimulated = 0;
+	pipeline.Start([&numSimulated](Snapshot& snapshot) { snapshot.Frame = ++numSimulated; });
+
+	CHECK(pipeline.AcquireSnapshot().Frame == 1);
+
+	// Stopped before the simulation is let through to frame 2: rendering gets frame 1 again instead of hanging
+	pipeline.Stop();
+	pipeline.BeginSimulation();
+	CHECK(pipeline.AcquireSnapshot().Frame == 1);
+	CHECK(numSimulated == 1);
+
+	// And it starts over cleanly
+	numSimulated = 0;
+	pipeline.Start([&numSimulated](Snapshot& snapshot) { snapshot.Frame = ++numSimulated; });
+	CHECK(pipeline.AcquireSnapshot().Frame == 1);
+	pipeline.BeginSimulation();
+	CHECK(pipeline.AcquireSnapshot().Frame == 2);
+	pipeline.Stop();
+}
+
+int main()
+{
+	return RunTests();
+}
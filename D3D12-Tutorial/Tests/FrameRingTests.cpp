@@ -0,0 +1,146 @@
+#include "Test.h"
+
+#include "../FrameRing.h"
+
+namespace
+{
+	// A queue whose GPU only makes progress when told to, or when the CPU blocks on it, which the fake counts
+	class FakeQueue
+	{
+	public:
+		// Submits work, returning the fence value signalled once it is done, like Queue::Execute
+		uint64_t Execute() { return ++m_LastSignalledValue; }
+
+		void CompleteUpTo(uint64_t fenceValue) { m_CompletedValue = std::max(m_CompletedValue, fenceValue); }
+		void CompleteAll() { m_CompletedValue = m_LastSignalledValue; }
+
+		bool IsComplete(uint64_t fenceValue) const { return m_CompletedValue >= fenceValue; }
+
+		void WaitForFenceValue(uint64_t fenceValue)
+		{
+			if (!IsComplete(fenceValue))
+			{
+				m_NumBlockingWaits++;
+				m_CompletedValue = fenceValue;
+			}
+		}
+
+		uint64_t GetCompletedValue() const { return m_CompletedValue; }
+		uint32_t GetNumBlockingWaits() const { return m_NumBlockingWaits; }
+
+	private:
+		uint64_t m_LastSignalledValue = 0;
+		uint64_t m_CompletedValue = 0;
+		uint32_t m_NumBlockingWaits = 0;
+	};
+
+	struct FakeFrame
+	{
+		uint64_t FenceValue = 0;
+		uint32_t NumUses = 0;
+	};
+
+	// One renderer: its own queue and frames in flight, and nothing shared with any other
+	struct Renderer
+	{
+		explicit Renderer(uint32_t numFrames) { Frames.Initialize(numFrames); }
+
+		// Records and submits a frame, checking the GPU was done with the frame's previous use
+		void RenderFrame()
+		{
+			FakeFrame& frame = Frames.BeginFrame(Queue);
+			if (!Queue.IsComplete(frame.FenceValue))
+			{
+				NumFramesReusedEarly++;
+			}
+			frame.NumUses++;
+			Frames.EndFrame(Queue.Execute(), Frames.GetNextFrameIndex());
+		}
+
+		FakeQueue Queue;
+		FrameRing<FakeFrame, 4> Frames;
+		uint32_t NumFramesReusedEarly = 0;
+	};
+}
+
+TEST(FramesAreOnlyReusedOnceTheGpuIsDone)
+{
+	Renderer renderer(3);
+	// The GPU never catches up by itself, so from the fourth frame on every frame waits for the one three before it
+	for (uint32_t i = 0; i < 9; i++)
+	{
+		renderer.RenderFrame();
+		if (i >= 3)
+		{
+			CHECK(renderer.Queue.GetCompletedValue() == i - 2);
+		}
+	}
+	CHECK(renderer.Queue.GetNumBlockingWaits() == 6);
+	CHECK(renderer.NumFramesReusedEarly == 0);
+	CHECK(renderer.Frames[0].NumUses == 3 && renderer.Frames[1].NumUses == 3 && renderer.Frames[2].NumUses == 3);
+}
+
+TEST(AGpuWhichKeepsUpNeverBlocks)
+{
+	Renderer renderer(2);
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		renderer.RenderFrame();
+		renderer.Queue.CompleteAll();
+	}
+	CHECK(renderer.Queue.GetNumBlockingWaits() == 0);
+}
+
+TEST(RenderersSideBySideDontWaitOnEachOther)
+{
+	// Interleaved on one thread, as a process serving several clients would. Only a's GPU falls behind.
+	Renderer a(3);
+	Renderer b(2);
+	for (uint32_t i = 0; i < 12; i++)
+	{
+		a.RenderFrame();
+		b.RenderFrame();
+		b.Queue.CompleteAll();
+	}
+
+	CHECK(a.Queue.GetNumBlockingWaits() == 9);
+	CHECK(b.Queue.GetNumBlockingWaits() == 0);
+	CHECK(a.NumFramesReusedEarly == 0 && b.NumFramesReusedEarly == 0);
+	// Each counts its own fence values from 1
+	CHECK(a.Frames[a.Frames.GetCurrentFrameIndex()].FenceValue == 10);
+	CHECK(b.Frames[b.Frames.GetCurrentFrameIndex()].FenceValue == 11);
+	CHECK(b.Frames.GetNumFrames() == 2 && a.Frames.GetNumFrames() == 3);
+}
+
+TEST(SwapChainOrderIsFollowed)
+{
+	// Flip model swap chains may not hand out buffers round robin
+	Renderer renderer(3);
+	const uint32_t order[] = { 2, 0, 1, 0, 2 };
+	for (uint32_t next : order)
+	{
+		renderer.Frames.BeginFrame(renderer.Queue).NumUses++;
+		renderer.Frames.EndFrame(renderer.Queue.Execute(), next);
+		CHECK(renderer.Frames.GetCurrentFrameIndex() == next);
+	}
+	// Starting from frame 0, the frames used were 0, 2, 0, 1, 0
+	CHECK(renderer.Frames[0].NumUses == 3 && renderer.Frames[1].NumUses == 1 && renderer.Frames[2].NumUses == 1);
+}
+
+TEST(WaitForAllFramesWaitsForTheNewest)
+{
+	Renderer renderer(3);
+	renderer.RenderFrame();
+	renderer.RenderFrame();
+	renderer.Frames.WaitForAllFrames(renderer.Queue);
+	CHECK(renderer.Queue.GetCompletedValue() == 2);
+
+	// Initialize forgets the old fence values, e.g. after a renderer is shut down and created again
+	renderer.Frames.Initialize(2);
+	CHECK(renderer.Frames[0].FenceValue == 0 && renderer.Frames.GetCurrentFrameIndex() == 0);
+}
+
+int main()
+{
+	return RunTests();
+}
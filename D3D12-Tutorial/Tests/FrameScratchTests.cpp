@@ -0,0 +1,141 @@
+#include "Test.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../FrameScratch.h"
+
+namespace
+{
+	// The GPU is always done, as far as the scratch memory's assert is concerned
+	struct CompletedFence
+	{
+		bool IsComplete(uint64_t) const { return true; }
+	};
+
+	// Allocates count blocks of the arena's, filling each with value, and checks they all still hold it at the end
+	bool AllocateAndCheck(LinearArena& arena, uint32_t count, uint8_t value)
+	{
+		std::vector<uint8_t*> blocks;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint8_t* block = arena.AllocateArray<uint8_t>(24 + i % 40);
+			memset(block, value, 24 + i % 40);
+			blocks.push_back(block);
+		}
+		for (uint32_t i = 0; i < count; i++)
+		{
+			for (uint32_t j = 0; j < 24 + i % 40; j++)
+			{
+				if (blocks[i][j] != value)
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
+
+TEST(SteadyFramesStopAllocating)
+{
+	FrameScratch scratch;
+	scratch.Initialize(3, 256);
+	CompletedFence fence;
+	uint64_t numHeapAllocations = 0;
+	for (uint32_t frame = 0; frame < 20; frame++)
+	{
+		scratch.BeginFrame(fence);
+		ScratchVector<uint32_t> values = scratch.MakeVector<uint32_t>();
+		for (uint32_t i = 0; i < 1000; i++)
+		{
+			values.push_back(i);
+		}
+		scratch.EndFrame(frame + 1);
+
+		// Each frame's arena grows to fit in its first few uses, then stays as it is
+		if (frame == 10)
+		{
+			numHeapAllocations = scratch.GetNumHeapAllocations();
+		}
+	}
+	CHECK(numHeapAllocations > 0);
+	CHECK(scratch.GetNumHeapAllocations() == numHeapAllocations);
+	CHECK(scratch.GetHighWaterMark() >= 1000 * sizeof(uint32_t));
+}
+
+TEST(MoreThreadsThanMaxThreadsShareAnArena)
+{
+	FrameScratch scratch;
+	scratch.Initialize(2, 1024);
+	CompletedFence fence;
+	scratch.BeginFrame(fence);
+
+	// Enough threads at once that some get the shared arena, and allocate from it together
+	const uint32_t numThreads = FrameScratch::MaxThreads + 16;
+	std::vector<std::thread> threads;
+	std::atomic<uint32_t> numCorrupted{ 0 };
+	std::atomic<uint32_t> numStarted{ 0 };
+	for (uint32_t i = 0; i < numThreads; i++)
+	{
+		threads.emplace_back([&scratch, &numCorrupted, &numStarted, i, numThreads]()
+		{
+			numStarted.fetch_add(1);
+			while (numStarted.load() < numThreads)
+			{
+				std::this_thread::yield();
+			}
+			if (!AllocateAndCheck(scratch.GetThreadArena(), 500, static_cast<uint8_t>(i)))
+			{
+				numCorrupted.fetch_add(1);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	CHECK(numCorrupted.load() == 0);
+
+	// Later threads still get the shared arena, and the next frame resets it with the rest
+	std::thread late([&scratch]() { scratch.GetThreadArena().Allocate(64); });
+	late.join();
+	scratch.EndFrame(1);
+	scratch.BeginFrame(fence);
+	scratch.BeginFrame(fence);
+	bool isReset = true;
+	std::thread after([&scratch, &isReset]() { isReset = scratch.GetThreadArena().GetUsed() == 0; });
+	after.join();
+	CHECK(isReset);
+}
+
+TEST(SharedArenaAllocatesFromSeveralThreads)
+{
+	LinearArena arena(4096);
+	arena.SetShared(true);
+	std::vector<std::thread> threads;
+	std::atomic<uint32_t> numCorrupted{ 0 };
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		threads.emplace_back([&arena, &numCorrupted, i]()
+		{
+			if (!AllocateAndCheck(arena, 2000, static_cast<uint8_t>(i + 1)))
+			{
+				numCorrupted.fetch_add(1);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	CHECK(numCorrupted.load() == 0);
+	arena.Reset();
+	CHECK(arena.GetUsed() == 0 && arena.GetCapacity() >= arena.GetHighWaterMark());
+}
+
+int main()
+{
+	return RunTests();
+}
@@ -0,0 +1,131 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "../JobSystem.h"
+
+TEST(ParallelForCoversEveryIndexOnce)
+{
+	JobSystem jobs;
+	jobs.Initialize(3);
+	std::vector<std::atomic<uint32_t>> counts(1000);
+	jobs.ParallelFor(0, 1000, 7, [&counts](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			counts[i].fetch_add(1);
+		}
+	});
+
+	bool isEachOnce = true;
+	for (std::atomic<uint32_t>& count : counts)
+	{
+		isEachOnce = isEachOnce && count.load() == 1;
+	}
+	CHECK(isEachOnce);
+}
+
+TEST(CounterWaitsForChildren)
+{
+	JobSystem jobs;
+	jobs.Initialize(2);
+	std::atomic<uint32_t> numChildrenRun{ 0 };
+	JobCounter counter;
+	jobs.Run([&jobs, &numChildrenRun]()
+	{
+		for (uint32_t i = 0; i < 50; i++)
+		{
+			jobs.RunChild([&numChildrenRun]() { numChildrenRun.fetch_add(1); });
+		}
+	}, &counter);
+	jobs.Wait(counter);
+	CHECK(numChildrenRun.load() == 50);
+}
+
+TEST(ShutdownReleasesCountersOfDroppedJobs)
+{
+	JobSystem jobs;
+	jobs.Initialize(2);
+
+	// Jobs waiting on something which never happens, e.g. a fence on a lost device
+	JobCounter counter;
+	std::atomic<bool> hasRun{ false };
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		jobs.RunWhen([]() { return false; }, [&hasRun]() { hasRun.store(true); }, &counter);
+	}
+
+	// Another thread waiting on them returns once they are dropped, instead of spinning forever
+	std::atomic<bool> hasReturned{ false };
+	std::thread waiter([&jobs, &counter, &hasReturned]()
+	{
+		jobs.Wait(counter);
+		hasReturned.store(true);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK(!hasReturned.load());
+
+	jobs.Shutdown();
+	waiter.join();
+	CHECK(hasReturned.load());
+	CHECK(counter.IsDone());
+	CHECK(!hasRun.load());
+}
+
+TEST(ShutdownFinishesTheRunningJobAndDropsTheRest)
+{
+	JobSystem jobs;
+	jobs.Initialize(1);
+
+	// The only worker is held in a job while Shutdown starts, with more jobs queued behind it
+	std::atomic<bool> isHeld{ true };
+	std::atomic<bool> hasStarted{ false };
+	JobCounter counter;
+	jobs.Run([&isHeld, &hasStarted]()
+	{
+		hasStarted.store(true);
+		while (isHeld.load())
+		{
+			std::this_thread::yield();
+		}
+	}, &counter);
+	while (!hasStarted.load())
+	{
+		std::this_thread::yield();
+	}
+	std::atomic<uint32_t> numRun{ 0 };
+	for (uint32_t i = 0; i < 20; i++)
+	{
+		jobs.RunWhen([]() { return false; }, [&numRun]() { numRun.fetch_add(1); }, &counter);
+	}
+
+	std::thread stopper([&jobs]() { jobs.Shutdown(); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	isHeld.store(false);
+	stopper.join();
+
+	CHECK(counter.IsDone());
+	CHECK(numRun.load() == 0);
+	CHECK(jobs.GetNumWorkers() == 0);
+}
+
+TEST(InitializeAgainAfterShutdown)
+{
+	JobSystem jobs;
+	jobs.Initialize(2);
+	jobs.Shutdown();
+	jobs.Initialize(2);
+	JobCounter counter;
+	std::atomic<uint32_t> numRun{ 0 };
+	for (uint32_t i = 0; i < 100; i++)
+	{
+		jobs.Run([&numRun]() { numRun.fetch_add(1); }, &counter);
+	}
+	jobs.Wait(counter);
+	CHECK(numRun.load() == 100);
+}
+
+int main()
+{
+	return RunTests();
+}
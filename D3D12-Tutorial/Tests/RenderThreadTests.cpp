@@ -0,0 +1,108 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "../RenderThread.h"
+
+namespace
+{
+	// Runs a RenderThread whose frames only finish when the test lets them, to post events while it is stuck
+	// in a frame, as it would be on a slow GPU
+	class Harness
+	{
+	public:
+		Harness()
+		{
+			m_RenderThread.Start([this](const RenderThread::Event& event) { m_Events.push_back(event); },
+				[this]()
+				{
+					m_NumFramesStarted.fetch_add(1, std::memory_order_acq_rel);
+					while (m_NumFramesStarted.load(std::memory_order_acquire) > m_NumFramesAllowed.load(std::memory_order_acquire) &&
+						!m_IsStopping.load(std::memory_order_acquire))
+					{
+						std::this_thread::yield();
+					}
+				});
+			WaitForFrame(1);
+		}
+
+		~Harness()
+		{
+			m_IsStopping.store(true, std::memory_order_release);
+			m_RenderThread.Stop();
+		}
+
+		// Lets the frame in progress finish, and waits until the render thread has handled the events posted
+		// during it and started the next
+		void FinishFrame()
+		{
+			const uint32_t next = m_NumFramesAllowed.fetch_add(1, std::memory_order_acq_rel) + 2;
+			WaitForFrame(next);
+		}
+
+		RenderThread& GetRenderThread() { return m_RenderThread; }
+		// Only read while the render thread is stuck in a frame
+		const std::vector<RenderThread::Event>& GetEvents() const { return m_Events; }
+
+	private:
+		void WaitForFrame(uint32_t frame)
+		{
+			while (m_NumFramesStarted.load(std::memory_order_acquire) < frame)
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		RenderThread m_RenderThread;
+		std::vector<RenderThread::Event> m_Events;
+		std::atomic<uint32_t> m_NumFramesStarted{ 0 };
+		std::atomic<uint32_t> m_NumFramesAllowed{ 1 };
+		std::atomic<bool> m_IsStopping{ false };
+	};
+}
+
+TEST(ResizesCoalesceToTheLatest)
+{
+	Harness harness;
+	for (uint32_t i = 1; i <= 1000; i++)
+	{
+		harness.GetRenderThread().PostResize(i, 2 * i);
+	}
+	harness.GetRenderThread().PostVSync(false);
+	harness.FinishFrame();
+
+	// The other events first, then one resize to the latest size
+	const std::vector<RenderThread::Event>& events = harness.GetEvents();
+	CHECK(events.size() == 2);
+	CHECK(events[0].Type == RenderThread::EventType::VSync && !events[0].Enabled);
+	CHECK(events[1].Type == RenderThread::EventType::Resize && events[1].Width == 1000 && events[1].Height == 2000);
+	CHECK(harness.GetRenderThread().GetNumCoalescedResizes() == 999);
+
+	// Nothing new, nothing handled
+	harness.FinishFrame();
+	CHECK(harness.GetEvents().size() == 2);
+}
+
+TEST(PostingNeverBlocksOnAStuckFrame)
+{
+	Harness harness;
+	// More than the queue holds, with the render thread stuck: the extra ones are dropped rather than waited on
+	uint32_t numPosted = 0;
+	for (uint32_t i = 0; i < 300; i++)
+	{
+		numPosted += harness.GetRenderThread().PostVSync(i % 2 == 0) ? 1 : 0;
+	}
+	CHECK(numPosted == 256);
+	CHECK(harness.GetRenderThread().GetNumDroppedEvents() == 44);
+	// Resizes don't take room in the queue, so still get through
+	harness.GetRenderThread().Post({ RenderThread::EventType::Resize, 640, 480, false });
+
+	harness.FinishFrame();
+	CHECK(harness.GetEvents().size() == 257);
+	CHECK(harness.GetEvents().back().Width == 640 && harness.GetEvents().back().Height == 480);
+}
+
+int main()
+{
+	return RunTests();
+}
@@ -0,0 +1,228 @@
+#include "Test.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../StartupProfiler.h"
+
+namespace
+{
+	// Records the order steps finish in, from any thread
+	class Log
+	{
+	public:
+		void Add(InitGraph::StepId id)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Order.push_back(id);
+		}
+
+		// Index of id in the order, or -1 if it never ran
+		int IndexOf(InitGraph::StepId id)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (size_t i = 0; i < m_Order.size(); i++)
+			{
+				if (m_Order[i] == id)
+				{
+					return static_cast<int>(i);
+				}
+			}
+			return -1;
+		}
+
+		size_t Size()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_Order.size();
+		}
+
+	private:
+		std::mutex m_Mutex;
+		std::vector<InitGraph::StepId> m_Order;
+	};
+
+	void Sleep(int milliseconds)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+	}
+
+	// The line of the report about the step called name
+	std::string GetReportLine(const std::string& report, const std::string& name)
+	{
+		const std::string ending = "]  " + name;
+		size_t start = 0;
+		while (start < report.size())
+		{
+			size_t end = report.find('\n', start);
+			if (end == std::string::npos)
+			{
+				end = report.size();
+			}
+			const std::string line = report.substr(start, end - start);
+			if (line.size() >= ending.size() && line.compare(line.size() - ending.size(), ending.size(), ending) == 0)
+			{
+				return line;
+			}
+			start = end + 1;
+		}
+		return std::string();
+	}
+}
+
+TEST(StepsRunAfterTheirDependencies)
+{
+	// A diamond, a chain hanging off it, and a step on its own, each step taking a moment so others overlap
+	InitGraph graph;
+	Log log;
+	std::vector<InitGraph::StepId> ids(7);
+	auto step = [&log, &ids](uint32_t index)
+	{
+		return [&log, &ids, index]()
+		{
+			Sleep(2);
+			log.Add(ids[index]);
+		};
+	};
+	ids[0] = graph.AddStep("Root", step(0));
+	ids[1] = graph.AddStep("Left", step(1), { ids[0] });
+	ids[2] = graph.AddStep("Right", step(2), { ids[0] });
+	ids[3] = graph.AddStep("Join", step(3), { ids[1], ids[2] });
+	ids[4] = graph.AddStep("Chain", step(4), { ids[3] });
+	ids[5] = graph.AddStep("Alone", step(5));
+	ids[6] = graph.AddStep("AfterAlone", step(6), { ids[5], ids[1] });
+	graph.Run(4);
+
+	CHECK(log.Size() == 7);
+	CHECK(log.IndexOf(ids[0]) < log.IndexOf(ids[1]));
+	CHECK(log.IndexOf(ids[0]) < log.IndexOf(ids[2]));
+	CHECK(log.IndexOf(ids[1]) < log.IndexOf(ids[3]));
+	CHECK(log.IndexOf(ids[2]) < log.IndexOf(ids[3]));
+	CHECK(log.IndexOf(ids[3]) < log.IndexOf(ids[4]));
+	CHECK(log.IndexOf(ids[5]) < log.IndexOf(ids[6]));
+	CHECK(log.IndexOf(ids[1]) < log.IndexOf(ids[6]));
+
+	// The timeline agrees
+	CHECK(graph.GetStepStart(ids[3]) >= graph.GetStepEnd(ids[1]));
+	CHECK(graph.GetStepStart(ids[3]) >= graph.GetStepEnd(ids[2]));
+	CHECK(graph.GetStepStart(ids[4]) >= graph.GetStepEnd(ids[3]));
+}
+
+TEST(CallingThreadStepsRunOnTheCallingThread)
+{
+	InitGraph graph;
+	const std::thread::id callingThread = std::this_thread::get_id();
+	std::atomic<uint32_t> numOnCallingThread{ 0 };
+	std::atomic<uint32_t> numAnyThreadOnCallingThread{ 0 };
+
+	auto onCallingThread = [&]() { numOnCallingThread += std::this_thread::get_id() == callingThread ? 1 : 0; };
+	auto onAnyThread = [&]() { numAnyThreadOnCallingThread += std::this_thread::get_id() == callingThread ? 1 : 0; };
+
+	// Mixed in with steps which can run anywhere, in both directions
+	InitGraph::StepId any = graph.AddStep("Any", onAnyThread);
+	InitGraph::StepId window = graph.AddStep("Window", onCallingThread, { any }, true);
+	InitGraph::StepId afterWindow = graph.AddStep("AfterWindow", onAnyThread, { window });
+	graph.AddStep("SwapChain", onCallingThread, { afterWindow }, true);
+	graph.AddStep("Register", onCallingThread, {}, true);
+	graph.Run(3);
+
+	CHECK(numOnCallingThread.load() == 3);
+	// With more than one thread, the calling thread only runs its own steps
+	CHECK(numAnyThreadOnCallingThread.load() == 0);
+
+	const std::string report = graph.GetReport();
+	CHECK(GetReportLine(report, "Window").find("[thread 0]") != std::string::npos);
+	CHECK(GetReportLine(report, "SwapChain").find("[thread 0]") != std::string::npos);
+	CHECK(GetReportLine(report, "AfterWindow").find("[thread 0]") == std::string::npos);
+}
+
+TEST(OneThreadRunsEveryStepOnTheCallingThread)
+{
+	InitGraph graph;
+	Log log;
+	const std::thread::id callingThread = std::this_thread::get_id();
+	std::atomic<bool> isAllOnCallingThread{ true };
+	std::vector<InitGraph::StepId> ids(4);
+	auto step = [&](uint32_t index)
+	{
+		return [&, index]()
+		{
+			isAllOnCallingThread = isAllOnCallingThread && std::this_thread::get_id() == callingThread;
+			log.Add(ids[index]);
+		};
+	};
+	ids[0] = graph.AddStep("A", step(0));
+	ids[1] = graph.AddStep("B", step(1), { ids[0] }, true);
+	ids[2] = graph.AddStep("C", step(2), { ids[1] });
+	ids[3] = graph.AddStep("D", step(3));
+	graph.Run(1);
+
+	CHECK(log.Size() == 4);
+	CHECK(isAllOnCallingThread.load());
+	CHECK(log.IndexOf(ids[0]) < log.IndexOf(ids[1]));
+	CHECK(log.IndexOf(ids[1]) < log.IndexOf(ids[2]));
+}
+
+TEST(ThrowingStepSkipsLaterStepsAndIsRethrown)
+{
+	for (uint32_t numThreads : { 1u, 4u })
+	{
+		InitGraph graph;
+		std::atomic<bool> hasDependentRun{ false };
+		InitGraph::StepId device = graph.AddStep("Device", []() { throw std::runtime_error("No device"); });
+		InitGraph::StepId swapChain = graph.AddStep("SwapChain", [&]() { hasDependentRun = true; }, { device });
+		graph.AddStep("Pipelines", [&]() { hasDependentRun = true; }, { swapChain });
+
+		bool hasThrown = false;
+		try
+		{
+			graph.Run(numThreads);
+		}
+		catch (const std::runtime_error& error)
+		{
+			hasThrown = std::string(error.what()) == "No device";
+		}
+		CHECK(hasThrown);
+		CHECK(!hasDependentRun.load());
+
+		// Skipped steps are left out of the report
+		const std::string report = graph.GetReport();
+		CHECK(GetReportLine(report, "Device").size() > 0);
+		CHECK(GetReportLine(report, "SwapChain").empty());
+		CHECK(GetReportLine(report, "Pipelines").empty());
+	}
+}
+
+TEST(CriticalPathFollowsTheLatestDependencies)
+{
+	// Slow -> Join -> Last decides when startup finishes; Fast and Alone finish well before
+	InitGraph graph;
+	InitGraph::StepId slow = graph.AddStep("Slow", []() { Sleep(60); });
+	InitGraph::StepId fast = graph.AddStep("Fast", []() { Sleep(1); });
+	InitGraph::StepId join = graph.AddStep("Join", []() { Sleep(1); }, { fast, slow });
+	InitGraph::StepId last = graph.AddStep("Last", []() { Sleep(1); }, { join });
+	graph.AddStep("Alone", []() { Sleep(1); });
+	graph.Run(4);
+
+	const std::vector<InitGraph::StepId> path = graph.GetCriticalPath();
+	CHECK(path.size() == 3);
+	CHECK(path.size() == 3 && path[0] == slow && path[1] == join && path[2] == last);
+
+	// Critical steps are starred, the others not, and the total runs until the last step finished
+	const std::string report = graph.GetReport();
+	CHECK(GetReportLine(report, "Slow")[0] == '*');
+	CHECK(GetReportLine(report, "Join")[0] == '*');
+	CHECK(GetReportLine(report, "Last")[0] == '*');
+	CHECK(GetReportLine(report, "Fast")[0] == ' ');
+	CHECK(GetReportLine(report, "Alone")[0] == ' ');
+	CHECK(graph.GetTotalTime() >= graph.GetStepEnd(last));
+	CHECK(report.find("Total ") != std::string::npos);
+}
+
+int main()
+{
+	return RunTests();
+}
@@ -0,0 +1,127 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "../CommandQueue.h"
+
+namespace
+{
+	typedef SubmissionGraph::SubmissionId SubmissionId;
+
+	bool IsBefore(const std::vector<SubmissionId>& order, SubmissionId first, SubmissionId second)
+	{
+		size_t firstIndex = order.size();
+		size_t secondIndex = order.size();
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			firstIndex = order[i] == first ? i : firstIndex;
+			secondIndex = order[i] == second ? i : secondIndex;
+		}
+		return firstIndex < secondIndex && secondIndex < order.size();
+	}
+}
+
+TEST(IndependentSubmissionsKeepTheirOrder)
+{
+	SubmissionGraph graph;
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		graph.Add();
+	}
+
+	std::vector<SubmissionId> order;
+	CHECK(graph.Sort(order));
+	CHECK((order == std::vector<SubmissionId>{ 0, 1, 2, 3, 4 }));
+}
+
+TEST(DependenciesComeFirstAndTheRestKeepTheirOrder)
+{
+	// Shadows (direct) -> blur (compute) -> composite (direct), with an unrelated upload in between, and the
+	// composite added before the blur it waits on
+	SubmissionGraph graph;
+	const SubmissionId shadows = graph.Add();
+	const SubmissionId composite = graph.Add();
+	const SubmissionId upload = graph.Add();
+	const SubmissionId blur = graph.Add();
+	graph.AddDependency(blur, shadows);
+	graph.AddDependency(composite, blur);
+
+	std::vector<SubmissionId> order;
+	CHECK(graph.Sort(order));
+	CHECK(order.size() == 4);
+	CHECK(IsBefore(order, shadows, blur));
+	CHECK(IsBefore(order, blur, composite));
+	// Lowest ready first: the upload is free once the shadows are taken, and comes before the blur
+	CHECK((order == std::vector<SubmissionId>{ shadows, upload, blur, composite }));
+
+	// Sorting again gives the same order
+	std::vector<SubmissionId> again;
+	CHECK(graph.Sort(again));
+	CHECK(again == order);
+}
+
+TEST(DiamondSortsOnce)
+{
+	SubmissionGraph graph;
+	const SubmissionId top = graph.Add();
+	const SubmissionId left = graph.Add();
+	const SubmissionId right = graph.Add();
+	const SubmissionId bottom = graph.Add();
+	graph.AddDependency(left, top);
+	graph.AddDependency(right, top);
+	graph.AddDependency(bottom, left);
+	graph.AddDependency(bottom, right);
+	// The same dependency twice is harmless
+	graph.AddDependency(bottom, right);
+
+	std::vector<SubmissionId> order;
+	CHECK(graph.Sort(order));
+	CHECK((order == std::vector<SubmissionId>{ top, left, right, bottom }));
+}
+
+TEST(TwoSubmissionCycleFails)
+{
+	SubmissionGraph graph;
+	const SubmissionId free = graph.Add();
+	const SubmissionId a = graph.Add();
+	const SubmissionId b = graph.Add();
+	const SubmissionId afterCycle = graph.Add();
+	graph.AddDependency(a, b);
+	graph.AddDependency(b, a);
+	graph.AddDependency(afterCycle, b);
+
+	std::vector<SubmissionId> order;
+	CHECK(!graph.Sort(order));
+	// Only what doesn't wait on the cycle was ordered
+	CHECK((order == std::vector<SubmissionId>{ free }));
+}
+
+TEST(SelfDependencyFails)
+{
+	SubmissionGraph graph;
+	const SubmissionId a = graph.Add();
+	const SubmissionId self = graph.Add();
+	graph.AddDependency(self, a);
+	graph.AddDependency(self, self);
+
+	std::vector<SubmissionId> order;
+	CHECK(!graph.Sort(order));
+	CHECK((order == std::vector<SubmissionId>{ a }));
+}
+
+TEST(ClearedGraphSortsEmpty)
+{
+	SubmissionGraph graph;
+	const SubmissionId a = graph.Add();
+	graph.AddDependency(a, a);
+	graph.Clear();
+
+	std::vector<SubmissionId> order(3, 7);
+	CHECK(graph.Sort(order));
+	CHECK(order.empty());
+}
+
+int main()
+{
+	return RunTests();
+}
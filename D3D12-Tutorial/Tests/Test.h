@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal test harness for the parts of the renderer which don't need D3D12: file formats, schedulers and
+// timing loops, run against fakes of the clock, fences and backends they use. Each test file is a program of
+// its own, built from this directory, e.g.
+//
+//	g++ -std=c++14 -pthread -I.. AssetPackTests.cpp -o AssetPackTests && ./AssetPackTests
+//
+// (FenceAwaiterTests.cpp needs -std=c++20 for its coroutine tests.) A program exits with 1 if any check failed.
+//
+//	TEST(Name)
+//	{
+//		CHECK(a == b);
+//	}
+//
+//	int main() { return RunTests(); }
+
+struct TestCase
+{
+	const char* Name;
+	void (*Function)();
+	TestCase* Next;
+};
+
+inline TestCase*& GetTestList()
+{
+	static TestCase* s_First = nullptr;
+	return s_First;
+}
+
+inline int& GetNumFailedChecks()
+{
+	static int s_NumFailed = 0;
+	return s_NumFailed;
+}
+
+struct TestRegistration
+{
+	TestRegistration(TestCase& test)
+	{
+		// Prepend, then RunTests reverses, so tests run in the order they are declared
+		test.Next = GetTestList();
+		GetTestList() = &test;
+	}
+};
+
+#define TEST(name) \
+	static void name(); \
+	static TestCase name##Case = { #name, &name, nullptr }; \
+	static TestRegistration name##Registration(name##Case); \
+	static void name()
+
+// Reports a failure and carries on, so one run shows every failing check
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			GetNumFailedChecks()++; \
+		} \
+	} while (false)
+
+inline int RunTests()
+{
+	TestCase* reversed = nullptr;
+	for (TestCase* test = GetTestList(); test; )
+	{
+		TestCase* next = test->Next;
+		test->Next = reversed;
+		reversed = test;
+		test = next;
+	}
+
+	int numTests = 0;
+	for (TestCase* test = reversed; test; test = test->Next)
+	{
+		const int failedBefore = GetNumFailedChecks();
+		test->Function();
+		std::printf("%s %s\n", GetNumFailedChecks() == failedBefore ? "[ OK ]" : "[FAIL]", test->Name);
+		numTests++;
+	}
+
+	std::printf("%d tests, %d failed checks\n", numTests, GetNumFailedChecks());
+	return GetNumFailedChecks() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
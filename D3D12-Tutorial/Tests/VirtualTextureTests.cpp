@@ -0,0 +1,229 @@
+#include "Test.h"
+
+#include <map>
+#include <tuple>
+
+#include "../VirtualTexture.h"
+
+namespace
+{
+	// Stands in for UpdateTileMappings on a reserved texture and its tile pool: applies a frame's unmaps, then
+	// its maps, and records what is mapped where. Counts changes that the GPU would get wrong, e.g. mapping a
+	// pool tile which another tile still uses.
+	class FakeTileMapper
+	{
+	public:
+		explicit FakeTileMapper(uint32_t numPoolTiles)
+			: m_IsPoolTileUsed(numPoolTiles, false)
+		{}
+
+		void Apply(const std::vector<TileMapping>& unmapped, const std::vector<TileMapping>& mapped)
+		{
+			for (const TileMapping& mapping : unmapped)
+			{
+				auto it = m_PageTable.find(Key(mapping.Coordinate));
+				if (mapping.PoolTile != TileResidency::NullTile || it == m_PageTable.end())
+				{
+					m_NumErrors++;
+					continue;
+				}
+				m_IsPoolTileUsed[it->second] = false;
+				m_PageTable.erase(it);
+			}
+			for (const TileMapping& mapping : mapped)
+			{
+				if (mapping.PoolTile >= m_IsPoolTileUsed.size() || m_IsPoolTileUsed[mapping.PoolTile] ||
+					m_PageTable.count(Key(mapping.Coordinate)) != 0)
+				{
+					m_NumErrors++;
+					continue;
+				}
+				m_IsPoolTileUsed[mapping.PoolTile] = true;
+				m_PageTable[Key(mapping.Coordinate)] = mapping.PoolTile;
+			}
+		}
+
+		// The pool tile the GPU would read for coordinate, NullTile if it isn't mapped
+		uint32_t GetPoolTile(const TileCoordinate& coordinate) const
+		{
+			auto it = m_PageTable.find(Key(coordinate));
+			return it == m_PageTable.end() ? TileResidency::NullTile : it->second;
+		}
+
+		size_t GetNumMapped() const { return m_PageTable.size(); }
+		uint32_t GetNumErrors() const { return m_NumErrors; }
+
+	private:
+		typedef std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> TileKey;
+
+		static TileKey Key(const TileCoordinate& coordinate)
+		{
+			return TileKey(coordinate.X, coordinate.Y, coordinate.Z, coordinate.Subresource);
+		}
+
+		std::map<TileKey, uint32_t> m_PageTable;
+		std::vector<bool> m_IsPoolTileUsed;
+		uint32_t m_NumErrors = 0;
+	};
+
+	// A texture with 4 standard mips and 2 packed tiles, driven like VirtualTexture drives its residency
+	struct Harness
+	{
+		static const uint32_t NumStandardMips = 4;
+		static const uint32_t NumPackedTiles = 2;
+		static const uint32_t NumMips = 6;
+
+		explicit Harness(uint32_t numPoolTiles, uint32_t numArraySlices = 1)
+			: Mapper(numPoolTiles)
+		{
+			Residency.Initialize(numPoolTiles);
+			IsInitialized = Residency.PinPackedMips(NumStandardMips, NumPackedTiles, NumMips, numArraySlices);
+		}
+
+		void Update(uint32_t maxNewTiles = 0xffffffff)
+		{
+			Residency.Update(Unmapped, Mapped, maxNewTiles);
+			Mapper.Apply(Unmapped, Mapped);
+		}
+
+		// The backend agrees with the residency about every tile it has mapped
+		bool IsConsistent() const
+		{
+			return Mapper.GetNumErrors() == 0 && Mapper.GetNumMapped() == Residency.GetNumResident();
+		}
+
+		TileResidency Residency;
+		FakeTileMapper Mapper;
+		std::vector<TileMapping> Unmapped;
+		std::vector<TileMapping> Mapped;
+		bool IsInitialized = false;
+	};
+
+	TileCoordinate Tile(uint32_t x, uint32_t mip = 0)
+	{
+		return TileCoordinate{ x, 0, 0, mip };
+	}
+
+	TileCoordinate PackedTile(uint32_t index, uint32_t slice = 0)
+	{
+		return TileCoordinate{ index, 0, 0, Harness::NumStandardMips + slice * Harness::NumMips };
+	}
+}
+
+TEST(PackedMipsArePinnedAndMappedByTheFirstUpdate)
+{
+	Harness harness(8, 2);
+	CHECK(harness.IsInitialized);
+	CHECK(harness.Residency.GetNumFreePoolTiles() == 4);
+
+	harness.Update();
+	CHECK(harness.Mapped.size() == 4);
+	CHECK(harness.Mapper.GetPoolTile(PackedTile(1, 1)) != TileResidency::NullTile);
+	CHECK(harness.IsConsistent());
+}
+
+TEST(BudgetTooSmallForThePackedMipsFails)
+{
+	Harness harness(3, 2);
+	CHECK(!harness.IsInitialized);
+	// Nothing was pinned, so the pool is left as it was
+	CHECK(harness.Residency.GetNumFreePoolTiles() == 3);
+	harness.Update();
+	CHECK(harness.Mapper.GetNumMapped() == 0);
+}
+
+TEST(RequestedTilesAreMappedByTheNextUpdate)
+{
+	Harness harness(6);
+	harness.Update();
+
+	CHECK(harness.Residency.Request(Tile(0)) == TileResidency::NullTile);
+	CHECK(harness.Residency.Request(Tile(1)) == TileResidency::NullTile);
+	// Asking twice in a frame only maps it once
+	CHECK(harness.Residency.Request(Tile(1)) == TileResidency::NullTile);
+	harness.Update();
+	CHECK(harness.Mapped.size() == 2);
+
+	const uint32_t poolTile = harness.Residency.Request(Tile(0));
+	CHECK(poolTile != TileResidency::NullTile);
+	CHECK(harness.Mapper.GetPoolTile(Tile(0)) == poolTile);
+	CHECK(harness.IsConsistent());
+}
+
+TEST(FullPoolEvictsTheLeastRecentlyUsedTile)
+{
+	// Room for 2 tiles besides the packed mips
+	Harness harness(4);
+	harness.Update();
+	harness.Residency.Request(Tile(0));
+	harness.Residency.Request(Tile(1));
+	harness.Update();
+
+	// Tile 1 is used again, tile 0 isn't, so tile 2 takes tile 0's place
+	harness.Residency.Request(Tile(1));
+	harness.Residency.Request(Tile(2));
+	harness.Update();
+	CHECK(harness.Unmapped.size() == 1 && harness.Unmapped[0].Coordinate.X == 0);
+	CHECK(harness.Mapper.GetPoolTile(Tile(0)) == TileResidency::NullTile);
+	CHECK(harness.Mapper.GetPoolTile(Tile(1)) != TileResidency::NullTile);
+	CHECK(harness.Mapper.GetPoolTile(Tile(2)) != TileResidency::NullTile);
+	CHECK(harness.IsConsistent());
+}
+
+TEST(TilesUsedThisFrameAndPackedMipsAreNeverEvicted)
+{
+	Harness harness(4);
+	harness.Update();
+	harness.Residency.Request(Tile(0));
+	harness.Residency.Request(Tile(1));
+	harness.Update();
+
+	// Both mapped tiles are in use, so the third request has to wait
+	harness.Residency.Request(Tile(0));
+	harness.Residency.Request(Tile(1));
+	harness.Residency.Request(Tile(2));
+	harness.Update();
+	CHECK(harness.Unmapped.empty() && harness.Mapped.empty());
+	CHECK(harness.Mapper.GetPoolTile(PackedTile(0)) != TileResidency::NullTile);
+	CHECK(harness.Mapper.GetPoolTile(PackedTile(1)) != TileResidency::NullTile);
+	CHECK(harness.IsConsistent());
+}
+
+TEST(MaxNewTilesSpreadsMappingOverFrames)
+{
+	Harness harness(16);
+	harness.Update();
+	for (uint32_t frame = 0; frame < 3; frame++)
+	{
+		for (uint32_t x = 0; x < 5; x++)
+		{
+			harness.Residency.Request(Tile(x, 1));
+		}
+		harness.Update(2);
+		CHECK(harness.Mapped.size() == (frame < 2 ? 2u : 1u));
+	}
+	CHECK(harness.Residency.GetNumResident() == 5 + Harness::NumPackedTiles);
+	CHECK(harness.IsConsistent());
+}
+
+TEST(ChurnKeepsTheBackendConsistent)
+{
+	Harness harness(10);
+	harness.Update();
+	// A camera panning across a strip of tiles, a few at a time, with a pool smaller than the strip
+	for (uint32_t frame = 0; frame < 100; frame++)
+	{
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			harness.Residency.Request(Tile((frame + i) % 24, frame % 2));
+		}
+		harness.Update(3);
+		CHECK(harness.IsConsistent());
+	}
+	CHECK(harness.Residency.GetNumFreePoolTiles() == 0);
+}
+
+int main()
+{
+	return RunTests();
+}
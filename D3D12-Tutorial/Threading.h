@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+
+// Worker threads for a pool which leaves one hardware thread to the thread submitting its work, e.g. the
+// render thread. At least one, also when hardware_concurrency doesn't know and returns 0.
+inline uint32_t GetDefaultNumWorkerThreads()
+{
+	const uint32_t numHardwareThreads = std::thread::hardware_concurrency();
+	return numHardwareThreads > 1 ? numHardwareThreads - 1 : 1;
+}
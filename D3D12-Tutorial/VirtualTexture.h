@@ -0,0 +1,390 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#include <wrl.h>
+#include <d3d12.h>
+#include "d3dx12.h"
+
+#include "Helpers.h"
+#endif
+
+// Sparse virtual textures.
+//
+// A reserved (tiled) texture has virtual address space for every tile but no memory behind it. Physical
+// memory comes from a fixed size tile pool heap, and tiles are mapped into it only when something asks for
+// them, so a huge texture costs only as much VRAM as the pool. When the pool is full, the least recently
+// requested tiles are unmapped to make room. All mapping changes for a frame go to the GPU in one
+// UpdateTileMappings call.
+//
+// TileResidency is the bookkeeping: which virtual tile lives in which pool tile, and the LRU order. It has no
+// D3D12 dependency, so it can be run and checked on any platform. VirtualTexture, under _WIN32, applies its
+// decisions to a reserved resource and heap.
+
+// Same meaning as D3D12_TILED_RESOURCE_COORDINATE. For packed mips X is the tile index within the packed
+// tiles and Subresource is the first packed mip.
+struct TileCoordinate
+{
+	uint32_t X;
+	uint32_t Y;
+	uint32_t Z;
+	uint32_t Subresource;
+};
+
+// A change to one tile's mapping. PoolTile is TileResidency::NullTile when the tile is being unmapped.
+struct TileMapping
+{
+	TileCoordinate Coordinate;
+	uint32_t PoolTile;
+};
+
+class TileResidency
+{
+public:
+	static const uint32_t NullTile = 0xffffffff;
+
+	void Initialize(uint32_t numPoolTiles)
+	{
+		m_NumPoolTiles = numPoolTiles;
+		m_Tiles.clear();
+		m_LeastRecentlyUsed.clear();
+		m_Requested.clear();
+		m_RequestedKeys.clear();
+		m_PendingMapped.clear();
+		m_Frame = 0;
+
+		// Hand out low pool tiles first
+		m_FreePoolTiles.resize(numPoolTiles);
+		for (uint32_t i = 0; i < numPoolTiles; i++)
+		{
+			m_FreePoolTiles[i] = numPoolTiles - 1 - i;
+		}
+	}
+
+	// Marks a tile as needed this frame. Returns its pool tile if it is mapped, otherwise NullTile, and the tile
+	// will be mapped by the next Update if there is room. Requests are only remembered until that Update, so
+	// tiles still needed must be requested again every frame.
+	uint32_t Request(const TileCoordinate& coordinate)
+	{
+		const uint64_t key = MakeKey(coordinate);
+		auto it = m_Tiles.find(key);
+		if (it != m_Tiles.end())
+		{
+			Touch(it->second);
+			return it->second.PoolTile;
+		}
+
+		if (m_RequestedKeys.insert(std::make_pair(key, 0)).second)
+		{
+			m_Requested.push_back(coordinate);
+		}
+		return NullTile;
+	}
+
+	// Pins the packed mips of every array slice: numTilesForPackedMips tiles each, at the first packed mip.
+	// Returns false, pinning none of them, if the pool doesn't have enough free tiles for all of them.
+	bool PinPackedMips(uint32_t numStandardMips, uint32_t numTilesForPackedMips, uint32_t numMips, uint32_t numArraySlices)
+	{
+		if (uint64_t(numTilesForPackedMips) * numArraySlices > m_FreePoolTiles.size())
+		{
+			return false;
+		}
+		for (uint32_t slice = 0; slice < numArraySlices; slice++)
+		{
+			for (uint32_t i = 0; i < numTilesForPackedMips; i++)
+			{
+				TileCoordinate coordinate = { i, 0, 0, numStandardMips + slice * numMips };
+				Pin(coordinate);
+			}
+		}
+		return true;
+	}
+
+	// Maps a tile immediately and keeps it mapped for good; used for packed mips, which can't be evicted a tile
+	// at a time, and for the lowest mips used as a fallback. Returns NullTile if the pool has no free tiles.
+	uint32_t Pin(const TileCoordinate& coordinate)
+	{
+		const uint64_t key = MakeKey(coordinate);
+		auto it = m_Tiles.find(key);
+		if (it != m_Tiles.end())
+		{
+			if (!it->second.IsPinned)
+			{
+				m_LeastRecentlyUsed.erase(it->second.LruPosition);
+				it->second.IsPinned = true;
+			}
+			return it->second.PoolTile;
+		}
+
+		if (m_FreePoolTiles.empty())
+		{
+			return NullTile;
+		}
+
+		Tile tile = {};
+		tile.Coordinate = coordinate;
+		tile.PoolTile = m_FreePoolTiles.back();
+		tile.IsPinned = true;
+		m_FreePoolTiles.pop_back();
+		m_Tiles.insert(std::make_pair(key, tile));
+
+		TileMapping mapping = { coordinate, tile.PoolTile };
+		m_PendingMapped.push_back(mapping);
+		return tile.PoolTile;
+	}
+
+	// Decides this frame's mapping changes. Requested tiles get a free pool tile, or take the one of the least
+	// recently used tile, which is unmapped. Tiles requested this frame are never evicted, so if the pool is
+	// smaller than a frame's working set the excess requests are dropped. maxNewTiles bounds how many tiles
+	// are mapped, and so have to be filled, per frame, including tiles pinned since the last Update.
+	// Then starts the next frame.
+	void Update(std::vector<TileMapping>& unmapped, std::vector<TileMapping>& mapped, uint32_t maxNewTiles = 0xffffffff)
+	{
+		unmapped.clear();
+		mapped.swap(m_PendingMapped);
+		m_PendingMapped.clear();
+
+		for (const TileCoordinate& coordinate : m_Requested)
+		{
+			if (mapped.size() >= maxNewTiles)
+			{
+				break;
+			}
+
+			uint32_t poolTile = NullTile;
+			if (!m_FreePoolTiles.empty())
+			{
+				poolTile = m_FreePoolTiles.back();
+				m_FreePoolTiles.pop_back();
+			}
+			else
+			{
+				if (m_LeastRecentlyUsed.empty())
+				{
+					break;
+				}
+				// The list is in order of use, so if the oldest tile was used this frame, every tile was
+				auto evicted = m_Tiles.find(m_LeastRecentlyUsed.back());
+				assert(evicted != m_Tiles.end());
+				if (evicted->second.LastUsedFrame == m_Frame)
+				{
+					break;
+				}
+
+				poolTile = evicted->second.PoolTile;
+				TileMapping unmapping = { evicted->second.Coordinate, NullTile };
+				unmapped.push_back(unmapping);
+				m_LeastRecentlyUsed.pop_back();
+				m_Tiles.erase(evicted);
+			}
+
+			Tile tile = {};
+			tile.Coordinate = coordinate;
+			tile.PoolTile = poolTile;
+			auto inserted = m_Tiles.insert(std::make_pair(MakeKey(coordinate), tile)).first;
+			m_LeastRecentlyUsed.push_front(inserted->first);
+			inserted->second.LruPosition = m_LeastRecentlyUsed.begin();
+			inserted->second.LastUsedFrame = m_Frame;
+
+			TileMapping mapping = { coordinate, poolTile };
+			mapped.push_back(mapping);
+		}
+
+		m_Requested.clear();
+		m_RequestedKeys.clear();
+		m_Frame++;
+	}
+
+	bool IsResident(const TileCoordinate& coordinate) const
+	{
+		return m_Tiles.find(MakeKey(coordinate)) != m_Tiles.end();
+	}
+
+	uint32_t GetPoolTile(const TileCoordinate& coordinate) const
+	{
+		auto it = m_Tiles.find(MakeKey(coordinate));
+		if (it == m_Tiles.end())
+		{
+			return NullTile;
+		}
+		return it->second.PoolTile;
+	}
+
+	uint32_t GetNumPoolTiles() const { return m_NumPoolTiles; }
+	uint32_t GetNumFreePoolTiles() const { return static_cast<uint32_t>(m_FreePoolTiles.size()); }
+	uint32_t GetNumResident() const { return static_cast<uint32_t>(m_Tiles.size()); }
+
+private:
+	struct Tile
+	{
+		TileCoordinate Coordinate;
+		uint32_t PoolTile;
+		uint64_t LastUsedFrame;
+		bool IsPinned;
+		// Unused for pinned tiles
+		std::list<uint64_t>::iterator LruPosition;
+	};
+
+	// Packs a coordinate into a map key. Tile counts per dimension are far below these limits even for
+	// 16K textures, since a 64KB tile is at least 64 texels wide.
+	static uint64_t MakeKey(const TileCoordinate& coordinate)
+	{
+		assert(coordinate.X < (1u << 18) && coordinate.Y < (1u << 18) && coordinate.Z < (1u << 12) &&
+			coordinate.Subresource < (1u << 16));
+		return uint64_t(coordinate.X) | (uint64_t(coordinate.Y) << 18) | (uint64_t(coordinate.Z) << 36) |
+			(uint64_t(coordinate.Subresource) << 48);
+	}
+
+	void Touch(Tile& tile)
+	{
+		if (tile.IsPinned)
+		{
+			return;
+		}
+		tile.LastUsedFrame = m_Frame;
+		// splice moves the node without invalidating the iterator
+		m_LeastRecentlyUsed.splice(m_LeastRecentlyUsed.begin(), m_LeastRecentlyUsed, tile.LruPosition);
+	}
+
+	uint32_t m_NumPoolTiles = 0;
+	uint64_t m_Frame = 0;
+	std::unordered_map<uint64_t, Tile> m_Tiles;
+	// Keys of unpinned mapped tiles, most recently used first
+	std::list<uint64_t> m_LeastRecentlyUsed;
+	std::vector<uint32_t> m_FreePoolTiles;
+
+	// Requested this frame and not mapped, in request order
+	std::vector<TileCoordinate> m_Requested;
+	std::unordered_map<uint64_t, uint8_t> m_RequestedKeys;
+	// Pinned since the last Update
+	std::vector<TileMapping> m_PendingMapped;
+};
+
+#if defined(_WIN32)
+// A reserved texture backed by a tile pool heap of budget bytes.
+// Packed mips are pinned at creation, so there is always something to fall back to when sampling.
+class VirtualTexture
+{
+public:
+	// desc must use D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE. Returns false, creating nothing, if budget
+	// can't hold the packed mips of every array slice.
+	bool Initialize(Microsoft::WRL::ComPtr<ID3D12Device2> device, const D3D12_RESOURCE_DESC& desc, uint64_t budget)
+	{
+		assert(desc.Layout == D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE);
+
+		m_Device = device;
+		ThrowIfFailed(m_Device->CreateReservedResource(&desc, D3D12_RESOURCE_STATE_COMMON, nullptr,
+			IID_PPV_ARGS(&m_Resource)));
+
+		// One tiling per mip of the first array slice; the other slices tile the same way
+		UINT numTiles = 0;
+		UINT numSubresourceTilings = desc.MipLevels;
+		m_SubresourceTilings.resize(numSubresourceTilings);
+		m_Device->GetResourceTiling(m_Resource.Get(), &numTiles, &m_PackedMipInfo, &m_TileShape,
+			&numSubresourceTilings, 0, m_SubresourceTilings.data());
+		m_NumMips = desc.MipLevels;
+		m_NumArraySlices = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : desc.DepthOrArraySize;
+
+		const uint32_t numPoolTiles = static_cast<uint32_t>(budget / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES);
+		m_Residency.Initialize(numPoolTiles);
+		if (!m_Residency.PinPackedMips(m_PackedMipInfo.NumStandardMips, m_PackedMipInfo.NumTilesForPackedMips, m_NumMips,
+			m_NumArraySlices))
+		{
+			m_Resource.Reset();
+			m_Device.Reset();
+			return false;
+		}
+
+		CD3DX12_HEAP_DESC heapDesc(uint64_t(numPoolTiles) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES,
+			D3D12_HEAP_TYPE_DEFAULT, 0, D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES);
+		ThrowIfFailed(m_Device->CreateHeap(&heapDesc, IID_PPV_ARGS(&m_TilePool)));
+		return true;
+	}
+
+	// Marks the tile at (x, y, z), in tiles, of a standard mip as needed. Returns true if it can be sampled now;
+	// if not, sample a lower mip this frame.
+	bool RequestTile(uint32_t mip, uint32_t x, uint32_t y, uint32_t z = 0, uint32_t slice = 0)
+	{
+		assert(mip < m_PackedMipInfo.NumStandardMips && "Packed mips are always resident");
+		assert(x < m_SubresourceTilings[mip].WidthInTiles && y < m_SubresourceTilings[mip].HeightInTiles);
+
+		TileCoordinate coordinate = { x, y, z, D3D12CalcSubresource(mip, slice, 0, m_NumMips, m_NumArraySlices) };
+		return m_Residency.Request(coordinate) != TileResidency::NullTile;
+	}
+
+	// Applies this frame's mapping changes with a single UpdateTileMappings on queue, ordered after the work
+	// already submitted to it. Returns the tiles newly mapped, whose contents are undefined until the caller
+	// fills them, for example with CopyTiles.
+	const std::vector<TileMapping>& Update(ID3D12CommandQueue* queue, uint32_t maxNewTiles = 0xffffffff)
+	{
+		m_Residency.Update(m_Unmapped, m_Mapped, maxNewTiles);
+
+		const size_t numRegions = m_Unmapped.size() + m_Mapped.size();
+		if (numRegions == 0)
+		{
+			return m_Mapped;
+		}
+
+		// One tile per region and range. Unmaps come first, since a pool tile may be evicted and reused in
+		// the same call.
+		m_RegionCoordinates.clear();
+		m_RangeFlags.clear();
+		m_RangeOffsets.clear();
+		for (const std::vector<TileMapping>* mappings : { &m_Unmapped, &m_Mapped })
+		{
+			for (const TileMapping& mapping : *mappings)
+			{
+				m_RegionCoordinates.push_back(CD3DX12_TILED_RESOURCE_COORDINATE(mapping.Coordinate.X,
+					mapping.Coordinate.Y, mapping.Coordinate.Z, mapping.Coordinate.Subresource));
+				m_RangeFlags.push_back(mapping.PoolTile == TileResidency::NullTile ?
+					D3D12_TILE_RANGE_FLAG_NULL : D3D12_TILE_RANGE_FLAG_NONE);
+				m_RangeOffsets.push_back(mapping.PoolTile == TileResidency::NullTile ? 0 : mapping.PoolTile);
+			}
+		}
+		m_RegionSizes.assign(numRegions, CD3DX12_TILE_REGION_SIZE(1, FALSE, 0, 0, 0));
+		m_RangeTileCounts.assign(numRegions, 1);
+
+		const UINT count = static_cast<UINT>(numRegions);
+		queue->UpdateTileMappings(m_Resource.Get(), count, m_RegionCoordinates.data(), m_RegionSizes.data(),
+			m_TilePool.Get(), count, m_RangeFlags.data(), m_RangeOffsets.data(), m_RangeTileCounts.data(),
+			D3D12_TILE_MAPPING_FLAG_NONE);
+
+		return m_Mapped;
+	}
+
+	ID3D12Resource* GetResource() const { return m_Resource.Get(); }
+	ID3D12Heap* GetTilePool() const { return m_TilePool.Get(); }
+	const D3D12_TILE_SHAPE& GetTileShape() const { return m_TileShape; }
+	const D3D12_PACKED_MIP_INFO& GetPackedMipInfo() const { return m_PackedMipInfo; }
+	const D3D12_SUBRESOURCE_TILING& GetSubresourceTiling(uint32_t mip) const { return m_SubresourceTilings[mip]; }
+	const TileResidency& GetResidency() const { return m_Residency; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device2> m_Device;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_Resource;
+	Microsoft::WRL::ComPtr<ID3D12Heap> m_TilePool;
+
+	uint32_t m_NumMips = 0;
+	uint32_t m_NumArraySlices = 0;
+	D3D12_PACKED_MIP_INFO m_PackedMipInfo = {};
+	D3D12_TILE_SHAPE m_TileShape = {};
+	std::vector<D3D12_SUBRESOURCE_TILING> m_SubresourceTilings;
+
+	TileResidency m_Residency;
+	std::vector<TileMapping> m_Unmapped;
+	std::vector<TileMapping> m_Mapped;
+
+	// Reused every frame to build the UpdateTileMappings arguments
+	std::vector<D3D12_TILED_RESOURCE_COORDINATE> m_RegionCoordinates;
+	std::vector<D3D12_TILE_REGION_SIZE> m_RegionSizes;
+	std::vector<D3D12_TILE_RANGE_FLAGS> m_RangeFlags;
+	std::vector<UINT> m_RangeOffsets;
+	std::vector<UINT> m_RangeTileCounts;
+};
+#endif
@@ -41,6 +41,49 @@ using namespace Microsoft::WRL;
 
 // Helper functions
 #include "Helpers.h"
+// Hashed PSO cache, persisted to disk with a pipeline library
+#include "PipelineStateCache.h"
+// Background PSO compilation with fallback pipelines
+#include "PipelineCompiler.h"
+// Root signatures declared as types, validated and hashed at compile time
+#include "RootSignatureBuilder.h"
+// Serialized root signature blobs, persisted to disk and prewarmed at startup
+#include "RootSignatureCache.h"
+// Compiled shader bytecode, memory mapped from a single cache file
+#include "ShaderCache.h"
+// Memory mapped asset packs laid out for direct upload
+#include "AssetPack.h"
+// Async file reads into GPU resources on a dedicated copy queue
+#include "StreamingQueue.h"
+// Reserved textures with tiles mapped on demand into an LRU managed tile pool
+#include "VirtualTexture.h"
+// Video memory budget tracking, evicting least recently used heaps when over budget
+#include "ResidencyManager.h"
+// Adapter selection policies, with adapter capabilities probed once and cached on disk
+#include "AdapterSelection.h"
+// Dependency ordered, parallel and timed initialization steps
+#include "StartupProfiler.h"
+// Device capabilities queried once per adapter and driver, and kept on disk
+#include "DeviceCapabilities.h"
+// Queues with their own fences, and batched submission with cross-queue dependencies
+#include "CommandQueue.h"
+// A device with its queues, and the frames in flight of what it renders to
+#include "RenderDevice.h"
+#include "Swapchain.h"
+// Input to present and display latency distributions
+#include "LatencyTracker.h"
+// Missed vblanks, duplicated frames and uneven cadence, from the swap chain's present statistics
+#include "FramePacing.h"
+// Frame rate limiting with high resolution timers and a short spin
+#include "FrameLimiter.h"
+// Render thread fed window events over a lock-free queue
+#include "RenderThread.h"
+// Update and Render overlapped on two threads, handing over immutable frame snapshots
+#include "FramePipeline.h"
+// Work stealing scheduler for parallel CPU work, which can also wait on fences
+#include "JobSystem.h"
+// Per-frame, per-thread linear arenas for transient CPU data
+#include "FrameScratch.h"
 
 // The number of swap chain back buffers
 const uint8_t g_NumFrames = 3;
@@ -53,49 +96,110 @@ bool g_UseWARP = false;
 uint32_t g_ClientWidth = 1024;
 uint32_t g_ClientHeight = 768;
 
-// True once DX12 objs are initialised
-bool b_IsInitialized = false;
-
 // Window Handle
 HWND g_hWnd;
 // Window Rectangle (used to store window dims when going to fullscreen state)
 RECT g_WindowRect;
 
+// DXGI factory shared by everything which needs one (adapter enumeration, tearing check, swap chain creation),
+// created once at startup rather than by each of them
+ComPtr<IDXGIFactory4> g_DXGIFactory;
+
 // DirectX 12 Objects
-// DirectX Device Object
-ComPtr<ID3D12Device2> g_Device; 
-ComPtr<ID3D12CommandQueue> g_CommandQueue;
-// Swap Chain - responsible for presenting rendered image to window
-ComPtr<IDXGISwapChain4> g_SwapChain; 
-// Traces pointers to back buffers created with swap chain
-ComPtr<ID3D12Resource> g_BackBuffers[g_NumFrames]; 
-// CmdList for all GPU Commands, only need one since all commands will be submitted from main thread
-ComPtr<ID3D12GraphicsCommandList> g_CommandList; 
-// Backing memory for recording GPU commands into command list. Need one per back buffer as cannot reset one until all commands for that allocator have been executed by cmd q
-// Resetting before all cmds executed results in a COMMAND_ALLOCATOR_SYNC. Therefore must have one allocator per back buffer.
-ComPtr<ID3D12CommandAllocator> g_CommandAllocators[g_NumFrames];
-// Backbuffer textures of swap chain described with Render Target Views (RTVs). RTVs descrive the location, dimensions and format of texture in GPU memory.
-// Used to clear backbuffer of render target, as well as render geometry to screen. RTVs are stored in Descriptor Heap
-ComPtr<ID3D12DescriptorHeap> g_RTVDescriptorHeap;
-// Size of a descriptor in heap is device dependent. Size of single element needs to be queried and stored during initialisation
-UINT g_RTVDescriptorSize;
-UINT g_CurrentBackBufferIndex;
-
-// Synchronization Objects
-ComPtr<ID3D12Fence> g_Fence; // Only one since we have only one command queue
-uint64_t g_FenceValue;
-// Stores values used to signal command queue for each frame 'in-flight'
-uint64_t g_FrameFenceValues[g_NumFrames] = {};
-// Handle to OS event obj used to receive notification that fence has reached a specific value
-HANDLE g_FenceEvent;
+// The device and its queues. Nothing else refers to the device through a global, so several renderers,
+// each with a RenderDevice of its own, can run in one process.
+RenderDevice g_RenderDevice;
+// The window's swap chain, with the command allocator, back buffer and fence value of each frame in flight.
+// Window messages arrive before it is created (e.g. WM_SIZE from CreateWindow), so check IsInitialized first.
+Swapchain g_Swapchain;
 
 // Swap Chain Present stuff
 // By default, enable V-Sync, toggled with V key
 bool g_VSync = true;
-bool g_TearingSupported = false;
-// By Default, use windowed mode, Alt+Enter or F11 to toggle
+// Frames which can be queued for presentation before the CPU waits, set with --latency. 1 gives the lowest
+// input latency. The swap chain is waitable unless this is 0, which leaves DXGI's default of 3 frames.
+uint32_t g_MaxFrameLatency = 1;
+// Caps the frame rate, set with --fps, e.g. to save power with tearing, without the latency V-Sync adds.
+// 0 for no cap.
+double g_TargetFrameRate = 0.0;
+WaitableTimerClock g_FrameLimiterClock;
+FrameLimiter g_FrameLimiter;
+
+// Runs frames, and owns everything Render uses, once Initialize is done. WndProc must post resize and V-Sync
+// changes to it (PostResize, PostVSync) rather than apply them itself, so the settings above and g_Swapchain are
+// only touched by the render thread from then on. WndProc is only declared in this program, so nothing posts
+// them yet.
+RenderThread g_RenderThread;
+
+// What Update produces for Render. Immutable once Update has finished with it, so Render can read it while
+// Update already works on the next frame.
+struct FrameSnapshot
+{
+	// The newest input the frame consumed, for latency measurement
+	LatencyTracker::InputEvent Input;
+	FLOAT ClearColor[4];
+	// Non-zero once a second, when Render reports the frame rate and statistics
+	double FramesPerSecond;
+};
+
+// Set with --pipelined: Update for the next frame runs on a thread of its own while the render thread records
+// the current one, for a shorter CPU frame time at the cost of one frame of latency
+bool g_Pipelined = false;
+FramePipeline<FrameSnapshot> g_FramePipeline;
+// By Default, use windowed mode, Alt+Enter or F11 to toggle. Window thread only: it restyles the window, and
+// the render thread only sees the resize which follows.
 bool g_Fullscreen = false;
 
+// Pipeline State Objects are cached in memory and in a pipeline library on disk, since compiling
+// them is the most expensive part of startup. Initialised once the device exists, saved on shutdown.
+PipelineStateCache g_PipelineStateCache;
+const wchar_t* g_PipelineLibraryPath = L"PipelineLibrary.bin";
+// Compiles PSOs through g_PipelineStateCache as jobs on g_JobSystem, so the render thread never calls
+// CreatePipelineState. Draws use PipelineHandle::Resolve, which returns a fallback (or nothing) until ready.
+PipelineCompiler g_PipelineCompiler;
+// Root signatures are serialized once and the blobs kept on disk, so later runs only create them
+RootSignatureCache g_RootSignatureCache;
+const wchar_t* g_RootSignatureCachePath = L"RootSignatures.bin";
+// Shader bytecode keyed by source, includes, defines and target. Hits point straight into the mapped cache file.
+ShaderCache g_ShaderCache;
+const wchar_t* g_ShaderCachePath = L"ShaderCache.bin";
+// Streams asset data on its own COPY queue. The direct queue waits on its tickets GPU-side, so loading
+// overlaps rendering and the CPU never waits for it.
+StreamingQueue g_StreamingQueue;
+// Keeps usage of the adapter's local video memory within the OS budget. Heaps are marked used with the
+// direct queue's fence value of the frame using them, and evicted in LRU order once the fence has passed it.
+// Only for heaps and committed resources the app creates: the swap chain's back buffers belong to DXGI, which
+// may still be presenting or scanning one out after the fence has passed the frame that rendered it.
+ResidencyManager g_ResidencyManager;
+// Which GPU GetAdapter picks, set from the command line. Probes of adapters' capabilities are kept on disk,
+// so after the first run selection doesn't need to create a device on any adapter.
+AdapterSelection g_AdapterSelection;
+AdapterProbeCache g_AdapterProbeCache;
+const wchar_t* g_AdapterProbeCachePath = L"AdapterProbes.bin";
+// What the device supports: feature tiers, shader model, per format support and plane counts.
+// Look things up here instead of calling CheckFeatureSupport (or D3D12GetFormatPlaneCount, which does).
+DeviceCapabilities g_DeviceCapabilities;
+DeviceCapabilityCache g_DeviceCapabilityCache;
+const wchar_t* g_DeviceCapabilityCachePath = L"DeviceCapabilities.bin";
+// Timestamps input as it arrives, and measures how long until the first frame which consumed it is presented
+// and shown. The distribution goes to the debug output with the frame rate.
+LatencyTracker g_LatencyTracker;
+// Checks the swap chain's statistics after every present for frames held on screen unevenly, which reads as
+// stutter even at a steady frame rate. Reported with the frame rate.
+FramePacingAnalyzer g_FramePacing;
+// Worker threads shared by everything which runs CPU work in parallel, e.g. PSO compiles, decompression,
+// uploads, command list recording, culling and asset processing. Set --pin-threads to pin each worker to a
+// logical processor of its own.
+JobSystem g_JobSystem;
+bool g_PinJobThreads = false;
+// Where coroutines waiting on fences (Queue::Completion) resume when they need the render thread, which pumps
+// it at the start of every frame. Those which don't can resume on g_JobSystem, through a JobResumeScheduler.
+ThreadResumeQueue g_RenderThreadResumeQueue;
+// Memory for arrays which only live for a frame, e.g. barriers and command lists, so steady-state frames
+// don't allocate them from the heap. Each frame's memory is reused once the direct queue's fence shows the GPU
+// is done with it.
+FrameScratch g_FrameScratch;
+
 // Windows Callback Function
 LRESULT CALLBACK WndProc( HWND, UINT, WPARAM, LPARAM );
 
@@ -118,6 +222,46 @@ void ParseCommandLineArgs()
 		{
 			g_UseWARP = true;
 		}
+		if (::wcscmp(argv[i], L"--latency") == 0 && i + 1 < static_cast<size_t>(argc))
+		{
+			g_MaxFrameLatency = std::min<uint32_t>(::wcstoul(argv[++i], nullptr, 10), DXGI_MAX_SWAP_CHAIN_BUFFERS);
+		}
+		if (::wcscmp(argv[i], L"--pipelined") == 0)
+		{
+			g_Pipelined = true;
+		}
+		if (::wcscmp(argv[i], L"--pin-threads") == 0)
+		{
+			g_PinJobThreads = true;
+		}
+		if (::wcscmp(argv[i], L"--fps") == 0 && i + 1 < static_cast<size_t>(argc))
+		{
+			g_TargetFrameRate = ::wcstod(argv[++i], nullptr);
+		}
+		// high-performance, minimum-power, best, or an adapter LUID as 16 hex digits
+		if (::wcscmp(argv[i], L"--adapter") == 0 && i + 1 < static_cast<size_t>(argc))
+		{
+			const wchar_t* policy = argv[++i];
+			if (::wcscmp(policy, L"high-performance") == 0)
+			{
+				g_AdapterSelection.Policy = AdapterPolicy::HighPerformance;
+			}
+			else if (::wcscmp(policy, L"minimum-power") == 0)
+			{
+				g_AdapterSelection.Policy = AdapterPolicy::MinimumPower;
+			}
+			else if (::wcscmp(policy, L"best") == 0)
+			{
+				g_AdapterSelection.Policy = AdapterPolicy::BestCapabilities;
+			}
+			else
+			{
+				uint64_t luid = ::wcstoull(policy, nullptr, 16);
+				g_AdapterSelection.Policy = AdapterPolicy::ExplicitLuid;
+				g_AdapterSelection.Luid.HighPart = static_cast<LONG>(luid >> 32);
+				g_AdapterSelection.Luid.LowPart = static_cast<DWORD>(luid);
+			}
+		}
 	}
 
 	// Free memory allocated by ::GetCommandLineW()
@@ -210,9 +354,9 @@ HWND CreateWindow(const wchar_t* windowClassName, HINSTANCE hInst, const wchar_t
 	return hWnd;
 }
 
-ComPtr<IDXGIAdapter4> GetAdapter(bool useWarp)
+// Enables creating DXGI Objects. Creating a factory is not free, so one is created at startup and shared.
+ComPtr<IDXGIFactory4> CreateFactory()
 {
-	// Enabkes creating DXGI Objects
 	ComPtr<IDXGIFactory4> dxgiFactory;
 	UINT createFactoryFlags = 0;
 #if defined(_DEBUG)
@@ -222,6 +366,11 @@ ComPtr<IDXGIAdapter4> GetAdapter(bool useWarp)
 
 	ThrowIfFailed(CreateDXGIFactory2(createFactoryFlags, IID_PPV_ARGS(&dxgiFactory)));
 
+	return dxgiFactory;
+}
+
+ComPtr<IDXGIAdapter4> GetAdapter(ComPtr<IDXGIFactory4> dxgiFactory, bool useWarp)
+{
 	ComPtr<IDXGIAdapter1> dxgiAdapter1;
 	ComPtr<IDXGIAdapter4> dxgiAdapter4;
 
@@ -234,28 +383,13 @@ ComPtr<IDXGIAdapter4> GetAdapter(bool useWarp)
 		// Note us As to cast COM objects, static_cast is not safe or reliable
 		ThrowIfFailed(dxgiAdapter1.As(&dxgiAdapter4));
 	}
-	// Otherwise, DXGI factory is used to query for hardware adapters
+	// Otherwise, the hardware adapter is chosen by g_AdapterSelection's policy.
+	// Adapters are only probed (which loads their driver) the first time they are seen, see AdapterSelection.h
 	else
 	{
-		SIZE_T maxDedicatedVideoMemory = 0;
-		// IDXGIFactory1::EnumAdapters1 is used to enumerate available GPU adaters in system
-		for (UINT i = 0; dxgiFactory->EnumAdapters1(i, &dxgiAdapter1) != DXGI_ERROR_NOT_FOUND; i++)
-		{
-			// Get description of dxgiAdapter1
-			DXGI_ADAPTER_DESC1 dxgiAdapterDesc1;
-			dxgiAdapter1->GetDesc1(&dxgiAdapterDesc1);
-
-			// Check if adapter can create a D3D12 Device. Adapter with largest VRAM is favoured
-			// Note this does not actually create the D3D12 device
-			if ((dxgiAdapterDesc1.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) == 0 && // If adapter is not a software adapter (ala WARP)
-				SUCCEEDED(D3D12CreateDevice(dxgiAdapter1.Get(),
-					D3D_FEATURE_LEVEL_11_0, __uuidof(ID3D12Device), nullptr)) && // If a D3D12 device can be created
-				dxgiAdapterDesc1.DedicatedVideoMemory > maxDedicatedVideoMemory ) // Prefer larger dedicated Video Mem
-			{
-				maxDedicatedVideoMemory = dxgiAdapterDesc1.DedicatedVideoMemory;
-				ThrowIfFailed(dxgiAdapter1.As(&dxgiAdapter4));
-			}
-		}
+		g_AdapterProbeCache.Load(g_AdapterProbeCachePath);
+		dxgiAdapter4 = SelectAdapter(dxgiFactory.Get(), g_AdapterSelection, g_AdapterProbeCache);
+		g_AdapterProbeCache.Save(g_AdapterProbeCachePath);
 	}
 
 	return dxgiAdapter4;
@@ -314,257 +448,40 @@ ComPtr<ID3D12Device2> CreateDevice(ComPtr<IDXGIAdapter4> adapter)
 	return d3d12Device2;
 }
 
-ComPtr<ID3D12CommandQueue> CreateCommandQueue(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE type)
+// Timestamps input messages as early as possible. The hook WndProc must call first thing for every message;
+// this program doesn't define its WndProc yet, so until one calls this the latency report has no samples.
+void RecordInput(UINT message)
 {
-	ComPtr<ID3D12CommandQueue> d3d12CommandQueue;
-
-	D3D12_COMMAND_QUEUE_DESC desc = {};
-	// Type:
-	// - D3D12_COMMAND_LIST_TYPE_COPY : Can exec copy commands
-	// - D3D12_COMMAND_LIST_TYPE_DIRECT : SuperSet of COPY + Compute commands
-	// - D3D12_COMMAND_LIST_TYPE_DIRECT : SuperSet of COMPUTE + Draw commands
-	desc.Type = type;
-	// Specifies prority of command Queue
-	desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
-	// Flags: 
-	// - D3D12_COMMAND_QUEUE_FLAG_NONE
-	// - D3D12_COMMAND_QUEUE_FLAG_DISABLE_GPU_TIMEOUT
-	desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-	// Identifier for when there are mutliple GPU nodes 
-	desc.NodeMask = 0;
-
-	ThrowIfFailed(device->CreateCommandQueue(&desc, IID_PPV_ARGS(&d3d12CommandQueue)));
-
-	return d3d12CommandQueue;
-}
-
-bool CheckTearingSupport() 
-{
-	BOOL allowTearing = FALSE;
-
-	// Rather than create the DXGI 1.5 factory interface directly, we create the
-	// DXGI 1.4 interface and query for the 1.5 interface. This is to enable the 
-	// graphics debugging tools which will not support the 1.5 factory interface 
-	// until a future update.
-	ComPtr<IDXGIFactory4> factory4;
-	if (SUCCEEDED(CreateDXGIFactory1(IID_PPV_ARGS(&factory4))))
+	if ((message >= WM_KEYFIRST && message <= WM_KEYLAST) || (message >= WM_MOUSEFIRST && message <= WM_MOUSELAST) ||
+		message == WM_INPUT)
 	{
-		ComPtr<IDXGIFactory5> factory5;
-		// Query DXGI 1.5 factory interface
-		if (SUCCEEDED(factory4.As(&factory5)))
-		{
-			// Check Feature Support
-			if (FAILED(factory5->CheckFeatureSupport(
-				DXGI_FEATURE_PRESENT_ALLOW_TEARING,
-				&allowTearing, sizeof(allowTearing))))
-			{
-				allowTearing = FALSE;
-			}
-		}
-	}
-
-	return allowTearing == TRUE;
-}
-
-ComPtr<IDXGISwapChain4> CreateSwapChain(HWND hWnd, ComPtr<ID3D12CommandQueue> commandQueue,
-	uint32_t width, uint32_t height, uint32_t bufferCount)
-{
-	ComPtr<IDXGISwapChain4> dxgiSwapChain4;
-	
-	// Create DXGI Factory
-	ComPtr<IDXGIFactory4> dxgiFactory4;
-	UINT createFactoryFlags = 0;
-#if defined(_DEBUG)
-	createFactoryFlags = DXGI_CREATE_FACTORY_DEBUG;
-#endif
-	ThrowIfFailed(CreateDXGIFactory2(createFactoryFlags, IID_PPV_ARGS(&dxgiFactory4)));
-
-	// Setup Swap Chain Desc
-	DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-	swapChainDesc.Width = width;
-	swapChainDesc.Height = height;
-	swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; 
-	// Used for 3D
-	swapChainDesc.Stereo = FALSE;
-	// Use for bitblt transfer models, must be { 1, 0 } for flip models
-	swapChainDesc.SampleDesc = { 1, 0 };
-	// Describes surface usage and CPU access options for back buffer.
-	//  DXGI_USAGE_RENDER_TARGET_OUTPUT : Use the surface or resource as an output render target.
-	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	// Buffer count. With Fullscreen swap chain, front buffer is typically included in this count
-	swapChainDesc.BufferCount = bufferCount;
-	// Defines behaviour when back buffer size does not match target output size.
-	swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
-	// Defines how swapping between front and back buffers.
-	// Docs; https://docs.microsoft.com/en-us/windows/win32/api/dxgi/ne-dxgi-dxgi_swap_effect
-	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-	// Identifies transparency behaviour
-	// Docs: https://docs.microsoft.com/en-us/windows/win32/api/dxgi1_2/ne-dxgi1_2-dxgi_alpha_mode
-	swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
-	// It is recommended to always allow tearing support if tearing support is available
-	swapChainDesc.Flags = CheckTearingSupport() ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING : 0;
-
-	// Create Swap Chain
-	ComPtr<IDXGISwapChain1> swapChain1;
-	ThrowIfFailed(dxgiFactory4->CreateSwapChainForHwnd(
-		commandQueue.Get(),
-		hWnd,
-		&swapChainDesc,
-		nullptr, // Pointer to desc for full screen swap chain, NULL creates windowed swap chain
-		nullptr, // Pointer to IDXGIOutput interface for the output to restrict content to
-		&swapChain1
-	));
-
-	// Disable Alt+Enter to fullscreen, as we will handle that manually
-	ThrowIfFailed(dxgiFactory4->MakeWindowAssociation(hWnd, DXGI_MWA_NO_ALT_ENTER));
-
-	ThrowIfFailed(swapChain1.As(&dxgiSwapChain4));
-	return dxgiSwapChain4;
-}
-
-// Creates Descriptor Heap
-// Descriptor heap can be considered an array of resouce views.
-// UAV, SRV, CBV can be stored in the same desc heap, but RTV and Sampler views each require their own
-ComPtr<ID3D12DescriptorHeap> CreateDescriptorHeap(ComPtr<ID3D12Device2> device, 
-	D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t numDescriptors)
-{
-	ComPtr<ID3D12DescriptorHeap> descriptorHeap;
-
-	// Setup Desc Heap Desc
-	D3D12_DESCRIPTOR_HEAP_DESC desc = {};
-	desc.NumDescriptors = numDescriptors;
-	// What will this desc heap store? UAV/SRV/CBV, SAMPLER, RTV or DSV
-	desc.Type = type;
-	// desc.Flags (https://docs.microsoft.com/en-us/windows/win32/api/d3d12/ne-d3d12-d3d12_descriptor_heap_flags)
-	// desc.NodeMask, similar to CommandQueue desc.NodeMask
-
-	ThrowIfFailed(device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&descriptorHeap)));
-
-	return descriptorHeap;
-}
-
-void UpdateRenderTargetViews(ComPtr<ID3D12Device2> device, ComPtr<IDXGISwapChain4> swapChain,
-	ComPtr<ID3D12DescriptorHeap> descriptorHeap)
-{
-	// Query the size of a single descriptor in the descheap
-	auto rtvDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-
-	// Get CPU Handle to first descriptor in descheap
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(descriptorHeap->GetCPUDescriptorHandleForHeapStart());
-
-	for (int i = 0; i < g_NumFrames; i++)
-	{
-		// Get ith backbuffer in swap chain
-		ComPtr<ID3D12Resource> backBuffer;
-		ThrowIfFailed(swapChain->GetBuffer(i, IID_PPV_ARGS(&backBuffer)));
-
-		// Create RTV for that backbuffer, with default desc (specified with nullptr), 
-		// placed at the current location pointed to in the descHeap by rtvHandle
-		device->CreateRenderTargetView(backBuffer.Get(), nullptr, rtvHandle);
-
-		// Store a pointer to the buffer so that the resource can be transitioned to
-		// the proper state later on
-		g_BackBuffers[i] = backBuffer;
-
-		// Increment handle to point to next handle in descheap
-		rtvHandle.Offset(rtvDescriptorSize);
+		g_LatencyTracker.RecordInput(QueryTimestamp());
 	}
 }
 
-// Creates Command Allocator, which is the backing memory used by a command list.
-ComPtr<ID3D12CommandAllocator> CreateCommandAllocator(ComPtr<ID3D12Device2> device,
-	D3D12_COMMAND_LIST_TYPE type)
+// Waits until the next frame should start, on the render thread. Input is sampled after this.
+void WaitForNextFrame()
 {
-	ComPtr<ID3D12CommandAllocator> commandAllocator;
-	ThrowIfFailed(device->CreateCommandAllocator(type, IID_PPV_ARGS(&commandAllocator)));
-
-	return commandAllocator;
+	// Wait until the swap chain can take another frame, before sampling anything the frame depends on (e.g.
+	// input). Waiting here rather than in Present keeps the frame from sitting in the present queue.
+	g_Swapchain.WaitForNextFrame();
+	// Then for the frame rate cap, also before input is sampled
+	g_FrameLimiter.Wait();
 }
 
-// Creates a Command List. Used for recording commands to be executed on GPU (always deferred).
-// i.e. commands in the list will not be executed until the lsit is sent to the command queue.
-// Unlike Allocators, CmdLists can be reused before commands are finished executing on the GPU,
-// as long as the list is reset before adding any new commands
-ComPtr<ID3D12GraphicsCommandList> CreateCommandList(ComPtr<ID3D12Device2> device,
-	ComPtr<ID3D12CommandAllocator> commandAllocator, D3D12_COMMAND_LIST_TYPE type)
+// Called once per frame, on the render thread or, when pipelined, on the simulation thread. Fills in
+// everything Render needs in snapshot. In this program, measures frame-rate, which Render outputs each
+// second to Debug Output.
+void Update(FrameSnapshot& snapshot)
 {
-	ComPtr<ID3D12GraphicsCommandList> commandList;
-	ThrowIfFailed(device->CreateCommandList(0, type, commandAllocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
+	// The frame takes the newest input which arrived before this point, and carries it through to Present
+	snapshot.Input = g_LatencyTracker.ConsumeInput();
+	snapshot.ClearColor[0] = 0.4f;
+	snapshot.ClearColor[1] = 0.6f;
+	snapshot.ClearColor[2] = 0.9f;
+	snapshot.ClearColor[3] = 1.0f;
+	snapshot.FramesPerSecond = 0.0;
 
-	// Command Lists are initialised in the recording state. For consistency, the first thing done
-	// with the command list in the render loop is to reset them, and command lists must be closed 
-	// in order to be reset, so reset after creation.
-	ThrowIfFailed(commandList->Close());
-
-	return commandList;
-}
-
-// Create fence with initial value 0
-ComPtr<ID3D12Fence> CreateFence(ComPtr<ID3D12Device2> device)
-{
-	ComPtr<ID3D12Fence> fence;
-
-	// Flags: https://docs.microsoft.com/en-us/windows/win32/api/d3d12/ne-d3d12-d3d12_fence_flags
-	ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
-
-	return fence;
-}
-
-// This returns an OS Event handle needed to block the CPU while waiting for a fence to be signalled
-HANDLE CreateEventHandle()
-{
-	HANDLE fenceEvent;
-
-	// Params:
-	// -lpEventAttributes: a pointer to a SECURITY_ATTRIBUTES structure. If NULL, handle may not be inherited by child processes
-	//	Docs: https://docs.microsoft.com/en-us/previous-versions/windows/desktop/legacy/aa379560(v=vs.85)
-	// -bManualReset: if TRUE, event created must be manually set event state to nonsignaled via ResetEvent
-	// -bInitialState: TRUE -> Signaled, else Non-Signaled
-	// -lpName: Name of the event object
-	fenceEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
-	assert(fenceEvent && "Failed to create fence event.");
-
-	return fenceEvent;
-}
-
-// Used to signal the fence from the GPU by adding a signal event to the provided command queue.
-// Note that the Signal happens only once it is reached in the CommandQueue, not immediately.
-// Returns the value the CPU Thread should wait for before using any resources that are "in-flight" for that frame on the GPU
-uint64_t Signal(ComPtr<ID3D12CommandQueue> commandQueue, ComPtr<ID3D12Fence> fence,
-	uint64_t& fenceValue)
-{
-	uint64_t fenceValueForSignal = ++fenceValue;
-	ThrowIfFailed(commandQueue->Signal(fence.Get(), fenceValueForSignal));
-
-	return fenceValueForSignal;
-}
-
-// Used to stall the CPU thread until the fence is signalled with the specified value or greater.
-// Will wait until the duration is reached (default ~584 million years)
-void WaitForFenceValue(ComPtr<ID3D12Fence> fence, uint64_t fenceValue, HANDLE fenceEvent,
-	std::chrono::milliseconds duration = std::chrono::milliseconds::max())
-{
-	// Query current fence value, only wait if our value is gt fence value
-	if (fence->GetCompletedValue() < fenceValue)
-	{
-		ThrowIfFailed(fence->SetEventOnCompletion(fenceValue, fenceEvent));
-		::WaitForSingleObject(fenceEvent, static_cast<DWORD>(duration.count()));
-	}
-}
-
-// Flush ensures that any previously exxecuted commands on the GPU have finished executing
-// before the CPU Thread is allowed to continue processing. Is simply a Signal followed by a WaitForFenceValue
-// Useful to ensure that commands are finished executing before releasing resources used by them
-void Flush(ComPtr<ID3D12CommandQueue> commandQueue, ComPtr<ID3D12Fence> fence,
-	uint64_t& fenceValue, HANDLE fenceEvent)
-{
-	uint64_t fenceValueForSignal = Signal(commandQueue, fence, fenceValue);
-	WaitForFenceValue(fence, fenceValueForSignal, fenceEvent);
-}
-
-// Called once per frame. In this program, outputs frame-rate each second to Debug Output
-void Update()
-{
 	// Static State required to track framerate
 	static uint64_t frameCounter = 0;
 	static double elapsedSeconds = 0.0;
@@ -577,14 +494,11 @@ void Update()
 	auto deltaTime = t1 - t0;
 	t0 = t1;
 
-	// Update elapsedSeconds, output framerate if 1s elapsed
+	// Update elapsedSeconds, hand framerate to Render if 1s elapsed
 	elapsedSeconds += deltaTime.count() * 1e-9;
 	if (elapsedSeconds > 1.0)
 	{
-		char buffer[500];
-		double fps = frameCounter / elapsedSeconds;
-		sprintf_s(buffer, 500, "FPS: %f\n", fps);
-		OutputDebugString(buffer);
+		snapshot.FramesPerSecond = frameCounter / elapsedSeconds;
 
 		frameCounter = 0;
 		elapsedSeconds = 0.0;
@@ -593,8 +507,11 @@ void Update()
 
 // Generally, Render is where we will do graphics work, queue commands, and present
 // In this program, we simply clear the back buffer and present the rendered frame.
-void Render()
+// Only reads what the frame needs from snapshot, which Update filled in.
+void Render(const FrameSnapshot& snapshot)
 {
+	g_LatencyTracker.BeginFrame(snapshot.Input);
+
 	// Note in DX12, it is on programmer to ensure that resources are in the correct state
 	// before being used. Resources are transitioned between states by a resource barrier,
 	// inserted in the command list.
@@ -616,68 +533,84 @@ void Render()
 	//			to prevent race conditions.
 	// Note we will only use Transition resource barriers in this program
 
-	auto commandAllocator = g_CommandAllocators[g_CurrentBackBufferIndex];
-	auto backBuffer = g_BackBuffers[g_CurrentBackBufferIndex];
-	
-	// Reset cmd allocator and list so the command list can be used for recording the next frame
-	commandAllocator->Reset();
-	g_CommandList->Reset(commandAllocator.Get(), nullptr);
+	// BeginFrame waits until the GPU has finished with this frame's allocator and back buffer, resets the
+	// allocator and command list for recording the next frame, and transitions the back buffer from
+	// PRESENT to RENDER_TARGET.
+	ID3D12GraphicsCommandList* commandList = g_Swapchain.BeginFrame();
+	// The frame in flight BeginFrame waited for is done with its scratch memory too
+	g_FrameScratch.BeginFrame(g_RenderDevice.GetDirectQueue());
 
 	// Clear the render target
 	{
-		// Set up Barrier to transition backBuffer from PRESENT to RENDER_TARGET
-		// Note that previous state MUST be specified, and there is no way to query for it,
-		// so application programmer must keep track of it.
-		CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-			backBuffer.Get(), 
-			D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
-
-		// Add resource barrier to command list
-		g_CommandList->ResourceBarrier(1, &barrier);
-
-		FLOAT clearColor[] = { 0.4f, 0.6f, 0.9f, 1.0f }; 
-		// Get the Descriptor table handle of current backbuffer
-		CD3DX12_CPU_DESCRIPTOR_HANDLE rtv(g_RTVDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
-			g_CurrentBackBufferIndex, g_RTVDescriptorSize);
-
-		g_CommandList->ClearRenderTargetView(rtv, clearColor, 0, nullptr);
+		commandList->ClearRenderTargetView(g_Swapchain.GetRenderTargetView(), snapshot.ClearColor, 0, nullptr);
 	}
-	
 
 	// Present
 	{
-		// Transition resource barrier to transition backBUffer from render target state to present
-		CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-			backBuffer.Get(),
-			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-		g_CommandList->ResourceBarrier(1, &barrier);
-
-		// Command List must be closed before being executed on Command Queue
-		ThrowIfFailed(g_CommandList->Close());
-
-		// Execute Command Lists on Command Queue
-		ID3D12CommandList* const commandLists[] = {
-			g_CommandList.Get()
-		};
-		g_CommandQueue->ExecuteCommandLists(_countof(commandLists), commandLists);
-
-		// Swap Chain's back buffer is presented.
-		//	-syncInterval : specifies how to sync presentation of frame with vertical blank
-		//	-flags: https://docs.microsoft.com/en-us/windows/win32/direct3ddxgi/dxgi-present
-		UINT syncInterval = g_VSync ? 1 : 0;
-		UINT presentFlags = g_TearingSupported && !g_VSync ? DXGI_PRESENT_ALLOW_TEARING : 0;
-		ThrowIfFailed(g_SwapChain->Present(syncInterval, presentFlags));
-
-		// Insert Signal into command queue to ensure writeable render targets arent touched until
-		// they are finished being used.
-		g_FrameFenceValues[g_CurrentBackBufferIndex] = Signal(g_CommandQueue, g_Fence, g_FenceValue);
-	
-		// Update back buffer index to match swap chains next back buffer
-		g_CurrentBackBufferIndex = g_SwapChain->GetCurrentBackBufferIndex();
-
-		// Before we can do anything with the current back buffer, we must make sure that 
-		// no work needs to finish for it first.
-		WaitForFenceValue(g_Fence, g_FrameFenceValues[g_CurrentBackBufferIndex], g_FenceEvent);
+		// Transitions the back buffer back to PRESENT, and closes the command list,
+		// which must be closed before being executed on the command queue
+		ScratchVector<ID3D12CommandList*> commandLists = g_FrameScratch.MakeVector<ID3D12CommandList*>();
+		commandLists.push_back(g_Swapchain.EndFrame());
+
+		Queue& directQueue = g_RenderDevice.GetDirectQueue();
+
+		// Execute Command Lists on Command Queue. The fence value signalled after them is stored with the
+		// frame, to ensure writeable render targets aren't touched until they are finished being used.
+		uint64_t fenceValue = directQueue.Execute(static_cast<UINT>(commandLists.size()), commandLists.data());
+		g_FrameScratch.EndFrame(fenceValue);
+
+		// Swap Chain's back buffer is presented, and the swap chain moves on to its next back buffer
+		g_Swapchain.Present(fenceValue, g_VSync);
+		MarkPresented(g_LatencyTracker, g_Swapchain.GetSwapChain());
+
+		// One statistics query a frame, for both when presents reached the display and how evenly
+		PresentStatistics statistics;
+		if (QueryPresentStatistics(g_Swapchain.GetSwapChain(), statistics))
+		{
+			g_LatencyTracker.MarkDisplayed(statistics.PresentCount, statistics.SyncQPCTime);
+			g_FramePacing.AddSample(statistics, g_VSync ? 1 : 0);
+		}
+		else
+		{
+			g_FramePacing.Discontinuity();
+		}
+	}
+
+	if (snapshot.FramesPerSecond > 0.0)
+	{
+		char buffer[500];
+		sprintf_s(buffer, 500, "FPS: %f\n", snapshot.FramesPerSecond);
+		OutputDebugString(buffer);
+		sprintf_s(buffer, 500, "Frame scratch: %zu bytes high-water mark, %llu heap allocations\n",
+			g_FrameScratch.GetHighWaterMark(), static_cast<unsigned long long>(g_FrameScratch.GetNumHeapAllocations()));
+		::OutputDebugStringA(buffer);
+		::OutputDebugStringA(g_LatencyTracker.GetReport().c_str());
+		::OutputDebugStringA(g_FramePacing.GetReport().c_str());
+	}
+}
+
+// One frame on the render thread
+void RunFrame()
+{
+	WaitForNextFrame();
+	g_RenderThreadResumeQueue.Pump();
+	// Starts reads and copies for streaming requests, and recycles staging buffers the copy queue is done with
+	g_StreamingQueue.Update();
+	// Evicts what finished frames no longer use if the video memory budget has shrunk below usage
+	g_ResidencyManager.Update(g_RenderDevice.GetDirectQueue().GetCompletedValue());
+
+	if (g_Pipelined)
+	{
+		// Frame N was simulated while frame N-1 was recorded. Frame N+1 is simulated while this one is.
+		const FrameSnapshot& snapshot = g_FramePipeline.AcquireSnapshot();
+		g_FramePipeline.BeginSimulation();
+		Render(snapshot);
+	}
+	else
+	{
+		static FrameSnapshot snapshot;
+		Update(snapshot);
+		Render(snapshot);
 	}
 }
 
@@ -692,30 +625,130 @@ void Resize(uint32_t width, uint32_t height)
 		g_ClientWidth = std::max(1u, width);
 		g_ClientHeight = std::max(1u, height);
 
-		// Flush GPU queue to make sure swap chain backbuffers aren't being
-		// referenced by in flight command list.
-		Flush(g_CommandQueue, g_Fence, g_FenceValue, g_FenceEvent);
-		
-		for (int i = 0; i < g_NumFrames; i++)
+		// Waits for the GPU to finish with the back buffers before resizing them, and recreates their RTVs
+		g_Swapchain.Resize(g_ClientWidth, g_ClientHeight);
+	}
+}
+
+// Applies a window event, on the render thread between frames. The events are the ones WndProc must post
+// to g_RenderThread.
+void HandleWindowEvent(const RenderThread::Event& event)
+{
+	switch (event.Type)
+	{
+	case RenderThread::EventType::Resize:
+		Resize(event.Width, event.Height);
+		break;
+	case RenderThread::EventType::VSync:
+		// The sync interval changes, so intervals across it say nothing about pacing
+		if (event.Enabled != g_VSync)
 		{
-			// Release references to the Back buffers before swap chain can be resized
-			g_BackBuffers[i].Reset();
-			g_FrameFenceValues[i] = g_FrameFenceValues[g_CurrentBackBufferIndex];
+			g_FramePacing.Discontinuity();
 		}
+		g_VSync = event.Enabled;
+		break;
+	}
+}
 
-		// Query Swap Chain Desc, needed for color format and flags for Resizing Buffers
-		DXGI_SWAP_CHAIN_DESC swapChainDesc = {};
-		ThrowIfFailed(g_SwapChain->GetDesc(&swapChainDesc));
-
-		// Resize swap chain buffers
-		ThrowIfFailed(g_SwapChain->ResizeBuffers(g_NumFrames, g_ClientWidth, g_ClientHeight,
-			swapChainDesc.BufferDesc.Format, swapChainDesc.Flags));
-
-		// Current back buffer index may have changed, ensure it is correct
-		g_CurrentBackBufferIndex = g_SwapChain->GetCurrentBackBufferIndex();
+// Name of the window class registered by Initialize
+const wchar_t* g_WindowClassName = L"DX12WindowClass";
 
-		// Swap Chain Buffers have been updated, so we need to update descriptors in descheap
-		// to reflect changes
-		UpdateRenderTargetViews(g_Device, g_SwapChain, g_RTVDescriptorHeap);
+// Creates the window and every DX12 object needed to render the first frame.
+// Steps run as soon as what they depend on is ready, so independent ones overlap, e.g. the window is
+// registered and created while the adapter is picked and the device created. Window and swap chain steps
+// stay on the calling thread, which owns the window and must pump its messages. Each step is timed, and the
+// timeline with its critical path goes to the debug output.
+void Initialize(HINSTANCE hInstance)
+{
+	InitGraph graph;
+	ComPtr<IDXGIAdapter4> adapter;
+	ComPtr<ID3D12Device2> d3d12Device;
+
+	auto parseArgs = graph.AddStep("ParseCommandLineArgs", ParseCommandLineArgs);
+	// The debug layer must be enabled before the device is created
+	auto debugLayer = graph.AddStep("EnableDebugLayer", EnableDebugLayer);
+	auto factory = graph.AddStep("CreateFactory", []() { g_DXGIFactory = CreateFactory(); });
+
+	auto windowClass = graph.AddStep("RegisterWindowClass",
+		[hInstance]() { RegisterWindowClass(hInstance, g_WindowClassName); }, {}, true);
+	auto window = graph.AddStep("CreateWindow", [hInstance]()
+	{
+		g_hWnd = CreateWindow(g_WindowClassName, hInstance, L"Learning DirectX 12", g_ClientWidth, g_ClientHeight);
+		// Stored to restore the window when leaving fullscreen
+		::GetWindowRect(g_hWnd, &g_WindowRect);
+	}, { windowClass, parseArgs }, true);
+
+	auto adapterStep = graph.AddStep("GetAdapter",
+		[&adapter]() { adapter = GetAdapter(g_DXGIFactory, g_UseWARP); }, { factory, parseArgs });
+	auto device = graph.AddStep("CreateDevice", [&adapter, &d3d12Device]() { d3d12Device = CreateDevice(adapter); }, { adapterStep, debugLayer });
+	auto deviceCapabilities = graph.AddStep("DeviceCapabilities", [&adapter, &d3d12Device]()
+	{
+		g_DeviceCapabilityCache.Load(g_DeviceCapabilityCachePath);
+		g_DeviceCapabilities = g_DeviceCapabilityCache.Get(adapter.Get(), d3d12Device.Get());
+		g_DeviceCapabilityCache.Save(g_DeviceCapabilityCachePath);
+	}, { device });
+	// Creates the direct and compute queues, and checks for tearing support
+	auto renderDevice = graph.AddStep("RenderDevice",
+		[&d3d12Device]() { g_RenderDevice.Initialize(g_DXGIFactory, d3d12Device); }, { device, factory });
+
+	// Creates the swap chain with an RTV, command allocator and fence value for each of its back buffers
+	graph.AddStep("CreateSwapChain",
+		[]() { g_Swapchain.InitializeWindow(&g_RenderDevice, g_hWnd, g_ClientWidth, g_ClientHeight, g_NumFrames,
+			g_MaxFrameLatency); },
+		{ renderDevice, window }, true);
+
+	// Caches and services, which mostly wait on the disk and the driver
+	auto jobSystem = graph.AddStep("JobSystem", []() { g_JobSystem.Initialize(0, g_PinJobThreads); }, { parseArgs });
+	auto pipelineStateCache = graph.AddStep("PipelineStateCache",
+		[&d3d12Device]() { g_PipelineStateCache.Initialize(d3d12Device, g_PipelineLibraryPath); }, { device });
+	graph.AddStep("PipelineCompiler", []() { g_PipelineCompiler.Initialize(&g_PipelineStateCache, g_JobSystem); },
+		{ pipelineStateCache, jobSystem });
+	graph.AddStep("RootSignatureCache", [&d3d12Device]()
+	{
+		g_RootSignatureCache.Initialize(d3d12Device, g_RootSignatureCachePath,
+			static_cast<D3D_ROOT_SIGNATURE_VERSION>(g_DeviceCapabilities.HighestRootSignatureVersion));
+	}, { device, deviceCapabilities });
+	graph.AddStep("LatencyTracker", []() { g_LatencyTracker.Initialize(QueryTimestampFrequency()); });
+	graph.AddStep("FrameLimiter", []()
+	{
+		g_FrameLimiter.Initialize(&g_FrameLimiterClock);
+		g_FrameLimiter.SetTargetFrameRate(g_TargetFrameRate);
+	}, { parseArgs });
+	graph.AddStep("FrameScratch", []() { g_FrameScratch.Initialize(g_NumFrames, 64 * 1024); });
+	graph.AddStep("FramePacing", []() { g_FramePacing.Initialize(QueryTimestampFrequency()); });
+	graph.AddStep("ShaderCache", []() { g_ShaderCache.Initialize(g_ShaderCachePath); });
+	graph.AddStep("StreamingQueue",
+		[&d3d12Device]() { g_StreamingQueue.Initialize(d3d12Device, g_DeviceCapabilities, g_JobSystem); },
+		{ device, deviceCapabilities, jobSystem });
+	graph.AddStep("ResidencyManager",
+		[&adapter, &d3d12Device]() { g_ResidencyManager.Initialize(d3d12Device, adapter); }, { device });
+
+	graph.Run();
+
+	::OutputDebugStringA(graph.GetReport().c_str());
+
+	if (g_Pipelined)
+	{
+		g_FramePipeline.Start(Update);
 	}
+	g_RenderThread.Start(HandleWindowEvent, RunFrame);
+}
+
+// Stops rendering, waits for the GPU to finish, and saves the caches to disk for the next run. Call once the
+// message loop has ended.
+void Shutdown()
+{
+	g_RenderThread.Stop();
+	g_FramePipeline.Stop();
+
+	// Compiles and decompression run as jobs, so these finish with theirs before the job system stops
+	g_PipelineCompiler.Shutdown();
+	g_StreamingQueue.Shutdown();
+	g_JobSystem.Shutdown();
+	g_RenderDevice.Flush();
+
+	// Nothing may still be compiling into the pipeline library when it is serialized
+	g_PipelineStateCache.Shutdown();
+	g_RootSignatureCache.Shutdown();
+	g_ShaderCache.Shutdown();
 }
\ No newline at end of file